@@ -47,10 +47,12 @@ AccessControlProvider::AccessControlProvider() :
 	const QJsonArray accessControlRules = VeyonCore::config().accessControlRules();
 
 	m_accessControlRules.reserve( accessControlRules.size() );
+	m_compiledRules.reserve( accessControlRules.size() );
 
 	for (const auto& accessControlRule : accessControlRules)
 	{
 		m_accessControlRules.append(AccessControlRule::Pointer::create(accessControlRule));
+		m_compiledRules.append(compileRule(m_accessControlRules.last()));
 	}
 }
 
@@ -178,7 +180,7 @@ bool AccessControlProvider::processAuthorizedGroups( const QString& accessingUse
 {
 	vDebug() << "processing for user" << accessingUser;
 
-	const auto groupsOfAccessingUser = m_userGroupsBackend->groupsOfUser( accessingUser, m_useDomainUserGroups );
+	const auto groupsOfAccessingUser = groupsOfUser( accessingUser );
 	const auto authorizedUserGroups = VeyonCore::config().authorizedUserGroups();
 
 	vDebug() << groupsOfAccessingUser << authorizedUserGroups;
@@ -199,8 +201,12 @@ AccessControlRule::Pointer AccessControlProvider::processAccessControlRules(cons
 {
 	vDebug() << "processing rules for" << accessingUser << accessingComputer << localUser << localComputer << connectedUsers;
 
-	for (const auto& rule : std::as_const(m_accessControlRules))
+	CheckContext context{accessingUser, accessingComputer, localUser, localComputer, connectedUsers};
+
+	for (const auto& compiledRule : std::as_const(m_compiledRules))
 	{
+		const auto& rule = compiledRule.rule;
+
 		// rule disabled?
 		if (rule->action() == AccessControlRule::Action::None)
 		{
@@ -208,8 +214,7 @@ AccessControlRule::Pointer AccessControlProvider::processAccessControlRules(cons
 			continue;
 		}
 
-		if (rule->areConditionsIgnored() ||
-			matchConditions(*rule, accessingUser, accessingComputer, localUser, localComputer, connectedUsers))
+		if (rule->areConditionsIgnored() || matchConditions(compiledRule, context))
 		{
 			vDebug() << "rule" << rule->name() << "matched with action" << rule->action();
 			return rule;
@@ -232,12 +237,13 @@ bool AccessControlProvider::isAccessToLocalComputerDenied() const
 		return false;
 	}
 
-	for (const auto& rule : std::as_const(m_accessControlRules))
+	CheckContext context{{}, {}, VeyonCore::platform().userFunctions().currentUser(), HostAddress::localFQDN(), {}};
+
+	for (const auto& compiledRule : std::as_const(m_compiledRules))
 	{
-		if (matchConditions(*rule, {}, {},
-							VeyonCore::platform().userFunctions().currentUser(), HostAddress::localFQDN(), {}))
+		if (matchConditions(compiledRule, context))
 		{
-			switch (rule->action())
+			switch (compiledRule.rule->action())
 			{
 			case AccessControlRule::Action::Deny:
 				return true;
@@ -277,41 +283,35 @@ void AccessControlProvider::sendDetails(QIODevice* ioDevice, const QString& deta
 
 
 
-bool AccessControlProvider::isMemberOfUserGroup( const QString &user,
-												 const QString &groupName ) const
+QStringList AccessControlProvider::groupsOfUser( const QString& username ) const
 {
-	return matchList(m_userGroupsBackend->groupsOfUser(user, m_useDomainUserGroups), groupName);
+	return VeyonCore::userGroupsBackendManager().groupsOfUser( m_userGroupsBackend, username, m_useDomainUserGroups );
 }
 
 
 
-bool AccessControlProvider::isLocatedAt( const QString &computer, const QString &locationName ) const
+const QStringList& AccessControlProvider::groupsOfUser( CheckContext& context, const QString& username ) const
 {
-	return matchList(locationsOfComputer(computer), locationName);
-}
-
-
-
-bool AccessControlProvider::haveGroupsInCommon( const QString &userOne, const QString &userTwo ) const
-{
-	const auto userOneGroups = m_userGroupsBackend->groupsOfUser( userOne, m_useDomainUserGroups );
-	const auto userTwoGroups = m_userGroupsBackend->groupsOfUser( userTwo, m_useDomainUserGroups );
-
-	const auto userOneGroupSet = QSet<QString>{ userOneGroups.begin(), userOneGroups.end() };
-	const auto userTwoGroupSet = QSet<QString>{ userTwoGroups.begin(), userTwoGroups.end() };
+	auto it = context.groupsOfUser.find( username );
+	if( it == context.groupsOfUser.end() )
+	{
+		it = context.groupsOfUser.insert( username, groupsOfUser( username ) );
+	}
 
-	return userOneGroupSet.intersects( userTwoGroupSet );
+	return *it;
 }
 
 
 
-bool AccessControlProvider::haveSameLocations( const QString &computerOne, const QString &computerTwo ) const
+const QStringList& AccessControlProvider::locationsOfComputer( CheckContext& context, const QString& computer ) const
 {
-	const auto computerOneLocations = locationsOfComputer( computerOne );
-	const auto computerTwoLocations = locationsOfComputer( computerTwo );
+	auto it = context.locationsOfComputer.find( computer );
+	if( it == context.locationsOfComputer.end() )
+	{
+		it = context.locationsOfComputer.insert( computer, locationsOfComputer( computer ) );
+	}
 
-	return computerOneLocations.isEmpty() == false &&
-			computerOneLocations == computerTwoLocations;
+	return *it;
 }
 
 
@@ -356,126 +356,178 @@ QString AccessControlProvider::lookupSubject( AccessControlRule::Subject subject
 
 
 
-bool AccessControlProvider::matchConditions( const AccessControlRule &rule,
-											 const QString& accessingUser, const QString& accessingComputer,
-											 const QString& localUser, const QString& localComputer,
-											 const QStringList& connectedUsers ) const
+AccessControlProvider::CompiledRule AccessControlProvider::compileRule( const AccessControlRule::Pointer& rule )
 {
-	bool hasConditions = false;
-
-	// normally all selected conditions have to match in order to make the whole rule match
-	// if conditions should be inverted (i.e. "is member of" is to be interpreted as "is NOT member of")
-	// we have to check against the opposite boolean value
-	bool matchResult = rule.areConditionsInverted() == false;
+	CompiledRule compiledRule{rule, {}};
 
-	vDebug() << rule.toJson() << matchResult;
-
-	if( rule.isConditionEnabled( AccessControlRule::Condition::MemberOfUserGroup ) )
+	const auto& parameters = rule->parameters();
+	for( auto it = parameters.constBegin(), end = parameters.constEnd(); it != end; ++it )
 	{
-		hasConditions = true;
+		// conditions without costs are not supported
+		if( it->enabled == false || conditionCosts( it.key() ) < 0 )
+		{
+			continue;
+		}
 
-		const auto condition = AccessControlRule::Condition::MemberOfUserGroup;
-		const auto user = lookupSubject( rule.subject( condition ), accessingUser, {}, localUser, {} );
-		const auto group = rule.argument( condition );
+		CompiledCondition condition{it.key(), it->subject, it->argument, {}};
 
-		if( user.isEmpty() || group.isEmpty() ||
-			isMemberOfUserGroup( user, group ) != matchResult )
+		const auto& argument = condition.argument;
+		if( argument.startsWith( QLatin1Char('/') ) && argument.endsWith( QLatin1Char('/') ) && argument.length() > 2 )
 		{
-			return false;
+			condition.pattern = QRegularExpression( argument.mid( 1, argument.length() - 2 ) );
 		}
+		else if( argument.endsWith( QLatin1Char('*') ) )
+		{
+			const QRegularExpression rx( argument );
+			if( rx.isValid() )
+			{
+				condition.pattern = rx;
+			}
+		}
+
+		compiledRule.conditions.append( condition );
 	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::GroupsInCommon ) )
-	{
-		hasConditions = true;
+	std::stable_sort( compiledRule.conditions.begin(), compiledRule.conditions.end(),
+					  []( const CompiledCondition& a, const CompiledCondition& b ) {
+						  return conditionCosts( a.condition ) < conditionCosts( b.condition );
+					  } );
 
-		if( accessingUser.isEmpty() || localUser.isEmpty() ||
-			haveGroupsInCommon( accessingUser, localUser ) != matchResult )
-		{
-			return false;
-		}
+	return compiledRule;
+}
+
+
+
+int AccessControlProvider::conditionCosts( AccessControlRule::Condition condition )
+{
+	switch( condition )
+	{
+	case AccessControlRule::Condition::AccessFromLocalUser:
+	case AccessControlRule::Condition::AccessFromAlreadyConnectedUser:
+	case AccessControlRule::Condition::ComputerAlreadyBeingAccessed:
+		return 0;
+	case AccessControlRule::Condition::AccessFromLocalHost:
+		return 1;
+	case AccessControlRule::Condition::NoUserLoggedOn:
+		return 2;
+	case AccessControlRule::Condition::MemberOfUserGroup:
+	case AccessControlRule::Condition::GroupsInCommon:
+		return 3;
+	case AccessControlRule::Condition::LocatedAt:
+	case AccessControlRule::Condition::SameLocation:
+		return 4;
+	default:
+		break;
 	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::LocatedAt ) )
+	return -1;
+}
+
+
+
+bool AccessControlProvider::matchConditions( const CompiledRule& rule, CheckContext& context ) const
+{
+	// do not match the rule if no conditions are set at all
+	if( rule.conditions.isEmpty() )
 	{
-		hasConditions = true;
+		return false;
+	}
 
-		const auto condition = AccessControlRule::Condition::LocatedAt;
-		const auto computer = lookupSubject( rule.subject( condition ), {}, accessingComputer, {}, localComputer );
-		const auto location = rule.argument( condition );
+	// normally all selected conditions have to match in order to make the whole rule match
+	// if conditions should be inverted (i.e. "is member of" is to be interpreted as "is NOT member of")
+	// we have to check against the opposite boolean value
+	const auto matchResult = rule.rule->areConditionsInverted() == false;
 
-		if( computer.isEmpty() || location.isEmpty() ||
-			isLocatedAt( computer, location ) != matchResult )
+	for( const auto& condition : rule.conditions )
+	{
+		if( matchCondition( condition, matchResult, context ) == false )
 		{
 			return false;
 		}
 	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::SameLocation ) )
+	return true;
+}
+
+
+
+bool AccessControlProvider::matchCondition( const CompiledCondition& condition, bool matchResult,
+											CheckContext& context ) const
+{
+	switch( condition.condition )
+	{
+	case AccessControlRule::Condition::MemberOfUserGroup:
 	{
-		hasConditions = true;
+		const auto user = lookupSubject( condition.subject, context.accessingUser, {}, context.localUser, {} );
 
-		if( accessingComputer.isEmpty() || localComputer.isEmpty() ||
-			haveSameLocations( accessingComputer, localComputer ) != matchResult )
-		{
-			return false;
-		}
+		return user.isEmpty() == false && condition.argument.isEmpty() == false &&
+			   matchList( groupsOfUser( context, user ), condition ) == matchResult;
 	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::AccessFromLocalHost ) )
+	case AccessControlRule::Condition::GroupsInCommon:
 	{
-		hasConditions = true;
-
-		if( isLocalHost( accessingComputer ) != matchResult )
+		if( context.accessingUser.isEmpty() || context.localUser.isEmpty() )
 		{
 			return false;
 		}
+
+		// copies as references into the context may become invalid by the second lookup
+		const auto accessingUserGroups = groupsOfUser( context, context.accessingUser );
+		const auto localUserGroups = groupsOfUser( context, context.localUser );
+
+		const auto accessingUserGroupSet = QSet<QString>{ accessingUserGroups.begin(), accessingUserGroups.end() };
+		const auto localUserGroupSet = QSet<QString>{ localUserGroups.begin(), localUserGroups.end() };
+
+		return accessingUserGroupSet.intersects( localUserGroupSet ) == matchResult;
 	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::AccessFromLocalUser ) )
+	case AccessControlRule::Condition::LocatedAt:
 	{
-		hasConditions = true;
+		const auto computer = lookupSubject( condition.subject, {}, context.accessingComputer, {}, context.localComputer );
 
-		if( isLocalUser( accessingUser, localUser ) != matchResult )
-		{
-			return false;
-		}
+		return computer.isEmpty() == false && condition.argument.isEmpty() == false &&
+			   matchList( locationsOfComputer( context, computer ), condition ) == matchResult;
 	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::AccessFromAlreadyConnectedUser ) )
+	case AccessControlRule::Condition::SameLocation:
 	{
-		hasConditions = true;
-
-		if( connectedUsers.contains( accessingUser ) != matchResult )
+		if( context.accessingComputer.isEmpty() || context.localComputer.isEmpty() )
 		{
 			return false;
 		}
-	}
 
-	if( rule.isConditionEnabled( AccessControlRule::Condition::NoUserLoggedOn ) )
-	{
-		hasConditions = true;
+		const auto accessingComputerLocations = locationsOfComputer( context, context.accessingComputer );
+		const auto localComputerLocations = locationsOfComputer( context, context.localComputer );
+
+		return ( accessingComputerLocations.isEmpty() == false &&
+				 accessingComputerLocations == localComputerLocations ) == matchResult;
+	}
 
-		if( isNoUserLoggedOn() != matchResult )
+	case AccessControlRule::Condition::AccessFromLocalHost:
+		if( context.accessFromLocalHost.has_value() == false )
 		{
-			return false;
+			context.accessFromLocalHost = isLocalHost( context.accessingComputer );
 		}
-	}
+		return *context.accessFromLocalHost == matchResult;
 
-	if (rule.isConditionEnabled(AccessControlRule::Condition::ComputerAlreadyBeingAccessed))
-	{
-		hasConditions = true;
+	case AccessControlRule::Condition::AccessFromLocalUser:
+		return isLocalUser( context.accessingUser, context.localUser ) == matchResult;
 
-		if (!connectedUsers.isEmpty() != matchResult)
+	case AccessControlRule::Condition::AccessFromAlreadyConnectedUser:
+		return context.connectedUsers.contains( context.accessingUser ) == matchResult;
+
+	case AccessControlRule::Condition::NoUserLoggedOn:
+		if( context.noUserLoggedOn.has_value() == false )
 		{
-			return false;
+			context.noUserLoggedOn = isNoUserLoggedOn();
 		}
-	}
+		return *context.noUserLoggedOn == matchResult;
 
-	// do not match the rule if no conditions are set at all
-	if( hasConditions == false )
-	{
-		return false;
+	case AccessControlRule::Condition::ComputerAlreadyBeingAccessed:
+		return ( context.connectedUsers.isEmpty() == false ) == matchResult;
+
+	default:
+		break;
 	}
 
 	return true;
@@ -498,22 +550,12 @@ QStringList AccessControlProvider::objectNames( const NetworkObjectList& objects
 
 
 
-bool AccessControlProvider::matchList(const QStringList& list, const QString& pattern)
+bool AccessControlProvider::matchList( const QStringList& list, const CompiledCondition& condition )
 {
-	if (pattern.startsWith(QLatin1Char('/')) && pattern.endsWith(QLatin1Char('/')) &&
-		pattern.length() > 2)
+	if( condition.pattern.has_value() )
 	{
-		return list.indexOf(QRegularExpression(pattern.mid(1, pattern.length() - 2))) >= 0;
-	}
-
-	if (pattern.endsWith(QLatin1Char('*')))
-	{
-		const QRegularExpression rx(pattern);
-		if (rx.isValid())
-		{
-			return list.indexOf(rx) >= 0;
-		}
+		return list.indexOf( *condition.pattern ) >= 0;
 	}
 
-	return list.contains(pattern);
+	return list.contains( condition.argument );
 }
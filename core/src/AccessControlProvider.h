@@ -24,6 +24,11 @@
 
 #pragma once
 
+#include <optional>
+
+#include <QHash>
+#include <QRegularExpression>
+
 #include "AccessControlRule.h"
 #include "FeatureProviderInterface.h"
 #include "NetworkObject.h"
@@ -139,10 +144,43 @@ public:
 	void sendDetails(QIODevice* ioDevice, const QString& details);
 
 private:
-	bool isMemberOfUserGroup( const QString& user, const QString& groupName ) const;
-	bool isLocatedAt( const QString& computer, const QString& locationName ) const;
-	bool haveGroupsInCommon( const QString& userOne, const QString& userTwo ) const;
-	bool haveSameLocations( const QString& computerOne, const QString& computerTwo ) const;
+	// condition of a rule prepared for repeated evaluation
+	struct CompiledCondition
+	{
+		AccessControlRule::Condition condition{AccessControlRule::Condition::None};
+		AccessControlRule::Subject subject{AccessControlRule::Subject::None};
+		QString argument;
+		std::optional<QRegularExpression> pattern;
+	};
+
+	struct CompiledRule
+	{
+		AccessControlRule::Pointer rule;
+		// enabled conditions ordered by the costs of looking up the required facts
+		QVector<CompiledCondition> conditions;
+	};
+
+	// facts about the parties of a single access check, each looked up at most once
+	struct CheckContext
+	{
+		QString accessingUser;
+		QString accessingComputer;
+		QString localUser;
+		QString localComputer;
+		QStringList connectedUsers;
+
+		QHash<QString, QStringList> groupsOfUser{};
+		QHash<QString, QStringList> locationsOfComputer{};
+		std::optional<bool> accessFromLocalHost{};
+		std::optional<bool> noUserLoggedOn{};
+	};
+
+	static CompiledRule compileRule( const AccessControlRule::Pointer& rule );
+	static int conditionCosts( AccessControlRule::Condition condition );
+
+	QStringList groupsOfUser( const QString& username ) const;
+	const QStringList& groupsOfUser( CheckContext& context, const QString& username ) const;
+	const QStringList& locationsOfComputer( CheckContext& context, const QString& computer ) const;
 	bool isLocalHost( const QString& accessingComputer ) const;
 	bool isLocalUser( const QString& accessingUser, const QString& localUser ) const;
 	bool isNoUserLoggedOn() const;
@@ -151,15 +189,14 @@ private:
 						   const QString& accessingUser, const QString& accessingComputer,
 						   const QString& localUser, const QString& localComputer ) const;
 
-	bool matchConditions( const AccessControlRule& rule,
-						  const QString& accessingUser, const QString& accessingComputer,
-						  const QString& localUser, const QString& localComputer,
-						  const QStringList& connectedUsers ) const;
+	bool matchConditions( const CompiledRule& rule, CheckContext& context ) const;
+	bool matchCondition( const CompiledCondition& condition, bool matchResult, CheckContext& context ) const;
 
 	static QStringList objectNames( const NetworkObjectList& objects );
-	static bool matchList(const QStringList& list, const QString& pattern);
+	static bool matchList( const QStringList& list, const CompiledCondition& condition );
 
 	QList<AccessControlRule::Pointer> m_accessControlRules{};
+	QVector<CompiledRule> m_compiledRules{};
 	UserGroupsBackendInterface* m_userGroupsBackend;
 	NetworkObjectDirectory* m_networkObjectDirectory;
 	bool m_useDomainUserGroups;
@@ -89,12 +89,14 @@ void ComputerControlInterface::start( QSize scaledFramebufferSize, UpdateMode up
 		}
 		vncConnection->setScaledSize( m_scaledFramebufferSize );
 		connect( vncConnection, &VncConnection::framebufferUpdateComplete, this, &ComputerControlInterface::resetWatchdog );
-		connect( vncConnection, &VncConnection::framebufferUpdateComplete, this, &ComputerControlInterface::framebufferUpdated );
+		connect( vncConnection, &VncConnection::framebufferUpdateComplete, this, &ComputerControlInterface::handleFramebufferUpdate );
+		connect( vncConnection, &VncConnection::scaledFramebufferUpdated, this, &ComputerControlInterface::framebufferUpdated );
 
 		connect( vncConnection, &VncConnection::framebufferSizeChanged, this, &ComputerControlInterface::framebufferSizeChanged );
 
 		connect( vncConnection, &VncConnection::stateChanged, this, &ComputerControlInterface::updateState );
 		connect(vncConnection, &VncConnection::stateChanged, this, &ComputerControlInterface::setMinimumFramebufferUpdateInterval);
+		connect(vncConnection, &VncConnection::stateChanged, this, &ComputerControlInterface::setServerSideScaling);
 		connect(vncConnection, &VncConnection::stateChanged, this, &ComputerControlInterface::updateServerVersion);
 		connect( vncConnection, &VncConnection::stateChanged, this, &ComputerControlInterface::updateUser );
 		connect( vncConnection, &VncConnection::stateChanged, this, &ComputerControlInterface::updateSessionInfo );
@@ -188,6 +190,8 @@ void ComputerControlInterface::setScaledFramebufferSize( QSize scaledFramebuffer
 	{
 		vncConnection()->setScaledSize( m_scaledFramebufferSize );
 	}
+
+	setServerSideScaling();
 }
 
 
@@ -216,6 +220,18 @@ QImage ComputerControlInterface::framebuffer() const
 
 
 
+quint64 ComputerControlInterface::framebufferGeneration() const
+{
+	if( vncConnection() )
+	{
+		return vncConnection()->framebufferGeneration();
+	}
+
+	return 0;
+}
+
+
+
 void ComputerControlInterface::setAccessControlFailed(const QString& details)
 {
 	lock();
@@ -234,11 +250,12 @@ void ComputerControlInterface::setAccessControlFailed(const QString& details)
 
 
 
-void ComputerControlInterface::setServerVersion(VeyonCore::ApplicationVersion version)
+void ComputerControlInterface::setServerVersion(VeyonCore::ApplicationVersion version, ServerCapabilities capabilities)
 {
 	m_serverVersionQueryTimer.stop();
 
 	m_serverVersion = version;
+	m_serverCapabilities = capabilities;
 
 	const auto statePollingInterval = VeyonCore::config().computerStatePollingInterval();
 
@@ -263,6 +280,8 @@ void ComputerControlInterface::setServerVersion(VeyonCore::ApplicationVersion ve
 		m_statePollingTimer.start(statePollingInterval > 0 ? statePollingInterval :
 															 VeyonCore::config().computerMonitoringUpdateInterval());
 	}
+
+	setServerSideScaling();
 }
 
 
@@ -344,6 +363,7 @@ void ComputerControlInterface::setUpdateMode( UpdateMode updateMode )
 
 	setMinimumFramebufferUpdateInterval();
 	setQuality();
+	setServerSideScaling();
 
 	if (vncConnection())
 	{
@@ -353,6 +373,30 @@ void ComputerControlInterface::setUpdateMode( UpdateMode updateMode )
 
 
 
+void ComputerControlInterface::setVisibility( Visibility visibility )
+{
+	if( visibility == m_visibility )
+	{
+		return;
+	}
+
+	const auto previousVisibility = m_visibility;
+	m_visibility = visibility;
+
+	if( m_updateMode == UpdateMode::Monitoring )
+	{
+		setMinimumFramebufferUpdateInterval();
+
+		// catch up immediately instead of showing an outdated thumbnail until the next regular update
+		if( m_visibility == Visibility::Visible && previousVisibility != Visibility::Visible && vncConnection() )
+		{
+			vncConnection()->triggerFramebufferUpdate();
+		}
+	}
+}
+
+
+
 void ComputerControlInterface::setProperty(QUuid propertyId, const QVariant& data)
 {
 	if (propertyId.isNull() == false)
@@ -398,6 +442,7 @@ void ComputerControlInterface::ping()
 void ComputerControlInterface::setMinimumFramebufferUpdateInterval()
 {
 	auto updateInterval = -1;
+	auto skipFramebufferUpdates = false;
 
 	switch (m_updateMode)
 	{
@@ -406,23 +451,36 @@ void ComputerControlInterface::setMinimumFramebufferUpdateInterval()
 		break;
 
 	case UpdateMode::Basic:
-	case UpdateMode::Monitoring:
 		updateInterval = VeyonCore::config().computerMonitoringUpdateInterval();
 		break;
 
+	case UpdateMode::Monitoring:
+		switch (m_visibility)
+		{
+		case Visibility::Visible:
+			updateInterval = VeyonCore::config().computerMonitoringUpdateInterval();
+			break;
+		case Visibility::Hidden:
+			updateInterval = std::max(UpdateIntervalHidden, VeyonCore::config().computerMonitoringUpdateInterval());
+			break;
+		case Visibility::Suspended:
+			updateInterval = UpdateIntervalDisabled;
+			skipFramebufferUpdates = true;
+			break;
+		}
+		break;
+
 	case UpdateMode::Live:
 		break;
 
 	case UpdateMode::FeatureControlOnly:
-		if (vncConnection())
-		{
-			vncConnection()->setSkipFramebufferUpdates(true);
-		}
+		skipFramebufferUpdates = true;
 		break;
 	}
 
 	if (vncConnection())
 	{
+		vncConnection()->setSkipFramebufferUpdates(skipFramebufferUpdates);
 		vncConnection()->setFramebufferUpdateInterval(updateInterval);
 	}
 
@@ -434,6 +492,38 @@ void ComputerControlInterface::setMinimumFramebufferUpdateInterval()
 
 
 
+void ComputerControlInterface::setServerSideScaling()
+{
+	if (vncConnection() == nullptr || state() != State::Connected)
+	{
+		// new connections start unscaled
+		m_serverSideScaledFramebufferSize = {};
+		return;
+	}
+
+	QSize scaledSize;
+	if (m_updateMode == UpdateMode::Monitoring && VeyonCore::config().computerMonitoringServerSideScaling())
+	{
+		scaledSize = m_scaledFramebufferSize;
+	}
+
+	// ignore minor changes caused by rounding when the thumbnail size is derived from the scaled framebuffers
+	const auto sizeDifference = scaledSize - m_serverSideScaledFramebufferSize;
+	if (m_serverCapabilities.testFlag(ServerCapability::ScaledFramebuffer) == false ||
+		(scaledSize.isEmpty() == m_serverSideScaledFramebufferSize.isEmpty() &&
+		 qAbs(sizeDifference.width()) <= ServerSideScalingSizeTolerance &&
+		 qAbs(sizeDifference.height()) <= ServerSideScalingSizeTolerance))
+	{
+		return;
+	}
+
+	m_serverSideScaledFramebufferSize = scaledSize;
+
+	VeyonCore::builtinFeatures().monitoringMode().setScaledFramebufferSize({weakPointer()}, scaledSize);
+}
+
+
+
 void ComputerControlInterface::setQuality()
 {
 	auto quality = VncConnectionConfiguration::Quality::Highest;
@@ -490,6 +580,19 @@ void ComputerControlInterface::restartConnection()
 
 
 
+void ComputerControlInterface::handleFramebufferUpdate()
+{
+	// notifications are queued so coalesce all which refer to an already announced framebuffer
+	const auto generation = framebufferGeneration();
+	if( generation != m_notifiedFramebufferGeneration )
+	{
+		m_notifiedFramebufferGeneration = generation;
+		Q_EMIT framebufferUpdated();
+	}
+}
+
+
+
 void ComputerControlInterface::updateState()
 {
 	lock();
@@ -511,13 +614,24 @@ void ComputerControlInterface::updateState()
 
 
 
+bool ComputerControlInterface::isInitialStatePushed() const
+{
+	// server sends its initial monitoring state on its own if negotiated during handshake
+	return m_connection && m_connection->handshakeFlags().testFlag(RfbVeyonAuth::HandshakeFlag::InitialState);
+}
+
+
+
 void ComputerControlInterface::updateServerVersion()
 {
 	lock();
 
 	if (vncConnection())
 	{
-		VeyonCore::builtinFeatures().monitoringMode().queryApplicationVersion({weakPointer()});
+		if (isInitialStatePushed() == false)
+		{
+			VeyonCore::builtinFeatures().monitoringMode().queryApplicationVersion({weakPointer()});
+		}
 		m_serverVersionQueryTimer.start();
 	}
 
@@ -532,7 +646,10 @@ void ComputerControlInterface::updateActiveFeatures()
 
 	if (vncConnection() && state() == State::Connected)
 	{
-		VeyonCore::builtinFeatures().monitoringMode().queryActiveFeatures({weakPointer()});
+		if (isInitialStatePushed() == false)
+		{
+			VeyonCore::builtinFeatures().monitoringMode().queryActiveFeatures({weakPointer()});
+		}
 	}
 	else
 	{
@@ -550,7 +667,7 @@ void ComputerControlInterface::updateUser()
 
 	if( vncConnection() && state() == State::Connected )
 	{
-		if( userLoginName().isEmpty() )
+		if( userLoginName().isEmpty() && isInitialStatePushed() == false )
 		{
 			VeyonCore::builtinFeatures().monitoringMode().queryUserInfo( { weakPointer() } );
 		}
@@ -572,7 +689,10 @@ void ComputerControlInterface::updateSessionInfo()
 	if (vncConnection() && state() == State::Connected &&
 		m_serverVersion >= VeyonCore::ApplicationVersion::Version_4_8)
 	{
-		VeyonCore::builtinFeatures().monitoringMode().querySessionInfo({weakPointer()});
+		if (isInitialStatePushed() == false)
+		{
+			VeyonCore::builtinFeatures().monitoringMode().querySessionInfo({weakPointer()});
+		}
 	}
 	else
 	{
@@ -591,7 +711,10 @@ void ComputerControlInterface::updateScreens()
 	if (vncConnection() && state() == State::Connected &&
 		m_serverVersion >= VeyonCore::ApplicationVersion::Version_4_7)
 	{
-		VeyonCore::builtinFeatures().monitoringMode().queryScreens({weakPointer()});
+		if (isInitialStatePushed() == false)
+		{
+			VeyonCore::builtinFeatures().monitoringMode().queryScreens({weakPointer()});
+		}
 	}
 	else
 	{
@@ -43,6 +43,20 @@ public:
 		FeatureControlOnly,
 	};
 
+	// affects framebuffer updates in UpdateMode::Monitoring only
+	enum class Visibility {
+		Visible,	// displayed - regular update interval
+		Hidden,		// not displayed right now, e.g. scrolled out of view - low update rate
+		Suspended	// no view displayed at all, e.g. window minimized - no framebuffer updates
+	};
+
+	// optional functionality announced by the server along with its version
+	enum class ServerCapability {
+		NoCapabilities = 0x00,
+		ScaledFramebuffer = 0x01
+	};
+	Q_DECLARE_FLAGS(ServerCapabilities, ServerCapability)
+
 	using Pointer = QSharedPointer<ComputerControlInterface>;
 
 	using State = VncConnection::State;
@@ -108,6 +122,8 @@ public:
 
 	QImage framebuffer() const;
 
+	quint64 framebufferGeneration() const;
+
 	const QString& accessControlDetails() const
 	{
 		return m_accessControlDetails;
@@ -120,7 +136,12 @@ public:
 		return m_serverVersion;
 	}
 
-	void setServerVersion(VeyonCore::ApplicationVersion version);
+	ServerCapabilities serverCapabilities() const
+	{
+		return m_serverCapabilities;
+	}
+
+	void setServerVersion(VeyonCore::ApplicationVersion version, ServerCapabilities capabilities = {});
 
 	const QString& userLoginName() const
 	{
@@ -174,6 +195,12 @@ public:
 		return m_updateMode;
 	}
 
+	void setVisibility( Visibility visibility );
+	Visibility visibility() const
+	{
+		return m_visibility;
+	}
+
 	void setProperty(QUuid propertyId, const QVariant& data);
 
 	QVariant queryProperty(QUuid propertyId);
@@ -194,9 +221,13 @@ public:
 private:
 	void ping();
 	void setMinimumFramebufferUpdateInterval();
+	void setServerSideScaling();
 	void setQuality();
 	void resetWatchdog();
 	void restartConnection();
+	void handleFramebufferUpdate();
+
+	bool isInitialStatePushed() const;
 
 	void updateState();
 	void updateServerVersion();
@@ -211,11 +242,14 @@ private:
 	static constexpr int ConnectionWatchdogTimeout = ConnectionWatchdogPingDelay*2;
 	static constexpr int ServerVersionQueryTimeout = 5000;
 	static constexpr int UpdateIntervalDisabled = 5000;
+	static constexpr int UpdateIntervalHidden = 5000;
+	static constexpr int ServerSideScalingSizeTolerance = 4;
 
 	const Computer m_computer;
 	const int m_port;
 
 	UpdateMode m_updateMode{UpdateMode::Disabled};
+	Visibility m_visibility{Visibility::Visible};
 	Computer::NameSource m_computerNameSource{Computer::NameSource::Default};
 
 	State m_state{State::Disconnected};
@@ -227,6 +261,8 @@ private:
 	Feature::Uid m_designatedModeFeature;
 
 	QSize m_scaledFramebufferSize{};
+	QSize m_serverSideScaledFramebufferSize{};
+	quint64 m_notifiedFramebufferGeneration{0};
 	int m_timestamp{0};
 
 	VeyonConnection* m_connection{nullptr};
@@ -234,6 +270,7 @@ private:
 	QTimer m_connectionWatchdogTimer{this};
 
 	VeyonCore::ApplicationVersion m_serverVersion{VeyonCore::ApplicationVersion::Unknown};
+	ServerCapabilities m_serverCapabilities{};
 	QTimer m_serverVersionQueryTimer{this};
 
 	QString m_accessControlDetails{};
@@ -259,4 +296,6 @@ using ComputerControlInterfaceList = QVector<ComputerControlInterface::Pointer>;
 VEYON_CORE_EXPORT QDebug operator<<(QDebug stream, ComputerControlInterface::Pointer computerControlInterface);
 VEYON_CORE_EXPORT QDebug operator<<(QDebug stream, const ComputerControlInterfaceList& computerControlInterfaces);
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(ComputerControlInterface::ServerCapabilities)
+
 Q_DECLARE_METATYPE(ComputerControlInterface::Pointer)
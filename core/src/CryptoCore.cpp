@@ -23,6 +23,9 @@
  */
 
 #include <openssl/bn.h>
+#include <openssl/crypto.h>
+
+#include <QMessageAuthenticationCode>
 
 #include "CryptoCore.h"
 
@@ -73,6 +76,54 @@ QByteArray CryptoCore::generateChallenge()
 
 
 
+QByteArray CryptoCore::generateSecret()
+{
+	// the most significant bit of a challenge is always set so take the lower bytes
+	return generateChallenge().right( SecretSize );
+}
+
+
+
+QByteArray CryptoCore::messageAuthenticationCode( const QByteArray& key, const QByteArray& message )
+{
+	return QMessageAuthenticationCode::hash( message, key, QCryptographicHash::Sha256 );
+}
+
+
+
+QByteArray CryptoCore::maskSecret( const QByteArray& secret, const QByteArray& key, const QByteArray& nonce )
+{
+	if( secret.size() != SecretSize || key.isEmpty() )
+	{
+		return {};
+	}
+
+	auto masked = messageAuthenticationCode( key, nonce );
+	for( int i = 0; i < SecretSize; ++i )
+	{
+		masked[i] = char( masked[i] ^ secret[i] );
+	}
+
+	return masked;
+}
+
+
+
+QByteArray CryptoCore::deriveSessionTicketKey( const QByteArray& ticketSecret, const QByteArray& challenge )
+{
+	// use a distinct message so the key differs from the proof of possession sent for the same challenge
+	return messageAuthenticationCode( ticketSecret, QByteArrayLiteral("VeyonSessionTicketKey") + challenge );
+}
+
+
+
+bool CryptoCore::isEqual( const QByteArray& a, const QByteArray& b )
+{
+	return a.size() == b.size() && CRYPTO_memcmp( a.constData(), b.constData(), size_t(a.size()) ) == 0;
+}
+
+
+
 QString CryptoCore::encryptPassword( const PlaintextPassword& password ) const
 {
 	return QString::fromLatin1( m_defaultPrivateKey.toPublicKey().
@@ -42,6 +42,7 @@ public:
 	enum {
 		RsaKeySize = 4096,
 		ChallengeSize = 128,
+		SecretSize = 32,
 	};
 
 	static constexpr QCA::EncryptionAlgorithm DefaultEncryptionAlgorithm = QCA::EME_PKCS1_OAEP;
@@ -51,6 +52,17 @@ public:
 	~CryptoCore();
 
 	static QByteArray generateChallenge();
+	static QByteArray generateSecret();
+
+	// HMAC-SHA256
+	static QByteArray messageAuthenticationCode( const QByteArray& key, const QByteArray& message );
+	// masks/unmasks a secret of SecretSize bytes with a key stream derived from the given key and nonce
+	static QByteArray maskSecret( const QByteArray& secret, const QByteArray& key, const QByteArray& nonce );
+	// key for masking the secret of the session ticket issued after resuming with the given ticket,
+	// known to both client and server but never transmitted
+	static QByteArray deriveSessionTicketKey( const QByteArray& ticketSecret, const QByteArray& challenge );
+	// compares in constant time to not leak information about secrets through timing
+	static bool isEqual( const QByteArray& a, const QByteArray& b );
 
 	QString encryptPassword( const PlaintextPassword& password ) const;
 	PlaintextPassword decryptPassword( const QString& encryptedPassword ) const;
@@ -0,0 +1,341 @@
+/*
+ * ImageScaler.cpp - implementation of ImageScaler class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <QVarLengthArray>
+#include <QVector>
+
+#include "ImageScaler.h"
+
+#if defined(Q_PROCESSOR_X86) && defined(__GNUC__)
+#define IMAGE_SCALER_X86
+#include <immintrin.h>
+#endif
+
+
+ImageScaler::Implementation ImageScaler::s_implementation = ImageScaler::Implementation::Auto;
+
+
+namespace {
+
+// sums up the 4 channels of each pixel of one source row into 32 bit accumulators
+using AccumulateRowFunction = void (*)( quint32* accumulators, const quint32* pixels, int pixelCount );
+
+// averages accumulated columns xBounds[i]..xBounds[i+1] into one destination pixel each
+using ReduceColumnsFunction = void (*)( const quint32* accumulators, const int* xBounds, int pixelCount,
+										int rowCount, quint32* destination );
+
+
+void accumulateRowScalar( quint32* accumulators, const quint32* pixels, int pixelCount )
+{
+	for( int x = 0; x < pixelCount; ++x )
+	{
+		const auto pixel = pixels[x];
+		accumulators[x*4+0] += pixel & 0xff;
+		accumulators[x*4+1] += ( pixel >> 8 ) & 0xff;
+		accumulators[x*4+2] += ( pixel >> 16 ) & 0xff;
+		accumulators[x*4+3] += pixel >> 24;
+	}
+}
+
+
+
+void reduceColumnsScalar( const quint32* accumulators, const int* xBounds, int pixelCount,
+						  int rowCount, quint32* destination )
+{
+	for( int i = 0; i < pixelCount; ++i )
+	{
+		quint32 sums[4] = { 0, 0, 0, 0 };
+		for( int x = xBounds[i]; x < xBounds[i+1]; ++x )
+		{
+			sums[0] += accumulators[x*4+0];
+			sums[1] += accumulators[x*4+1];
+			sums[2] += accumulators[x*4+2];
+			sums[3] += accumulators[x*4+3];
+		}
+
+		const auto count = quint32( ( xBounds[i+1] - xBounds[i] ) * rowCount );
+		const auto round = count / 2;
+
+		destination[i] = ( ( sums[0] + round ) / count ) |
+						 ( ( ( sums[1] + round ) / count ) << 8 ) |
+						 ( ( ( sums[2] + round ) / count ) << 16 ) |
+						 ( ( ( sums[3] + round ) / count ) << 24 );
+	}
+}
+
+
+
+#ifdef IMAGE_SCALER_X86
+__attribute__((target("sse2")))
+void accumulateRowSSE2( quint32* accumulators, const quint32* pixels, int pixelCount )
+{
+	const auto zero = _mm_setzero_si128();
+
+	int x = 0;
+	for( ; x + 4 <= pixelCount; x += 4 )
+	{
+		const auto source = _mm_loadu_si128( reinterpret_cast<const __m128i *>( pixels + x ) );
+		const auto low = _mm_unpacklo_epi8( source, zero );
+		const auto high = _mm_unpackhi_epi8( source, zero );
+
+		auto accumulator = reinterpret_cast<__m128i *>( accumulators + x*4 );
+		_mm_storeu_si128( accumulator+0, _mm_add_epi32( _mm_loadu_si128( accumulator+0 ), _mm_unpacklo_epi16( low, zero ) ) );
+		_mm_storeu_si128( accumulator+1, _mm_add_epi32( _mm_loadu_si128( accumulator+1 ), _mm_unpackhi_epi16( low, zero ) ) );
+		_mm_storeu_si128( accumulator+2, _mm_add_epi32( _mm_loadu_si128( accumulator+2 ), _mm_unpacklo_epi16( high, zero ) ) );
+		_mm_storeu_si128( accumulator+3, _mm_add_epi32( _mm_loadu_si128( accumulator+3 ), _mm_unpackhi_epi16( high, zero ) ) );
+	}
+
+	accumulateRowScalar( accumulators + x*4, pixels + x, pixelCount - x );
+}
+
+
+
+__attribute__((target("sse2")))
+void reduceColumnsSSE2( const quint32* accumulators, const int* xBounds, int pixelCount,
+						int rowCount, quint32* destination )
+{
+	for( int i = 0; i < pixelCount; ++i )
+	{
+		auto sum = _mm_setzero_si128();
+		for( int x = xBounds[i]; x < xBounds[i+1]; ++x )
+		{
+			sum = _mm_add_epi32( sum, _mm_loadu_si128( reinterpret_cast<const __m128i *>( accumulators + x*4 ) ) );
+		}
+
+		// sums are unsigned while the conversion is signed, so convert upper and lower halves separately
+		const auto sumHigh = _mm_cvtepi32_ps( _mm_srli_epi32( sum, 16 ) );
+		const auto sumLow = _mm_cvtepi32_ps( _mm_and_si128( sum, _mm_set1_epi32( 0xffff ) ) );
+		const auto sumFloat = _mm_add_ps( _mm_mul_ps( sumHigh, _mm_set1_ps( 65536.0f ) ), sumLow );
+
+		const auto scale = _mm_set1_ps( 1.0f / float( ( xBounds[i+1] - xBounds[i] ) * rowCount ) );
+		const auto average = _mm_cvtps_epi32( _mm_mul_ps( sumFloat, scale ) );
+		const auto packed16 = _mm_packs_epi32( average, average );
+
+		destination[i] = quint32( _mm_cvtsi128_si32( _mm_packus_epi16( packed16, packed16 ) ) );
+	}
+}
+
+
+
+__attribute__((target("avx2")))
+void accumulateRowAVX2( quint32* accumulators, const quint32* pixels, int pixelCount )
+{
+	int x = 0;
+	for( ; x + 8 <= pixelCount; x += 8 )
+	{
+		const auto source = reinterpret_cast<const __m128i *>( pixels + x );
+		auto accumulator = reinterpret_cast<__m256i *>( accumulators + x*4 );
+
+		// each conversion widens 2 pixels (8 channels) to 32 bit
+		for( int i = 0; i < 4; ++i )
+		{
+			const auto widened = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i *>(
+																		   reinterpret_cast<const quint64 *>( source ) + i ) ) );
+			_mm256_storeu_si256( accumulator+i, _mm256_add_epi32( _mm256_loadu_si256( accumulator+i ), widened ) );
+		}
+	}
+
+	accumulateRowSSE2( accumulators + x*4, pixels + x, pixelCount - x );
+}
+#endif
+
+
+
+struct Kernels
+{
+	AccumulateRowFunction accumulateRow;
+	ReduceColumnsFunction reduceColumns;
+};
+
+
+
+Kernels kernels( ImageScaler::Implementation implementation )
+{
+	switch( implementation )
+	{
+#ifdef IMAGE_SCALER_X86
+	case ImageScaler::Implementation::AVX2: return { accumulateRowAVX2, reduceColumnsSSE2 };
+	case ImageScaler::Implementation::SSE2: return { accumulateRowSSE2, reduceColumnsSSE2 };
+#endif
+	default:
+		break;
+	}
+
+	return { accumulateRowScalar, reduceColumnsScalar };
+}
+
+}
+
+
+
+QImage ImageScaler::scaled( const QImage& image, QSize size )
+{
+	if( image.isNull() || size.isEmpty() )
+	{
+		return {};
+	}
+
+	if( size == image.size() )
+	{
+		return image;
+	}
+
+	if( isSupportedFormat( image.format() ) &&
+		size.width() <= image.width() && size.height() <= image.height() )
+	{
+		// averaging requires premultiplied alpha values
+		const auto source = image.format() == QImage::Format_ARGB32 ?
+								image.convertToFormat( QImage::Format_ARGB32_Premultiplied ) : image;
+
+		QImage destination( size, source.format() );
+		if( downscale( source, destination, destination.rect() ) )
+		{
+			// return the format passed in like QImage::scaled() does
+			if( destination.format() != image.format() )
+			{
+				destination.convertTo( image.format() );
+			}
+			return destination;
+		}
+	}
+
+	return image.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+}
+
+
+
+QImage ImageScaler::scaledKeepAspectRatio( const QImage& image, QSize size )
+{
+	return scaled( image, image.size().scaled( size, Qt::KeepAspectRatio ) );
+}
+
+
+
+bool ImageScaler::downscale( const QImage& source, QImage& destination, const QRect& destinationRect )
+{
+	const auto sourceWidth = source.width();
+	const auto sourceHeight = source.height();
+	const auto scaledWidth = destination.width();
+	const auto scaledHeight = destination.height();
+
+	if( source.isNull() || destination.isNull() ||
+		isSupportedFormat( source.format() ) == false || isSupportedFormat( destination.format() ) == false ||
+		scaledWidth > sourceWidth || scaledHeight > sourceHeight )
+	{
+		return false;
+	}
+
+	const auto rect = destinationRect.intersected( destination.rect() );
+	if( rect.isEmpty() )
+	{
+		return true;
+	}
+
+	const auto scaleKernels = kernels( implementation() );
+
+	// source column boundaries of all destination columns relative to the first source column
+	QVarLengthArray<int, 1024> xBounds( rect.width() + 1 );
+	const auto firstSourceColumn = int( qint64(rect.left()) * sourceWidth / scaledWidth );
+	for( int i = 0; i <= rect.width(); ++i )
+	{
+		xBounds[i] = int( qint64(rect.left() + i) * sourceWidth / scaledWidth ) - firstSourceColumn;
+	}
+
+	const auto sourceColumnCount = xBounds[rect.width()];
+
+	QVector<quint32> accumulators( sourceColumnCount * 4 );
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		const auto firstSourceRow = int( qint64(y) * sourceHeight / scaledHeight );
+		const auto lastSourceRow = int( qint64(y + 1) * sourceHeight / scaledHeight );
+
+		accumulators.fill( 0 );
+
+		for( int sourceRow = firstSourceRow; sourceRow < lastSourceRow; ++sourceRow )
+		{
+			scaleKernels.accumulateRow( accumulators.data(),
+										reinterpret_cast<const quint32 *>( source.constScanLine( sourceRow ) ) + firstSourceColumn,
+										sourceColumnCount );
+		}
+
+		scaleKernels.reduceColumns( accumulators.constData(), xBounds.constData(), rect.width(),
+									lastSourceRow - firstSourceRow,
+									reinterpret_cast<quint32 *>( destination.scanLine( y ) ) + rect.left() );
+	}
+
+	return true;
+}
+
+
+
+bool ImageScaler::isSupportedFormat( QImage::Format format )
+{
+	return format == QImage::Format_RGB32 ||
+		   format == QImage::Format_ARGB32_Premultiplied;
+}
+
+
+
+ImageScaler::Implementation ImageScaler::implementation()
+{
+	static const auto bestImplementation = bestAvailableImplementation();
+
+	if( s_implementation == Implementation::Auto )
+	{
+		return bestImplementation;
+	}
+
+	return s_implementation;
+}
+
+
+
+void ImageScaler::setImplementation( Implementation implementation )
+{
+	if( implementation == Implementation::Auto || implementation == Implementation::Scalar ||
+		implementation <= bestAvailableImplementation() )
+	{
+		s_implementation = implementation;
+	}
+}
+
+
+
+ImageScaler::Implementation ImageScaler::bestAvailableImplementation()
+{
+#ifdef IMAGE_SCALER_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+	{
+		return Implementation::AVX2;
+	}
+	if( __builtin_cpu_supports( "sse2" ) )
+	{
+		return Implementation::SSE2;
+	}
+#endif
+
+	return Implementation::Scalar;
+}
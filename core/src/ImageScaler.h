@@ -0,0 +1,72 @@
+/*
+ * ImageScaler.h - declaration of ImageScaler class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <QImage>
+
+#include "VeyonCore.h"
+
+/**
+ * \brief Fast area-averaging (box filter) downscaler for 32 bit images
+ *
+ * Each destination pixel is the average of the source pixels it covers. This yields the same visual
+ * quality as QImage::scaled() with Qt::SmoothTransformation for large reduction ratios but is much
+ * faster, especially with the SSE2 and AVX2 kernels which get selected at runtime.
+ */
+class VEYON_CORE_EXPORT ImageScaler
+{
+public:
+	enum class Implementation
+	{
+		Auto,
+		Scalar,
+		SSE2,
+		AVX2
+	};
+
+	/** \brief Returns an image scaled to the given size - falls back to QImage::scaled() if not downscaling */
+	static QImage scaled( const QImage& image, QSize size );
+
+	/** \brief Returns an image scaled to fit into the given size with the aspect ratio being kept */
+	static QImage scaledKeepAspectRatio( const QImage& image, QSize size );
+
+	/** \brief Downscales the area of source covered by destinationRect in destination
+	 *
+	 * Both images have to be in a 32 bit format and destination must not be larger than source.
+	 * Allows updating parts of a persistent scaled image after partial updates of the source.
+	 */
+	static bool downscale( const QImage& source, QImage& destination, const QRect& destinationRect );
+
+	static bool isSupportedFormat( QImage::Format format );
+
+	static Implementation implementation();
+	static void setImplementation( Implementation implementation );
+
+	static Implementation bestAvailableImplementation();
+
+private:
+	static Implementation s_implementation;
+
+} ;
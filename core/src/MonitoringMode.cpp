@@ -33,6 +33,7 @@
 #include "MonitoringMode.h"
 #include "PlatformCoreFunctions.h"
 #include "PlatformUserFunctions.h"
+#include "UserGroupsBackendManager.h"
 #include "VeyonConfiguration.h"
 #include "VeyonServerInterface.h"
 #include "VeyonWorkerInterface.h"
@@ -112,6 +113,15 @@ void MonitoringMode::setMinimumFramebufferUpdateInterval(const ComputerControlIn
 
 
 
+void MonitoringMode::setScaledFramebufferSize(const ComputerControlInterfaceList& computerControlInterfaces, QSize size)
+{
+	sendFeatureMessage(FeatureMessage{m_monitoringModeFeature.uid(), FeatureCommand::SetScaledFramebufferSize}
+					   .addArgument(Argument::ScaledFramebufferSize, size),
+					   computerControlInterfaces);
+}
+
+
+
 void MonitoringMode::queryApplicationVersion(const ComputerControlInterfaceList& computerControlInterfaces)
 {
 	sendFeatureMessage(FeatureMessage{m_queryApplicationVersionFeature.uid()}, computerControlInterfaces);
@@ -169,7 +179,9 @@ bool MonitoringMode::handleFeatureMessage( ComputerControlInterface::Pointer com
 	if (message.featureUid() == m_queryApplicationVersionFeature.uid())
 	{
 		computerControlInterface->setServerVersion(message.argument(Argument::ApplicationVersion)
-												   .value<VeyonCore::ApplicationVersion>());
+												   .value<VeyonCore::ApplicationVersion>(),
+												   ComputerControlInterface::ServerCapabilities(
+													   message.argument(Argument::ServerCapabilities).toInt()));
 		return true;
 	}
 
@@ -263,13 +275,20 @@ bool MonitoringMode::handleFeatureMessage(VeyonServerInterface& server,
 													   message.argument(Argument::MinimumFramebufferUpdateInterval).toInt());
 			return true;
 		}
+
+		if (message.command<FeatureCommand>() == FeatureCommand::SetScaledFramebufferSize)
+		{
+			server.setScaledFramebufferSize(messageContext, message.argument(Argument::ScaledFramebufferSize).toSize());
+			return true;
+		}
 	}
 
 	if (message.featureUid() == m_queryApplicationVersionFeature.uid())
 	{
 		server.sendFeatureMessageReply(messageContext,
 									   FeatureMessage{m_queryApplicationVersionFeature.uid()}
-									   .addArgument(Argument::ApplicationVersion, int(VeyonCore::config().applicationVersion())));
+									   .addArgument(Argument::ApplicationVersion, int(VeyonCore::config().applicationVersion()))
+									   .addArgument(Argument::ServerCapabilities, int(serverCapabilities())));
 	}
 
 	if (m_queryActiveFeatures.uid() == message.featureUid())
@@ -309,43 +328,78 @@ bool MonitoringMode::handleFeatureMessage(VeyonServerInterface& server,
 
 void MonitoringMode::sendAsyncFeatureMessages(VeyonServerInterface& server, const MessageContext& messageContext)
 {
-	const auto activeFeaturesVersion = messageContext.ioDevice()->property(activeFeaturesVersionProperty()).toInt();
+	// may be called from the worker threads of different connections concurrently
+	const auto ioDevice = messageContext.ioDevice();
+	if (ioDevice == nullptr)
+	{
+		return;
+	}
+
+	QMutexLocker locker(&m_subscriptionsMutex);
 
-	if (activeFeaturesVersion != m_activeFeaturesVersion)
+	auto& subscription = subscriptionState(ioDevice);
+
+	const auto stateVersion = m_stateVersion.loadAcquire();
+	if (subscription.stateVersion == stateVersion)
+	{
+		return;
+	}
+
+	subscription.stateVersion = stateVersion;
+
+	if (subscription.activeFeaturesVersion != m_activeFeaturesVersion)
 	{
 		sendActiveFeatures(server, messageContext);
-		messageContext.ioDevice()->setProperty(activeFeaturesVersionProperty(), m_activeFeaturesVersion);
+		subscription.activeFeaturesVersion = m_activeFeaturesVersion;
 	}
 
 	const auto currentUserInfoVersion = m_userInfoVersion.loadAcquire();
-	const auto contextUserInfoVersion = messageContext.ioDevice()->property(userInfoVersionProperty()).toInt();
-
-	if(contextUserInfoVersion != currentUserInfoVersion)
+	if (subscription.userInfoVersion != currentUserInfoVersion)
 	{
 		sendUserInformation(server, messageContext);
-		messageContext.ioDevice()->setProperty(userInfoVersionProperty(), currentUserInfoVersion);
+		subscription.userInfoVersion = currentUserInfoVersion;
 	}
 
 	const auto currentSessionInfoVersion = m_sessionInfoVersion.loadAcquire();
-	const auto sessionInfoVersion = messageContext.ioDevice()->property(sessionInfoVersionProperty()).toInt();
-
-	if (sessionInfoVersion != currentSessionInfoVersion)
+	if (subscription.sessionInfoVersion != currentSessionInfoVersion)
 	{
 		sendSessionInfo(server, messageContext);
-		messageContext.ioDevice()->setProperty(sessionInfoVersionProperty(), currentSessionInfoVersion);
+		subscription.sessionInfoVersion = currentSessionInfoVersion;
 	}
 
-	const auto screenInfoVersion = messageContext.ioDevice()->property(screenInfoListVersionProperty()).toInt();
-
-	if (screenInfoVersion != m_screenInfoListVersion)
+	if (subscription.screenInfoListVersion != m_screenInfoListVersion)
 	{
 		sendScreenInfoList(server, messageContext);
-		messageContext.ioDevice()->setProperty(screenInfoListVersionProperty(), m_screenInfoListVersion);
+		subscription.screenInfoListVersion = m_screenInfoListVersion;
 	}
 }
 
 
 
+void MonitoringMode::sendInitialState(VeyonServerInterface& server, const MessageContext& messageContext)
+{
+	const auto ioDevice = messageContext.ioDevice();
+	if (ioDevice == nullptr)
+	{
+		return;
+	}
+
+	// send version first as the master evaluates further information depending on it
+	server.sendFeatureMessageReply(messageContext,
+								   FeatureMessage{m_queryApplicationVersionFeature.uid()}
+								   .addArgument(Argument::ApplicationVersion, int(VeyonCore::config().applicationVersion()))
+								   .addArgument(Argument::ServerCapabilities, int(serverCapabilities())));
+
+	// mark all parts of the state as outdated for this connection so everything is sent
+	m_subscriptionsMutex.lock();
+	subscriptionState(ioDevice) = {-1, -1, -1, -1, -1};
+	m_subscriptionsMutex.unlock();
+
+	sendAsyncFeatureMessages(server, messageContext);
+}
+
+
+
 bool MonitoringMode::handleFeatureMessageFromWorker(VeyonServerInterface& server, const FeatureMessage& message)
 {
 	if (message.featureUid() == m_identifyUserFeature.uid() &&
@@ -459,6 +513,7 @@ void MonitoringMode::updateActiveFeatures()
 		{
 			m_activeFeatures = activeFeatures;
 			m_activeFeaturesVersion++;
+			notifyStateChanged();
 		}
 	}
 }
@@ -481,6 +536,10 @@ void MonitoringMode::updateUserInfo()
 				m_userLoginName = userLoginName;
 				m_userFullName = userFullName;
 				++m_userInfoVersion;
+				notifyStateChanged();
+
+				// group memberships might have changed while logging on
+				VeyonCore::userGroupsBackendManager().invalidateGroupsOfUserCache(userLoginName);
 			}
 			m_userDataLock.unlock();
 		}
@@ -526,6 +585,7 @@ void MonitoringMode::updateSessionInfo()
 		{
 			m_sessionInfo = currentSessionInfo;
 			++m_sessionInfoVersion;
+			notifyStateChanged();
 		}
 		m_sessionInfoLock.unlock();
 	});
@@ -557,11 +617,49 @@ void MonitoringMode::updateScreenInfoList()
 	{
 		m_screenInfoList = screenInfoList;
 		++m_screenInfoListVersion;
+		notifyStateChanged();
 	}
 }
 
 
 
+ComputerControlInterface::ServerCapabilities MonitoringMode::serverCapabilities()
+{
+	// lets masters use functionality independent of the reported version
+	return ComputerControlInterface::ServerCapability::ScaledFramebuffer;
+}
+
+
+
+MonitoringMode::SubscriptionState& MonitoringMode::subscriptionState(const QIODevice* ioDevice)
+{
+	auto subscription = m_subscriptions.find(ioDevice);
+	if (subscription == m_subscriptions.end())
+	{
+		subscription = m_subscriptions.insert(ioDevice, {});
+
+		// socket may live in a different thread - remove the state right away so a new socket
+		// allocated at the same address does not inherit it
+		connect(ioDevice, &QObject::destroyed, this, [this, ioDevice]() {
+			QMutexLocker locker(&m_subscriptionsMutex);
+			m_subscriptions.remove(ioDevice);
+		}, Qt::DirectConnection);
+	}
+
+	return *subscription;
+}
+
+
+
+void MonitoringMode::notifyStateChanged()
+{
+	m_stateVersion.fetchAndAddOrdered(1);
+
+	Q_EMIT stateChanged();
+}
+
+
+
 QString MonitoringMode::queryUserIdentity()
 {
 	qApp->setQuitOnLastWindowClosed(false);
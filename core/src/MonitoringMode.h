@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <QHash>
+#include <QMutex>
 #include <QTimer>
 
 #include "FeatureProviderInterface.h"
@@ -49,6 +51,8 @@ public:
 		SessionMetaData,
 		UserIdentity,
 		UserIdentificationContextId,
+		ScaledFramebufferSize,
+		ServerCapabilities,
 		ActiveFeaturesList = 0 // for compatibility after migration from FeatureControl
 	};
 	Q_ENUM(Argument)
@@ -67,7 +71,7 @@ public:
 
 	QVersionNumber version() const override
 	{
-		return QVersionNumber( 1, 2 );
+		return QVersionNumber( 1, 3 );
 	}
 
 	QString name() const override
@@ -100,6 +104,8 @@ public:
 	void setMinimumFramebufferUpdateInterval(const ComputerControlInterfaceList& computerControlInterfaces,
 											 int interval);
 
+	void setScaledFramebufferSize(const ComputerControlInterfaceList& computerControlInterfaces, QSize size);
+
 	void queryApplicationVersion(const ComputerControlInterfaceList& computerControlInterfaces);
 
 	void queryActiveFeatures(const ComputerControlInterfaceList& computerControlInterfaces);
@@ -130,8 +136,18 @@ public:
 							   const MessageContext& messageContext,
 							   const FeatureMessage& message ) override;
 
+	// messages which only concern the connection they have been received through (e.g. ping)
+	// and thus can be handled in the thread serving this connection
+	bool isConnectionLocalMessage(const FeatureMessage& message) const
+	{
+		return message.featureUid() == m_monitoringModeFeature.uid();
+	}
+
 	void sendAsyncFeatureMessages(VeyonServerInterface& server, const MessageContext& messageContext) override;
 
+	// sends the complete state without being queried, e.g. right after a connection has been established
+	void sendInitialState(VeyonServerInterface& server, const MessageContext& messageContext);
+
 	bool handleFeatureMessageFromWorker(VeyonServerInterface& server, const FeatureMessage& message) override;
 
 	bool handleFeatureMessage(VeyonWorkerInterface& worker, const FeatureMessage& message) override;
@@ -143,25 +159,22 @@ private:
 	bool sendScreenInfoList(VeyonServerInterface& server, const MessageContext& messageContext);
 	void queryUsername();
 
-	static const char* activeFeaturesVersionProperty()
-	{
-		return "activeFeaturesListVersion";
-	}
+	static ComputerControlInterface::ServerCapabilities serverCapabilities();
 
-	static const char* userInfoVersionProperty()
+	// versions of the state last sent through a particular connection
+	struct SubscriptionState
 	{
-		return "userInfoVersion";
-	}
+		int stateVersion{-1};
+		int activeFeaturesVersion{0};
+		int userInfoVersion{0};
+		int sessionInfoVersion{0};
+		int screenInfoListVersion{0};
+	};
 
-	static const char* sessionInfoVersionProperty()
-	{
-		return "sessionInfoVersion";
-	}
+	// m_subscriptionsMutex has to be locked
+	SubscriptionState& subscriptionState(const QIODevice* ioDevice);
 
-	static const char* screenInfoListVersionProperty()
-	{
-		return "screenInfoListVersion";
-	}
+	void notifyStateChanged();
 
 	void updateActiveFeatures();
 	void updateUserInfo();
@@ -173,7 +186,8 @@ private:
 	enum class FeatureCommand
 	{
 		Ping,
-		SetMinimumFramebufferUpdateInterval
+		SetMinimumFramebufferUpdateInterval,
+		SetScaledFramebufferSize
 	};
 
 	static constexpr int ActiveFeaturesUpdateInterval = 250;
@@ -216,4 +230,13 @@ private:
 
 	QMap<QUuid, MessageContext> m_userIdentificationContexts;
 
+	// incremented whenever any part of the state changes
+	QAtomicInt m_stateVersion{0};
+	QMutex m_subscriptionsMutex;
+	QHash<const QIODevice *, SubscriptionState> m_subscriptions;
+
+Q_SIGNALS:
+	// emitted from arbitrary threads whenever state which is sent asynchronously has changed
+	void stateChanged();
+
 };
@@ -48,6 +48,10 @@ public:
 	virtual ~PlatformNetworkFunctions() = default;
 
 	virtual PingResult ping(const QString& hostAddress) = 0;
+
+	// probes all hosts concurrently without spawning processes - hosts accepting or refusing
+	// connections on the given TCP port are considered reachable as well
+	virtual QVector<PingResult> pingHosts(const QStringList& hostAddresses, int port, int timeout = PingTimeout) = 0;
 	virtual bool configureFirewallException( const QString& applicationPath, const QString& description, bool enabled ) = 0;
 
 	virtual bool configureSocketKeepalive( Socket socket, bool enabled, int idleTime, int interval, int probes ) = 0;
@@ -0,0 +1,534 @@
+/*
+ * ReachabilityProbe.cpp - implementation of ReachabilityProbe class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <QtGlobal>
+
+#if defined(Q_OS_WIN)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if defined(Q_OS_LINUX)
+#include <netinet/ip_icmp.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostInfo>
+#include <QtConcurrent>
+
+#include "ReachabilityProbe.h"
+
+
+namespace {
+
+#if defined(Q_OS_WIN)
+using NativeSocket = SOCKET;
+using PollFd = WSAPOLLFD;
+constexpr auto InvalidNativeSocket = INVALID_SOCKET;
+constexpr auto ConnectionRefusedError = WSAECONNREFUSED;
+constexpr auto InterruptedError = WSAEINTR;
+#else
+using NativeSocket = int;
+using PollFd = pollfd;
+constexpr auto InvalidNativeSocket = -1;
+constexpr auto ConnectionRefusedError = ECONNREFUSED;
+constexpr auto InterruptedError = EINTR;
+#endif
+
+
+void closeSocket( NativeSocket socket )
+{
+#if defined(Q_OS_WIN)
+	closesocket( socket );
+#else
+	close( socket );
+#endif
+}
+
+
+
+bool setNonBlocking( NativeSocket socket )
+{
+#if defined(Q_OS_WIN)
+	u_long enabled = 1;
+	return ioctlsocket( socket, FIONBIO, &enabled ) == 0;
+#else
+	const auto flags = fcntl( socket, F_GETFL, 0 );
+	return flags >= 0 && fcntl( socket, F_SETFL, flags | O_NONBLOCK ) == 0;
+#endif
+}
+
+
+
+bool isConnectInProgress()
+{
+#if defined(Q_OS_WIN)
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EINPROGRESS;
+#endif
+}
+
+
+
+int pollSockets( QVector<PollFd>& pollFds, int timeout )
+{
+#if defined(Q_OS_WIN)
+	return WSAPoll( pollFds.data(), ULONG(pollFds.size()), timeout );
+#else
+	return poll( pollFds.data(), nfds_t(pollFds.size()), timeout );
+#endif
+}
+
+
+
+int lastSocketError()
+{
+#if defined(Q_OS_WIN)
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+
+
+socklen_t toSocketAddress( const QHostAddress& address, int port, sockaddr_storage& storage )
+{
+	storage = {};
+
+	if( address.protocol() == QAbstractSocket::IPv4Protocol )
+	{
+		auto ipv4SocketAddress = reinterpret_cast<sockaddr_in *>( &storage );
+		ipv4SocketAddress->sin_family = AF_INET;
+		ipv4SocketAddress->sin_port = htons( quint16(port) );
+		ipv4SocketAddress->sin_addr.s_addr = htonl( address.toIPv4Address() );
+		return sizeof(sockaddr_in);
+	}
+
+	if( address.protocol() == QAbstractSocket::IPv6Protocol )
+	{
+		auto ipv6SocketAddress = reinterpret_cast<sockaddr_in6 *>( &storage );
+		ipv6SocketAddress->sin6_family = AF_INET6;
+		ipv6SocketAddress->sin6_port = htons( quint16(port) );
+		const auto ipv6Address = address.toIPv6Address();
+		memcpy( &ipv6SocketAddress->sin6_addr, &ipv6Address, sizeof(ipv6Address) ); // Flawfinder: ignore
+		return sizeof(sockaddr_in6);
+	}
+
+	return 0;
+}
+
+
+
+// returns the socket of a pending connect or InvalidNativeSocket if it failed or completed immediately
+NativeSocket startTcpProbe( const QHostAddress& address, int port, bool* connected )
+{
+	*connected = false;
+
+	sockaddr_storage socketAddress;
+	const auto socketAddressLength = toSocketAddress( address, port, socketAddress );
+	if( socketAddressLength == 0 )
+	{
+		return InvalidNativeSocket;
+	}
+
+	const auto tcpSocket = socket( socketAddress.ss_family, SOCK_STREAM, IPPROTO_TCP );
+	if( tcpSocket == InvalidNativeSocket )
+	{
+		return InvalidNativeSocket;
+	}
+
+	if( setNonBlocking( tcpSocket ) == false )
+	{
+		closeSocket( tcpSocket );
+		return InvalidNativeSocket;
+	}
+
+	if( ::connect( tcpSocket, reinterpret_cast<sockaddr *>( &socketAddress ), socketAddressLength ) == 0 )
+	{
+		*connected = true;
+	}
+	else if( isConnectInProgress() )
+	{
+		return tcpSocket;
+	}
+
+	closeSocket( tcpSocket );
+
+	return InvalidNativeSocket;
+}
+
+
+
+bool isTcpProbeSuccessful( NativeSocket socket )
+{
+	int error = 0;
+	socklen_t errorLength = sizeof(error);
+	if( getsockopt( socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>( &error ), &errorLength ) != 0 )
+	{
+		return false;
+	}
+
+	// a refused connection also proves that the host is up
+	return error == 0 || error == ConnectionRefusedError;
+}
+
+
+
+NativeSocket openIcmpSocket()
+{
+#if defined(Q_OS_LINUX)
+	// requires the group of the process to be within net.ipv4.ping_group_range
+	return socket( AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_ICMP );
+#else
+	return InvalidNativeSocket;
+#endif
+}
+
+
+
+void sendEchoRequest( NativeSocket socket, quint32 ipv4Address, quint16 sequence )
+{
+#if defined(Q_OS_LINUX)
+	// identifier and checksum are filled in by the kernel for ICMP datagram sockets
+	icmphdr header{};
+	header.type = ICMP_ECHO;
+	header.un.echo.sequence = htons( sequence );
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( ipv4Address );
+
+	if( sendto( socket, &header, sizeof(header), 0, reinterpret_cast<sockaddr *>( &address ), sizeof(address) ) < 0 )
+	{
+		vDebug() << "failed to send ICMP echo request to" << QHostAddress( ipv4Address ) << errno;
+	}
+#else
+	Q_UNUSED(socket)
+	Q_UNUSED(ipv4Address)
+	Q_UNUSED(sequence)
+#endif
+}
+
+
+
+// returns the IPv4 addresses of all hosts which sent an echo reply
+QVector<quint32> readEchoReplies( NativeSocket socket )
+{
+	QVector<quint32> addresses;
+
+#if defined(Q_OS_LINUX)
+	for(;;)
+	{
+		char buffer[512];
+		sockaddr_in address{};
+		socklen_t addressLength = sizeof(address);
+
+		const auto size = recvfrom( socket, buffer, sizeof(buffer), 0, // Flawfinder: ignore
+									reinterpret_cast<sockaddr *>( &address ), &addressLength );
+		if( size < 0 )
+		{
+			break;
+		}
+
+		icmphdr header{};
+		if( size_t(size) >= sizeof(header) )
+		{
+			memcpy( &header, buffer, sizeof(header) ); // Flawfinder: ignore
+			if( header.type == ICMP_ECHOREPLY )
+			{
+				addresses.append( ntohl( address.sin_addr.s_addr ) );
+			}
+		}
+	}
+#else
+	Q_UNUSED(socket)
+#endif
+
+	return addresses;
+}
+
+}
+
+
+
+ReachabilityProbe::ReachabilityProbe( Methods methods, int port, int timeout ) :
+	m_methods( methods ),
+	m_port( port ),
+	m_timeout( timeout )
+{
+}
+
+
+
+QVector<ReachabilityProbe::Result> ReachabilityProbe::probe( const QStringList& hostAddresses )
+{
+	QVector<Result> results( hostAddresses.size(), Result::TimedOut );
+
+	// name lookups block so run them in parallel up front
+	const auto addresses = QtConcurrent::blockingMapped<QVector<QHostAddress>>( hostAddresses, resolve );
+
+	QVector<int> tcpTargets;
+	QHash<quint32, QVector<int>> icmpTargets;
+
+	for( int i = 0; i < addresses.size(); ++i )
+	{
+		if( addresses[i].isNull() )
+		{
+			results[i] = Result::NameResolutionFailed;
+			continue;
+		}
+
+		if( m_methods.testFlag( Method::TcpConnect ) && m_port > 0 )
+		{
+			tcpTargets.append( i );
+		}
+
+		if( addresses[i].protocol() == QAbstractSocket::IPv4Protocol )
+		{
+			icmpTargets[addresses[i].toIPv4Address()].append( i );
+		}
+	}
+
+	const auto isPending = [&results]( int index ) {
+		return results[index] == Result::TimedOut;
+	};
+
+	QElapsedTimer timer;
+	timer.start();
+
+	auto icmpSocket = InvalidNativeSocket;
+	if( m_methods.testFlag( Method::IcmpEcho ) && icmpTargets.isEmpty() == false )
+	{
+		icmpSocket = openIcmpSocket();
+
+		quint16 sequence = 0;
+		for( auto it = icmpTargets.constBegin(), end = icmpTargets.constEnd(); icmpSocket != InvalidNativeSocket && it != end; ++it )
+		{
+			sendEchoRequest( icmpSocket, it.key(), sequence++ );
+		}
+	}
+
+	struct TcpProbe
+	{
+		NativeSocket socket;
+		int index;
+		qint64 deadline;
+	};
+
+	QVector<TcpProbe> tcpProbes;
+	tcpProbes.reserve( MaximumConcurrentTcpProbes );
+	int nextTcpTarget = 0;
+
+	QVector<PollFd> pollFds;
+	pollFds.reserve( MaximumConcurrentTcpProbes + 1 );
+
+	for(;;)
+	{
+		const auto now = timer.elapsed();
+
+		// drop probes which are finished by now
+		for( auto it = tcpProbes.begin(); it != tcpProbes.end(); )
+		{
+			if( isPending( it->index ) == false || now >= it->deadline )
+			{
+				closeSocket( it->socket );
+				it = tcpProbes.erase( it );
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		while( tcpProbes.size() < MaximumConcurrentTcpProbes && nextTcpTarget < tcpTargets.size() )
+		{
+			const auto index = tcpTargets[nextTcpTarget++];
+			if( isPending( index ) == false )
+			{
+				continue;
+			}
+
+			bool connected = false;
+			const auto tcpSocket = startTcpProbe( addresses[index], m_port, &connected );
+			if( tcpSocket != InvalidNativeSocket )
+			{
+				tcpProbes.append( { tcpSocket, index, now + m_timeout } );
+			}
+			else if( connected )
+			{
+				results[index] = Result::ReplyReceived;
+			}
+		}
+
+		const auto icmpActive = icmpSocket != InvalidNativeSocket && now < m_timeout &&
+								std::any_of( icmpTargets.constBegin(), icmpTargets.constEnd(), [&]( const QVector<int>& indices ) {
+									return std::any_of( indices.constBegin(), indices.constEnd(), isPending );
+								} );
+
+		if( tcpProbes.isEmpty() && icmpActive == false )
+		{
+			break;
+		}
+
+		qint64 timeout = icmpActive ? m_timeout - now : m_timeout;
+		pollFds.clear();
+
+		if( icmpActive )
+		{
+			pollFds.append( PollFd{ icmpSocket, POLLIN, 0 } );
+		}
+
+		for( const auto& tcpProbe : std::as_const(tcpProbes) )
+		{
+			pollFds.append( PollFd{ tcpProbe.socket, POLLOUT, 0 } );
+			timeout = qMin( timeout, tcpProbe.deadline - now );
+		}
+
+		const auto pollResult = pollSockets( pollFds, int( qMax<qint64>( 0, timeout ) ) );
+		const auto pollError = pollResult < 0 ? lastSocketError() : 0;
+		if( pollResult < 0 && pollError != InterruptedError )
+		{
+			// would fail again immediately, so give up instead of spinning until all probes time out -
+			// hosts not probed to the end must not be reported as offline
+			vWarning() << "failed to poll probe sockets" << pollError;
+			for( auto& result : results )
+			{
+				if( result == Result::TimedOut )
+				{
+					result = Result::Unknown;
+				}
+			}
+			break;
+		}
+
+		if( pollResult <= 0 )
+		{
+			continue;
+		}
+
+		int pollIndex = 0;
+		if( icmpActive )
+		{
+			if( pollFds[pollIndex].revents )
+			{
+				const auto replies = readEchoReplies( icmpSocket );
+				for( const auto address : replies )
+				{
+					for( const auto index : icmpTargets.value( address ) )
+					{
+						results[index] = Result::ReplyReceived;
+					}
+				}
+			}
+			++pollIndex;
+		}
+
+		for( auto& tcpProbe : tcpProbes )
+		{
+			if( pollFds[pollIndex++].revents == 0 )
+			{
+				continue;
+			}
+
+			if( isTcpProbeSuccessful( tcpProbe.socket ) )
+			{
+				results[tcpProbe.index] = Result::ReplyReceived;
+			}
+			else
+			{
+				// keep waiting for an echo reply but do not poll the socket again
+				tcpProbe.deadline = 0;
+			}
+		}
+	}
+
+	for( const auto& tcpProbe : std::as_const(tcpProbes) )
+	{
+		closeSocket( tcpProbe.socket );
+	}
+
+	if( icmpSocket != InvalidNativeSocket )
+	{
+		closeSocket( icmpSocket );
+	}
+
+	return results;
+}
+
+
+
+bool ReachabilityProbe::isIcmpEchoSupported()
+{
+	const auto icmpSocket = openIcmpSocket();
+	if( icmpSocket == InvalidNativeSocket )
+	{
+		return false;
+	}
+
+	closeSocket( icmpSocket );
+
+	return true;
+}
+
+
+
+QHostAddress ReachabilityProbe::resolve( const QString& hostAddress )
+{
+	QHostAddress address;
+	if( address.setAddress( hostAddress ) )
+	{
+		return address;
+	}
+
+	const auto hostInfo = QHostInfo::fromName( hostAddress );
+	if( hostInfo.error() != QHostInfo::NoError || hostInfo.addresses().isEmpty() )
+	{
+		return {};
+	}
+
+	// prefer IPv4 addresses as they can be probed via ICMP as well
+	for( const auto& resolvedAddress : hostInfo.addresses() )
+	{
+		if( resolvedAddress.protocol() == QAbstractSocket::IPv4Protocol )
+		{
+			return resolvedAddress;
+		}
+	}
+
+	return hostInfo.addresses().constFirst();
+}
@@ -0,0 +1,69 @@
+/*
+ * ReachabilityProbe.h - declaration of ReachabilityProbe class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <QHostAddress>
+#include <QVector>
+
+#include "PlatformNetworkFunctions.h"
+
+/**
+ * \brief Checks reachability of many hosts concurrently from the calling thread
+ *
+ * Sends ICMP echo requests through an unprivileged ICMP datagram socket (where supported) and
+ * at the same time tries to open TCP connections to the given port. A host counts as reachable
+ * as soon as it replies to the echo request or accepts or actively refuses the TCP connection,
+ * so hosts with ICMP blocked by a firewall are still detected. All probes are multiplexed with
+ * poll() and no external processes are spawned.
+ */
+class VEYON_CORE_EXPORT ReachabilityProbe
+{
+public:
+	using Result = PlatformNetworkFunctions::PingResult;
+
+	enum class Method {
+		IcmpEcho = 0x01,
+		TcpConnect = 0x02
+	};
+	Q_DECLARE_FLAGS(Methods, Method)
+
+	ReachabilityProbe( Methods methods, int port, int timeout );
+
+	QVector<Result> probe( const QStringList& hostAddresses );
+
+	static bool isIcmpEchoSupported();
+
+private:
+	static constexpr int MaximumConcurrentTcpProbes = 256;
+
+	static QHostAddress resolve( const QString& hostAddress );
+
+	const Methods m_methods;
+	const int m_port;
+	const int m_timeout;
+
+} ;
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(ReachabilityProbe::Methods)
@@ -46,8 +46,25 @@ public:
 
 		// client has to prove its authenticity by knowing common token
 		Token,
+
+		// client presents a ticket issued by the server after a previous successful authentication
+		SessionTicket,
 	} ;
 
 	Q_ENUM(Type)
 
+	// optional handshake extensions negotiated along with the authentication type
+	enum class HandshakeFlag
+	{
+		// authentication data is sent along with the chosen authentication type
+		SpeculativeAuthentication = 0x01,
+
+		// server sends its initial monitoring state right after the server init message
+		InitialState = 0x02,
+	} ;
+
+	Q_DECLARE_FLAGS(HandshakeFlags, HandshakeFlag)
+
 };
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(RfbVeyonAuth::HandshakeFlags)
@@ -90,4 +90,83 @@ void UserGroupsBackendManager::reloadConfiguration()
 	{
 		m_configuredBackend = m_defaultBackend;
 	}
+
+	QMutexLocker locker( &m_groupsOfUserCacheMutex );
+	m_groupsOfUserCacheTimeout = VeyonCore::config().userGroupsCacheTimeout();
+	m_groupsOfUserCache.clear();
+}
+
+
+
+QStringList UserGroupsBackendManager::groupsOfUser( UserGroupsBackendInterface* backend,
+													const QString& username, bool queryDomainGroups )
+{
+	if( backend == nullptr )
+	{
+		return {};
+	}
+
+	const auto key = groupsOfUserCacheKey( backend, username, queryDomainGroups );
+
+	m_groupsOfUserCacheMutex.lock();
+	const auto cacheTimeout = m_groupsOfUserCacheTimeout;
+	const auto it = m_groupsOfUserCache.constFind( key );
+	if( it != m_groupsOfUserCache.constEnd() )
+	{
+		const auto timeout = it->groups.isEmpty() ? qMin( cacheTimeout, NegativeCacheTimeout ) : cacheTimeout;
+		if( it->timer.hasExpired( timeout * 1000 ) == false )
+		{
+			const auto groups = it->groups;
+			m_groupsOfUserCacheMutex.unlock();
+			return groups;
+		}
+	}
+	m_groupsOfUserCacheMutex.unlock();
+
+	// query without holding the lock as backends may block for a long time
+	const auto groups = backend->groupsOfUser( username, queryDomainGroups );
+
+	if( cacheTimeout > 0 )
+	{
+		GroupsOfUserCacheEntry entry{username, groups, {}};
+		entry.timer.start();
+
+		QMutexLocker locker( &m_groupsOfUserCacheMutex );
+		m_groupsOfUserCache.insert( key, entry );
+	}
+
+	return groups;
+}
+
+
+
+void UserGroupsBackendManager::invalidateGroupsOfUserCache( const QString& username )
+{
+	QMutexLocker locker( &m_groupsOfUserCacheMutex );
+
+	if( username.isEmpty() )
+	{
+		m_groupsOfUserCache.clear();
+		return;
+	}
+
+	for( auto it = m_groupsOfUserCache.begin(); it != m_groupsOfUserCache.end(); )
+	{
+		if( it->username == username )
+		{
+			it = m_groupsOfUserCache.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+
+
+QString UserGroupsBackendManager::groupsOfUserCacheKey( UserGroupsBackendInterface* backend,
+														const QString& username, bool queryDomainGroups )
+{
+	return QStringLiteral("%1:%2:%3").arg( quintptr(backend) ).arg( int(queryDomainGroups) ).arg( username );
 }
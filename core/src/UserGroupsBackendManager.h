@@ -24,6 +24,10 @@
 
 #pragma once
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+
 #include "UserGroupsBackendInterface.h"
 
 class VEYON_CORE_EXPORT UserGroupsBackendManager : public QObject
@@ -45,9 +49,32 @@ public:
 
 	void reloadConfiguration();
 
+	// cached version of UserGroupsBackendInterface::groupsOfUser() - may be called from any thread
+	QStringList groupsOfUser( UserGroupsBackendInterface* backend, const QString& username, bool queryDomainGroups );
+
+	// drops cached group memberships of the given user or of all users if username is empty
+	void invalidateGroupsOfUserCache( const QString& username = {} );
+
 private:
+	// users without any groups (e.g. unknown users) are queried again earlier
+	static constexpr int NegativeCacheTimeout = 30;
+
+	struct GroupsOfUserCacheEntry
+	{
+		QString username;
+		QStringList groups;
+		QElapsedTimer timer;
+	};
+
+	static QString groupsOfUserCacheKey( UserGroupsBackendInterface* backend,
+										  const QString& username, bool queryDomainGroups );
+
 	Backends m_backends{};
 	UserGroupsBackendInterface* m_defaultBackend{nullptr};
 	UserGroupsBackendInterface* m_configuredBackend{nullptr};
 
+	QMutex m_groupsOfUserCacheMutex;
+	QHash<QString, GroupsOfUserCacheEntry> m_groupsOfUserCache;
+	int m_groupsOfUserCacheTimeout{0};
+
 };
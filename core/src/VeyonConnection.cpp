@@ -24,6 +24,8 @@
 
 #include "rfb/rfbclient.h"
 
+#include <QDeadlineTimer>
+
 #include "AuthenticationProxy.h"
 #include "CryptoCore.h"
 #include "PlatformUserFunctions.h"
@@ -37,6 +39,203 @@
 static rfbClientProtocolExtension* __veyonProtocolExt = nullptr;
 static const uint32_t __veyonSecurityTypes[2] = { rfbSecTypeVeyon, 0 };
 
+struct SessionTicket
+{
+	RfbVeyonAuth::Type authType{RfbVeyonAuth::Invalid};
+	QString identity;
+	QByteArray id;
+	QByteArray secret;
+	QDeadlineTimer expiry;
+	// number of resumptions in a row which led to this ticket
+	int resumptions{0};
+};
+
+static struct {
+	QMutex mutex;
+	QHash<QString, SessionTicket> tickets;
+} __veyonSessionTickets;
+
+
+static SessionTicket findSessionTicket( const QString& server, RfbVeyonAuth::Type authType, const QString& identity )
+{
+	QMutexLocker locker( &__veyonSessionTickets.mutex );
+
+	// keep the ticket until the server accepted or rejected it so a failed handshake does not lose it
+	const auto ticket = __veyonSessionTickets.tickets.value( server );
+	if( ticket.authType == authType && ticket.identity == identity && ticket.expiry.hasExpired() == false )
+	{
+		return ticket;
+	}
+
+	return {};
+}
+
+
+static void storeSessionTicket( const QString& server, const SessionTicket& ticket )
+{
+	QMutexLocker locker( &__veyonSessionTickets.mutex );
+	__veyonSessionTickets.tickets[server] = ticket;
+}
+
+
+static void removeSessionTicket( const QString& server, const QByteArray& id )
+{
+	QMutexLocker locker( &__veyonSessionTickets.mutex );
+
+	// do not remove a ticket issued to a concurrent connection in the meantime
+	const auto it = __veyonSessionTickets.tickets.find( server );
+	if( it != __veyonSessionTickets.tickets.end() && it->id == id )
+	{
+		__veyonSessionTickets.tickets.erase( it );
+	}
+}
+
+
+static bool writeAuthenticationData( const AuthenticationCredentials& credentials, RfbVeyonAuth::Type authType,
+									 const QByteArray& challenge, const SessionTicket& sessionTicket,
+									 VariantArrayMessage& message )
+{
+	switch( authType )
+	{
+	case RfbVeyonAuth::KeyFile:
+	{
+		if( challenge.size() != CryptoCore::ChallengeSize )
+		{
+			vCritical() << QThread::currentThreadId() << "challenge size mismatch!";
+			return false;
+		}
+
+		// create local copy of private key so we can modify it within our own thread
+		auto key = credentials.privateKey();
+		if( key.isNull() || key.canSign() == false )
+		{
+			vCritical() << QThread::currentThreadId() << "invalid private key!";
+			return false;
+		}
+
+		message.write( credentials.authenticationKeyName() );
+		message.write( key.signMessage( challenge, CryptoCore::DefaultSignatureAlgorithm ) );
+		return true;
+	}
+
+	case RfbVeyonAuth::Token:
+		message.write( credentials.token().toByteArray() );
+		return true;
+
+	case RfbVeyonAuth::SessionTicket:
+		if( challenge.size() != CryptoCore::ChallengeSize )
+		{
+			vCritical() << QThread::currentThreadId() << "challenge size mismatch!";
+			return false;
+		}
+
+		// prove possession of the ticket secret without revealing it and
+		// tell the server which authentication type to fall back to on rejection
+		message.write( sessionTicket.id );
+		message.write( CryptoCore::messageAuthenticationCode( sessionTicket.secret, challenge ) );
+		message.write( sessionTicket.authType );
+		return true;
+
+	default:
+		break;
+	}
+
+	return false;
+}
+
+
+static bool performAuthentication( const AuthenticationCredentials& credentials, RfbVeyonAuth::Type authType,
+								   const QByteArray& sessionTicketKey, SocketDevice& socketDevice )
+{
+	switch( authType )
+	{
+	case RfbVeyonAuth::KeyFile:
+		if( credentials.hasCredentials( AuthenticationCredentials::Type::PrivateKey ) )
+		{
+			VariantArrayMessage challengeReceiveMessage( &socketDevice );
+			challengeReceiveMessage.receive();
+			const auto challenge = challengeReceiveMessage.read().toByteArray();
+
+			VariantArrayMessage challengeResponseMessage( &socketDevice );
+			if( writeAuthenticationData( credentials, authType, challenge, {}, challengeResponseMessage ) == false )
+			{
+				return false;
+			}
+			challengeResponseMessage.send();
+		}
+		break;
+
+	case RfbVeyonAuth::Logon:
+	{
+		VariantArrayMessage publicKeyMessage( &socketDevice );
+		publicKeyMessage.receive();
+
+		CryptoCore::PublicKey publicKey = CryptoCore::PublicKey::fromPEM( publicKeyMessage.read().toString() );
+
+		if( publicKey.canEncrypt() == false )
+		{
+			vCritical() << QThread::currentThreadId() << "can't encrypt with given public key!";
+			return false;
+		}
+
+		CryptoCore::SecureArray plainTextPassword( credentials.logonPassword() );
+		CryptoCore::SecureArray encryptedPassword = publicKey.encrypt( plainTextPassword, CryptoCore::DefaultEncryptionAlgorithm );
+		if( encryptedPassword.isEmpty() )
+		{
+			vCritical() << QThread::currentThreadId() << "password encryption failed!";
+			return false;
+		}
+
+		VariantArrayMessage passwordResponse( &socketDevice );
+		passwordResponse.write( encryptedPassword.toByteArray() );
+		if( sessionTicketKey.isEmpty() == false )
+		{
+			// let the server encrypt the secret of the session ticket to be issued with our key
+			passwordResponse.write( publicKey.encrypt( CryptoCore::SecureArray( sessionTicketKey ),
+													   CryptoCore::DefaultEncryptionAlgorithm ).toByteArray() );
+		}
+		passwordResponse.send();
+		break;
+	}
+
+	case RfbVeyonAuth::Token:
+	{
+		VariantArrayMessage authDataMessage( &socketDevice );
+		writeAuthenticationData( credentials, authType, {}, {}, authDataMessage );
+		authDataMessage.send();
+		break;
+	}
+
+	default:
+		// nothing to do - we just get accepted
+		break;
+	}
+
+	return true;
+}
+
+
+static QByteArray decryptSessionTicketSecret( const AuthenticationCredentials& credentials, RfbVeyonAuth::Type authType,
+											  const QByteArray& sessionTicketKey, const QByteArray& ticketId,
+											  const QByteArray& encryptedSecret )
+{
+	if( authType == RfbVeyonAuth::KeyFile )
+	{
+		auto key = credentials.privateKey();
+		CryptoCore::SecureArray secret;
+		if( key.isNull() == false &&
+			key.decrypt( CryptoCore::SecureArray( encryptedSecret ), &secret, CryptoCore::DefaultEncryptionAlgorithm ) )
+		{
+			return secret.toByteArray();
+		}
+
+		return {};
+	}
+
+	return CryptoCore::maskSecret( encryptedSecret, sessionTicketKey, ticketId );
+}
+
+
 
 rfbBool handleVeyonMessage( rfbClient* client, rfbServerToClientMsg* msg )
 {
@@ -140,6 +339,21 @@ bool VeyonConnection::handleServerMessage( rfbClient* client, uint8_t msg )
 
 
 
+int VeyonConnection::sessionTicketResumptions( const QString& server )
+{
+	QMutexLocker locker( &__veyonSessionTickets.mutex );
+
+	const auto it = __veyonSessionTickets.tickets.constFind( server );
+	if( it == __veyonSessionTickets.tickets.constEnd() || it->expiry.hasExpired() )
+	{
+		return -1;
+	}
+
+	return it->resumptions;
+}
+
+
+
 void VeyonConnection::registerConnection()
 {
 	if( m_vncConnection )
@@ -219,6 +433,22 @@ rfbBool VeyonConnection::handleSecTypeVeyon( rfbClient* client, uint32_t authSch
 		authTypes.append( authType );
 	}
 
+	// optional fields only sent by servers supporting handshake extensions
+	const auto serverHandshakeFlags = RfbVeyonAuth::HandshakeFlags( message.read().toInt() );
+	const auto speculativeChallenge = message.read().toByteArray();
+
+	// session tickets are no authentication method on their own and thus are not offered for selection
+	const auto sessionTicketsSupported = authTypes.removeAll( RfbVeyonAuth::SessionTicket ) > 0;
+	if( authTypes.isEmpty() )
+	{
+		vDebug() << QThread::currentThreadId() << "no usable auth types received";
+		if( proxy )
+		{
+			proxy->notifyProtocolError();
+		}
+		return FALSE;
+	}
+
 	if( proxy )
 	{
 		proxy->setAuthenticationTypes( authTypes );
@@ -245,99 +475,181 @@ rfbBool VeyonConnection::handleSecTypeVeyon( rfbClient* client, uint32_t authSch
 
 	vDebug() << QThread::currentThreadId() << "chose authentication type:" << authTypes;
 
+	const auto credentials = connection->authenticationCredentials();
+
+	// username is used when displaying an access confirm dialog
+	const auto username = credentials.hasCredentials( AuthenticationCredentials::Type::UserLogon ) ?
+							  credentials.logonUsername() :
+							  VeyonCore::platform().userFunctions().currentUser();
+
+	// let the server issue a ticket for skipping the expensive authentication steps on reconnect
+	const auto sessionTicketRequested = sessionTicketsSupported && proxy == nullptr &&
+										( chosenAuthType == RfbVeyonAuth::KeyFile || chosenAuthType == RfbVeyonAuth::Logon );
+	const auto sessionTicketServer = QStringLiteral("%1:%2").arg( QString::fromUtf8( client->serverHost ) ).arg( client->serverPort );
+	const auto sessionTicketIdentity = chosenAuthType == RfbVeyonAuth::KeyFile ?
+										   credentials.authenticationKeyName() + QLatin1Char(':') + username :
+										   username;
+	const auto sessionTicket = sessionTicketRequested ?
+								   findSessionTicket( sessionTicketServer, chosenAuthType, sessionTicketIdentity ) :
+								   SessionTicket{};
+	// key for letting the server encrypt the secret of a new session ticket when authenticating by logon
+	auto sessionTicketKey = sessionTicketRequested && chosenAuthType == RfbVeyonAuth::Logon ?
+								CryptoCore::generateSecret() : QByteArray{};
+	QByteArray sessionTicketChallenge;
+	bool sessionTicketAccepted = false;
+
+	const auto effectiveAuthType = sessionTicket.id.isEmpty() ? chosenAuthType : RfbVeyonAuth::SessionTicket;
+
+	// save round trips by sending authentication data along with the chosen authentication type
+	// whenever it does not depend on data from the server not received yet
+	RfbVeyonAuth::HandshakeFlags handshakeFlags{};
+	if( VeyonCore::config().handshakePipeliningEnabled() )
+	{
+		handshakeFlags = serverHandshakeFlags & RfbVeyonAuth::HandshakeFlag::InitialState;
+
+		if( serverHandshakeFlags.testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication ) &&
+			( effectiveAuthType == RfbVeyonAuth::Token ||
+			  ( effectiveAuthType == RfbVeyonAuth::SessionTicket &&
+				speculativeChallenge.size() == CryptoCore::ChallengeSize ) ||
+			  ( effectiveAuthType == RfbVeyonAuth::KeyFile &&
+				speculativeChallenge.size() == CryptoCore::ChallengeSize &&
+				credentials.hasCredentials( AuthenticationCredentials::Type::PrivateKey ) ) ) )
+		{
+			handshakeFlags |= RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication;
+		}
+	}
+
+	connection->m_handshakeFlags.storeRelease( int(handshakeFlags) );
+
 	VariantArrayMessage authReplyMessage( &socketDevice );
 
-	authReplyMessage.write( chosenAuthType );
+	authReplyMessage.write( effectiveAuthType );
+	authReplyMessage.write( username );
 
-	// send username which is used when displaying an access confirm dialog
-	if( connection->authenticationCredentials().hasCredentials( AuthenticationCredentials::Type::UserLogon ) )
+	if( sessionTicketsSupported || serverHandshakeFlags )
 	{
-		authReplyMessage.write( connection->authenticationCredentials().logonUsername() );
+		authReplyMessage.write( sessionTicketRequested );
 	}
-	else
+
+	if( serverHandshakeFlags )
 	{
-		authReplyMessage.write( VeyonCore::platform().userFunctions().currentUser() );
+		authReplyMessage.write( int(handshakeFlags) );
 	}
 
-	authReplyMessage.send();
-
-	VariantArrayMessage authAckMessage( &socketDevice );
-	if( authAckMessage.receive() == false )
+	if( handshakeFlags.testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication ) )
 	{
-		vWarning() << QThread::currentThreadId() << "failed to receive authentication acknowledge";
-		return FALSE;
-	}
+		if( writeAuthenticationData( credentials, effectiveAuthType, speculativeChallenge,
+									 sessionTicket, authReplyMessage ) == false )
+		{
+			return FALSE;
+		}
+
+		sessionTicketChallenge = speculativeChallenge;
 
-	switch( chosenAuthType )
+		// server does not send an auth ack message in this case
+		authReplyMessage.send();
+	}
+	else
 	{
-	case RfbVeyonAuth::KeyFile:
-		if( connection->authenticationCredentials().hasCredentials( AuthenticationCredentials::Type::PrivateKey ) )
+		authReplyMessage.send();
+
+		VariantArrayMessage authAckMessage( &socketDevice );
+		if( authAckMessage.receive() == false )
+		{
+			vWarning() << QThread::currentThreadId() << "failed to receive authentication acknowledge";
+			return FALSE;
+		}
+
+		if( effectiveAuthType == RfbVeyonAuth::SessionTicket )
 		{
 			VariantArrayMessage challengeReceiveMessage( &socketDevice );
 			challengeReceiveMessage.receive();
 			const auto challenge = challengeReceiveMessage.read().toByteArray();
 
-			if( challenge.size() != CryptoCore::ChallengeSize )
+			VariantArrayMessage sessionTicketResponseMessage( &socketDevice );
+			if( writeAuthenticationData( credentials, effectiveAuthType, challenge,
+										 sessionTicket, sessionTicketResponseMessage ) == false )
 			{
-				vCritical() << QThread::currentThreadId() << "challenge size mismatch!";
 				return FALSE;
 			}
+			sessionTicketResponseMessage.send();
 
-			// create local copy of private key so we can modify it within our own thread
-			auto key = connection->authenticationCredentials().privateKey();
-			if( key.isNull() || key.canSign() == false )
-			{
-				vCritical() << QThread::currentThreadId() << "invalid private key!";
-				return FALSE;
-			}
-
-			const auto signature = key.signMessage( challenge, CryptoCore::DefaultSignatureAlgorithm );
-
-			VariantArrayMessage challengeResponseMessage( &socketDevice );
-			challengeResponseMessage.write( connection->authenticationCredentials().authenticationKeyName() );
-			challengeResponseMessage.write( signature );
-			challengeResponseMessage.send();
+			sessionTicketChallenge = challenge;
 		}
-		break;
+		else if( performAuthentication( credentials, effectiveAuthType, sessionTicketKey, socketDevice ) == false )
+		{
+			return FALSE;
+		}
+	}
 
-	case RfbVeyonAuth::Logon:
+	if( effectiveAuthType == RfbVeyonAuth::SessionTicket )
 	{
-		VariantArrayMessage publicKeyMessage( &socketDevice );
-		publicKeyMessage.receive();
+		VariantArrayMessage sessionTicketResultMessage( &socketDevice );
+		const auto received = sessionTicketResultMessage.receive();
 
-		CryptoCore::PublicKey publicKey = CryptoCore::PublicKey::fromPEM( publicKeyMessage.read().toString() );
+		// the server accepts each ticket only once and thus has consumed it in any case
+		removeSessionTicket( sessionTicketServer, sessionTicket.id );
 
-		if( publicKey.canEncrypt() == false )
+		if( received == false )
 		{
-			vCritical() << QThread::currentThreadId() << "can't encrypt with given public key!";
+			vWarning() << QThread::currentThreadId() << "failed to receive session ticket result";
 			return FALSE;
 		}
 
-		CryptoCore::SecureArray plainTextPassword( connection->authenticationCredentials().logonPassword() );
-		CryptoCore::SecureArray encryptedPassword = publicKey.encrypt( plainTextPassword, CryptoCore::DefaultEncryptionAlgorithm );
-		if( encryptedPassword.isEmpty() )
+		sessionTicketAccepted = sessionTicketResultMessage.read().toBool(); // Flawfinder: ignore
+		if( sessionTicketAccepted )
 		{
-			vCritical() << QThread::currentThreadId() << "password encryption failed!";
-			return FALSE;
+			if( chosenAuthType == RfbVeyonAuth::Logon )
+			{
+				// no fresh key is transferred when resuming, so the server derives the same key as we do
+				sessionTicketKey = CryptoCore::deriveSessionTicketKey( sessionTicket.secret, sessionTicketChallenge );
+			}
 		}
+		else
+		{
+			vDebug() << QThread::currentThreadId() << "session ticket rejected - falling back to" << chosenAuthType;
 
-		VariantArrayMessage passwordResponse( &socketDevice );
-		passwordResponse.write( encryptedPassword.toByteArray() );
-		passwordResponse.send();
-		break;
+			// server continues with the full authentication method within the same handshake
+			if( performAuthentication( credentials, chosenAuthType, sessionTicketKey, socketDevice ) == false )
+			{
+				return FALSE;
+			}
+		}
 	}
 
-	case RfbVeyonAuth::Token:
+	if( sessionTicketRequested )
 	{
-		VariantArrayMessage tokenAuthMessage( &socketDevice );
-		tokenAuthMessage.write( connection->authenticationCredentials().token().toByteArray() );
-		tokenAuthMessage.send();
-		break;
-	}
+		// server replies with a (possibly empty) ticket after successful authentication only
+		VariantArrayMessage sessionTicketMessage( &socketDevice );
+		if( sessionTicketMessage.receive() == false )
+		{
+			vDebug() << QThread::currentThreadId() << "authentication failed or no session ticket received";
+			return FALSE;
+		}
 
-	default:
-		// nothing to do - we just get accepted
-		break;
+		SessionTicket ticket;
+		ticket.authType = chosenAuthType;
+		ticket.identity = sessionTicketIdentity;
+		ticket.id = sessionTicketMessage.read().toByteArray(); // Flawfinder: ignore
+		ticket.resumptions = sessionTicketAccepted ? sessionTicket.resumptions + 1 : 0;
+
+		const auto encryptedSecret = sessionTicketMessage.read().toByteArray(); // Flawfinder: ignore
+		const auto lifetime = sessionTicketMessage.read().toInt(); // Flawfinder: ignore
+
+		if( ticket.id.isEmpty() == false && lifetime > 0 )
+		{
+			ticket.secret = decryptSessionTicketSecret( credentials, chosenAuthType, sessionTicketKey,
+														ticket.id, encryptedSecret );
+			if( ticket.secret.size() == CryptoCore::SecretSize )
+			{
+				ticket.expiry.setRemainingTime( lifetime );
+				storeSessionTicket( sessionTicketServer, ticket );
+			}
+			else
+			{
+				vWarning() << QThread::currentThreadId() << "failed to decrypt session ticket secret";
+			}
+		}
 	}
 
 	return TRUE;
@@ -70,6 +70,12 @@ public:
 		return m_veyonAuthType;
 	}
 
+	// handshake extensions negotiated for the current connection
+	RfbVeyonAuth::HandshakeFlags handshakeFlags() const
+	{
+		return RfbVeyonAuth::HandshakeFlags( m_handshakeFlags.loadAcquire() );
+	}
+
 	void setAuthenticationProxy( AuthenticationProxy* authenticationProxy )
 	{
 		m_authenticationProxy = authenticationProxy;
@@ -79,6 +85,10 @@ public:
 
 	bool handleServerMessage( rfbClient* client, uint8_t msg );
 
+	// number of resumptions in a row which led to the session ticket stored for the given
+	// server ("host:port") or -1 if there's no valid ticket
+	static int sessionTicketResumptions( const QString& server );
+
 	static constexpr auto VeyonConnectionTag = 0xFE14A11;
 
 
@@ -100,6 +110,7 @@ private:
 	VncConnection* m_vncConnection{new VncConnection};
 
 	RfbVeyonAuth::Type m_veyonAuthType;
+	QAtomicInt m_handshakeFlags{0};
 
 	AuthenticationProxy* m_authenticationProxy{nullptr};
 	QString m_accessControlMessage;
@@ -54,6 +54,7 @@
 #include "UserGroupsBackendManager.h"
 #include "VeyonConfiguration.h"
 #include "VncConnection.h"
+#include "VncConnectionEngine.h"
 
 
 VeyonCore* VeyonCore::s_instance = nullptr;
@@ -112,6 +113,9 @@ VeyonCore::~VeyonCore()
 {
 	vDebug();
 
+	delete m_vncConnectionEngine;
+	m_vncConnectionEngine = nullptr;
+
 	delete m_featureManager;
 	m_featureManager = nullptr;
 
@@ -154,6 +158,21 @@ VeyonCore* VeyonCore::instance()
 
 
 
+VncConnectionEngine& VeyonCore::vncConnectionEngine()
+{
+	// create on demand as only few components actually establish VNC connections
+	QMutexLocker locker( &instance()->m_vncConnectionEngineMutex );
+
+	if( instance()->m_vncConnectionEngine == nullptr )
+	{
+		instance()->m_vncConnectionEngine = new VncConnectionEngine;
+	}
+
+	return *( instance()->m_vncConnectionEngine );
+}
+
+
+
 QString VeyonCore::versionString()
 {
 	return QStringLiteral( VEYON_VERSION );
@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include <QMutex>
 #include <QObject>
 #include <QtEndian>
 #include <QDebug>
@@ -54,6 +55,7 @@ class PlatformPluginManager;
 class PluginManager;
 class UserGroupsBackendManager;
 class VeyonConfiguration;
+class VncConnectionEngine;
 
 // clazy:excludeall=ctor-missing-parent-argument
 
@@ -169,6 +171,8 @@ public:
 		return *( instance()->m_filesystem );
 	}
 
+	static VncConnectionEngine& vncConnectionEngine();
+
 	static void setupApplicationParameters();
 	bool initAuthentication();
 
@@ -231,6 +235,8 @@ private:
 	FeatureManager* m_featureManager{nullptr};
 	UserGroupsBackendManager* m_userGroupsBackendManager;
 	NetworkObjectDirectoryManager* m_networkObjectDirectoryManager;
+	QMutex m_vncConnectionEngineMutex;
+	VncConnectionEngine* m_vncConnectionEngine{nullptr};
 
 	Component m_component;
 	bool m_debugging;
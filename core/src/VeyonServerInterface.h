@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <QSize>
+
 #include "VeyonCore.h"
 
 class FeatureMessage;
@@ -49,5 +51,6 @@ public:
 	virtual int vncServerBasePort() const = 0;
 
 	virtual void setMinimumFramebufferUpdateInterval(const MessageContext& context, int interval) = 0;
+	virtual void setScaledFramebufferSize(const MessageContext& context, QSize size) = 0;
 
 };
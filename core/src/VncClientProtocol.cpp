@@ -33,6 +33,8 @@ extern "C"
 #include <QRegularExpression>
 #include <QTcpSocket>
 
+#include "RfbVeyonAuth.h"
+#include "VariantArrayMessage.h"
 #include "VncClientProtocol.h"
 
 
@@ -67,6 +69,14 @@ vncEncryptBytes(unsigned char *bytes, const char *passwd, size_t passwd_length)
 
 
 
+// advances the buffer position without copying data
+static bool skipData( QBuffer& buffer, qint64 size )
+{
+	return size >= 0 && buffer.bytesAvailable() >= size && buffer.seek( buffer.pos() + size );
+}
+
+
+
 VncClientProtocol::VncClientProtocol( QIODevice* socket, const Password& vncPassword ) :
 	m_socket( socket ),
 	m_state( Disconnected ),
@@ -82,6 +92,10 @@ VncClientProtocol::VncClientProtocol( QIODevice* socket, const Password& vncPass
 void VncClientProtocol::start()
 {
 	m_state = Protocol;
+
+	m_receiveBuffer.clear();
+	m_receiveBufferOffset = 0;
+	m_framebufferUpdateParserState = {};
 }
 
 
@@ -99,6 +113,12 @@ bool VncClientProtocol::read() // Flawfinder: ignore
 	case SecurityChallenge:
 		return receiveSecurityChallenge();
 
+	case AuthenticationTypes:
+		return receiveAuthenticationTypes();
+
+	case AuthenticationAck:
+		return receiveAuthenticationAck();
+
 	case SecurityResult:
 		return receiveSecurityResult();
 
@@ -197,15 +217,27 @@ void VncClientProtocol::requestFramebufferUpdate( bool incremental )
 
 bool VncClientProtocol::receiveMessage()
 {
-	if( m_socket->bytesAvailable() > MaximumMessageSize )
+	if( m_socket->bytesAvailable() > 0 )
+	{
+		compactReceiveBuffer();
+		m_receiveBuffer.append( m_socket->readAll() );
+	}
+
+	if( m_receiveBuffer.size() - m_receiveBufferOffset > MaximumMessageSize )
 	{
 		vCritical() << "Message too big or invalid";
 		m_socket->close();
 		return false;
 	}
 
+	// continue parsing an incomplete framebuffer update (parts of it may have been forwarded already)
+	if( m_framebufferUpdateParserState.rectCount >= 0 )
+	{
+		return receiveFramebufferUpdateMessage();
+	}
+
 	uint8_t messageType = 0;
-	if( m_socket->peek( reinterpret_cast<char *>( &messageType ), sizeof(messageType) ) != sizeof(messageType) )
+	if( peekMessageData( reinterpret_cast<char *>( &messageType ), sizeof(messageType) ) == false )
 	{
 		return false;
 	}
@@ -306,7 +338,12 @@ bool VncClientProtocol::receiveSecurityTypes()
 
 		char securityType = rfbSecTypeInvalid;
 
-		if( securityTypeList.contains( rfbSecTypeVncAuth ) )
+		if( m_authenticationToken.isEmpty() == false && securityTypeList.contains( rfbSecTypeVeyon ) )
+		{
+			securityType = rfbSecTypeVeyon;
+			m_state = State::AuthenticationTypes;
+		}
+		else if( securityTypeList.contains( rfbSecTypeVncAuth ) )
 		{
 			securityType = rfbSecTypeVncAuth;
 			m_state = State::SecurityChallenge;
@@ -354,6 +391,83 @@ bool VncClientProtocol::receiveSecurityChallenge()
 
 
 
+bool VncClientProtocol::receiveAuthenticationTypes()
+{
+	VariantArrayMessage message( m_socket );
+
+	if( message.isReadyForReceive() && message.receive() )
+	{
+		const auto authTypeCount = message.read().toInt();
+
+		QList<RfbVeyonAuth::Type> authTypes;
+		authTypes.reserve( authTypeCount );
+
+		for( int i = 0; i < authTypeCount; ++i )
+		{
+			authTypes.append( message.read().value<RfbVeyonAuth::Type>() );
+		}
+
+		if( authTypes.contains( RfbVeyonAuth::Token ) == false )
+		{
+			vCritical() << "server does not support token authentication!" << authTypes;
+			m_socket->close();
+			return false;
+		}
+
+		// optional field only sent by servers supporting handshake extensions
+		const auto serverHandshakeFlags = RfbVeyonAuth::HandshakeFlags( message.read().toInt() );
+		const auto handshakeFlags = serverHandshakeFlags & RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication;
+
+		VariantArrayMessage authReplyMessage( m_socket );
+
+		authReplyMessage.write( RfbVeyonAuth::Token );
+		authReplyMessage.write( QString() );
+
+		if( serverHandshakeFlags )
+		{
+			// no session ticket requested
+			authReplyMessage.write( false );
+			authReplyMessage.write( int(handshakeFlags) );
+		}
+
+		if( handshakeFlags.testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication ) )
+		{
+			// send the token right away as the server does not send an auth ack message in this case
+			authReplyMessage.write( m_authenticationToken.toByteArray() );
+			m_state = SecurityResult;
+		}
+		else
+		{
+			m_state = AuthenticationAck;
+		}
+
+		return authReplyMessage.send();
+	}
+
+	return false;
+}
+
+
+
+bool VncClientProtocol::receiveAuthenticationAck()
+{
+	VariantArrayMessage authAckMessage( m_socket );
+
+	if( authAckMessage.isReadyForReceive() && authAckMessage.receive() )
+	{
+		VariantArrayMessage authDataMessage( m_socket );
+		authDataMessage.write( m_authenticationToken.toByteArray() );
+
+		m_state = SecurityResult;
+
+		return authDataMessage.send();
+	}
+
+	return false;
+}
+
+
+
 bool VncClientProtocol::receiveSecurityResult()
 {
 	if( m_socket->bytesAvailable() >= 4 )
@@ -433,24 +547,70 @@ bool VncClientProtocol::receiveServerInitMessage()
 
 bool VncClientProtocol::receiveFramebufferUpdateMessage()
 {
-	// peek all available data and work on a local buffer so we can continously read from it
-	auto data = m_socket->peek( m_socket->bytesAvailable() );
+	auto& parserState = m_framebufferUpdateParserState;
 
-	QBuffer buffer( &data );
+	// work on the received data in place and continue where the previous call stopped
+	const qint64 messageStart = m_receiveBufferOffset;
+	QBuffer buffer( &m_receiveBuffer );
 	buffer.open( QBuffer::ReadOnly ); // Flawfinder: ignore
+	buffer.seek( messageStart + parserState.offset );
 
-	rfbFramebufferUpdateMsg message;
-	if( buffer.read( reinterpret_cast<char *>( &message ), sz_rfbFramebufferUpdateMsg ) != sz_rfbFramebufferUpdateMsg )
+	if( parserState.rectCount < 0 )
 	{
-		return false;
+		rfbFramebufferUpdateMsg message;
+		if( buffer.read( reinterpret_cast<char *>( &message ), sz_rfbFramebufferUpdateMsg ) != sz_rfbFramebufferUpdateMsg )
+		{
+			return false;
+		}
+
+		parserState.rectCount = qFromBigEndian( message.nRects );
+		parserState.offset = buffer.pos() - messageStart;
+	}
+
+	parserState.missingPayloadSize = 0;
+
+	if( parserState.pendingPayloadSize > 0 )
+	{
+		// remaining payload of a rect whose beginning has been forwarded already
+		if( skipPayload( buffer, parserState.pendingPayloadSize ) == false )
+		{
+			return false;
+		}
+
+		finishRect( parserState.incompleteRect );
+
+		parserState.pendingPayloadSize = 0;
+		++parserState.rectIndex;
+		parserState.offset = buffer.pos() - messageStart;
 	}
+	else if( parserState.incompleteRectEnd > 0 )
+	{
+		// skip the remaining payload of the incomplete rect without parsing its headers again
+		const auto receivedSize = m_receiveBuffer.size() - messageStart;
+		if( receivedSize < parserState.incompleteRectEnd )
+		{
+			parserState.missingPayloadSize = parserState.incompleteRectEnd - receivedSize;
+			return false;
+		}
 
-	QRegion updatedRegion;
+		finishRect( parserState.incompleteRect );
 
-	const auto nRects = qFromBigEndian( message.nRects );
+		if( parserState.forwarding == false )
+		{
+			parserState.rects.append( { parserState.incompleteRect.encoding, parserState.incompleteRectOffset,
+										parserState.incompleteRectEnd - parserState.incompleteRectOffset } );
+		}
+
+		parserState.offset = parserState.incompleteRectEnd;
+		parserState.incompleteRectEnd = 0;
+		++parserState.rectIndex;
+		buffer.seek( messageStart + parserState.offset );
+	}
 
-	for( int i = 0; i < nRects; ++i )
+	while( parserState.rectIndex < parserState.rectCount )
 	{
+		const auto rectOffset = buffer.pos() - messageStart;
+
 		rfbFramebufferUpdateRectHeader rectHeader;
 		if( buffer.read( reinterpret_cast<char *>( &rectHeader ), sz_rfbFramebufferUpdateRectHeader ) != sz_rfbFramebufferUpdateRectHeader )
 		{
@@ -465,26 +625,106 @@ bool VncClientProtocol::receiveFramebufferUpdateMessage()
 
 		if( rectHeader.encoding == rfbEncodingLastRect )
 		{
+			parserState.offset = buffer.pos() - messageStart;
 			break;
 		}
 
 		if( handleRect( buffer, rectHeader ) == false )
 		{
+			if( parserState.missingPayloadSize > 0 )
+			{
+				parserState.incompleteRect = rectHeader;
+				parserState.incompleteRectOffset = rectOffset;
+				parserState.incompleteRectEnd = m_receiveBuffer.size() - messageStart + parserState.missingPayloadSize;
+			}
 			return false;
 		}
 
-		if( isPseudoEncoding( rectHeader ) == false &&
-			rectHeader.r.x+rectHeader.r.w <= m_framebufferWidth &&
-			rectHeader.r.y+rectHeader.r.h <= m_framebufferHeight )
+		finishRect( rectHeader );
+
+		if( parserState.forwarding == false )
 		{
-			updatedRegion += QRect( rectHeader.r.x, rectHeader.r.y, rectHeader.r.w, rectHeader.r.h );
+			parserState.rects.append( { rectHeader.encoding, rectOffset, buffer.pos() - messageStart - rectOffset } );
 		}
+
+		++parserState.rectIndex;
+		parserState.offset = buffer.pos() - messageStart;
 	}
 
-	m_lastUpdatedRect = updatedRegion.boundingRect();
+	m_lastUpdatedRect = parserState.updatedRegion.boundingRect();
+	m_lastMessageRects = parserState.forwarding ? QVector<RectLocation>{} : std::move( parserState.rects );
+
+	const auto messageSize = parserState.offset;
+	const auto forwarding = parserState.forwarding;
+	parserState = {};
 
-	// save as much data as we read by processing rects
-	return readMessage( static_cast<int>( buffer.pos() ) );
+	if( forwarding )
+	{
+		// only the remainder of the message not taken by takeIncompleteMessage() yet
+		m_lastMessage = m_receiveBuffer.mid( int(messageStart), int(messageSize) );
+		m_lastMessageType = rfbFramebufferUpdate;
+		takeReceivedData( int(messageSize) );
+		return true;
+	}
+
+	return readMessage( static_cast<int>( messageSize ) );
+}
+
+
+
+QByteArray VncClientProtocol::takeIncompleteMessage()
+{
+	auto& parserState = m_framebufferUpdateParserState;
+
+	if( parserState.missingPayloadSize <= 0 )
+	{
+		return {};
+	}
+
+	// all received data belongs to the current message and the next bytes to
+	// arrive complete the payload of the incomplete rect
+	parserState.pendingPayloadSize = parserState.missingPayloadSize;
+	parserState.incompleteRectEnd = 0;
+	parserState.offset = 0;
+	parserState.forwarding = true;
+
+	QByteArray data;
+	if( m_receiveBufferOffset > 0 )
+	{
+		data = m_receiveBuffer.mid( m_receiveBufferOffset );
+		m_receiveBuffer.clear();
+		m_receiveBufferOffset = 0;
+	}
+	else
+	{
+		data.swap( m_receiveBuffer );
+	}
+
+	return data;
+}
+
+
+
+void VncClientProtocol::markPayloadForwarded( qint64 size )
+{
+	auto& parserState = m_framebufferUpdateParserState;
+
+	if( size <= 0 || size > parserState.missingPayloadSize ||
+		m_receiveBuffer.size() > m_receiveBufferOffset )
+	{
+		vCritical() << "invalid size of forwarded payload";
+		m_socket->close();
+		return;
+	}
+
+	parserState.missingPayloadSize -= size;
+	parserState.pendingPayloadSize = parserState.missingPayloadSize;
+
+	if( parserState.pendingPayloadSize == 0 )
+	{
+		finishRect( parserState.incompleteRect );
+		++parserState.rectIndex;
+	}
 }
 
 
@@ -492,7 +732,7 @@ bool VncClientProtocol::receiveFramebufferUpdateMessage()
 bool VncClientProtocol::receiveColourMapEntriesMessage()
 {
 	rfbSetColourMapEntriesMsg message;
-	if( m_socket->peek( reinterpret_cast<char *>( &message ), sz_rfbSetColourMapEntriesMsg ) != sz_rfbSetColourMapEntriesMsg )
+	if( peekMessageData( reinterpret_cast<char *>( &message ), sz_rfbSetColourMapEntriesMsg ) == false )
 	{
 		return false;
 	}
@@ -513,7 +753,7 @@ bool VncClientProtocol::receiveBellMessage()
 bool VncClientProtocol::receiveCutTextMessage()
 {
 	rfbServerCutTextMsg message;
-	if( m_socket->peek( reinterpret_cast<char *>( &message ), sz_rfbServerCutTextMsg ) != sz_rfbServerCutTextMsg )
+	if( peekMessageData( reinterpret_cast<char *>( &message ), sz_rfbServerCutTextMsg ) == false )
 	{
 		return false;
 	}
@@ -546,23 +786,101 @@ bool VncClientProtocol::receiveXvpMessage()
 
 
 
+bool VncClientProtocol::peekMessageData( char* data, int size ) const
+{
+	if( m_receiveBuffer.size() - m_receiveBufferOffset < size )
+	{
+		return false;
+	}
+
+	memcpy( data, m_receiveBuffer.constData() + m_receiveBufferOffset, size_t(size) ); // Flawfinder: ignore
+
+	return true;
+}
+
+
+
 bool VncClientProtocol::readMessage( int size )
 {
-	if( m_socket->bytesAvailable() < size )
+	if( size <= 0 || m_receiveBuffer.size() - m_receiveBufferOffset < size )
 	{
 		return false;
 	}
 
-	auto message = m_socket->read( size );
-	if( message.size() == size )
+	if( m_receiveBufferOffset == 0 && size == m_receiveBuffer.size() )
 	{
-		m_lastMessage = message;
-		return true;
+		// hand over the buffer without copying
+		m_lastMessage.swap( m_receiveBuffer );
+		m_receiveBuffer.clear();
+	}
+	else
+	{
+		m_lastMessage = m_receiveBuffer.mid( m_receiveBufferOffset, size );
+		takeReceivedData( size );
 	}
 
-	vWarning() << "only received" << message.size() << "of" << size << "bytes";
+	m_lastMessageType = static_cast<uint8_t>( m_lastMessage.constData()[0] );
 
-	return false;
+	return true;
+}
+
+
+
+void VncClientProtocol::takeReceivedData( int size )
+{
+	// only advance the read offset as removing the data from the beginning of the buffer
+	// for every message would move all following data each time
+	m_receiveBufferOffset += size;
+
+	if( m_receiveBufferOffset >= m_receiveBuffer.size() )
+	{
+		m_receiveBuffer.clear();
+		m_receiveBufferOffset = 0;
+	}
+}
+
+
+
+void VncClientProtocol::compactReceiveBuffer()
+{
+	if( m_receiveBufferOffset > 0 )
+	{
+		m_receiveBuffer.remove( 0, m_receiveBufferOffset );
+		m_receiveBufferOffset = 0;
+	}
+}
+
+
+
+bool VncClientProtocol::skipPayload( QBuffer& buffer, qint64 size )
+{
+	if( size >= 0 && buffer.bytesAvailable() < size )
+	{
+		// remember how much data is missing for finishing the current rect
+		m_framebufferUpdateParserState.missingPayloadSize = size - buffer.bytesAvailable();
+		return false;
+	}
+
+	return skipData( buffer, size );
+}
+
+
+
+void VncClientProtocol::finishRect( rfbFramebufferUpdateRectHeader rectHeader )
+{
+	if( rectHeader.encoding == rfbEncodingNewFBSize ||
+		rectHeader.encoding == rfbEncodingExtDesktopSize )
+	{
+		m_framebufferWidth = rectHeader.r.w;
+		m_framebufferHeight = rectHeader.r.h;
+	}
+
+	if( isPseudoEncoding( rectHeader ) == false &&
+		rectHeader.r.x+rectHeader.r.w <= m_framebufferWidth &&
+		rectHeader.r.y+rectHeader.r.h <= m_framebufferHeight )
+	{
+		m_framebufferUpdateParserState.updatedRegion += QRect( rectHeader.r.x, rectHeader.r.y, rectHeader.r.w, rectHeader.r.h );
+	}
 }
 
 
@@ -582,27 +900,27 @@ bool VncClientProtocol::handleRect( QBuffer& buffer, rfbFramebufferUpdateRectHea
 
 	case rfbEncodingXCursor:
 		return width * height == 0 ||
-				( buffer.read( sz_rfbXCursorColors ).size() == sz_rfbXCursorColors &&
-				  buffer.read( size_t(2) * bytesPerRow * height ).size() == static_cast<int>( 2 * bytesPerRow * height ) );
+				( skipData( buffer, sz_rfbXCursorColors ) &&
+				  skipData( buffer, qint64(2) * bytesPerRow * height ) );
 
 	case rfbEncodingRichCursor:
 		return width * height == 0 ||
-				( buffer.read( size_t(width) * height * bytesPerPixel ).size() == static_cast<int>( width * height * bytesPerPixel ) &&
-				  buffer.read( size_t(bytesPerRow) * height ).size() == static_cast<int>( bytesPerRow * height ) );
+				( skipData( buffer, qint64(width) * height * bytesPerPixel ) &&
+				  skipData( buffer, qint64(bytesPerRow) * height ) );
 
 	case rfbEncodingSupportedMessages:
-		return buffer.read( sz_rfbSupportedMessages ).size() == sz_rfbSupportedMessages;
+		return skipData( buffer, sz_rfbSupportedMessages );
 
 	case rfbEncodingSupportedEncodings:
 	case rfbEncodingServerIdentity:
 		// width = byte count
-		return buffer.read( width ).size() == static_cast<int>( width );
+		return skipData( buffer, width );
 
 	case rfbEncodingRaw:
-		return buffer.read( size_t(width) * height * bytesPerPixel ).size() == static_cast<int>( width * height * bytesPerPixel );
+		return skipPayload( buffer, qint64(width) * height * bytesPerPixel );
 
 	case rfbEncodingCopyRect:
-		return buffer.read( sz_rfbCopyRect ).size() == sz_rfbCopyRect;
+		return skipData( buffer, sz_rfbCopyRect );
 
 	case rfbEncodingRRE:
 		return handleRectEncodingRRE( buffer, bytesPerPixel );
@@ -657,7 +975,7 @@ bool VncClientProtocol::handleRectEncodingRRE( QBuffer& buffer, uint bytesPerPix
 	const auto rectDataSize = qFromBigEndian( hdr.nSubrects ) * ( bytesPerPixel + sz_rfbRectangle );
 	const auto totalDataSize = static_cast<int>( bytesPerPixel + rectDataSize );
 
-	return totalDataSize < MaxMessageSize && buffer.read( totalDataSize ).size() == totalDataSize;
+	return totalDataSize < MaxMessageSize && skipPayload( buffer, totalDataSize );
 }
 
 
@@ -674,7 +992,7 @@ bool VncClientProtocol::handleRectEncodingCoRRE( QBuffer& buffer, uint bytesPerP
 	const auto rectDataSize = qFromBigEndian( hdr.nSubrects ) * ( bytesPerPixel + 4 );
 	const auto totalDataSize = static_cast<int>( bytesPerPixel + rectDataSize );
 
-	return totalDataSize < MaxMessageSize && buffer.read( totalDataSize ).size() == totalDataSize;
+	return totalDataSize < MaxMessageSize && skipPayload( buffer, totalDataSize );
 
 }
 
@@ -684,15 +1002,31 @@ bool VncClientProtocol::handleRectEncodingHextile( QBuffer& buffer,
 												   const rfbFramebufferUpdateRectHeader rectHeader,
 												   uint bytesPerPixel )
 {
+	auto& parserState = m_framebufferUpdateParserState;
+
 	const uint rx = rectHeader.r.x;
 	const uint ry = rectHeader.r.y;
 	const uint rw = rectHeader.r.w;
 	const uint rh = rectHeader.r.h;
 
-	for( uint y = ry; y < ry+rh; y += 16 )
+	uint startX = rx;
+	uint startY = ry;
+
+	if( parserState.hextileTileOffset > 0 )
+	{
+		// continue with the first tile which has not been received completely before
+		startX = uint(parserState.hextileTile.x());
+		startY = uint(parserState.hextileTile.y());
+		buffer.seek( m_receiveBufferOffset + parserState.hextileTileOffset );
+	}
+
+	for( uint y = startY; y < ry+rh; y += 16 )
 	{
-		for( uint x = rx; x < rx+rw; x += 16 )
+		for( uint x = ( y == startY ) ? startX : rx; x < rx+rw; x += 16 )
 		{
+			parserState.hextileTile = QPoint( int(x), int(y) );
+			parserState.hextileTileOffset = buffer.pos() - m_receiveBufferOffset;
+
 			uint w = 16, h = 16;
 			if( rx+rw - x < 16 )
 			{
@@ -712,7 +1046,7 @@ bool VncClientProtocol::handleRectEncodingHextile( QBuffer& buffer,
 			if( subEncoding & rfbHextileRaw )
 			{
 				const auto dataSize = static_cast<int>( w * h * bytesPerPixel );
-				if( buffer.read( dataSize ).size() != dataSize )
+				if( skipData( buffer, dataSize ) == false )
 				{
 					return false;
 				}
@@ -721,7 +1055,7 @@ bool VncClientProtocol::handleRectEncodingHextile( QBuffer& buffer,
 
 			if( subEncoding & rfbHextileBackgroundSpecified )
 			{
-				if( buffer.read( bytesPerPixel ).size() != static_cast<int>( bytesPerPixel ) )
+				if( skipData( buffer, bytesPerPixel ) == false )
 				{
 					return false;
 				}
@@ -729,7 +1063,7 @@ bool VncClientProtocol::handleRectEncodingHextile( QBuffer& buffer,
 
 			if( subEncoding & rfbHextileForegroundSpecified )
 			{
-				if( buffer.read( bytesPerPixel ).size() != static_cast<int>( bytesPerPixel ) )
+				if( skipData( buffer, bytesPerPixel ) == false )
 				{
 					return false;
 				}
@@ -757,13 +1091,16 @@ bool VncClientProtocol::handleRectEncodingHextile( QBuffer& buffer,
 				subRectDataSize = nSubrects * 2;
 			}
 
-			if( buffer.read( subRectDataSize ).size() != subRectDataSize )
+			if( skipData( buffer, subRectDataSize ) == false )
 			{
 				return false;
 			}
 		}
 	}
 
+	parserState.hextileTile = {};
+	parserState.hextileTileOffset = 0;
+
 	return true;
 }
 
@@ -780,7 +1117,7 @@ bool VncClientProtocol::handleRectEncodingZlib( QBuffer& buffer )
 
 	const auto n = qFromBigEndian( hdr.nBytes );
 
-	return n < MaxMessageSize && uint32_t(buffer.read(n).size()) == n;
+	return n < MaxMessageSize && skipPayload( buffer, n );
 }
 
 
@@ -796,7 +1133,7 @@ bool VncClientProtocol::handleRectEncodingZRLE(QBuffer &buffer)
 
 	const auto n = qFromBigEndian( hdr.length );
 
-	return n < MaxMessageSize && uint32_t(buffer.read(n).size()) == n;
+	return n < MaxMessageSize && skipPayload( buffer, n );
 }
 
 
@@ -866,13 +1203,13 @@ bool VncClientProtocol::handleRectEncodingTight(QBuffer& buffer,
 
 	if (compCtl == rfbTightFill)
 	{
-		return buffer.read(bytesPerPixel).size() == bytesPerPixel;
+		return skipData(buffer, bytesPerPixel);
 	}
 
 	if (compCtl == rfbTightJpeg)
 	{
 		const auto dataLength = readCompactLength(buffer);
-		return buffer.read(dataLength).size() == dataLength;
+		return skipPayload(buffer, dataLength);
 	}
 
 	if (compCtl > rfbTightMaxSubencoding)
@@ -906,7 +1243,7 @@ bool VncClientProtocol::handleRectEncodingTight(QBuffer& buffer,
 				return false;
 			}
 			const auto rectBytes = tightRectColors * bytesPerPixel;
-			if (buffer.read(rectBytes).size() != rectBytes)
+			if (skipData(buffer, rectBytes) == false)
 			{
 				return false;
 			}
@@ -927,7 +1264,7 @@ bool VncClientProtocol::handleRectEncodingTight(QBuffer& buffer,
 	const int uncompressedRectSize = rectHeader.r.h * rowSize;
 	if (uncompressedRectSize < MaximumUncompressedSize)
 	{
-		return buffer.read(uncompressedRectSize).size() == uncompressedRectSize;
+		return skipData(buffer, uncompressedRectSize);
 	}
 
 	const auto compressedLength = readCompactLength(buffer);
@@ -937,7 +1274,7 @@ bool VncClientProtocol::handleRectEncodingTight(QBuffer& buffer,
 		return false;
 	}
 
-	return buffer.read(compressedLength).size() == compressedLength;
+	return skipPayload(buffer, compressedLength);
 }
 
 
@@ -951,12 +1288,7 @@ bool VncClientProtocol::handleRectEncodingExtDesktopSize(QBuffer& buffer)
 	}
 
 	const auto totalMessageSize = sz_rfbExtDesktopSizeMsg + extDesktopSizeMsg.numberOfScreens * sz_rfbExtDesktopScreen;
-	if (buffer.bytesAvailable() >= totalMessageSize)
-	{
-		return buffer.read(totalMessageSize).size() == totalMessageSize;
-	}
-
-	return false;
+	return skipData(buffer, totalMessageSize);
 }
 
 
@@ -24,7 +24,9 @@
 
 #pragma once
 
+#include <QPoint>
 #include <QRect>
+#include <QRegion>
 
 #include "rfb/rfbproto.h"
 
@@ -43,6 +45,8 @@ public:
 		Protocol,
 		SecurityInit,
 		SecurityChallenge,
+		AuthenticationTypes,
+		AuthenticationAck,
 		SecurityResult,
 		FramebufferInit,
 		Running,
@@ -59,6 +63,13 @@ public:
 	void start();
 	bool read();  // Flawfinder: ignore
 
+	// authenticate with the given token (RfbVeyonAuth::Token) when connecting to Veyon's
+	// own VNC server implementations (e.g. a demo server) instead of plain VNC servers
+	void setAuthenticationToken( const Password& token )
+	{
+		m_authenticationToken = token;
+	}
+
 	const QByteArray& serverInitMessage() const
 	{
 		return m_serverInitMessage;
@@ -74,6 +85,18 @@ public:
 		return m_framebufferHeight;
 	}
 
+	// for framebuffer updates received through other connections to the same server
+	void setFramebufferSize( int width, int height )
+	{
+		m_framebufferWidth = quint16(width);
+		m_framebufferHeight = quint16(height);
+	}
+
+	const rfbPixelFormat& pixelFormat() const
+	{
+		return m_pixelFormat;
+	}
+
 	void setPixelFormat(rfbPixelFormat pixelFormat);
 	void setEncodings(const QVector<uint32_t>& encodings);
 
@@ -91,7 +114,7 @@ public:
 
 	uint8_t lastMessageType() const
 	{
-		return static_cast<uint8_t>( m_lastMessage.constData()[0] );
+		return m_lastMessageType;
 	}
 
 	const QRect& lastUpdatedRect() const
@@ -99,6 +122,35 @@ public:
 		return m_lastUpdatedRect;
 	}
 
+	// location of a rect including its header within a framebuffer update message
+	struct RectLocation
+	{
+		uint32_t encoding{0};
+		qint64 offset{0};
+		qint64 size{0};
+	};
+
+	// rects of the last framebuffer update unless it has been forwarded partially
+	const QVector<RectLocation>& lastMessageRects() const
+	{
+		return m_lastMessageRects;
+	}
+
+	// pass-through support: once the headers of a rect have been validated, the remaining
+	// opaque payload (e.g. ZRLE or Tight data) can be forwarded by the caller without parsing
+	qint64 missingPayloadSize() const
+	{
+		return m_framebufferUpdateParserState.missingPayloadSize;
+	}
+
+	bool isForwardingMessage() const
+	{
+		return m_framebufferUpdateParserState.forwarding;
+	}
+
+	QByteArray takeIncompleteMessage();
+	void markPayloadForwarded( qint64 size );
+
 protected:
 	void setState(State state)
 	{
@@ -111,6 +163,8 @@ private:
 	bool readProtocol();
 	bool receiveSecurityTypes();
 	bool receiveSecurityChallenge();
+	bool receiveAuthenticationTypes();
+	bool receiveAuthenticationAck();
 	bool receiveSecurityResult();
 	bool receiveServerInitMessage();
 
@@ -121,7 +175,13 @@ private:
 	bool receiveResizeFramebufferMessage();
 	bool receiveXvpMessage();
 
+	bool peekMessageData( char* data, int size ) const;
 	bool readMessage( int size );
+	void takeReceivedData( int size );
+	void compactReceiveBuffer();
+
+	bool skipPayload( QBuffer& buffer, qint64 size );
+	void finishRect( rfbFramebufferUpdateRectHeader rectHeader );
 
 	bool handleRect( QBuffer& buffer, rfbFramebufferUpdateRectHeader rectHeader );
 	bool handleRectEncodingRRE( QBuffer& buffer, uint bytesPerPixel );
@@ -143,6 +203,7 @@ private:
 	State m_state;
 
 	Password m_vncPassword;
+	Password m_authenticationToken;
 
 	QByteArray m_serverInitMessage;
 
@@ -153,6 +214,40 @@ private:
 	quint16 m_framebufferHeight;
 
 	QByteArray m_lastMessage;
+	uint8_t m_lastMessageType{0};
 	QRect m_lastUpdatedRect;
+	QVector<RectLocation> m_lastMessageRects;
+
+	// data received in running state - everything before m_receiveBufferOffset has been
+	// turned into messages already and is dropped once per batch of received data
+	QByteArray m_receiveBuffer;
+	int m_receiveBufferOffset{0};
+
+	// progress of parsing the (incomplete) framebuffer update at m_receiveBufferOffset
+	// so parsing continues with the first incomplete rect when more data arrives
+	struct FramebufferUpdateParserState
+	{
+		int rectCount{-1};
+		int rectIndex{0};
+		// offsets are relative to the beginning of the message
+		qint64 offset{0};
+		QRegion updatedRegion{};
+		QVector<RectLocation> rects{};
+		// rect whose trailing payload is incomplete
+		rfbFramebufferUpdateRectHeader incompleteRect{};
+		qint64 incompleteRectOffset{0};
+		qint64 incompleteRectEnd{0};
+		// next tile of an incomplete Hextile rect
+		QPoint hextileTile{};
+		qint64 hextileTileOffset{0};
+		// payload bytes missing beyond the end of m_receiveBuffer
+		qint64 missingPayloadSize{0};
+		// payload bytes at m_receiveBufferOffset which complete incompleteRect
+		qint64 pendingPayloadSize{0};
+		// parts of the message have been taken by takeIncompleteMessage() already
+		bool forwarding{false};
+	};
+
+	FramebufferUpdateParserState m_framebufferUpdateParserState;
 
 } ;
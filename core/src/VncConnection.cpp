@@ -25,18 +25,25 @@
  *
  */
 
+#include <limits>
+
 #include <rfb/rfbclient.h>
 
 #include <QBitmap>
 #include <QHostAddress>
 #include <QMutexLocker>
 #include <QPixmap>
+#include <QRandomGenerator>
 #include <QRegularExpression>
 #include <QTime>
+#include <QVarLengthArray>
+#include <QtEndian>
 
+#include "ImageScaler.h"
 #include "PlatformNetworkFunctions.h"
 #include "VeyonConfiguration.h"
 #include "VncConnection.h"
+#include "VncConnectionEngine.h"
 #include "SocketDevice.h"
 #include "VncEvents.h"
 
@@ -60,7 +67,8 @@ void VncConnection::hookUpdateFB( rfbClient* client, int x, int y, int w, int h
 	auto connection = static_cast<VncConnection *>( clientData( client, VncConnectionTag ) );
 	if( connection )
 	{
-		Q_EMIT connection->imageUpdated( x, y, w, h );
+		// imageUpdated() gets emitted once the update has been published
+		connection->m_framebufferDirtyRegion += QRect( x, y, w, h );
 	}
 }
 
@@ -164,7 +172,7 @@ void VncConnection::framebufferCleanup( void* framebuffer )
 
 
 VncConnection::VncConnection( QObject* parent ) :
-	QThread( parent ),
+	QObject( parent ),
 	m_state( State::Disconnected ),
 	m_framebufferState( FramebufferState::Invalid ),
 	m_controlFlags(),
@@ -174,7 +182,6 @@ VncConnection::VncConnection( QObject* parent ) :
 	m_defaultPort( VeyonCore::config().veyonServerPort() ),
 	m_globalMutex(),
 	m_eventQueueMutex(),
-	m_updateIntervalSleeper(),
 	m_framebufferUpdateInterval( 0 )
 {
 	if( VeyonCore::config().useCustomVncConnectionSettings() )
@@ -183,6 +190,7 @@ VncConnection::VncConnection( QObject* parent ) :
 		m_connectTimeout = VeyonCore::config().vncConnectionConnectTimeout();
 		m_readTimeout = VeyonCore::config().vncConnectionReadTimeout();
 		m_connectionRetryInterval = VeyonCore::config().vncConnectionRetryInterval();
+		m_maximumConnectionRetryInterval = VeyonCore::config().vncConnectionMaximumRetryInterval();
 		m_messageWaitTimeout = VeyonCore::config().vncConnectionMessageWaitTimeout();
 		m_fastFramebufferUpdateInterval = VeyonCore::config().vncConnectionFastFramebufferUpdateInterval();
 		m_initialFramebufferUpdateTimeout = VeyonCore::config().vncConnectionInitialFramebufferUpdateTimeout();
@@ -199,16 +207,27 @@ VncConnection::~VncConnection()
 {
 	if( isRunning() )
 	{
-		vWarning() << "Waiting for VNC connection thread to finish.";
-		wait( m_threadTerminationTimeout );
-	}
+		// the worker thread must not touch this object anymore once it's destroyed
+		setControlFlag( ControlFlag::DeleteAfterFinished, false );
+		stop();
 
-	if( isRunning() )
-	{
-		vWarning() << "Terminating hanging VNC connection thread!";
+		QMutexLocker locker( &m_serviceMutex );
+		QDeadlineTimer terminationDeadline( m_threadTerminationTimeout );
+		while( isRunning() && m_serviceFinished.wait( &m_serviceMutex, terminationDeadline ) )
+		{
+		}
+
+		if( isRunning() )
+		{
+			// freeing the object now would leave the worker with a dangling pointer, so keep waiting
+			// e.g. for a blocking connect attempt to time out
+			vWarning() << "VNC connection still being serviced after" << m_threadTerminationTimeout << "ms - waiting";
 
-		terminate();
-		wait();
+			while( isRunning() )
+			{
+				m_serviceFinished.wait( &m_serviceMutex );
+			}
+		}
 	}
 }
 
@@ -238,11 +257,24 @@ QImage VncConnection::image()
 
 
 
+void VncConnection::start()
+{
+	if( m_running.exchange( true ) )
+	{
+		return;
+	}
+
+	VeyonCore::vncConnectionEngine().addConnection( this );
+}
+
+
+
 void VncConnection::restart()
 {
 	if (isRunning())
 	{
 		setControlFlag(ControlFlag::RestartConnection, true);
+		VncConnectionEngine::wakeUp(this);
 	}
 	else
 	{
@@ -257,11 +289,13 @@ void VncConnection::stop()
 {
 	setClientData( VncConnectionTag, nullptr );
 
+	m_scaledFramebufferMutex.lock();
 	m_scaledFramebuffer = {};
+	m_scaledFramebufferMutex.unlock();
 
 	setControlFlag( ControlFlag::TerminateThread, true );
 
-	m_updateIntervalSleeper.wakeAll();
+	VncConnectionEngine::wakeUp( this );
 }
 
 
@@ -368,6 +402,30 @@ void VncConnection::setServerReachable()
 
 
 
+VncConnection::ConnectionRetryState VncConnection::connectionRetryState() const
+{
+	ConnectionRetryState retryState;
+	retryState.failedAttempts = m_failedConnectAttempts;
+	retryState.retryDelay = m_connectionRetryDelay;
+	if( retryState.failedAttempts > 0 )
+	{
+		retryState.nextAttemptIn = qMax<qint64>( 0, m_nextConnectAttemptTime - QDeadlineTimer::current().deadline() );
+	}
+
+	return retryState;
+}
+
+
+
+void VncConnection::resetConnectionRetryDelay()
+{
+	setControlFlag( ControlFlag::ResetConnectionRetryDelay, true );
+
+	VncConnectionEngine::wakeUp( this );
+}
+
+
+
 void VncConnection::setScaledSize( QSize s )
 {
 	QMutexLocker globalLock( &m_globalMutex );
@@ -376,6 +434,9 @@ void VncConnection::setScaledSize( QSize s )
 	{
 		m_scaledSize = s;
 		setControlFlag( ControlFlag::ScaledFramebufferNeedsUpdate, true );
+
+		// let the worker thread rescale the framebuffer without waiting for the next update
+		VncConnectionEngine::wakeUp( this );
 	}
 }
 
@@ -383,7 +444,12 @@ void VncConnection::setScaledSize( QSize s )
 
 QImage VncConnection::scaledFramebuffer()
 {
-	rescaleFramebuffer();
+	if( hasValidFramebuffer() == false )
+	{
+		return {};
+	}
+
+	QMutexLocker locker( &m_scaledFramebufferMutex );
 	return m_scaledFramebuffer;
 }
 
@@ -400,35 +466,30 @@ void VncConnection::setFramebufferUpdateInterval( int interval )
 			setControlFlag(ControlFlag::TriggerFramebufferUpdate, true);
 		}
 
-		m_updateIntervalSleeper.wakeAll();
+		VncConnectionEngine::wakeUp(this);
 	}
 }
 
 
 
-void VncConnection::rescaleFramebuffer()
+void VncConnection::setSkipFramebufferUpdates(bool on)
 {
-	if( hasValidFramebuffer() == false || m_scaledSize.isNull() )
+	if (isControlFlagSet(ControlFlag::SkipFramebufferUpdates) != on)
 	{
-		m_scaledFramebuffer = {};
-		return;
+		setControlFlag(ControlFlag::SkipFramebufferUpdates, on);
+		VncConnectionEngine::wakeUp(this);
 	}
+}
 
-	if( isControlFlagSet( ControlFlag::ScaledFramebufferNeedsUpdate ) == false )
-	{
-		return;
-	}
 
-	QReadLocker locker( &m_imgLock );
 
-	if (m_image.isNull() || m_image.size().isValid() == false)
+void VncConnection::triggerFramebufferUpdate()
+{
+	if (state() == State::Connected)
 	{
-		return;
+		setControlFlag(ControlFlag::TriggerFramebufferUpdate, true);
+		VncConnectionEngine::wakeUp(this);
 	}
-
-	m_scaledFramebuffer = m_image.scaled( m_scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
-
-	setControlFlag( ControlFlag::ScaledFramebufferNeedsUpdate, false );
 }
 
 
@@ -457,24 +518,104 @@ void VncConnection::setClientData( int tag, void* data )
 
 
 
-void VncConnection::run()
+int VncConnection::serviceConnection( bool socketReadable )
 {
-	while( isControlFlagSet( ControlFlag::TerminateThread ) == false )
+	if( m_connectAttemptPending )
 	{
-		QElapsedTimer connectionTimer;
-		connectionTimer.start();
+		// connect attempts still waiting for admission can be dropped right away when stopping
+		if( isControlFlagSet( ControlFlag::TerminateThread ) == false ||
+			VeyonCore::vncConnectionEngine().cancelConnectAttempt( this ) == false )
+		{
+			// connect attempt waiting for admission or in progress - retry admission when the
+			// handshake ramp allows it, otherwise we'll be woken up when the attempt has finished
+			const auto admissionDelay = VeyonCore::vncConnectionEngine().admitConnectAttempts();
+			return admissionDelay >= 0 ? qMin( admissionDelay, m_messageWaitTimeout ) : m_messageWaitTimeout;
+		}
+
+		m_connectAttemptPending = false;
+	}
+
+	if( isControlFlagSet( ControlFlag::TerminateThread ) )
+	{
+		closeConnection();
+		return -1;
+	}
+
+	if( state() == State::Connected && m_establishingConnection == false )
+	{
+		if( isControlFlagSet( ControlFlag::RestartConnection ) == false &&
+			handleConnection( socketReadable ) )
+		{
+			return nextServiceTimeout();
+		}
 
-		establishConnection();
-		handleConnection();
 		closeConnection();
 
 		const auto minimumConnectionTime = m_framebufferUpdateInterval > 0 ?
 											   int(m_framebufferUpdateInterval) :
 											   m_connectionRetryInterval;
-		QThread::msleep(std::max<int>(0, minimumConnectionTime - connectionTimer.elapsed()));
+		m_reconnectDeadline.setRemainingTime( std::max<qint64>( 0, minimumConnectionTime - m_connectionTimer.elapsed() ) );
+	}
+
+	if( isControlFlagSet( ControlFlag::ResetConnectionRetryDelay ) )
+	{
+		setControlFlag( ControlFlag::ResetConnectionRetryDelay, false );
+		if( m_failedConnectAttempts > 0 )
+		{
+			m_failedConnectAttempts = 0;
+			m_connectionRetryDelay = 0;
+			m_reconnectDeadline.setRemainingTime( 0 );
+		}
 	}
 
-	if( isControlFlagSet( ControlFlag::DeleteAfterFinished ) )
+	if( m_reconnectDeadline.hasExpired() == false )
+	{
+		return int(m_reconnectDeadline.remainingTime());
+	}
+
+	if( m_establishingConnection == false )
+	{
+		beginConnectionEstablishment();
+	}
+
+	m_connectAttemptPending = true;
+	const auto admissionDelay = VeyonCore::vncConnectionEngine().runConnectAttempt( this );
+
+	return admissionDelay >= 0 ? qMin( admissionDelay, m_messageWaitTimeout ) : m_messageWaitTimeout;
+}
+
+
+
+PlatformNetworkFunctions::Socket VncConnection::watchedSocket() const
+{
+	if( m_connectAttemptPending == false &&
+		m_establishingConnection == false &&
+		m_client &&
+		state() == State::Connected &&
+		m_readPauseDeadline.hasExpired() )
+	{
+		return static_cast<PlatformNetworkFunctions::Socket>( m_client->sock );
+	}
+
+	return static_cast<PlatformNetworkFunctions::Socket>( -1 );
+}
+
+
+
+void VncConnection::finishService()
+{
+	m_engineWorker = nullptr;
+	m_establishingConnection = false;
+
+	const auto deleteAfterFinished = isControlFlagSet( ControlFlag::DeleteAfterFinished );
+
+	m_serviceMutex.lock();
+	m_running = false;
+	m_serviceFinished.wakeAll();
+	m_serviceMutex.unlock();
+
+	// do not access any members from here on as the destructor may have returned already
+	if( deleteAfterFinished )
 	{
 		deleteLaterInMainThread();
 	}
@@ -482,197 +623,262 @@ void VncConnection::run()
 
 
 
-void VncConnection::establishConnection()
+void VncConnection::beginConnectionEstablishment()
 {
-	QMutex sleeperMutex;
+	m_connectionTimer.restart();
+	m_establishingConnection = true;
 
 	setState( State::Connecting );
 	setControlFlag( ControlFlag::RestartConnection, false );
 
 	m_framebufferState = FramebufferState::Invalid;
+}
+
+
 
-	while( isControlFlagSet( ControlFlag::TerminateThread ) == false &&
-		   state() != State::Connected ) // try to connect as long as the server allows
+void VncConnection::establishConnection( bool hostOffline )
+{
+	// try to connect once - called from within the connect thread pool of VncConnectionEngine
+	if( isControlFlagSet( ControlFlag::TerminateThread ) )
 	{
-		m_globalMutex.lock();
-		m_client = rfbGetClient( RfbBitsPerSample, RfbSamplesPerPixel, RfbBytesPerPixel );
-		m_client->MallocFrameBuffer = hookInitFrameBuffer;
-		m_client->canHandleNewFBSize = true;
-		m_client->GotFrameBufferUpdate = hookUpdateFB;
-		m_client->FinishedFrameBufferUpdate = hookFinishFrameBufferUpdate;
-		m_client->HandleCursorPos = hookHandleCursorPos;
-		m_client->GotCursorShape = hookCursorShape;
-		m_client->GotXCutText = hookCutText;
-		m_client->connectTimeout = m_connectTimeout / 1000;
-		m_client->readTimeout = m_readTimeout / 1000;
-		m_globalMutex.unlock();
+		return;
+	}
 
-		setClientData( VncConnectionTag, this );
+	m_globalMutex.lock();
+	m_client = rfbGetClient( RfbBitsPerSample, RfbSamplesPerPixel, RfbBytesPerPixel );
+	m_client->MallocFrameBuffer = hookInitFrameBuffer;
+	m_client->canHandleNewFBSize = true;
+	m_client->GotFrameBufferUpdate = hookUpdateFB;
+	m_client->FinishedFrameBufferUpdate = hookFinishFrameBufferUpdate;
+	m_client->HandleCursorPos = hookHandleCursorPos;
+	m_client->GotCursorShape = hookCursorShape;
+	m_client->GotXCutText = hookCutText;
+	// hosts known to be offline are probed briefly only so they do not occupy handshake slots for long
+	m_client->connectTimeout = ( hostOffline ? qMin( m_connectTimeout, OfflineHostConnectTimeout ) : m_connectTimeout ) / 1000;
+	m_client->readTimeout = m_readTimeout / 1000;
+	m_globalMutex.unlock();
 
-		Q_EMIT connectionPrepared();
+	setClientData( VncConnectionTag, this );
 
-		m_globalMutex.lock();
+	Q_EMIT connectionPrepared();
 
-		if( m_port < 0 ) // use default port?
-		{
-			m_client->serverPort = m_defaultPort;
-		}
-		else
-		{
-			m_client->serverPort = m_port;
-		}
+	m_globalMutex.lock();
 
-		free( m_client->serverHost );
-		m_client->serverHost = strdup( m_host.toUtf8().constData() );
+	if( m_port < 0 ) // use default port?
+	{
+		m_client->serverPort = m_defaultPort;
+	}
+	else
+	{
+		m_client->serverPort = m_port;
+	}
 
-		m_globalMutex.unlock();
+	free( m_client->serverHost );
+	m_client->serverHost = strdup( m_host.toUtf8().constData() );
 
-		setControlFlag( ControlFlag::ServerReachable, false );
+	m_globalMutex.unlock();
 
-		const auto clientInitialized = rfbInitClient( m_client, nullptr, nullptr );
-		if( clientInitialized == FALSE )
-		{
-			// rfbInitClient() calls rfbClientCleanup() when failed
-			m_client = nullptr;
-		}
+	setControlFlag( ControlFlag::ServerReachable, false );
 
-		// do not continue/sleep when already requested to stop
-		if( isControlFlagSet( ControlFlag::TerminateThread ) )
-		{
-			return;
-		}
+	const auto clientInitialized = rfbInitClient( m_client, nullptr, nullptr );
+	if( clientInitialized == FALSE )
+	{
+		// rfbInitClient() calls rfbClientCleanup() when failed
+		m_client = nullptr;
+	}
 
-		if( clientInitialized )
-		{
-			m_fullFramebufferUpdateTimer.restart();
-			m_incrementalFramebufferUpdateTimer.restart();
+	// do not continue/sleep when already requested to stop
+	if( isControlFlagSet( ControlFlag::TerminateThread ) )
+	{
+		return;
+	}
 
-			VeyonCore::platform().networkFunctions().
-					configureSocketKeepalive( static_cast<PlatformNetworkFunctions::Socket>( m_client->sock ), true,
-											  m_socketKeepaliveIdleTime, m_socketKeepaliveInterval, m_socketKeepaliveCount );
+	if( clientInitialized )
+	{
+		m_fullFramebufferUpdateTimer.restart();
+		m_incrementalFramebufferUpdateTimer.restart();
 
-			setState( State::Connected );
-		}
-		else
+		VeyonCore::platform().networkFunctions().
+				configureSocketKeepalive( static_cast<PlatformNetworkFunctions::Socket>( m_client->sock ), true,
+										  m_socketKeepaliveIdleTime, m_socketKeepaliveInterval, m_socketKeepaliveCount );
+
+		m_establishingConnection = false;
+		m_failedConnectAttempts = 0;
+		m_connectionRetryDelay = 0;
+
+		setState( State::Connected );
+	}
+	else
+	{
+		// guess reason why connection failed
+		if( isControlFlagSet( ControlFlag::ServerReachable ) == false )
 		{
-			// guess reason why connection failed
-			if( isControlFlagSet( ControlFlag::ServerReachable ) == false )
+			if (isControlFlagSet(ControlFlag::SkipHostPing))
 			{
-				if (isControlFlagSet(ControlFlag::SkipHostPing))
+				setState(State::HostOffline);
+			}
+			else if (isHostPingRequired())
+			{
+				const auto pingResult = VeyonCore::vncConnectionEngine().pingHost(m_host, m_port < 0 ? m_defaultPort : m_port);
+				switch (pingResult)
 				{
+				case PlatformNetworkFunctions::PingResult::ReplyReceived:
+					// host is reachable again, so the server is likely to be started soon and
+					// should not be retried with the delay reached for the unreachable host
+					m_failedConnectAttempts = 0;
+					setState(State::ServerNotRunning);
+					break;
+				case PlatformNetworkFunctions::PingResult::NameResolutionFailed:
+					setState(State::HostNameResolutionFailed);
+					break;
+				default:
 					setState(State::HostOffline);
 				}
-				else
-				{
-					const auto pingResult = VeyonCore::platform().networkFunctions().ping(m_host);
-					switch (pingResult)
-					{
-					case PlatformNetworkFunctions::PingResult::ReplyReceived:
-						setState(State::ServerNotRunning);
-						break;
-					case PlatformNetworkFunctions::PingResult::NameResolutionFailed:
-						setState(State::HostNameResolutionFailed);
-						break;
-					default:
-						setState(State::HostOffline);
-					}
-				}
-
-			}
-			else if( m_framebufferState == FramebufferState::Invalid )
-			{
-				setState( State::AuthenticationFailed );
-			}
-			else
-			{
-				// failed for an unknown reason
-				setState( State::ConnectionFailed );
 			}
 
-			// wait a bit until next connect
-			sleeperMutex.lock();
-			if( m_framebufferUpdateInterval > 0 )
-			{
-				m_updateIntervalSleeper.wait( &sleeperMutex, m_framebufferUpdateInterval );
-			}
-			else
-			{
-				// default: retry every second
-				m_updateIntervalSleeper.wait( &sleeperMutex, m_connectionRetryInterval );
-			}
-			sleeperMutex.unlock();
 		}
+		else if( m_framebufferState == FramebufferState::Invalid )
+		{
+			setState( State::AuthenticationFailed );
+		}
+		else
+		{
+			// failed for an unknown reason
+			setState( State::ConnectionFailed );
+		}
+
+		// wait a bit until next connect
+		m_reconnectDeadline.setRemainingTime( nextConnectionRetryDelay() );
+		m_nextConnectAttemptTime = m_reconnectDeadline.deadline();
 	}
 }
 
 
 
-void VncConnection::handleConnection()
+int VncConnection::nextConnectionRetryDelay()
 {
-	QMutex sleeperMutex;
-	QElapsedTimer loopTimer;
+	const auto baseInterval = m_framebufferUpdateInterval > 0 ? int(m_framebufferUpdateInterval) :
+																m_connectionRetryInterval;
+	const auto maximumInterval = qMax( baseInterval, m_maximumConnectionRetryInterval );
 
-	while( state() == State::Connected &&
-		   isControlFlagSet( ControlFlag::TerminateThread ) == false &&
-		   isControlFlagSet( ControlFlag::RestartConnection ) == false )
-	{
-		loopTimer.start();
+	// double the delay with every failed attempt until reaching the upper bound
+	const auto failedAttempts = m_failedConnectAttempts++;
+	const auto delay = int( qMin<qint64>( qint64(baseInterval) << qMin( failedAttempts, MaximumConnectionRetryExponent ),
+										  maximumInterval ) );
+	m_connectionRetryDelay = delay;
 
-		const auto waitTimeout = isControlFlagSet(ControlFlag::SkipFramebufferUpdates) ?
-									 m_messageWaitTimeout / 10
-								   :
-									 (m_framebufferUpdateInterval > 0 ? m_messageWaitTimeout * 100 : m_messageWaitTimeout);
+	// randomize delay by up to ±25% so retries of many hosts do not happen in lockstep
+	const auto jitter = delay / 4;
 
-		const int i = WaitForMessage(m_client, waitTimeout);
+	return delay - jitter + int( QRandomGenerator::global()->bounded( 2 * jitter + 1 ) );
+}
 
-		if( isControlFlagSet( ControlFlag::TerminateThread ) || i < 0 )
-		{
-			break;
-		}
-		else if( i )
-		{
-			// handle all available messages
-			bool handledOkay = true;
-			do {
-				handledOkay &= HandleRFBServerMessage( m_client );
-			} while( handledOkay && WaitForMessage( m_client, 0 ) );
 
-			if( handledOkay == false )
-			{
-				break;
-			}
-		}
-		else if (m_fullFramebufferUpdateTimer.elapsed() >= fullFramebufferUpdateTimeout())
+
+bool VncConnection::isHostPingRequired() const
+{
+	// the result of a previous ping still applies while backing off - only ping after the first failed
+	// attempt and every time the maximum retry delay has been reached
+	return state() == State::Connecting ||
+		   m_connectionRetryDelay >= m_maximumConnectionRetryInterval;
+}
+
+
+
+bool VncConnection::handleConnection( bool socketReadable )
+{
+	// double-check readiness as HandleRFBServerMessage() would block the whole worker when idle
+	const int i = m_client->buffered > 0 ? 1 : ( socketReadable ? WaitForMessage( m_client, 0 ) : 0 );
+	if( i < 0 )
+	{
+		return false;
+	}
+
+	if( i )
+	{
+		// handle available messages until the deadline - remaining ones are handled with the next
+		// iteration of the worker after the other connections have been served
+		const QDeadlineTimer messageHandlingDeadline( MaximumMessageHandlingTime );
+		bool handledOkay = true;
+		do {
+			handledOkay &= HandleRFBServerMessage( m_client );
+		} while( handledOkay && messageHandlingDeadline.hasExpired() == false &&
+				 ( m_client->buffered > 0 || WaitForMessage( m_client, 0 ) > 0 ) );
+
+		if( handledOkay == false )
 		{
-			requestFrameufferUpdate(FramebufferUpdateType::Full);
-			m_fullFramebufferUpdateTimer.restart();
+			return false;
 		}
-		else if (m_framebufferUpdateInterval > 0 &&
-				 m_incrementalFramebufferUpdateTimer.elapsed() > incrementalFramebufferUpdateTimeout())
+
+		// compat with Veyon Server < 4.7
+		if( m_framebufferUpdateInterval > 0 &&
+			isControlFlagSet( ControlFlag::RequiresManualUpdateRateControl ) )
 		{
-			requestFrameufferUpdate(FramebufferUpdateType::Incremental);
-			m_incrementalFramebufferUpdateTimer.restart();
+			// stop reading from the socket so the server can't send more updates than requested
+			m_readPauseDeadline.setRemainingTime( m_framebufferUpdateInterval );
 		}
-		else if (isControlFlagSet(ControlFlag::TriggerFramebufferUpdate))
+	}
+	else if (m_fullFramebufferUpdateTimer.elapsed() >= fullFramebufferUpdateTimeout())
+	{
+		requestFrameufferUpdate(FramebufferUpdateType::Full);
+		m_fullFramebufferUpdateTimer.restart();
+	}
+	else if (m_framebufferUpdateInterval > 0 &&
+			 m_incrementalFramebufferUpdateTimer.elapsed() > incrementalFramebufferUpdateTimeout())
+	{
+		requestFrameufferUpdate(FramebufferUpdateType::Incremental);
+		m_incrementalFramebufferUpdateTimer.restart();
+	}
+	else if (isControlFlagSet(ControlFlag::TriggerFramebufferUpdate))
+	{
+		setControlFlag(ControlFlag::TriggerFramebufferUpdate, false);
+		requestFrameufferUpdate(FramebufferUpdateType::Incremental);
+	}
+
+	if( isControlFlagSet( ControlFlag::ScaledFramebufferNeedsUpdate ) && hasValidFramebuffer() )
+	{
+		if( rescaleFramebuffer() )
 		{
-			setControlFlag(ControlFlag::TriggerFramebufferUpdate, false);
-			requestFrameufferUpdate(FramebufferUpdateType::Incremental);
+			Q_EMIT scaledFramebufferUpdated();
 		}
+	}
 
-		const auto remainingUpdateInterval = m_framebufferUpdateInterval - loopTimer.elapsed();
+	sendEvents();
 
-		// compat with Veyon Server < 4.7
-		if (remainingUpdateInterval > 0 &&
-			isControlFlagSet(ControlFlag::RequiresManualUpdateRateControl) &&
-			isControlFlagSet(ControlFlag::TerminateThread) == false)
-		{
-			sleeperMutex.lock();
-			m_updateIntervalSleeper.wait( &sleeperMutex, remainingUpdateInterval );
-			sleeperMutex.unlock();
-		}
+	return true;
+}
+
+
+
+int VncConnection::nextServiceTimeout() const
+{
+	// data already read from the socket does not make it readable again
+	if( m_client && m_client->buffered > 0 && m_readPauseDeadline.hasExpired() )
+	{
+		return 0;
+	}
 
-		sendEvents();
+	if( isControlFlagSet( ControlFlag::SkipFramebufferUpdates ) )
+	{
+		// no timers to serve - changing the flag wakes us up
+		return m_messageWaitTimeout;
 	}
+
+	qint64 timeout = m_framebufferUpdateInterval > 0 ? m_messageWaitTimeout * 100 : m_messageWaitTimeout;
+
+	timeout = std::min( timeout, fullFramebufferUpdateTimeout() - m_fullFramebufferUpdateTimer.elapsed() );
+
+	if( m_framebufferUpdateInterval > 0 )
+	{
+		timeout = std::min( timeout, incrementalFramebufferUpdateTimeout() + 1 - m_incrementalFramebufferUpdateTimer.elapsed() );
+	}
+
+	if( m_readPauseDeadline.hasExpired() == false )
+	{
+		timeout = std::min( timeout, m_readPauseDeadline.remainingTime() );
+	}
+
+	return int( std::max<qint64>( 0, timeout ) );
 }
 
 
@@ -685,6 +891,9 @@ void VncConnection::closeConnection()
 		m_client = nullptr;
 	}
 
+	// drop input events pushed shortly before the connection was lost
+	m_inputEventRing.clear();
+
 	setState( State::Disconnected );
 }
 
@@ -714,7 +923,7 @@ void VncConnection::setControlFlag( VncConnection::ControlFlag flag, bool on )
 
 
 
-bool VncConnection::isControlFlagSet( VncConnection::ControlFlag flag )
+bool VncConnection::isControlFlagSet( VncConnection::ControlFlag flag ) const
 {
 	return m_controlFlags & static_cast<int>( flag );
 }
@@ -737,11 +946,22 @@ bool VncConnection::initFrameBuffer()
 	memset(m_client->frameBuffer, '\0', pixelCount*RfbBytesPerPixel);
 
 	// initialize framebuffer image which just wraps the allocated memory and ensures cleanup after last
-	// image copy using the framebuffer gets destroyed
-	m_imgLock.lockForWrite();
-	m_image = QImage(m_client->frameBuffer, m_client->width, m_client->height, QImage::Format_RGB32,
-					 framebufferCleanup, m_client->frameBuffer);
-	m_imgLock.unlock();
+	// image copy using the framebuffer gets destroyed - it's only accessed by the thread decoding updates
+	m_decodingFramebuffer = QImage(m_client->frameBuffer, m_client->width, m_client->height, QImage::Format_RGB32,
+								   framebufferCleanup, m_client->frameBuffer);
+
+	// set up presentation buffers which get published alternately after each update
+	for (auto& presentationFramebuffer : m_presentationFramebuffers)
+	{
+		presentationFramebuffer = QImage(m_client->width, m_client->height, QImage::Format_RGB32);
+		presentationFramebuffer.fill(0);
+	}
+
+	m_currentPresentationFramebuffer = 0;
+	m_framebufferDirtyRegion = {};
+	m_previousFramebufferDirtyRegion = {};
+
+	publishFramebuffer(m_presentationFramebuffers[m_currentPresentationFramebuffer]);
 
 	// set up pixel format according to QImage
 	m_client->format.redShift = 16;
@@ -758,6 +978,9 @@ bool VncConnection::initFrameBuffer()
 
 	m_framebufferState = FramebufferState::Initialized;
 
+	m_scaledFramebufferDirtyRegion = {};
+	setControlFlag( ControlFlag::ScaledFramebufferNeedsUpdate, true );
+
 	Q_EMIT framebufferSizeChanged(m_client->width, m_client->height);
 
 	return true;
@@ -789,13 +1012,177 @@ void VncConnection::finishFrameBufferUpdate()
 	m_fullFramebufferUpdateTimer.restart();
 
 	m_framebufferState = FramebufferState::Valid;
-	setControlFlag( ControlFlag::ScaledFramebufferNeedsUpdate, true );
+
+	updatePresentationFramebuffer();
+
+	for (const auto& rect : std::as_const(m_framebufferDirtyRegion))
+	{
+		Q_EMIT imageUpdated(rect.x(), rect.y(), rect.width(), rect.height());
+	}
+
+	m_scaledFramebufferDirtyRegion += m_framebufferDirtyRegion;
+
+	m_previousFramebufferDirtyRegion = m_framebufferDirtyRegion;
+	m_framebufferDirtyRegion = {};
+
+	rescaleFramebuffer();
 
 	Q_EMIT framebufferUpdateComplete();
 }
 
 
 
+void VncConnection::updatePresentationFramebuffer()
+{
+	// the next presentation buffer reflects the state from two updates ago, so bring it up to date with
+	// the areas modified by the previous and the current update
+	const auto next = (m_currentPresentationFramebuffer + 1) % PresentationFramebufferCount;
+	auto& framebuffer = m_presentationFramebuffers[next];
+
+	if (framebuffer.isDetached() == false || framebuffer.size() != m_decodingFramebuffer.size())
+	{
+		// still in use by some reader (or invalid) so leave it alone and use a fresh copy instead
+		framebuffer = m_decodingFramebuffer.copy();
+	}
+	else
+	{
+		const auto outdatedRegion = m_previousFramebufferDirtyRegion.united(m_framebufferDirtyRegion)
+									.intersected(m_decodingFramebuffer.rect());
+		for (const auto& rect : outdatedRegion)
+		{
+			const auto bytesPerLine = size_t(rect.width()) * RfbBytesPerPixel;
+			for (int y = rect.top(); y <= rect.bottom(); ++y)
+			{
+				memcpy(framebuffer.scanLine(y) + rect.left() * RfbBytesPerPixel,
+					   m_decodingFramebuffer.constScanLine(y) + rect.left() * RfbBytesPerPixel, bytesPerLine);
+			}
+		}
+	}
+
+	m_currentPresentationFramebuffer = next;
+
+	publishFramebuffer(framebuffer);
+}
+
+
+
+void VncConnection::publishFramebuffer(const QImage& framebuffer)
+{
+	m_imgLock.lockForWrite();
+	m_image = framebuffer;
+	m_imgLock.unlock();
+
+	++m_framebufferGeneration;
+}
+
+
+
+bool VncConnection::rescaleFramebuffer()
+{
+	m_globalMutex.lock();
+	const auto scaledSize = m_scaledSize;
+	m_globalMutex.unlock();
+
+	if( hasValidFramebuffer() == false || scaledSize.isEmpty() ||
+		m_image.isNull() || m_image.size().isValid() == false )
+	{
+		// nothing to rescale until a scaled size is set or a valid framebuffer has been received
+		setControlFlag( ControlFlag::ScaledFramebufferNeedsUpdate, false );
+
+		m_scaledFramebufferBuffer = {};
+		m_scaledFramebufferDirtyRegion = {};
+		m_previousScaledFramebufferDirtyRegion = {};
+
+		QMutexLocker locker( &m_scaledFramebufferMutex );
+		// only report the removal of a scaled framebuffer published before
+		const auto removed = m_scaledFramebuffer.isNull() == false;
+		m_scaledFramebuffer = {};
+		return removed;
+	}
+
+	m_scaledFramebufferMutex.lock();
+	auto publishedFramebuffer = m_scaledFramebuffer;
+	m_scaledFramebufferMutex.unlock();
+
+	const auto rescaleAll = isControlFlagSet( ControlFlag::ScaledFramebufferNeedsUpdate ) ||
+							publishedFramebuffer.size() != scaledSize;
+
+	if( rescaleAll == false && m_scaledFramebufferDirtyRegion.isEmpty() )
+	{
+		return false;
+	}
+
+	const auto coversMostOfFramebuffer = [this]( const QRegion& region ) {
+		const auto rect = region.boundingRect();
+		return rect.width() * rect.height() * 2 >= m_image.width() * m_image.height();
+	};
+
+	// the buffer holds the scaled framebuffer published before the current one, so it lacks the areas
+	// updated for the current one besides the new updates
+	auto outdatedRegion = m_scaledFramebufferDirtyRegion.united( m_previousScaledFramebufferDirtyRegion );
+
+	if( rescaleAll == false &&
+		( m_scaledFramebufferBuffer.isDetached() == false ||
+		  m_scaledFramebufferBuffer.size() != scaledSize ||
+		  coversMostOfFramebuffer( m_previousScaledFramebufferDirtyRegion ) ) )
+	{
+		// still in use by some reader (or lacking too much) so start from a copy of the current one instead
+		m_scaledFramebufferBuffer = publishedFramebuffer.copy();
+		outdatedRegion = m_scaledFramebufferDirtyRegion;
+	}
+
+	publishedFramebuffer = {};
+
+	// rescale everything if the scaled size changed or most of the framebuffer has been updated anyway
+	if( rescaleAll || coversMostOfFramebuffer( outdatedRegion ) )
+	{
+		setControlFlag( ControlFlag::ScaledFramebufferNeedsUpdate, false );
+
+		m_scaledFramebufferBuffer = ImageScaler::scaled( m_image, scaledSize );
+	}
+	else
+	{
+		for( const auto& rect : outdatedRegion )
+		{
+			if( rescaleFramebufferRect( rect ) == false )
+			{
+				// not downscaling - process everything at once
+				m_scaledFramebufferBuffer = ImageScaler::scaled( m_image, scaledSize );
+				break;
+			}
+		}
+	}
+
+	// the previously published framebuffer becomes the buffer for the next update
+	m_previousScaledFramebufferDirtyRegion = rescaleAll ? QRegion( m_image.rect() ) : m_scaledFramebufferDirtyRegion;
+	m_scaledFramebufferDirtyRegion = {};
+
+	QMutexLocker locker( &m_scaledFramebufferMutex );
+	m_scaledFramebuffer.swap( m_scaledFramebufferBuffer );
+
+	return true;
+}
+
+
+
+bool VncConnection::rescaleFramebufferRect( const QRect& rect )
+{
+	const auto sourceWidth = m_image.width();
+	const auto sourceHeight = m_image.height();
+	const auto scaledWidth = m_scaledFramebufferBuffer.width();
+	const auto scaledHeight = m_scaledFramebufferBuffer.height();
+
+	// map dirty rectangle to scaled framebuffer (rounding outwards)
+	const auto x0 = int( qint64(rect.left()) * scaledWidth / sourceWidth );
+	const auto y0 = int( qint64(rect.top()) * scaledHeight / sourceHeight );
+	const auto x1 = int( ( qint64(rect.right() + 1) * scaledWidth + sourceWidth - 1 ) / sourceWidth );
+	const auto y1 = int( ( qint64(rect.bottom() + 1) * scaledHeight + sourceHeight - 1 ) / sourceHeight );
+
+	return ImageScaler::downscale( m_image, m_scaledFramebufferBuffer, QRect( x0, y0, x1 - x0, y1 - y0 ) );
+}
+
+
+
 int VncConnection::fullFramebufferUpdateTimeout() const
 {
 	return m_framebufferState == FramebufferState::Valid ?
@@ -841,29 +1228,206 @@ void VncConnection::updateEncodingSettingsFromQuality()
 
 
 
+void VncConnection::pushInputEvent( VncInputEventRing::Event event )
+{
+	// like other events, input events must not be replayed once (re)connected, possibly a lot later
+	if( state() != State::Connected )
+	{
+		return;
+	}
+
+	event.timestamp = VncInputEventRing::timestamp();
+	event.sequence = m_eventSequence.fetch_add( 1 );
+
+	if( m_inputEventRing.push( event ) == false )
+	{
+		// the ring only runs full if the connection thread is blocked for a longer time so queue the
+		// event together with the other events instead of waiting for it - the sequence number keeps
+		// it in order
+		VncEvent* overflowEvent = nullptr;
+		if( event.type == VncInputEventRing::Event::Type::Pointer )
+		{
+			overflowEvent = new VncPointerEvent( event.x, event.y, event.buttonMask );
+		}
+		else
+		{
+			overflowEvent = new VncKeyEvent( event.key, event.pressed );
+		}
+
+		m_eventQueueMutex.lock();
+		m_eventQueue.enqueue( { event.sequence, overflowEvent } );
+		m_eventQueueMutex.unlock();
+	}
+
+	VncConnectionEngine::wakeUp(this);
+}
+
+
+
+bool VncConnection::sendInputEvents( quint64 nextEventSequence )
+{
+	using Event = VncInputEventRing::Event;
+
+	QVarLengthArray<char, VncInputEventRing::Capacity * sizeof(rfbPointerEventMsg)> messages;
+	QVarLengthArray<qint64, VncInputEventRing::Capacity> timestamps;
+	quint64 coalescedEvents = 0;
+
+	Event pendingPointerEvent;
+	bool pointerEventPending = false;
+
+	const auto appendPointerEvent = [&]() {
+		rfbPointerEventMsg message{};
+		message.type = rfbPointerEvent;
+		message.buttonMask = uint8_t(pendingPointerEvent.buttonMask);
+		message.x = qToBigEndian<uint16_t>( uint16_t(qMax(0, pendingPointerEvent.x)) );
+		message.y = qToBigEndian<uint16_t>( uint16_t(qMax(0, pendingPointerEvent.y)) );
+		messages.append( reinterpret_cast<const char *>( &message ), sz_rfbPointerEventMsg );
+		timestamps.append( pendingPointerEvent.timestamp );
+		pointerEventPending = false;
+	};
+
+	// only send events queued before the next event of the event queue
+	Event event;
+	int eventCount = 0;
+	for( ; eventCount < VncInputEventRing::Capacity &&
+		   m_inputEventRing.peek( event ) && event.sequence < nextEventSequence; ++eventCount )
+	{
+		m_inputEventRing.pop( event );
+
+		if( event.type == Event::Type::Pointer )
+		{
+			// pure motion events only matter for their final position, so merge consecutive events
+			// with unchanged button state while keeping the timestamp of the oldest one
+			if( pointerEventPending && pendingPointerEvent.buttonMask == event.buttonMask )
+			{
+				event.timestamp = pendingPointerEvent.timestamp;
+				++coalescedEvents;
+			}
+			else if( pointerEventPending )
+			{
+				appendPointerEvent();
+			}
+			pendingPointerEvent = event;
+			pointerEventPending = true;
+			continue;
+		}
+
+		if( pointerEventPending )
+		{
+			appendPointerEvent();
+		}
+
+		rfbKeyEventMsg message{};
+		message.type = rfbKeyEvent;
+		message.down = event.pressed ? 1 : 0;
+		message.key = qToBigEndian<uint32_t>( event.key );
+		messages.append( reinterpret_cast<const char *>( &message ), sz_rfbKeyEventMsg );
+		timestamps.append( event.timestamp );
+	}
+
+	if( pointerEventPending )
+	{
+		appendPointerEvent();
+	}
+
+	const auto moreEventsPending = eventCount >= VncInputEventRing::Capacity;
+
+	if( messages.isEmpty() ||
+		isControlFlagSet( ControlFlag::TerminateThread ) ||
+		m_client == nullptr )
+	{
+		return moreEventsPending;
+	}
+
+	// send all events with a single write
+	if( WriteToRFBServer( m_client, messages.data(), uint(messages.size()) ) == false )
+	{
+		return moreEventsPending;
+	}
+
+	const auto now = VncInputEventRing::timestamp();
+	qint64 latencySum = 0;
+	qint64 maximumLatency = 0;
+	for( const auto timestamp : timestamps )
+	{
+		const auto latency = now - timestamp;
+		latencySum += latency;
+		maximumLatency = qMax( maximumLatency, latency );
+	}
+
+	m_sentInputEvents += quint64(timestamps.size());
+	m_coalescedInputEvents += coalescedEvents;
+	m_inputLatencySum += latencySum;
+
+	auto currentMaximum = m_maximumInputLatency.load();
+	while( maximumLatency > currentMaximum &&
+		   m_maximumInputLatency.compare_exchange_weak( currentMaximum, maximumLatency ) == false )
+	{
+	}
+
+	return moreEventsPending;
+}
+
+
+
+VncConnection::InputEventStatistics VncConnection::inputEventStatistics() const
+{
+	InputEventStatistics statistics;
+	statistics.sentEvents = m_sentInputEvents;
+	statistics.coalescedEvents = m_coalescedInputEvents;
+	if( statistics.sentEvents > 0 )
+	{
+		statistics.averageLatency = m_inputLatencySum / qint64(statistics.sentEvents) / 1000;
+	}
+	statistics.maximumLatency = m_maximumInputLatency / 1000;
+
+	return statistics;
+}
+
+
+
+void VncConnection::resetInputEventStatistics()
+{
+	m_sentInputEvents = 0;
+	m_coalescedInputEvents = 0;
+	m_inputLatencySum = 0;
+	m_maximumInputLatency = 0;
+}
+
+
+
 void VncConnection::sendEvents()
 {
 	m_eventQueueMutex.lock();
 
 	while( m_eventQueue.isEmpty() == false )
 	{
-		auto event = m_eventQueue.dequeue();
+		const auto queuedEvent = m_eventQueue.dequeue();
 
 		// unlock the queue mutex during the runtime of ClientEvent::fire()
 		m_eventQueueMutex.unlock();
 
+		// input events queued earlier have to be sent first
+		while( sendInputEvents( queuedEvent.sequence ) )
+		{
+		}
+
 		if( isControlFlagSet( ControlFlag::TerminateThread ) == false )
 		{
-			event->fire( m_client );
+			queuedEvent.event->fire( m_client );
 		}
 
-		delete event;
+		delete queuedEvent.event;
 
 		// and lock it again
 		m_eventQueueMutex.lock();
 	}
 
 	m_eventQueueMutex.unlock();
+
+	while( sendInputEvents( std::numeric_limits<quint64>::max() ) )
+	{
+	}
 }
 
 
@@ -883,10 +1447,10 @@ void VncConnection::enqueueEvent(VncEvent* event)
 	}
 
 	m_eventQueueMutex.lock();
-	m_eventQueue.enqueue( event );
+	m_eventQueue.enqueue( { m_eventSequence.fetch_add( 1 ), event } );
 	m_eventQueueMutex.unlock();
 
-	m_updateIntervalSleeper.wakeAll();
+	VncConnectionEngine::wakeUp(this);
 }
 
 
@@ -894,21 +1458,32 @@ void VncConnection::enqueueEvent(VncEvent* event)
 bool VncConnection::isEventQueueEmpty()
 {
 	QMutexLocker lock( &m_eventQueueMutex );
-	return m_eventQueue.isEmpty();
+	return m_eventQueue.isEmpty() && m_inputEventRing.isEmpty();
 }
 
 
 
 void VncConnection::mouseEvent( int x, int y, int buttonMask )
 {
-	enqueueEvent(new VncPointerEvent(x, y, buttonMask));
+	VncInputEventRing::Event event;
+	event.type = VncInputEventRing::Event::Type::Pointer;
+	event.x = x;
+	event.y = y;
+	event.buttonMask = buttonMask;
+
+	pushInputEvent( event );
 }
 
 
 
 void VncConnection::keyEvent( unsigned int key, bool pressed )
 {
-	enqueueEvent(new VncKeyEvent(key, pressed));
+	VncInputEventRing::Event event;
+	event.type = VncInputEventRing::Event::Type::Key;
+	event.key = key;
+	event.pressed = pressed;
+
+	pushInputEvent( event );
 }
 
 
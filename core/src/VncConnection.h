@@ -27,24 +27,31 @@
 
 #pragma once
 
+#include <array>
+
+#include <QDeadlineTimer>
 #include <QElapsedTimer>
 #include <QImage>
 #include <QMutex>
 #include <QQueue>
 #include <QReadWriteLock>
+#include <QRegion>
 #include <QThread>
 #include <QTimer>
 #include <QWaitCondition>
 
+#include "PlatformNetworkFunctions.h"
 #include "SocketDevice.h"
 #include "VeyonCore.h"
 #include "VncConnectionConfiguration.h"
+#include "VncInputEventRing.h"
 
 using rfbClient = struct _rfbClient;
 
+class VncConnectionEngineWorker;
 class VncEvent;
 
-class VEYON_CORE_EXPORT VncConnection : public QThread
+class VEYON_CORE_EXPORT VncConnection : public QObject
 {
 	Q_OBJECT
 public:
@@ -82,6 +89,13 @@ public:
 
 	QImage image();
 
+	/** \brief Returns a number which gets incremented whenever a new framebuffer image has been published */
+	quint64 framebufferGeneration() const
+	{
+		return m_framebufferGeneration;
+	}
+
+	void start();
 	void restart();
 	void stop();
 	void stopAndDeleteLater();
@@ -94,6 +108,11 @@ public:
 		return m_state;
 	}
 
+	bool isRunning() const
+	{
+		return m_running;
+	}
+
 	bool isConnected() const
 	{
 		return state() == State::Connected && isRunning();
@@ -110,6 +129,18 @@ public:
 
 	void setServerReachable();
 
+	struct ConnectionRetryState
+	{
+		int failedAttempts{0};
+		int retryDelay{0}; // ms
+		qint64 nextAttemptIn{0}; // ms
+	};
+
+	ConnectionRetryState connectionRetryState() const;
+
+	// retry connecting right away, e.g. when the host is known to be coming up
+	void resetConnectionRetryDelay();
+
 	void enqueueEvent(VncEvent* event);
 	bool isEventQueueEmpty();
 
@@ -125,10 +156,9 @@ public:
 
 	void setFramebufferUpdateInterval( int interval );
 
-	void setSkipFramebufferUpdates(bool on)
-	{
-		setControlFlag(ControlFlag::SkipFramebufferUpdates, on);
-	}
+	void setSkipFramebufferUpdates(bool on);
+
+	void triggerFramebufferUpdate();
 
 	void setSkipHostPing( bool on )
 	{
@@ -140,8 +170,6 @@ public:
 		setControlFlag(ControlFlag::RequiresManualUpdateRateControl, on);
 	}
 
-	void rescaleFramebuffer();
-
 	static constexpr int VncConnectionTag = 0x590123;
 
 	static void* clientData( rfbClient* client, int tag );
@@ -154,26 +182,44 @@ public:
 	void keyEvent( unsigned int key, bool pressed );
 	void clientCut( const QString& text );
 
+	struct InputEventStatistics
+	{
+		quint64 sentEvents{0};
+		quint64 coalescedEvents{0};
+		// time from queueing an event until it has been written to the socket
+		qint64 averageLatency{0}; // µs
+		qint64 maximumLatency{0}; // µs
+	};
+
+	InputEventStatistics inputEventStatistics() const;
+	void resetInputEventStatistics();
+
 Q_SIGNALS:
 	void connectionPrepared();
 	void imageUpdated( int x, int y, int w, int h );
 	void framebufferUpdateComplete();
+	void scaledFramebufferUpdated();
 	void framebufferSizeChanged( int w, int h );
 	void cursorPosChanged( int x, int y );
 	void cursorShapeUpdated( const QPixmap& cursorShape, int xh, int yh );
 	void gotCut( const QString& text );
 	void stateChanged();
 
-protected:
-	void run() override;
-
 private:
+	friend class VncConnectionEngine;
+	friend class VncConnectionEngineWorker;
+
 	// RFB parameters
 	using RfbPixel = uint32_t;
 	static constexpr int RfbBitsPerSample = 8;
 	static constexpr int RfbSamplesPerPixel = 3;
 	static constexpr int RfbBytesPerPixel = sizeof(RfbPixel);
 
+	static constexpr int MaximumConnectionRetryExponent = 16;
+	static constexpr int OfflineHostConnectTimeout = 2000;
+	// messages of one connection must not keep the worker from serving its other connections
+	static constexpr int MaximumMessageHandlingTime = 20;
+
 	enum class ControlFlag {
 		ScaledFramebufferNeedsUpdate = 0x01,
 		ServerReachable = 0x02,
@@ -183,29 +229,48 @@ private:
 		SkipHostPing = 0x20,
 		RequiresManualUpdateRateControl = 0x40,
 		TriggerFramebufferUpdate = 0x80,
-		SkipFramebufferUpdates = 0x100
+		SkipFramebufferUpdates = 0x100,
+		ResetConnectionRetryDelay = 0x200
 	};
 
 	~VncConnection() override;
 
-	void establishConnection();
-	void handleConnection();
+	// interface for VncConnectionEngine
+	int serviceConnection( bool socketReadable );
+	PlatformNetworkFunctions::Socket watchedSocket() const;
+	void finishService();
+
+	void beginConnectionEstablishment();
+	void establishConnection( bool hostOffline );
+	bool handleConnection( bool socketReadable );
 	void closeConnection();
 
+	int nextServiceTimeout() const;
+
+	int nextConnectionRetryDelay();
+	bool isHostPingRequired() const;
+
 	void setState( State state );
 
 	void setControlFlag( ControlFlag flag, bool on );
-	bool isControlFlagSet( ControlFlag flag );
+	bool isControlFlagSet( ControlFlag flag ) const;
 
 	bool initFrameBuffer();
 	void requestFrameufferUpdate(FramebufferUpdateType updateType);
 	void finishFrameBufferUpdate();
+	void updatePresentationFramebuffer();
+	void publishFramebuffer(const QImage& framebuffer);
+
+	bool rescaleFramebuffer();
+	bool rescaleFramebufferRect( const QRect& rect );
 
 	int fullFramebufferUpdateTimeout() const;
 	int incrementalFramebufferUpdateTimeout() const;
 
 	void updateEncodingSettingsFromQuality();
 
+	void pushInputEvent( VncInputEventRing::Event event );
+	bool sendInputEvents( quint64 nextEventSequence );
 	void sendEvents();
 
 	void deleteLaterInMainThread();
@@ -226,6 +291,7 @@ private:
 	int m_connectTimeout{VncConnectionConfiguration::DefaultConnectTimeout};
 	int m_readTimeout{VncConnectionConfiguration::DefaultReadTimeout};
 	int m_connectionRetryInterval{VncConnectionConfiguration::DefaultConnectionRetryInterval};
+	int m_maximumConnectionRetryInterval{VncConnectionConfiguration::DefaultMaximumConnectionRetryInterval};
 	int m_messageWaitTimeout{VncConnectionConfiguration::DefaultMessageWaitTimeout};
 	int m_fastFramebufferUpdateInterval{VncConnectionConfiguration::DefaultFastFramebufferUpdateInterval};
 	int m_initialFramebufferUpdateTimeout{VncConnectionConfiguration::DefaultInitialFramebufferUpdateTimeout};
@@ -247,21 +313,62 @@ private:
 	int m_defaultPort{-1};
 	bool m_useRemoteCursor{false};
 
-	// thread and timing control
+	// engine and timing control
+	std::atomic<bool> m_running{false};
+	QMutex m_serviceMutex;
+	QWaitCondition m_serviceFinished;
+	std::atomic<bool> m_connectAttemptPending{false};
+	std::atomic<VncConnectionEngineWorker *> m_engineWorker{nullptr};
+	bool m_establishingConnection{false};
 	QMutex m_globalMutex;
 	QMutex m_eventQueueMutex;
-	QWaitCondition m_updateIntervalSleeper;
 	QAtomicInt m_framebufferUpdateInterval;
+	QElapsedTimer m_connectionTimer{};
 	QElapsedTimer m_fullFramebufferUpdateTimer{};
 	QElapsedTimer m_incrementalFramebufferUpdateTimer{};
-
-	// queue for RFB and custom events
-	QQueue<VncEvent *> m_eventQueue;
-
-	// framebuffer data and thread synchronization objects
+	QDeadlineTimer m_reconnectDeadline{};
+	std::atomic<int> m_failedConnectAttempts{0};
+	std::atomic<int> m_connectionRetryDelay{0};
+	std::atomic<qint64> m_nextConnectAttemptTime{0};
+	QDeadlineTimer m_readPauseDeadline{};
+
+	// queue for RFB and custom events which are sent interleaved with input events in the order
+	// both were queued in
+	struct QueuedEvent
+	{
+		quint64 sequence;
+		VncEvent* event;
+	};
+	QQueue<QueuedEvent> m_eventQueue;
+	std::atomic<quint64> m_eventSequence{0};
+
+	// key and pointer events plus statistics about sending them
+	VncInputEventRing m_inputEventRing;
+	std::atomic<quint64> m_sentInputEvents{0};
+	std::atomic<quint64> m_coalescedInputEvents{0};
+	std::atomic<qint64> m_inputLatencySum{0};
+	std::atomic<qint64> m_maximumInputLatency{0};
+
+	// framebuffer data and thread synchronization objects - libvncclient decodes into
+	// m_decodingFramebuffer and complete updates get copied to one of the presentation
+	// framebuffers which then is published as m_image so readers never see partial updates
+	static constexpr int PresentationFramebufferCount = 2;
+	QImage m_decodingFramebuffer{};
+	std::array<QImage, PresentationFramebufferCount> m_presentationFramebuffers{};
+	int m_currentPresentationFramebuffer{0};
+	QRegion m_framebufferDirtyRegion{};
+	QRegion m_previousFramebufferDirtyRegion{};
 	QImage m_image{};
-	QImage m_scaledFramebuffer{};
+	std::atomic<quint64> m_framebufferGeneration{0};
 	QSize m_scaledSize{};
 	QReadWriteLock m_imgLock{};
 
+	// scaled framebuffer - updated incrementally in the connection's worker thread and published
+	// to other threads by swapping it with m_scaledFramebuffer (implicitly shared)
+	QImage m_scaledFramebufferBuffer{};
+	QRegion m_scaledFramebufferDirtyRegion{};
+	QRegion m_previousScaledFramebufferDirtyRegion{};
+	QImage m_scaledFramebuffer{};
+	QMutex m_scaledFramebufferMutex;
+
 } ;
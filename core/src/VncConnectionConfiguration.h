@@ -45,6 +45,7 @@ public:
 	static constexpr int DefaultConnectTimeout = 10000;
 	static constexpr int DefaultReadTimeout = 30000;
 	static constexpr int DefaultConnectionRetryInterval = 1000;
+	static constexpr int DefaultMaximumConnectionRetryInterval = 60000;
 	static constexpr int DefaultMessageWaitTimeout = 500;
 	static constexpr int DefaultFastFramebufferUpdateInterval = 100;
 	static constexpr int DefaultInitialFramebufferUpdateTimeout = 10000;
@@ -53,4 +54,8 @@ public:
 	static constexpr int DefaultSocketKeepaliveInterval = 500;
 	static constexpr int DefaultSocketKeepaliveCount = 5;
 
+	// admission of connect attempts
+	static constexpr int DefaultMaximumConcurrentHandshakes = 32;
+	static constexpr int DefaultHandshakeRampInterval = 10;
+
 } ;
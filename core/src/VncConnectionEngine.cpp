@@ -0,0 +1,699 @@
+/*
+ * VncConnectionEngine.cpp - implementation of VncConnectionEngine class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <QtGlobal>
+
+#if defined(Q_OS_LINUX)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <winsock2.h>
+using socklen_t = int;
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+
+#include "PlatformNetworkFunctions.h"
+#include "VeyonConfiguration.h"
+#include "VncConnection.h"
+#include "VncConnectionEngine.h"
+
+
+class VncConnectionEngineWorker : public QThread
+{
+public:
+	explicit VncConnectionEngineWorker( int index ) :
+		QThread()
+	{
+		setObjectName( QStringLiteral("VncConnectionEngineWorker-%1").arg( index ) );
+
+		initWakeUpChannel();
+	}
+
+	~VncConnectionEngineWorker() override
+	{
+		m_stopRequested = true;
+		wakeUp();
+		wait();
+
+		releaseWakeUpChannel();
+	}
+
+	int connectionCount() const
+	{
+		return m_connectionCount;
+	}
+
+	void addConnection( VncConnection* connection )
+	{
+		++m_connectionCount;
+
+		m_pendingConnectionsMutex.lock();
+		m_pendingConnections.append( connection );
+		m_pendingConnectionsMutex.unlock();
+
+		wakeUp();
+	}
+
+	void wakeUp()
+	{
+		// only signal once until the worker has consumed the previous wake-up
+		if( m_wakeUpPending.exchange( true ) )
+		{
+			return;
+		}
+
+#if defined(Q_OS_LINUX)
+		const uint64_t value = 1;
+		if( write( m_wakeUpFd, &value, sizeof(value) ) != sizeof(value) )
+		{
+			vWarning() << "failed to signal worker thread";
+		}
+#else
+		const char value = 1;
+		send( m_wakeUpSocket, &value, sizeof(value), 0 );
+#endif
+	}
+
+protected:
+	void run() override
+	{
+		QSet<VncConnection *> readyConnections;
+		readyConnections.reserve( MaxEvents );
+
+		while( m_stopRequested == false )
+		{
+			takePendingConnections();
+
+			auto timeout = IdleTimeout;
+
+			for( auto it = m_connections.begin(); it != m_connections.end(); )
+			{
+				const auto connection = it.key();
+				const auto nextServiceTimeout = connection->serviceConnection( readyConnections.contains( connection ) );
+				if( nextServiceTimeout < 0 )
+				{
+					unwatchSocket( connection, it.value() );
+					it = m_connections.erase( it );
+					--m_connectionCount;
+					connection->finishService();
+					continue;
+				}
+
+				updateWatchedSocket( connection, it.value() );
+
+				timeout = qMin( timeout, nextServiceTimeout );
+				++it;
+			}
+
+			readyConnections.clear();
+
+			waitForEvents( timeout, readyConnections );
+		}
+
+		for( auto it = m_connections.constBegin(), end = m_connections.constEnd(); it != end; ++it )
+		{
+			unwatchSocket( it.key(), it.value() );
+			it.key()->closeConnection();
+			it.key()->finishService();
+		}
+
+		m_connections.clear();
+	}
+
+private:
+	using Socket = PlatformNetworkFunctions::Socket;
+
+	static constexpr int MaxEvents = 64;
+	static constexpr int IdleTimeout = 1000;
+	static constexpr auto InvalidSocket = Socket(-1);
+
+	void takePendingConnections()
+	{
+		QMutexLocker locker( &m_pendingConnectionsMutex );
+
+		for( auto connection : std::as_const(m_pendingConnections) )
+		{
+			m_connections[connection] = InvalidSocket;
+		}
+
+		m_pendingConnections.clear();
+	}
+
+	void updateWatchedSocket( VncConnection* connection, Socket& watchedSocket )
+	{
+		const auto socket = connection->watchedSocket();
+		if( socket == watchedSocket )
+		{
+			return;
+		}
+
+		unwatchSocket( connection, watchedSocket );
+
+		if( socket != InvalidSocket )
+		{
+#if defined(Q_OS_LINUX)
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.ptr = connection;
+			if( epoll_ctl( m_epollFd, EPOLL_CTL_ADD, int(socket), &event ) != 0 )
+			{
+				vWarning() << "failed to watch socket" << socket;
+				return;
+			}
+#endif
+			watchedSocket = socket;
+		}
+	}
+
+	void unwatchSocket( VncConnection* connection, Socket& watchedSocket )
+	{
+		Q_UNUSED(connection)
+
+		if( watchedSocket != InvalidSocket )
+		{
+#if defined(Q_OS_LINUX)
+			// socket may already have been closed and thus removed from the epoll set implicitly
+			epoll_ctl( m_epollFd, EPOLL_CTL_DEL, int(watchedSocket), nullptr );
+#endif
+			watchedSocket = InvalidSocket;
+		}
+	}
+
+#if defined(Q_OS_LINUX)
+	void initWakeUpChannel()
+	{
+		m_epollFd = epoll_create1( EPOLL_CLOEXEC );
+		m_wakeUpFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.ptr = nullptr;
+		epoll_ctl( m_epollFd, EPOLL_CTL_ADD, m_wakeUpFd, &event );
+	}
+
+	void releaseWakeUpChannel()
+	{
+		close( m_wakeUpFd );
+		close( m_epollFd );
+	}
+
+	void waitForEvents( int timeout, QSet<VncConnection *>& readyConnections )
+	{
+		epoll_event events[MaxEvents];
+
+		const auto eventCount = epoll_wait( m_epollFd, events, MaxEvents, timeout );
+
+		for( int i = 0; i < eventCount; ++i )
+		{
+			if( events[i].data.ptr == nullptr )
+			{
+				m_wakeUpPending = false;
+				uint64_t value = 0;
+				if( read( m_wakeUpFd, &value, sizeof(value) ) < 0 ) // Flawfinder: ignore
+				{
+					// nothing to do - counter has been reset by a concurrent read already
+				}
+			}
+			else
+			{
+				readyConnections.insert( static_cast<VncConnection *>( events[i].data.ptr ) );
+			}
+		}
+	}
+#else
+	void initWakeUpChannel()
+	{
+		// emulate a self-pipe through a UDP socket connected to itself on the loopback interface,
+		// which works the same with Winsock and BSD sockets
+		const auto socket = ::socket( AF_INET, SOCK_DGRAM, 0 );
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		address.sin_port = 0;
+
+		socklen_t addressLength = sizeof(address);
+		if( bind( socket, reinterpret_cast<sockaddr *>( &address ), addressLength ) != 0 ||
+			getsockname( socket, reinterpret_cast<sockaddr *>( &address ), &addressLength ) != 0 ||
+			::connect( socket, reinterpret_cast<sockaddr *>( &address ), addressLength ) != 0 )
+		{
+			vCritical() << "failed to set up wake-up socket";
+		}
+
+		m_wakeUpSocket = Socket(socket);
+	}
+
+	void releaseWakeUpChannel()
+	{
+#if defined(Q_OS_WIN)
+		closesocket( m_wakeUpSocket );
+#else
+		close( int(m_wakeUpSocket) );
+#endif
+	}
+
+	void waitForEvents( int timeout, QSet<VncConnection *>& readyConnections )
+	{
+#if defined(Q_OS_WIN)
+		using PollFd = WSAPOLLFD;
+#else
+		using PollFd = pollfd;
+#endif
+		QVector<PollFd> pollFds;
+		QVector<VncConnection *> pollConnections;
+		pollFds.reserve( m_connections.size() + 1 );
+		pollConnections.reserve( m_connections.size() + 1 );
+
+		pollFds.append( PollFd{ decltype(PollFd::fd)(m_wakeUpSocket), POLLIN, 0 } );
+		pollConnections.append( nullptr );
+
+		for( auto it = m_connections.constBegin(), end = m_connections.constEnd(); it != end; ++it )
+		{
+			if( it.value() != InvalidSocket )
+			{
+				pollFds.append( PollFd{ decltype(PollFd::fd)(it.value()), POLLIN, 0 } );
+				pollConnections.append( it.key() );
+			}
+		}
+
+#if defined(Q_OS_WIN)
+		const auto result = WSAPoll( pollFds.data(), ULONG(pollFds.size()), timeout );
+#else
+		const auto result = poll( pollFds.data(), nfds_t(pollFds.size()), timeout );
+#endif
+		if( result <= 0 )
+		{
+			return;
+		}
+
+		if( pollFds[0].revents )
+		{
+			m_wakeUpPending = false;
+			char buffer[MaxEvents];
+			recv( m_wakeUpSocket, buffer, sizeof(buffer), 0 ); // Flawfinder: ignore
+		}
+
+		for( int i = 1; i < pollFds.size(); ++i )
+		{
+			if( pollFds[i].revents )
+			{
+				readyConnections.insert( pollConnections[i] );
+			}
+		}
+	}
+#endif
+
+	std::atomic<bool> m_stopRequested{false};
+	std::atomic<bool> m_wakeUpPending{false};
+	std::atomic<int> m_connectionCount{0};
+
+	QMutex m_pendingConnectionsMutex;
+	QVector<VncConnection *> m_pendingConnections;
+
+	// only accessed from within worker thread
+	QHash<VncConnection *, Socket> m_connections;
+
+#if defined(Q_OS_LINUX)
+	int m_epollFd{-1};
+	int m_wakeUpFd{-1};
+#else
+	Socket m_wakeUpSocket{InvalidSocket};
+#endif
+
+} ;
+
+
+
+VncConnectionEngine::VncConnectionEngine() :
+	m_maximumConcurrentHandshakes( VncConnectionConfiguration::DefaultMaximumConcurrentHandshakes ),
+	m_handshakeRampInterval( VncConnectionConfiguration::DefaultHandshakeRampInterval )
+{
+	if( VeyonCore::config().useCustomVncConnectionSettings() )
+	{
+		m_maximumConcurrentHandshakes = qMax( 1, VeyonCore::config().vncConnectionMaximumConcurrentHandshakes() );
+		m_handshakeRampInterval = qMax( 0, VeyonCore::config().vncConnectionHandshakeRampInterval() );
+	}
+
+	const auto coreCount = qMax( 1, QThread::idealThreadCount() );
+
+	m_workers.reserve( coreCount );
+	for( int i = 0; i < coreCount; ++i )
+	{
+		auto worker = new VncConnectionEngineWorker( i );
+		worker->start();
+		m_workers.append( worker );
+	}
+
+	m_connectThreadPool.setMaxThreadCount( m_maximumConcurrentHandshakes );
+
+	m_rampTimer.start();
+
+	vDebug() << "started" << coreCount << "worker threads, allowing" << m_maximumConcurrentHandshakes
+			 << "concurrent handshakes";
+}
+
+
+
+VncConnectionEngine::~VncConnectionEngine()
+{
+	m_admissionMutex.lock();
+	for( auto& queue : m_admissionQueues )
+	{
+		queue.clear();
+	}
+	m_admissionMutex.unlock();
+
+	// connect attempts reference their workers so let them finish first
+	m_connectThreadPool.clear();
+	m_connectThreadPool.waitForDone();
+
+	qDeleteAll( m_workers );
+	m_workers.clear();
+}
+
+
+
+void VncConnectionEngine::addConnection( VncConnection* connection )
+{
+	VncConnectionEngineWorker* leastLoadedWorker = nullptr;
+
+	for( auto worker : std::as_const(m_workers) )
+	{
+		if( leastLoadedWorker == nullptr || worker->connectionCount() < leastLoadedWorker->connectionCount() )
+		{
+			leastLoadedWorker = worker;
+		}
+	}
+
+	connection->m_engineWorker = leastLoadedWorker;
+
+	leastLoadedWorker->addConnection( connection );
+}
+
+
+
+int VncConnectionEngine::runConnectAttempt( VncConnection* connection )
+{
+	m_admissionMutex.lock();
+	m_admissionQueues[int(hostAvailability( connection ))].enqueue( connection );
+	m_admissionMutex.unlock();
+
+	return admitConnectAttempts();
+}
+
+
+
+bool VncConnectionEngine::cancelConnectAttempt( VncConnection* connection )
+{
+	QMutexLocker locker( &m_admissionMutex );
+
+	for( auto& queue : m_admissionQueues )
+	{
+		if( queue.removeOne( connection ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+
+PlatformNetworkFunctions::PingResult VncConnectionEngine::pingHost( const QString& host, int port )
+{
+	PingRequest request{ host, port };
+
+	QMutexLocker locker( &m_pingMutex );
+
+	m_pendingPingRequests.append( &request );
+
+	// while a batch is being probed, requests just queue up and the first one left waiting
+	// afterwards probes all of them at once
+	while( request.finished == false && m_pingBatchRunning )
+	{
+		m_pingBatchFinished.wait( &m_pingMutex );
+	}
+
+	if( request.finished )
+	{
+		return request.result;
+	}
+
+	m_pingBatchRunning = true;
+	const auto requests = std::exchange( m_pendingPingRequests, {} );
+
+	locker.unlock();
+	runPingRequests( requests );
+	locker.relock();
+
+	for( auto pingRequest : requests )
+	{
+		pingRequest->finished = true;
+	}
+
+	m_pingBatchRunning = false;
+	m_pingBatchFinished.wakeAll();
+
+	return request.result;
+}
+
+
+
+void VncConnectionEngine::runPingRequests( const QVector<PingRequest *>& requests )
+{
+	QHash<int, QVector<PingRequest *>> requestsByPort;
+	for( auto request : requests )
+	{
+		requestsByPort[request->port].append( request );
+	}
+
+	for( auto it = requestsByPort.constBegin(), end = requestsByPort.constEnd(); it != end; ++it )
+	{
+		QStringList hosts;
+		hosts.reserve( it.value().size() );
+		for( const auto request : it.value() )
+		{
+			hosts.append( request->host );
+		}
+
+		const auto results = VeyonCore::platform().networkFunctions().pingHosts( hosts, it.key() );
+
+		for( int i = 0; i < it.value().size(); ++i )
+		{
+			it.value()[i]->result = results.value( i, PlatformNetworkFunctions::PingResult::Unknown );
+		}
+	}
+}
+
+
+
+VncConnectionEngine::HostAvailability VncConnectionEngine::hostAvailability( VncConnection* connection ) const
+{
+	// m_admissionMutex has to be locked by caller
+	connection->m_globalMutex.lock();
+	const auto host = connection->m_host;
+	connection->m_globalMutex.unlock();
+
+	const auto entry = m_hostAvailabilities.constFind( host );
+	if( entry == m_hostAvailabilities.constEnd() ||
+		m_rampTimer.elapsed() - entry->updateTime > HostAvailabilityTimeout )
+	{
+		return HostAvailability::Unknown;
+	}
+
+	return entry->availability;
+}
+
+
+
+void VncConnectionEngine::updateHostAvailability( VncConnection* connection )
+{
+	if( connection->isControlFlagSet( VncConnection::ControlFlag::TerminateThread ) )
+	{
+		return;
+	}
+
+	auto availability = HostAvailability::Unknown;
+
+	switch( connection->state() )
+	{
+	case VncConnection::State::Connected:
+	case VncConnection::State::ServerNotRunning:
+	case VncConnection::State::AuthenticationFailed:
+		availability = HostAvailability::Online;
+		break;
+	case VncConnection::State::HostOffline:
+	case VncConnection::State::HostNameResolutionFailed:
+		availability = HostAvailability::Offline;
+		break;
+	default:
+		break;
+	}
+
+	connection->m_globalMutex.lock();
+	const auto host = connection->m_host;
+	connection->m_globalMutex.unlock();
+
+	QMutexLocker locker( &m_admissionMutex );
+
+	if( availability == HostAvailability::Unknown )
+	{
+		m_hostAvailabilities.remove( host );
+	}
+	else
+	{
+		m_hostAvailabilities[host] = { availability, m_rampTimer.elapsed() };
+	}
+
+	removeStaleHostAvailabilities();
+}
+
+
+
+void VncConnectionEngine::removeStaleHostAvailabilities()
+{
+	// m_admissionMutex has to be locked by caller
+	const auto now = m_rampTimer.elapsed();
+	if( now - m_lastHostAvailabilityCleanupTime < HostAvailabilityCleanupInterval )
+	{
+		return;
+	}
+
+	m_lastHostAvailabilityCleanupTime = now;
+
+	for( auto it = m_hostAvailabilities.begin(); it != m_hostAvailabilities.end(); )
+	{
+		if( now - it->updateTime > HostAvailabilityTimeout )
+		{
+			it = m_hostAvailabilities.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+
+
+int VncConnectionEngine::admitConnectAttempts()
+{
+	QMutexLocker locker( &m_admissionMutex );
+
+	for( int i = 0; i < int(HostAvailability::Count); ++i )
+	{
+		auto& queue = m_admissionQueues[i];
+
+		while( queue.isEmpty() == false && m_activeHandshakes < m_maximumConcurrentHandshakes )
+		{
+			// spread the starts of the admitted handshakes to avoid bursts of SYN packets - waiting
+			// connections retry when their worker's timeout expires so no handshake slot is blocked meanwhile
+			const auto now = m_rampTimer.elapsed();
+			if( now < m_nextHandshakeStartTime )
+			{
+				return int(m_nextHandshakeStartTime - now);
+			}
+
+			++m_activeHandshakes;
+			m_nextHandshakeStartTime = now + m_handshakeRampInterval;
+
+			startConnectAttempt( queue.dequeue(), HostAvailability(i) );
+		}
+
+		if( queue.isEmpty() == false )
+		{
+			// no handshake slot available - finished connect attempts admit further ones
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+
+
+void VncConnectionEngine::wakeUpWaitingConnection()
+{
+	QMutexLocker locker( &m_admissionMutex );
+
+	for( const auto& queue : m_admissionQueues )
+	{
+		if( queue.isEmpty() == false )
+		{
+			wakeUp( queue.head() );
+			return;
+		}
+	}
+}
+
+
+
+void VncConnectionEngine::startConnectAttempt( VncConnection* connection, HostAvailability availability )
+{
+	m_connectThreadPool.start( [this, connection, availability]() {
+		auto worker = connection->m_engineWorker.load();
+
+		// only probe briefly whether hosts known to be offline are back
+		connection->establishConnection( availability == HostAvailability::Offline );
+
+		updateHostAvailability( connection );
+
+		m_admissionMutex.lock();
+		--m_activeHandshakes;
+		m_admissionMutex.unlock();
+
+		if( admitConnectAttempts() > 0 )
+		{
+			// let a waiting connection retry once the ramp interval has passed
+			wakeUpWaitingConnection();
+		}
+
+		// hand the connection back to its worker thread
+		connection->m_connectAttemptPending = false;
+		worker->wakeUp();
+	} );
+}
+
+
+
+void VncConnectionEngine::wakeUp( VncConnection* connection )
+{
+	const auto worker = connection->m_engineWorker.load();
+	if( worker )
+	{
+		worker->wakeUp();
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * VncConnectionEngine.h - declaration of VncConnectionEngine class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "PlatformNetworkFunctions.h"
+#include "VeyonCore.h"
+
+class VncConnection;
+class VncConnectionEngineWorker;
+
+// clazy:excludeall=ctor-missing-parent-argument
+
+/**
+ * \brief Drives all VncConnection instances of a process from a small, fixed set of event loop threads
+ *
+ * Each worker thread multiplexes the sockets of many connections (epoll on Linux, poll() elsewhere)
+ * and services per-connection deadlines such as framebuffer update timers and reconnect delays.
+ * Blocking connection establishment (connect + RFB handshake + authentication) is carried out
+ * in a separate bounded thread pool so it never stalls established connections.
+ *
+ * Connect attempts pass an admission controller which limits the number of concurrent handshakes
+ * and spaces their starts so opening a large location does not flood the network and the servers.
+ * Hosts which have been reachable recently are admitted first.
+ */
+class VEYON_CORE_EXPORT VncConnectionEngine
+{
+public:
+	VncConnectionEngine();
+	~VncConnectionEngine();
+
+	int workerCount() const
+	{
+		return m_workers.size();
+	}
+
+	void addConnection( VncConnection* connection );
+	// both return milliseconds until the next queued connect attempt may be started or -1 if
+	// queued attempts wait for a handshake slot
+	int runConnectAttempt( VncConnection* connection );
+	int admitConnectAttempts();
+
+	bool cancelConnectAttempt( VncConnection* connection );
+
+	// probes the host together with the hosts of all other connect attempts failing meanwhile
+	PlatformNetworkFunctions::PingResult pingHost( const QString& host, int port );
+
+	static void wakeUp( VncConnection* connection );
+
+private:
+	enum class HostAvailability {
+		Online,
+		Unknown,
+		Offline,
+		Count
+	};
+
+	// forget about hosts not tried for a while, e.g. after switching to a different location
+	static constexpr qint64 HostAvailabilityTimeout = 10 * 60 * 1000;
+	static constexpr qint64 HostAvailabilityCleanupInterval = 60 * 1000;
+
+	struct HostAvailabilityEntry
+	{
+		HostAvailability availability{HostAvailability::Unknown};
+		qint64 updateTime{0};
+	};
+
+	HostAvailability hostAvailability( VncConnection* connection ) const;
+	void updateHostAvailability( VncConnection* connection );
+	void removeStaleHostAvailabilities();
+
+	struct PingRequest
+	{
+		QString host;
+		int port;
+		PlatformNetworkFunctions::PingResult result{PlatformNetworkFunctions::PingResult::Unknown};
+		bool finished{false};
+	};
+
+	void wakeUpWaitingConnection();
+	void startConnectAttempt( VncConnection* connection, HostAvailability availability );
+	void runPingRequests( const QVector<PingRequest *>& requests );
+
+	QVector<VncConnectionEngineWorker *> m_workers;
+	QThreadPool m_connectThreadPool;
+
+	int m_maximumConcurrentHandshakes;
+	int m_handshakeRampInterval;
+
+	// everything below is protected by m_admissionMutex
+	mutable QMutex m_admissionMutex;
+	QQueue<VncConnection *> m_admissionQueues[int(HostAvailability::Count)];
+	QHash<QString, HostAvailabilityEntry> m_hostAvailabilities;
+	qint64 m_lastHostAvailabilityCleanupTime{0};
+	int m_activeHandshakes{0};
+	QElapsedTimer m_rampTimer;
+	qint64 m_nextHandshakeStartTime{0};
+
+	// requests arriving while a batch is probed are collected for the next one
+	QMutex m_pingMutex;
+	QWaitCondition m_pingBatchFinished;
+	QVector<PingRequest *> m_pendingPingRequests;
+	bool m_pingBatchRunning{false};
+
+} ;
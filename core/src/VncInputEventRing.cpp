@@ -0,0 +1,142 @@
+/*
+ * VncInputEventRing.cpp - implementation of VncInputEventRing class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <chrono>
+
+#include "VncInputEventRing.h"
+
+
+VncInputEventRing::VncInputEventRing()
+{
+	for( int i = 0; i < Capacity; ++i )
+	{
+		m_slots[i].sequence.store( quint64(i), std::memory_order_relaxed );
+	}
+}
+
+
+
+bool VncInputEventRing::push( const Event& event )
+{
+	auto position = m_enqueuePosition.load( std::memory_order_relaxed );
+
+	Slot* slot = nullptr;
+
+	for(;;)
+	{
+		slot = &m_slots[position & ( Capacity - 1 )];
+
+		const auto sequence = slot->sequence.load( std::memory_order_acquire );
+		const auto difference = qint64( sequence - position );
+
+		if( difference == 0 )
+		{
+			// slot is free - try to claim it
+			if( m_enqueuePosition.compare_exchange_weak( position, position + 1, std::memory_order_relaxed ) )
+			{
+				break;
+			}
+		}
+		else if( difference < 0 )
+		{
+			// slot still holds an event from the previous round
+			return false;
+		}
+		else
+		{
+			// another producer claimed this slot
+			position = m_enqueuePosition.load( std::memory_order_relaxed );
+		}
+	}
+
+	slot->event = event;
+	slot->sequence.store( position + 1, std::memory_order_release );
+
+	return true;
+}
+
+
+
+bool VncInputEventRing::pop( Event& event )
+{
+	const auto position = m_dequeuePosition.load( std::memory_order_relaxed );
+	auto& slot = m_slots[position & ( Capacity - 1 )];
+
+	if( slot.sequence.load( std::memory_order_acquire ) != position + 1 )
+	{
+		return false;
+	}
+
+	event = slot.event;
+
+	// release slot for the producer of the next round
+	slot.sequence.store( position + Capacity, std::memory_order_release );
+	m_dequeuePosition.store( position + 1, std::memory_order_relaxed );
+
+	return true;
+}
+
+
+
+bool VncInputEventRing::peek( Event& event ) const
+{
+	const auto position = m_dequeuePosition.load( std::memory_order_relaxed );
+	const auto& slot = m_slots[position & ( Capacity - 1 )];
+
+	if( slot.sequence.load( std::memory_order_acquire ) != position + 1 )
+	{
+		return false;
+	}
+
+	event = slot.event;
+
+	return true;
+}
+
+
+
+void VncInputEventRing::clear()
+{
+	Event event;
+	while( pop( event ) )
+	{
+	}
+}
+
+
+
+bool VncInputEventRing::isEmpty() const
+{
+	const auto position = m_dequeuePosition.load( std::memory_order_relaxed );
+
+	return m_slots[position & ( Capacity - 1 )].sequence.load( std::memory_order_acquire ) != position + 1;
+}
+
+
+
+qint64 VncInputEventRing::timestamp()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
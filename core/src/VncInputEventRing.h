@@ -0,0 +1,94 @@
+/*
+ * VncInputEventRing.h - declaration of VncInputEventRing class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "VeyonCore.h"
+
+/**
+ * \brief Preallocated lock-free queue for key and pointer events
+ *
+ * Bounded multi-producer/single-consumer ring buffer where each slot carries a sequence number
+ * telling whether it is ready for writing or reading. Input events can be queued from any thread
+ * without locking or allocating memory while the connection thread drains them in batches.
+ */
+class VEYON_CORE_EXPORT VncInputEventRing
+{
+public:
+	static constexpr int Capacity = 256;
+
+	struct Event
+	{
+		enum class Type : quint8 {
+			Key,
+			Pointer
+		};
+
+		Type type{Type::Key};
+		bool pressed{false};
+		int buttonMask{0};
+		int x{0};
+		int y{0};
+		unsigned int key{0};
+		qint64 timestamp{0};
+		// position among all events queued for the connection
+		quint64 sequence{0};
+	};
+
+	VncInputEventRing();
+
+	// may be called from any thread, returns false if the ring is full
+	bool push( const Event& event );
+
+	// must only be called from one thread at a time
+	bool pop( Event& event );
+	bool peek( Event& event ) const;
+
+	void clear();
+
+	bool isEmpty() const;
+
+	/** \brief Returns a monotonic timestamp in nanoseconds for latency measurements */
+	static qint64 timestamp();
+
+private:
+	static_assert( ( Capacity & ( Capacity - 1 ) ) == 0, "Capacity has to be a power of two" );
+
+	static constexpr auto CacheLineSize = 64;
+
+	struct Slot
+	{
+		std::atomic<quint64> sequence{0};
+		Event event{};
+	};
+
+	std::array<Slot, Capacity> m_slots;
+
+	alignas(CacheLineSize) std::atomic<quint64> m_enqueuePosition{0};
+	alignas(CacheLineSize) std::atomic<quint64> m_dequeuePosition{0};
+
+} ;
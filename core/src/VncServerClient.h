@@ -24,6 +24,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <QElapsedTimer>
 
 #include "CryptoCore.h"
@@ -38,6 +40,7 @@ public:
 		Challenge,
 		Password,
 		Token,
+		SessionTicket,
 		Successful,
 		Failed,
 	} ;
@@ -64,9 +67,10 @@ public:
 	{
 	}
 
+	// protocol state may be changed from a different thread than the connection is served in
 	VncServerProtocol::State protocolState() const
 	{
-		return m_protocolState;
+		return m_protocolState.load();
 	}
 
 	void setProtocolState( VncServerProtocol::State protocolState )
@@ -149,6 +153,47 @@ public:
 		m_challenge = challenge;
 	}
 
+	const QString& authenticationKeyName() const
+	{
+		return m_authenticationKeyName;
+	}
+
+	void setAuthenticationKeyName( const QString& authenticationKeyName )
+	{
+		m_authenticationKeyName = authenticationKeyName;
+	}
+
+	RfbVeyonAuth::HandshakeFlags handshakeFlags() const
+	{
+		return m_handshakeFlags;
+	}
+
+	void setHandshakeFlags( RfbVeyonAuth::HandshakeFlags handshakeFlags )
+	{
+		m_handshakeFlags = handshakeFlags;
+	}
+
+	bool isSessionTicketRequested() const
+	{
+		return m_sessionTicketRequested;
+	}
+
+	void setSessionTicketRequested( bool requested )
+	{
+		m_sessionTicketRequested = requested;
+	}
+
+	// key provided by the client for encrypting a session ticket secret
+	const QByteArray& sessionTicketKey() const
+	{
+		return m_sessionTicketKey;
+	}
+
+	void setSessionTicketKey( const QByteArray& key )
+	{
+		m_sessionTicketKey = key;
+	}
+
 	const CryptoCore::PrivateKey& privateKey() const
 	{
 		return m_privateKey;
@@ -169,7 +214,7 @@ Q_SIGNALS:
 	void accessControlFinished( VncServerClient* );
 
 private:
-	VncServerProtocol::State m_protocolState;
+	std::atomic<VncServerProtocol::State> m_protocolState;
 	AuthState m_authState;
 	RfbVeyonAuth::Type m_authType;
 	AccessControlState m_accessControlState;
@@ -178,6 +223,10 @@ private:
 	QString m_username;
 	QString m_hostAddress;
 	QByteArray m_challenge;
+	QString m_authenticationKeyName;
+	bool m_sessionTicketRequested{false};
+	QByteArray m_sessionTicketKey;
+	RfbVeyonAuth::HandshakeFlags m_handshakeFlags{};
 	CryptoCore::PrivateKey m_privateKey;
 
 } ;
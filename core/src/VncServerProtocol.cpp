@@ -31,6 +31,7 @@
 #include "AccessControlProvider.h"
 #include "BuiltinFeatures.h"
 #include "VariantArrayMessage.h"
+#include "VeyonConfiguration.h"
 #include "VncServerClient.h"
 #include "VncServerProtocol.h"
 
@@ -117,6 +118,18 @@ bool VncServerProtocol::read()
 
 
 
+RfbVeyonAuth::HandshakeFlags VncServerProtocol::supportedHandshakeFlags() const
+{
+	if( VeyonCore::config().handshakePipeliningEnabled() )
+	{
+		return RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication;
+	}
+
+	return {};
+}
+
+
+
 void VncServerProtocol::setState( VncServerProtocol::State state )
 {
 	m_client->setProtocolState( state );
@@ -203,6 +216,22 @@ bool VncServerProtocol::sendAuthenticationTypes()
 		message.write( authType );
 	}
 
+	// append optional fields which are ignored by clients not supporting handshake extensions
+	const auto handshakeFlags = supportedHandshakeFlags();
+	if( handshakeFlags )
+	{
+		message.write( int(handshakeFlags) );
+
+		// send challenge in advance so the client can sign it (or prove possession of a session ticket) right away
+		if( handshakeFlags.testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication ) &&
+			( authTypes.contains( RfbVeyonAuth::KeyFile ) || authTypes.contains( RfbVeyonAuth::SessionTicket ) ) )
+		{
+			m_client->setChallenge( CryptoCore::generateChallenge() );
+		}
+
+		message.write( m_client->challenge() );
+	}
+
 	return message.send();
 }
 
@@ -226,17 +255,37 @@ bool VncServerProtocol::receiveAuthenticationTypeResponse()
 
 		const auto username = message.read().toString();
 
+		// optional fields which are only sent by clients supporting session tickets or handshake extensions
+		const auto sessionTicketRequested = message.read().toBool();
+		const auto handshakeFlags = RfbVeyonAuth::HandshakeFlags( message.read().toInt() ) & supportedHandshakeFlags();
+
 		m_client->setAuthType( chosenAuthType );
 		m_client->setUsername( username );
+		m_client->setSessionTicketRequested( sessionTicketRequested );
+		m_client->setHandshakeFlags( handshakeFlags );
 
 		setState( State::Authenticating );
 
-		// send auth ack message
-		VariantArrayMessage( m_socket ).send();
+		const auto speculativeAuthentication = handshakeFlags.testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication );
+
+		// client does not wait for the auth ack message if it sent its authentication data already
+		if( speculativeAuthentication == false )
+		{
+			VariantArrayMessage( m_socket ).send();
+		}
 
 		// init authentication
 		VariantArrayMessage dummyMessage( m_socket );
-		processAuthentication( dummyMessage );
+		const auto finished = processAuthentication( dummyMessage );
+
+		// process authentication data following in the same message
+		if( speculativeAuthentication && finished == false &&
+			m_client->authState() != VncServerClient::AuthState::Failed )
+		{
+			return processAuthentication( message );
+		}
+
+		return finished;
 	}
 
 	return false;
@@ -68,6 +68,7 @@ public:
 
 protected:
 	virtual QVector<RfbVeyonAuth::Type> supportedAuthTypes() const = 0;
+	virtual RfbVeyonAuth::HandshakeFlags supportedHandshakeFlags() const;
 	virtual void processAuthenticationMessage( VariantArrayMessage& message ) = 0;
 	virtual void performAccessControl() = 0;
 
@@ -27,6 +27,7 @@
 #include "ComputerControlListModel.h"
 #include "ComputerManager.h"
 #include "FeatureManager.h"
+#include "ImageScaler.h"
 #include "PlatformSessionFunctions.h"
 #include "VeyonMaster.h"
 #include "UserConfig.h"
@@ -184,6 +185,8 @@ void ComputerControlListModel::reload()
 	m_computerControlInterfaces.clear();
 	m_computerControlInterfaces.reserve( computerList.size() );
 
+	m_computersWithoutPicture.clear();
+
 	for( const auto& computer : computerList )
 	{
 		const auto controlInterface = ComputerControlInterface::Pointer::create( computer );
@@ -196,6 +199,34 @@ void ComputerControlListModel::reload()
 
 
 
+void ComputerControlListModel::setVisibleComputerControlInterfaces( QObject* view, bool displayed,
+																	const ComputerControlInterfaceList& visibleInterfaces )
+{
+	if( m_viewVisibilities.contains( view ) == false )
+	{
+		connect( view, &QObject::destroyed, this, [this, view]() {
+			m_viewVisibilities.remove( view );
+			updateVisibilities();
+		} );
+	}
+
+	auto& viewVisibility = m_viewVisibilities[view];
+	viewVisibility.displayed = displayed;
+	viewVisibility.visibleInterfaces.clear();
+
+	if( displayed )
+	{
+		for( const auto& controlInterface : visibleInterfaces )
+		{
+			viewVisibility.visibleInterfaces.insert( controlInterface.data() );
+		}
+	}
+
+	updateVisibilities();
+}
+
+
+
 void ComputerControlListModel::update()
 {
 	const auto newComputerList = m_master->computerManager().selectedComputers( QModelIndex() );
@@ -340,21 +371,110 @@ void ComputerControlListModel::updateSessionInfo(const QModelIndex& index)
 
 
 
+void ComputerControlListModel::updateVisibilities()
+{
+	// without any view reporting visibilities, all computers are considered visible
+	if( m_viewVisibilities.isEmpty() )
+	{
+		for( const auto& controlInterface : std::as_const(m_computerControlInterfaces) )
+		{
+			controlInterface->setVisibility( ComputerControlInterface::Visibility::Visible );
+		}
+		return;
+	}
+
+	bool anyViewDisplayed = false;
+	for( const auto& viewVisibility : std::as_const(m_viewVisibilities) )
+	{
+		anyViewDisplayed |= viewVisibility.displayed;
+	}
+
+	for( const auto& controlInterface : std::as_const(m_computerControlInterfaces) )
+	{
+		auto visibility = anyViewDisplayed ? ComputerControlInterface::Visibility::Hidden :
+											 ComputerControlInterface::Visibility::Suspended;
+
+		for( const auto& viewVisibility : std::as_const(m_viewVisibilities) )
+		{
+			if( viewVisibility.visibleInterfaces.contains( controlInterface.data() ) )
+			{
+				visibility = ComputerControlInterface::Visibility::Visible;
+				break;
+			}
+		}
+
+		controlInterface->setVisibility( visibility );
+	}
+}
+
+
+
+void ComputerControlListModel::updateFirstPictureProgress( ComputerControlInterface* controlInterface )
+{
+	if( m_computersWithoutPicture.contains( controlInterface ) == false )
+	{
+		return;
+	}
+
+	if( controlInterface->hasValidFramebuffer() )
+	{
+		++m_computersWithPicture;
+	}
+	else
+	{
+		switch( controlInterface->state() )
+		{
+		case ComputerControlInterface::State::HostOffline:
+		case ComputerControlInterface::State::HostNameResolutionFailed:
+		case ComputerControlInterface::State::ServerNotRunning:
+		case ComputerControlInterface::State::AuthenticationFailed:
+		case ComputerControlInterface::State::AccessControlFailed:
+			break;
+		default:
+			// still connecting or waiting for the first framebuffer update
+			return;
+		}
+	}
+
+	m_computersWithoutPicture.remove( controlInterface );
+
+	if( m_computersWithoutPicture.isEmpty() )
+	{
+		vDebug() << m_computersWithPicture << "computers show a picture after" << m_firstPictureTimer.elapsed()
+				 << "ms," << m_computerControlInterfaces.count() - m_computersWithPicture << "are unreachable";
+	}
+}
+
+
+
 void ComputerControlListModel::startComputerControlInterface( ComputerControlInterface* controlInterface )
 {
+	if( m_computersWithoutPicture.isEmpty() )
+	{
+		m_firstPictureTimer.start();
+		m_computersWithPicture = 0;
+	}
+	m_computersWithoutPicture.insert( controlInterface );
+
 	controlInterface->start( computerScreenSize(), ComputerControlInterface::UpdateMode::Monitoring );
 
 	connect( controlInterface, &ComputerControlInterface::framebufferSizeChanged,
 			 this, &ComputerControlListModel::updateComputerScreenSize );
 
 	connect( controlInterface, &ComputerControlInterface::framebufferUpdated,
-			 this, [=] () { updateScreen( interfaceIndex( controlInterface ) ); } );
+			 this, [=] () {
+		updateScreen( interfaceIndex( controlInterface ) );
+		updateFirstPictureProgress( controlInterface );
+	} );
 
 	connect( controlInterface, &ComputerControlInterface::activeFeaturesChanged,
 			 this, [=] () { updateActiveFeatures( interfaceIndex( controlInterface ) ); } );
 
 	connect( controlInterface, &ComputerControlInterface::stateChanged,
-			 this, [=] () { updateState( interfaceIndex( controlInterface ) ); } );
+			 this, [=] () {
+		updateState( interfaceIndex( controlInterface ) );
+		updateFirstPictureProgress( controlInterface );
+	} );
 
 	connect( controlInterface, &ComputerControlInterface::userChanged,
 			 this, [=]() { updateUser( interfaceIndex( controlInterface ) ); } );
@@ -372,6 +492,8 @@ void ComputerControlListModel::stopComputerControlInterface( const ComputerContr
 {
 	m_master->stopAllFeatures( { controlInterface } );
 
+	m_computersWithoutPicture.remove( controlInterface.data() );
+
 	controlInterface->disconnect(this);
 	controlInterface->disconnect( &m_master->computerManager() );
 
@@ -400,7 +522,7 @@ double ComputerControlListModel::averageAspectRatio() const
 
 QImage ComputerControlListModel::scaleAndAlignIcon( const QImage& icon, QSize size ) const
 {
-	const auto scaledIcon = icon.scaled(size.width(), size.height(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	const auto scaledIcon = ImageScaler::scaledKeepAspectRatio(icon, size);
 
 	QImage scaledAndAlignedIcon( size, QImage::Format_ARGB32 );
 	scaledAndAlignedIcon.fill( Qt::transparent );
@@ -469,6 +591,16 @@ QString ComputerControlListModel::computerToolTipRole( const ComputerControlInte
 
 	if (controlInterface->state() != ComputerControlInterface::State::Connected)
 	{
+		const auto vncConnection = controlInterface->vncConnection();
+		const auto retryState = vncConnection ? vncConnection->connectionRetryState() : VncConnection::ConnectionRetryState{};
+		if (retryState.failedAttempts > 0)
+		{
+			const QString retry(tr("Failed connection attempts: %1, next attempt in %2 s")
+									.arg(retryState.failedAttempts)
+									.arg((retryState.nextAttemptIn + 999) / 1000));
+			return QStringLiteral("<b>%1</b><br>%2<br>%3<br>%4<br>%5").arg(state, name, location, host, retry);
+		}
+
 		return QStringLiteral("<b>%1</b><br>%2<br>%3<br>%4").arg(state, name, location, host);
 	}
 
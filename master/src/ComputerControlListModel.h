@@ -25,7 +25,10 @@
 #pragma once
 
 #include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QImage>
+#include <QSet>
 
 #include "ComputerListModel.h"
 #include "ComputerControlInterface.h"
@@ -58,6 +61,9 @@ public:
 
 	void reload();
 
+	void setVisibleComputerControlInterfaces( QObject* view, bool displayed,
+											  const ComputerControlInterfaceList& visibleInterfaces );
+
 Q_SIGNALS:
 	void stateChanged(QModelIndex);
 	void activeFeaturesChanged( QModelIndex );
@@ -76,6 +82,10 @@ private:
 	void updateUser( const QModelIndex& index );
 	void updateSessionInfo(const QModelIndex& index);
 
+	void updateVisibilities();
+
+	void updateFirstPictureProgress( ComputerControlInterface* controlInterface );
+
 	void startComputerControlInterface( ComputerControlInterface* controlInterface );
 	void stopComputerControlInterface( const ComputerControlInterface::Pointer& controlInterface );
 
@@ -102,4 +112,17 @@ private:
 
 	ComputerControlInterfaceList m_computerControlInterfaces{};
 
+	struct ViewVisibility
+	{
+		bool displayed{false};
+		QSet<ComputerControlInterface *> visibleInterfaces{};
+	};
+
+	QHash<QObject *, ViewVisibility> m_viewVisibilities{};
+
+	// measures how long it takes until all computers show a picture or turned out to be unreachable
+	QElapsedTimer m_firstPictureTimer{};
+	QSet<ComputerControlInterface *> m_computersWithoutPicture{};
+	int m_computersWithPicture{0};
+
 };
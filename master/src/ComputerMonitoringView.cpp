@@ -40,17 +40,29 @@ ComputerMonitoringView::ComputerMonitoringView() :
 
 	m_iconSizeAutoAdjustTimer.setInterval( IconSizeAdjustDelay );
 	m_iconSizeAutoAdjustTimer.setSingleShot( true );
+
+	m_visibilityUpdateTimer.setInterval( VisibilityUpdateDelay );
+	m_visibilityUpdateTimer.setSingleShot( true );
 }
 
 
 
 void ComputerMonitoringView::initializeView( QObject* self )
 {
+	m_view = self;
+
 	const auto autoAdjust = [this]() { initiateIconSizeAutoAdjust(); };
+	const auto visibilityUpdate = [this]() { initiateVisibilityUpdate(); };
 
 	QObject::connect( &m_iconSizeAutoAdjustTimer, &QTimer::timeout, self, [this]() { performIconSizeAutoAdjust(); } );
+	QObject::connect( &m_visibilityUpdateTimer, &QTimer::timeout, self, [this]() { updateVisibility(); } );
 	QObject::connect( dataModel(), &ComputerMonitoringModel::rowsInserted, self, autoAdjust );
 	QObject::connect( dataModel(), &ComputerMonitoringModel::rowsRemoved, self, autoAdjust );
+	QObject::connect( dataModel(), &ComputerMonitoringModel::rowsInserted, self, visibilityUpdate );
+	QObject::connect( dataModel(), &ComputerMonitoringModel::rowsRemoved, self, visibilityUpdate );
+	QObject::connect( dataModel(), &ComputerMonitoringModel::rowsMoved, self, visibilityUpdate );
+	QObject::connect( dataModel(), &ComputerMonitoringModel::modelReset, self, visibilityUpdate );
+	QObject::connect( dataModel(), &ComputerMonitoringModel::layoutChanged, self, visibilityUpdate );
 	QObject::connect( &m_master->computerControlListModel(), &ComputerControlListModel::computerScreenSizeChanged, self,
 					  [this]() { setIconSize( m_master->computerControlListModel().computerScreenSize() ); } );
 
@@ -165,6 +177,29 @@ void ComputerMonitoringView::initiateIconSizeAutoAdjust()
 
 
 
+void ComputerMonitoringView::initiateVisibilityUpdate()
+{
+	if( m_visibilityUpdateTimer.isActive() == false )
+	{
+		m_visibilityUpdateTimer.start();
+	}
+}
+
+
+
+void ComputerMonitoringView::updateVisibility()
+{
+	m_visibilityUpdateTimer.stop();
+
+	if( m_view )
+	{
+		m_master->computerControlListModel().setVisibleComputerControlInterfaces( m_view, isDisplayed(),
+																				  visibleComputerControlInterfaces() );
+	}
+}
+
+
+
 void ComputerMonitoringView::runFeature( const Feature& feature )
 {
 	auto computerControlInterfaces = selectedComputerControlInterfaces();
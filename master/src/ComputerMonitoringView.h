@@ -42,6 +42,7 @@ public:
 
 	static constexpr auto IconSizeAdjustStepSize = 10;
 	static constexpr auto IconSizeAdjustDelay = 250;
+	static constexpr auto VisibilityUpdateDelay = 100;
 
 	ComputerMonitoringView();
 	virtual ~ComputerMonitoringView() = default;
@@ -84,6 +85,13 @@ protected:
 
 	void initiateIconSizeAutoAdjust();
 
+	// computers currently displayed so others can be updated less frequently
+	virtual ComputerControlInterfaceList visibleComputerControlInterfaces() const = 0;
+	virtual bool isDisplayed() const = 0;
+
+	void initiateVisibilityUpdate();
+	void updateVisibility();
+
 	VeyonMaster* master() const
 	{
 		return m_master;
@@ -101,4 +109,7 @@ private:
 	bool m_autoAdjustIconSize{false};
 	QTimer m_iconSizeAutoAdjustTimer{};
 
+	QObject* m_view{nullptr};
+	QTimer m_visibilityUpdateTimer{};
+
 };
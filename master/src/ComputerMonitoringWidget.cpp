@@ -89,6 +89,40 @@ ComputerControlInterfaceList ComputerMonitoringWidget::selectedComputerControlIn
 
 
 
+ComputerControlInterfaceList ComputerMonitoringWidget::visibleComputerControlInterfaces() const
+{
+	ComputerControlInterfaceList computerControlInterfaces;
+
+	if( model() == nullptr || isDisplayed() == false )
+	{
+		return computerControlInterfaces;
+	}
+
+	const auto viewportRect = viewport()->rect();
+	const auto rowCount = model()->rowCount();
+
+	for( int row = 0; row < rowCount; ++row )
+	{
+		const auto index = model()->index( row, 0 );
+		if( isIndexHidden( index ) == false && visualRect( index ).intersects( viewportRect ) )
+		{
+			computerControlInterfaces.append( model()->data( index, ComputerControlListModel::ControlInterfaceRole )
+												  .value<ComputerControlInterface::Pointer>() );
+		}
+	}
+
+	return computerControlInterfaces;
+}
+
+
+
+bool ComputerMonitoringWidget::isDisplayed() const
+{
+	return isVisible() && window()->isMinimized() == false;
+}
+
+
+
 bool ComputerMonitoringWidget::performIconSizeAutoAdjust()
 {
 	if( ComputerMonitoringView::performIconSizeAutoAdjust() == false)
@@ -390,6 +424,8 @@ void ComputerMonitoringWidget::resizeEvent( QResizeEvent* event )
 	{
 		initiateIconSizeAutoAdjust();
 	}
+
+	initiateVisibilityUpdate();
 }
 
 
@@ -402,6 +438,35 @@ void ComputerMonitoringWidget::showEvent( QShowEvent* event )
 	}
 
 	FlexibleListView::showEvent( event );
+
+	initiateVisibilityUpdate();
+}
+
+
+
+void ComputerMonitoringWidget::hideEvent( QHideEvent* event )
+{
+	FlexibleListView::hideEvent( event );
+
+	initiateVisibilityUpdate();
+}
+
+
+
+void ComputerMonitoringWidget::scrollContentsBy( int dx, int dy )
+{
+	FlexibleListView::scrollContentsBy( dx, dy );
+
+	initiateVisibilityUpdate();
+}
+
+
+
+void ComputerMonitoringWidget::updateGeometries()
+{
+	FlexibleListView::updateGeometries();
+
+	initiateVisibilityUpdate();
 }
 
 
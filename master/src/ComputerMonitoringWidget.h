@@ -65,6 +65,9 @@ private:
 
 	bool performIconSizeAutoAdjust() override;
 
+	ComputerControlInterfaceList visibleComputerControlInterfaces() const override;
+	bool isDisplayed() const override;
+
 	void populateFeatureMenu( const ComputerControlInterfaceList& computerControlInterfaces );
 	void addFeatureToMenu( const Feature& feature, const QString& label );
 	void addSubFeaturesToMenu( const Feature& parentFeature, const FeatureList& subFeatures, const QString& label );
@@ -79,6 +82,9 @@ private:
 
 	void resizeEvent( QResizeEvent* event ) override;
 	void showEvent( QShowEvent* event ) override;
+	void hideEvent( QHideEvent* event ) override;
+	void scrollContentsBy( int dx, int dy ) override;
+	void updateGeometries() override;
 	void wheelEvent( QWheelEvent* event ) override;
 
 	QMenu* m_featureMenu{};
@@ -34,5 +34,9 @@
 	OP( DemoConfiguration, m_configuration, int, framebufferUpdateInterval, setFramebufferUpdateInterval, "FramebufferUpdateInterval", "Demo", 100, Configuration::Property::Flag::Advanced )	\
 	OP( DemoConfiguration, m_configuration, int, keyFrameInterval, setKeyFrameInterval, "KeyFrameInterval", "Demo", 10, Configuration::Property::Flag::Advanced )	\
 	OP( DemoConfiguration, m_configuration, int, memoryLimit, setMemoryLimit, "MemoryLimit", "Demo", 128, Configuration::Property::Flag::Advanced )	\
+	OP( DemoConfiguration, m_configuration, int, workerThreadCount, setWorkerThreadCount, "WorkerThreadCount", "Demo", -1, Configuration::Property::Flag::Hidden )	\
+	OP( DemoConfiguration, m_configuration, int, clientBacklogLimit, setClientBacklogLimit, "ClientBacklogLimit", "Demo", 1024, Configuration::Property::Flag::Hidden )	\
+	OP( DemoConfiguration, m_configuration, bool, losslessQualityTier, setLosslessQualityTier, "LosslessQualityTier", "Demo", false, Configuration::Property::Flag::Hidden )	\
+	OP( DemoConfiguration, m_configuration, int, relayCount, setRelayCount, "RelayCount", "Demo", 0, Configuration::Property::Flag::Hidden )	\
 
 DECLARE_CONFIG_PROXY(DemoConfiguration, FOREACH_DEMO_CONFIG_PROPERTY)
@@ -147,8 +147,25 @@ bool DemoFeaturePlugin::controlFeature( Feature::Uid featureUid,
 	{
 		if( operation == Operation::Start )
 		{
-			m_demoServerArguments = arguments;
-			m_demoServerControlInterfaces = computerControlInterfaces;
+			if( arguments.contains( argToString(Argument::UpstreamDemoServerPort) ) )
+			{
+				for( const auto& computerControlInterface : computerControlInterfaces )
+				{
+					// replace previous arguments for the same relay
+					m_demoRelayControls.erase( std::remove_if( m_demoRelayControls.begin(), m_demoRelayControls.end(),
+						[&]( const DemoRelay& relay ) {
+							return relay.computerControlInterface == computerControlInterface &&
+								   relay.arguments.value( argToString(Argument::DemoServerPort) ) ==
+									   arguments.value( argToString(Argument::DemoServerPort) );
+						} ), m_demoRelayControls.end() );
+					m_demoRelayControls.append( { computerControlInterface, arguments } );
+				}
+			}
+			else
+			{
+				m_demoServerArguments = arguments;
+				m_demoServerControlInterfaces = computerControlInterfaces;
+			}
 			m_demoServerControlTimer.start( DemoServerControlInterval );
 			controlDemoServer();
 		}
@@ -182,10 +199,19 @@ bool DemoFeaturePlugin::startFeature( VeyonMasterInterface& master, const Featur
 {
 	if( feature == m_shareOwnScreenWindowFeature || feature == m_shareOwnScreenFullScreenFeature )
 	{
+		const auto demoClientFeatureUid = feature == m_shareOwnScreenFullScreenFeature ? m_demoClientFullScreenFeature.uid()
+																					   : m_demoClientWindowFeature.uid();
+		const auto relayCount = m_configuration.relayCount();
+
 		// start demo clients
-		controlFeature( feature == m_shareOwnScreenFullScreenFeature ? m_demoClientFullScreenFeature.uid()
-																	 : m_demoClientWindowFeature.uid(),
-						Operation::Start, {}, computerControlInterfaces );
+		if( relayCount > 0 && computerControlInterfaces.count() > relayCount )
+		{
+			startDemoRelays( demoClientFeatureUid, computerControlInterfaces, relayCount );
+		}
+		else
+		{
+			controlFeature( demoClientFeatureUid, Operation::Start, {}, computerControlInterfaces );
+		}
 
 		// start demo server
 		controlFeature( m_demoServerFeature.uid(), Operation::Start, {},
@@ -216,14 +242,10 @@ bool DemoFeaturePlugin::startFeature( VeyonMasterInterface& master, const Featur
 
 		const auto& demoServerInterface = selectedComputerControlInterfaces.constFirst();
 		const auto demoServerHost = demoServerInterface->computer().hostName();
-		const auto primaryServerPort = HostAddress::parsePortNumber( demoServerHost );
+		const auto sessionId = computerSessionId( demoServerHost );
 
-		if( primaryServerPort > 0 )
-		{
-			const auto sessionId = primaryServerPort - VeyonCore::config().veyonServerPort();
-			vncServerPortOffset = sessionId;
-			demoServerPort += sessionId;
-		}
+		vncServerPortOffset = sessionId;
+		demoServerPort += sessionId;
 
 		// start demo clients
 		auto userDemoControlInterfaces = computerControlInterfaces;
@@ -304,7 +326,25 @@ bool DemoFeaturePlugin::handleFeatureMessage( VeyonServerInterface& server,
 {
 	if( message.featureUid() == m_demoServerFeature.uid() )
 	{
-		if (message.command<FeatureCommand>() == FeatureCommand::StartDemoServer)
+		if (message.command<FeatureCommand>() == FeatureCommand::StartDemoServer &&
+			message.argument( Argument::UpstreamDemoServerPort ).toInt() > 0)
+		{
+			m_demoRelayStarted = true;
+
+			auto socket = qobject_cast<QTcpSocket *>( messageContext.ioDevice() );
+			if( message.argument( Argument::UpstreamDemoServerHost ).toString().isEmpty() && socket )
+			{
+				// relay the demo server of the master
+				server.featureWorkerManager().sendMessageToManagedSystemWorker(
+					FeatureMessage{ message }
+						.addArgument( Argument::UpstreamDemoServerHost, socket->peerAddress().toString() ) );
+			}
+			else
+			{
+				server.featureWorkerManager().sendMessageToManagedSystemWorker( message );
+			}
+		}
+		else if (message.command<FeatureCommand>() == FeatureCommand::StartDemoServer)
 		{
 			// add VNC server password to message
 			server.featureWorkerManager().
@@ -316,6 +356,11 @@ bool DemoFeaturePlugin::handleFeatureMessage( VeyonServerInterface& server,
 		else if (message.command<FeatureCommand>() != FeatureCommand::StopDemoServer ||
 				 server.featureWorkerManager().isWorkerRunning( m_demoServerFeature.uid() ) )
 		{
+			if (message.command<FeatureCommand>() == FeatureCommand::StopDemoServer)
+			{
+				m_demoRelayStarted = false;
+			}
+
 			// forward message to worker
 			server.featureWorkerManager().sendMessageToManagedSystemWorker( message );
 		}
@@ -328,9 +373,10 @@ bool DemoFeaturePlugin::handleFeatureMessage( VeyonServerInterface& server,
 	{
 		// if a demo server is started, it's likely that the demo accidentally was
 		// started on master computer as well therefore we deny starting a demo on
-		// hosts on which a demo server is running - exception: debug mode
+		// hosts on which a demo server is running - exceptions: demo relays and debug mode
 		if( message.featureUid() == m_demoClientFullScreenFeature.uid() &&
 			server.featureWorkerManager().isWorkerRunning( m_demoServerFeature.uid() ) &&
+			m_demoRelayStarted == false &&
 			VeyonCore::config().logLevel() < Logger::LogLevel::Debug )
 		{
 			return false;
@@ -386,7 +432,21 @@ bool DemoFeaturePlugin::handleFeatureMessage( VeyonWorkerInterface& worker, cons
 		switch (message.command<FeatureCommand>())
 		{
 		case FeatureCommand::StartDemoServer:
-			if( m_demoServer == nullptr )
+			if( message.argument( Argument::UpstreamDemoServerPort ).toInt() > 0 )
+			{
+				// multiple relays may be run for testing purposes
+				const auto demoServerPort = message.argument( Argument::DemoServerPort ).toInt();
+				if( m_demoRelays.contains( demoServerPort ) == false )
+				{
+					m_demoRelays[demoServerPort] = new DemoServer( message.argument( Argument::UpstreamDemoServerHost ).toString(),
+																   message.argument( Argument::UpstreamDemoServerPort ).toInt(),
+																   message.argument( Argument::DemoAccessToken ).toByteArray(),
+																   m_configuration,
+																   demoServerPort,
+																   this );
+				}
+			}
+			else if( m_demoServer == nullptr )
 			{
 				m_demoServer = new DemoServer( message.argument( Argument::VncServerPort ).toInt(),
 											   message.argument( Argument::VncServerPassword ).toByteArray(),
@@ -404,6 +464,12 @@ bool DemoFeaturePlugin::handleFeatureMessage( VeyonWorkerInterface& worker, cons
 			}
 			m_demoServer = nullptr;
 
+			for( auto relay : std::as_const(m_demoRelays) )
+			{
+				relay->terminate();
+			}
+			m_demoRelays.clear();
+
 			QCoreApplication::quit();
 
 			return true;
@@ -581,11 +647,106 @@ void DemoFeaturePlugin::controlDemoServer()
 						   .addArgument( Argument::VncServerPortOffset, vncServerPortOffset )
 						   .addArgument( Argument::DemoServerPort, demoServerPort ),
 						   m_demoServerControlInterfaces );
+
+		for( const auto& relay : std::as_const(m_demoRelayControls) )
+		{
+			const auto relayDemoAccessToken = relay.arguments.value( argToString(Argument::DemoAccessToken),
+																	 m_demoAccessToken.toByteArray() ).toByteArray();
+
+			sendFeatureMessage(FeatureMessage{m_demoServerFeature.uid(), FeatureCommand::StartDemoServer}
+							   .addArgument( Argument::DemoAccessToken, relayDemoAccessToken )
+							   .addArgument( Argument::DemoServerPort, relay.arguments.value( argToString(Argument::DemoServerPort) ) )
+							   .addArgument( Argument::UpstreamDemoServerHost, relay.arguments.value( argToString(Argument::UpstreamDemoServerHost) ) )
+							   .addArgument( Argument::UpstreamDemoServerPort, relay.arguments.value( argToString(Argument::UpstreamDemoServerPort) ) ),
+							   { relay.computerControlInterface } );
+		}
 	}
 	else
 	{
 		sendFeatureMessage(FeatureMessage{m_demoServerFeature.uid(), FeatureCommand::StopDemoServer},
 						   m_demoServerControlInterfaces );
+
+		for( const auto& relay : std::as_const(m_demoRelayControls) )
+		{
+			sendFeatureMessage(FeatureMessage{m_demoServerFeature.uid(), FeatureCommand::StopDemoServer},
+							   { relay.computerControlInterface } );
+		}
+
+		m_demoRelayControls.clear();
+	}
+}
+
+
+
+int DemoFeaturePlugin::computerSessionId( const QString& hostName )
+{
+	// computers running multiple sessions are added with the port of the session's Veyon Server
+	const auto primaryServerPort = HostAddress::parsePortNumber( hostName );
+	if( primaryServerPort > 0 )
+	{
+		return primaryServerPort - VeyonCore::config().veyonServerPort();
+	}
+
+	return 0;
+}
+
+
+
+void DemoFeaturePlugin::startDemoRelays( Feature::Uid demoClientFeatureUid,
+										 const ComputerControlInterfaceList& computerControlInterfaces, int relayCount )
+{
+	// let some of the computers connected already distribute the demo to the others
+	ComputerControlInterfaceList relays;
+	for( const auto& computerControlInterface : computerControlInterfaces )
+	{
+		if( relays.count() < relayCount &&
+			computerControlInterface->state() == ComputerControlInterface::State::Connected )
+		{
+			relays.append( computerControlInterface );
+		}
+	}
+
+	if( relays.isEmpty() )
+	{
+		controlFeature( demoClientFeatureUid, Operation::Start, {}, computerControlInterfaces );
+		return;
+	}
+
+	QVector<ComputerControlInterfaceList> relayClients( relays.count() );
+
+	int clientIndex = 0;
+	for( const auto& computerControlInterface : computerControlInterfaces )
+	{
+		if( relays.contains( computerControlInterface ) == false )
+		{
+			relayClients[clientIndex++ % relays.count()].append( computerControlInterface );
+		}
+	}
+
+	const auto demoServerPort = VeyonCore::config().demoServerPort() + VeyonCore::sessionId();
+
+	for( int i = 0; i < relays.count(); ++i )
+	{
+		const auto& relay = relays[i];
+		const auto relayHost = relay->computer().hostName();
+		const auto relayPort = VeyonCore::config().demoServerPort() + computerSessionId( relayHost );
+
+		// the relay receives the demo from our demo server with the upstream host being determined
+		// from the peer address of the connection to the relay
+		controlFeature( m_demoServerFeature.uid(), Operation::Start,
+						{
+							{ argToString(Argument::DemoServerPort), relayPort },
+							{ argToString(Argument::UpstreamDemoServerPort), demoServerPort },
+						},
+						{ relay } );
+
+		// and displays it itself just like the computers assigned to it
+		controlFeature( demoClientFeatureUid, Operation::Start,
+						{
+							{ argToString(Argument::DemoServerHost), HostAddress::parseHost( relayHost ) },
+							{ argToString(Argument::DemoServerPort), relayPort },
+						},
+						relayClients[i] + ComputerControlInterfaceList{ relay } );
 	}
 }
 
@@ -54,7 +54,9 @@ public:
 		ViewportY,
 		ViewportWidth,
 		ViewportHeight,
-		VncServerPortOffset
+		VncServerPortOffset,
+		UpstreamDemoServerHost,
+		UpstreamDemoServerPort
 	};
 	Q_ENUM(Argument)
 
@@ -126,6 +128,11 @@ private:
 
 	QRect viewportFromScreenSelection() const;
 
+	static int computerSessionId( const QString& hostName );
+
+	void startDemoRelays( Feature::Uid demoClientFeatureUid, const ComputerControlInterfaceList& computerControlInterfaces,
+						  int relayCount );
+
 	void controlDemoServer();
 	bool controlDemoClient( Feature::Uid featureUid, Operation operation, const QVariantMap& arguments,
 						   const ComputerControlInterfaceList& computerControlInterfaces );
@@ -157,11 +164,20 @@ private:
 	DemoConfiguration m_configuration;
 
 	DemoServer* m_demoServer;
+	QHash<int, DemoServer *> m_demoRelays{};
+	bool m_demoRelayStarted{false};
 	DemoClient* m_demoClient;
 
+	struct DemoRelay
+	{
+		ComputerControlInterface::Pointer computerControlInterface;
+		QVariantMap arguments;
+	};
+
 	ComputerControlInterfaceList m_demoServerControlInterfaces{};
 	ComputerControlInterfaceList m_demoServerClients{};
 	QVariantMap m_demoServerArguments{};
+	QList<DemoRelay> m_demoRelayControls{};
 	QTimer m_demoServerControlTimer{this};
 
 };
@@ -0,0 +1,845 @@
+/*
+ * DemoFramebuffer.cpp - implementation of DemoFramebuffer class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <algorithm>
+
+#include <QBuffer>
+#include <QtEndian>
+
+#include "DemoFramebuffer.h"
+
+
+DemoFramebuffer::DemoFramebuffer()
+{
+	memset( m_zlibStreams, 0, sizeof(m_zlibStreams) ); // Flawfinder: ignore
+}
+
+
+
+DemoFramebuffer::~DemoFramebuffer()
+{
+	for( int i = 0; i < ZlibStreamCount; ++i )
+	{
+		if( m_zlibStreamActive[i] )
+		{
+			inflateEnd( &m_zlibStreams[i] );
+		}
+	}
+}
+
+
+
+QVector<uint32_t> DemoFramebuffer::serverEncodings( int qualityLevel )
+{
+	// compression level 0 makes the VNC server not use any zlib streams whose state only our
+	// connection knows, so its updates can be passed on to clients joining at any time
+	QVector<uint32_t> encodings{ rfbEncodingTight, rfbEncodingCopyRect, rfbEncodingRaw,
+								 rfbEncodingCompressLevel0, rfbEncodingNewFBSize, rfbEncodingLastRect };
+
+	if( qualityLevel != LosslessQualityLevel )
+	{
+		encodings.append( rfbEncodingQualityLevel0 + uint32_t(qBound( MinimumQualityLevel, qualityLevel, MaximumQualityLevel )) );
+	}
+
+	return encodings;
+}
+
+
+
+QVector<QByteArray> DemoFramebuffer::processFramebufferUpdate( const QByteArray& message, const QVector<int>& qualityLevels,
+															   int serverQualityLevel )
+{
+	if( message.size() < sz_rfbFramebufferUpdateMsg )
+	{
+		return {};
+	}
+
+	const auto data = message.constData();
+
+	rfbFramebufferUpdateMsg header;
+	memcpy( &header, data, sz_rfbFramebufferUpdateMsg ); // Flawfinder: ignore
+
+	const auto nRects = qFromBigEndian( header.nRects );
+
+	QVector<QByteArray> updates( qualityLevels.count(), QByteArray( sz_rfbFramebufferUpdateMsg, 0 ) );
+	QVector<int> rectCounts( qualityLevels.count(), 0 );
+
+	// updates only have to be encoded for quality levels other than the one of the VNC server
+	QVector<int> encodedUpdates;
+	QVector<int> forwardedUpdates;
+	for( int i = 0; i < qualityLevels.count(); ++i )
+	{
+		( qualityLevels[i] == serverQualityLevel ? forwardedUpdates : encodedUpdates ).append( i );
+	}
+
+	auto forwardable = true;
+	auto resized = false;
+	QRegion changedRegion;
+	QRegion updatedRegion;
+	qint64 offset = sz_rfbFramebufferUpdateMsg;
+
+	for( int i = 0; i < nRects && offset + sz_rfbFramebufferUpdateRectHeader <= message.size(); ++i )
+	{
+		rfbFramebufferUpdateRectHeader rectHeader;
+		memcpy( &rectHeader, data + offset, sz_rfbFramebufferUpdateRectHeader ); // Flawfinder: ignore
+		offset += sz_rfbFramebufferUpdateRectHeader;
+
+		const auto encoding = qFromBigEndian( rectHeader.encoding );
+		const QRect rect( qFromBigEndian( rectHeader.r.x ), qFromBigEndian( rectHeader.r.y ),
+						  qFromBigEndian( rectHeader.r.w ), qFromBigEndian( rectHeader.r.h ) );
+
+		if( encoding == rfbEncodingLastRect )
+		{
+			break;
+		}
+
+		if( encoding == rfbEncodingNewFBSize )
+		{
+			resize( rect.size() );
+			for( const auto index : std::as_const(encodedUpdates) )
+			{
+				appendRectHeader( updates[index], m_framebuffer.rect(), rfbEncodingNewFBSize );
+				++rectCounts[index];
+			}
+			resized = true;
+			changedRegion = {};
+			continue;
+		}
+
+		if( encoding == rfbEncodingCopyRect && offset + sz_rfbCopyRect <= message.size() )
+		{
+			rfbCopyRect copyRectData;
+			memcpy( &copyRectData, data + offset, sz_rfbCopyRect ); // Flawfinder: ignore
+			offset += sz_rfbCopyRect;
+
+			const QPoint source( qFromBigEndian( copyRectData.srcX ), qFromBigEndian( copyRectData.srcY ) );
+
+			if( m_framebuffer.rect().contains( rect ) &&
+				m_framebuffer.rect().contains( QRect( source, rect.size() ) ) )
+			{
+				// clients have to receive all pending changes before copying
+				appendRegion( updates, rectCounts, qualityLevels, encodedUpdates, std::exchange( changedRegion, {} ) );
+
+				for( const auto index : std::as_const(encodedUpdates) )
+				{
+					appendRectHeader( updates[index], rect, rfbEncodingCopyRect );
+					updates[index].append( reinterpret_cast<const char *>( &copyRectData ), sz_rfbCopyRect );
+					++rectCounts[index];
+				}
+
+				copyRect( source, rect );
+				updatedRegion += rect;
+			}
+			continue;
+		}
+
+		if( m_framebuffer.rect().contains( rect ) == false )
+		{
+			m_fullUpdateRequired = true;
+			forwardable = false;
+			break;
+		}
+
+		auto decoded = false;
+
+		if( encoding == rfbEncodingRaw )
+		{
+			const auto rectDataSize = qint64(rect.width()) * rect.height() * 4;
+			if( offset + rectDataSize <= message.size() )
+			{
+				copyRawRect( data + offset, rect );
+				offset += rectDataSize;
+				decoded = true;
+			}
+		}
+		else if( encoding == rfbEncodingTight )
+		{
+			auto selfContained = true;
+			decoded = decodeTightRect( message, offset, rect, selfContained );
+			forwardable = forwardable && selfContained;
+		}
+
+		// rects of other encodings may still arrive right after switching encodings and can't be
+		// skipped without decoding them, and the rest of a rect which failed to decode is unknown
+		if( decoded == false )
+		{
+			m_fullUpdateRequired = true;
+			forwardable = false;
+			break;
+		}
+
+		changedRegion += rect;
+		updatedRegion += rect;
+	}
+
+	if( resized || updatedRegion.isEmpty() == false )
+	{
+		++m_generation;
+	}
+
+	appendRegion( updates, rectCounts, qualityLevels, encodedUpdates, changedRegion );
+
+	for( const auto index : std::as_const(forwardedUpdates) )
+	{
+		if( forwardable )
+		{
+			updates[index] = message;
+			continue;
+		}
+
+		// encode the final state of everything touched by this update instead
+		if( resized )
+		{
+			appendRectHeader( updates[index], m_framebuffer.rect(), rfbEncodingNewFBSize );
+			rectCounts[index] = 1;
+			updatedRegion = m_framebuffer.rect();
+		}
+
+		appendRegion( updates, rectCounts, qualityLevels, { index }, updatedRegion );
+	}
+
+	for( int i = 0; i < updates.count(); ++i )
+	{
+		if( forwardable && forwardedUpdates.contains( i ) )
+		{
+			continue;
+		}
+
+		if( rectCounts[i] == 0 )
+		{
+			updates[i].clear();
+		}
+		else
+		{
+			finishMessage( updates[i], rectCounts[i] );
+		}
+	}
+
+	return updates;
+}
+
+
+
+QByteArray DemoFramebuffer::keyFrame( int qualityLevel )
+{
+	if( m_framebuffer.isNull() )
+	{
+		return {};
+	}
+
+	// encode the whole framebuffer only once per quality level as long as it does not change
+	auto& cachedKeyFrame = m_keyFrames[qualityLevel];
+	if( cachedKeyFrame.message.isEmpty() == false && cachedKeyFrame.generation == m_generation )
+	{
+		return cachedKeyFrame.message;
+	}
+
+	QByteArray update;
+	update.append( sz_rfbFramebufferUpdateMsg, 0 );
+
+	// let clients which joined with an outdated server init message adapt their framebuffer first
+	appendRectHeader( update, m_framebuffer.rect(), rfbEncodingNewFBSize );
+
+	finishMessage( update, 1 + appendRect( update, m_framebuffer.rect(), qualityLevel ) );
+
+	cachedKeyFrame.generation = m_generation;
+	cachedKeyFrame.message = update;
+
+	return update;
+}
+
+
+
+void DemoFramebuffer::resize( QSize size )
+{
+	if( size.isEmpty() == false && size != m_framebuffer.size() )
+	{
+		m_framebuffer = QImage( size, QImage::Format_RGB32 );
+		m_framebuffer.fill( Qt::black );
+		++m_generation;
+		m_fullUpdateRequired = true;
+	}
+}
+
+
+
+void DemoFramebuffer::copyRawRect( const char* data, const QRect& rect )
+{
+	const auto source = reinterpret_cast<const quint32 *>( data );
+	const auto width = rect.width();
+
+	for( int y = 0; y < rect.height(); ++y )
+	{
+		const auto sourceLine = source + y * width;
+		auto destinationLine = reinterpret_cast<quint32 *>( m_framebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+		// the padding byte is undefined in the RFB pixel format but has to be opaque for QImage
+		for( int x = 0; x < width; ++x )
+		{
+			destinationLine[x] = sourceLine[x] | 0xff000000;
+		}
+	}
+}
+
+
+
+void DemoFramebuffer::copyRect( QPoint source, const QRect& rect )
+{
+	const auto width = rect.width();
+
+	// copy lines in an order which doesn't overwrite source lines not copied yet
+	const auto upwards = source.y() < rect.y();
+
+	for( int i = 0; i < rect.height(); ++i )
+	{
+		const auto y = upwards ? rect.height() - 1 - i : i;
+		const auto sourceLine = reinterpret_cast<const quint32 *>( m_framebuffer.constScanLine( source.y() + y ) ) + source.x();
+		auto destinationLine = reinterpret_cast<quint32 *>( m_framebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+		memmove( destinationLine, sourceLine, size_t(width) * sizeof(quint32) ); // Flawfinder: ignore
+	}
+}
+
+
+
+bool DemoFramebuffer::decodeTightRect( const QByteArray& message, qint64& offset, const QRect& rect, bool& selfContained )
+{
+	const auto data = message.constData();
+	const auto size = message.size();
+
+	if( offset >= size )
+	{
+		return false;
+	}
+
+	auto compressionControl = uint8_t(data[offset++]);
+
+	// reset zlib streams as told by the server
+	for( int i = 0; i < ZlibStreamCount; ++i )
+	{
+		if( ( compressionControl & 1 ) && m_zlibStreamActive[i] )
+		{
+			inflateEnd( &m_zlibStreams[i] );
+			m_zlibStreamActive[i] = false;
+		}
+		compressionControl >>= 1;
+	}
+
+	auto compressed = true;
+	if( ( compressionControl & rfbTightNoZlib ) == rfbTightNoZlib )
+	{
+		compressionControl &= ~rfbTightNoZlib;
+		compressed = false;
+	}
+
+	if( compressionControl == rfbTightFill )
+	{
+		if( offset + TightPixelSize > size )
+		{
+			return false;
+		}
+		const auto pixel = tightPixel( data + offset );
+		offset += TightPixelSize;
+
+		for( int y = rect.top(); y <= rect.bottom(); ++y )
+		{
+			std::fill_n( reinterpret_cast<QRgb *>( m_framebuffer.scanLine( y ) ) + rect.x(), rect.width(), pixel );
+		}
+		return true;
+	}
+
+	if( compressionControl == rfbTightJpeg )
+	{
+		return decodeTightJpegRect( message, offset, rect );
+	}
+
+	if( compressionControl > rfbTightMaxSubencoding )
+	{
+		return false;
+	}
+
+	uint8_t filter = rfbTightFilterCopy;
+	if( compressionControl & rfbTightExplicitFilter )
+	{
+		if( offset >= size )
+		{
+			return false;
+		}
+		filter = uint8_t(data[offset++]);
+	}
+
+	QVector<QRgb> palette;
+	auto bitsPerPixel = TightPixelSize * 8;
+
+	if( filter == rfbTightFilterPalette )
+	{
+		if( offset >= size )
+		{
+			return false;
+		}
+
+		const auto colorCount = int(uint8_t(data[offset++])) + 1;
+		if( colorCount < 2 || offset + colorCount * TightPixelSize > size )
+		{
+			return false;
+		}
+
+		palette.reserve( colorCount );
+		for( int i = 0; i < colorCount; ++i )
+		{
+			palette.append( tightPixel( data + offset ) );
+			offset += TightPixelSize;
+		}
+
+		bitsPerPixel = colorCount == 2 ? 1 : 8;
+	}
+	else if( filter != rfbTightFilterCopy && filter != rfbTightFilterGradient )
+	{
+		return false;
+	}
+
+	const auto rowSize = ( rect.width() * bitsPerPixel + 7 ) / 8;
+	const auto dataSize = rect.height() * rowSize;
+
+	QByteArray pixelData;
+
+	if( dataSize < MinimumCompressedDataSize )
+	{
+		if( offset + dataSize > size )
+		{
+			return false;
+		}
+		pixelData = message.mid( offset, dataSize );
+		offset += dataSize;
+	}
+	else
+	{
+		int length = 0;
+		if( readCompactLength( message, offset, length ) == false || offset + length > size )
+		{
+			return false;
+		}
+
+		if( compressed )
+		{
+			// data can only be decompressed with the state of the zlib stream of our connection
+			selfContained = false;
+
+			pixelData.resize( dataSize );
+			if( inflateTightData( compressionControl & 0x03, data + offset, length, pixelData ) == false )
+			{
+				return false;
+			}
+		}
+		else
+		{
+			pixelData = message.mid( offset, length );
+		}
+
+		offset += length;
+	}
+
+	if( pixelData.size() < dataSize )
+	{
+		return false;
+	}
+
+	const auto pixels = reinterpret_cast<const uint8_t *>( pixelData.constData() );
+
+	if( filter == rfbTightFilterPalette )
+	{
+		for( int y = 0; y < rect.height(); ++y )
+		{
+			const auto row = pixels + y * rowSize;
+			auto line = reinterpret_cast<QRgb *>( m_framebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+			for( int x = 0; x < rect.width(); ++x )
+			{
+				const auto index = bitsPerPixel == 1 ? ( row[x / 8] >> ( 7 - x % 8 ) ) & 1 : row[x];
+				line[x] = palette.value( index, palette.first() );
+			}
+		}
+	}
+	else if( filter == rfbTightFilterGradient )
+	{
+		// each pixel has been encoded as the difference to a prediction from its left and upper neighbours
+		QVector<int> previousRow( ( rect.width() + 1 ) * TightPixelSize, 0 );
+		QVector<int> currentRow( ( rect.width() + 1 ) * TightPixelSize, 0 );
+
+		for( int y = 0; y < rect.height(); ++y )
+		{
+			const auto row = pixels + y * rowSize;
+			auto line = reinterpret_cast<QRgb *>( m_framebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+			for( int x = 0; x < rect.width(); ++x )
+			{
+				int components[TightPixelSize];
+				for( int c = 0; c < TightPixelSize; ++c )
+				{
+					const auto left = x > 0 ? currentRow[( x - 1 ) * TightPixelSize + c] : 0;
+					const auto upperLeft = x > 0 ? previousRow[( x - 1 ) * TightPixelSize + c] : 0;
+					const auto prediction = qBound( 0, previousRow[x * TightPixelSize + c] + left - upperLeft, 0xff );
+					components[c] = ( prediction + row[x * TightPixelSize + c] ) & 0xff;
+					currentRow[x * TightPixelSize + c] = components[c];
+				}
+				line[x] = qRgb( components[0], components[1], components[2] );
+			}
+
+			std::swap( previousRow, currentRow );
+		}
+	}
+	else
+	{
+		for( int y = 0; y < rect.height(); ++y )
+		{
+			const auto row = pixelData.constData() + y * rowSize;
+			auto line = reinterpret_cast<QRgb *>( m_framebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+			for( int x = 0; x < rect.width(); ++x )
+			{
+				line[x] = tightPixel( row + x * TightPixelSize );
+			}
+		}
+	}
+
+	return true;
+}
+
+
+
+bool DemoFramebuffer::decodeTightJpegRect( const QByteArray& message, qint64& offset, const QRect& rect )
+{
+	int length = 0;
+	if( readCompactLength( message, offset, length ) == false || offset + length > message.size() )
+	{
+		return false;
+	}
+
+	QImage image;
+	const auto loaded = image.loadFromData( reinterpret_cast<const uchar *>( message.constData() + offset ), length, "JPG" );
+	offset += length;
+
+	if( loaded == false || image.size() != rect.size() )
+	{
+		return false;
+	}
+
+	image = image.convertToFormat( QImage::Format_RGB32 );
+
+	for( int y = 0; y < rect.height(); ++y )
+	{
+		memcpy( reinterpret_cast<QRgb *>( m_framebuffer.scanLine( rect.y() + y ) ) + rect.x(), // Flawfinder: ignore
+				image.constScanLine( y ), size_t(rect.width()) * sizeof(QRgb) );
+	}
+
+	return true;
+}
+
+
+
+bool DemoFramebuffer::inflateTightData( int streamId, const char* data, int size, QByteArray& output )
+{
+	auto& stream = m_zlibStreams[streamId];
+
+	if( m_zlibStreamActive[streamId] == false )
+	{
+		stream.zalloc = Z_NULL;
+		stream.zfree = Z_NULL;
+		stream.opaque = Z_NULL;
+		stream.next_in = Z_NULL;
+		stream.avail_in = 0;
+
+		if( inflateInit( &stream ) != Z_OK )
+		{
+			return false;
+		}
+
+		m_zlibStreamActive[streamId] = true;
+	}
+
+	stream.next_in = reinterpret_cast<Bytef *>( const_cast<char *>( data ) );
+	stream.avail_in = uInt(size);
+	stream.next_out = reinterpret_cast<Bytef *>( output.data() );
+	stream.avail_out = uInt(output.size());
+
+	const auto result = inflate( &stream, Z_SYNC_FLUSH );
+
+	return ( result == Z_OK || result == Z_STREAM_END ) && stream.avail_out == 0;
+}
+
+
+
+void DemoFramebuffer::appendRegion( QVector<QByteArray>& messages, QVector<int>& rectCounts,
+									const QVector<int>& qualityLevels, const QVector<int>& indices,
+									const QRegion& region ) const
+{
+	if( region.isEmpty() || indices.isEmpty() )
+	{
+		return;
+	}
+
+	QVector<QRect> rects;
+	if( region.rectCount() > MaximumRectCount )
+	{
+		rects.append( region.boundingRect() );
+	}
+	else
+	{
+		rects.reserve( region.rectCount() );
+		for( const auto& rect : region )
+		{
+			rects.append( rect );
+		}
+	}
+
+	for( const auto index : indices )
+	{
+		for( const auto& rect : std::as_const(rects) )
+		{
+			rectCounts[index] += appendRect( messages[index], rect, qualityLevels[index] );
+		}
+	}
+}
+
+
+
+int DemoFramebuffer::appendRect( QByteArray& message, const QRect& rect, int qualityLevel ) const
+{
+	static constexpr int JpegQualities[] = { 5, 10, 15, 25, 37, 50, 60, 70, 75, 80 };
+
+	const auto jpegQuality = qualityLevel == LosslessQualityLevel ?
+								 -1 : JpegQualities[qBound( MinimumQualityLevel, qualityLevel, MaximumQualityLevel )];
+
+	int rectCount = 0;
+
+	// split large rects like the Tight encoder of the VNC server does
+	for( int y = rect.top(); y <= rect.bottom(); y += MaximumRectHeight )
+	{
+		for( int x = rect.left(); x <= rect.right(); x += MaximumRectWidth )
+		{
+			const auto tile = QRect( x, y, MaximumRectWidth, MaximumRectHeight ).intersected( rect );
+
+			// JPEG headers outweigh the savings for tiny rects
+			if( appendTightFillRect( message, tile ) == false &&
+				( jpegQuality < 0 || tile.width() * tile.height() < MinimumJpegRectArea ||
+				  appendTightJpegRect( message, tile, jpegQuality ) == false ) )
+			{
+				appendTightBasicRect( message, tile );
+			}
+
+			++rectCount;
+		}
+	}
+
+	return rectCount;
+}
+
+
+
+bool DemoFramebuffer::appendTightFillRect( QByteArray& message, const QRect& rect ) const
+{
+	const auto color = m_framebuffer.pixel( rect.topLeft() );
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		const auto line = reinterpret_cast<const QRgb *>( m_framebuffer.constScanLine( y ) ) + rect.x();
+		if( std::any_of( line, line + rect.width(), [color]( QRgb pixel ) { return pixel != color; } ) )
+		{
+			return false;
+		}
+	}
+
+	appendRectHeader( message, rect, rfbEncodingTight );
+	message.append( char( rfbTightFill << 4 ) );
+	appendTightPixel( message, color );
+
+	return true;
+}
+
+
+
+void DemoFramebuffer::appendTightBasicRect( QByteArray& message, const QRect& rect ) const
+{
+	QByteArray pixelData;
+	pixelData.reserve( rect.width() * rect.height() * TightPixelSize );
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		const auto line = reinterpret_cast<const QRgb *>( m_framebuffer.constScanLine( y ) ) + rect.x();
+		for( int x = 0; x < rect.width(); ++x )
+		{
+			appendTightPixel( pixelData, line[x] );
+		}
+	}
+
+	appendRectHeader( message, rect, rfbEncodingTight );
+
+	if( pixelData.size() < MinimumCompressedDataSize )
+	{
+		// tiny rects are sent uncompressed without length
+		message.append( char(0) );
+		message.append( pixelData );
+		return;
+	}
+
+	auto compressedSize = compressBound( uLong(pixelData.size()) );
+	QByteArray compressedData( int(compressedSize), Qt::Uninitialized );
+
+	if( compress2( reinterpret_cast<Bytef *>( compressedData.data() ), &compressedSize,
+				   reinterpret_cast<const Bytef *>( pixelData.constData() ), uLong(pixelData.size()),
+				   ZlibCompressionLevel ) != Z_OK )
+	{
+		// send uncompressed data if zlib fails for whatever reason
+		message.append( char( rfbTightNoZlib << 4 ) );
+		appendCompactLength( message, pixelData.size() );
+		message.append( pixelData );
+		return;
+	}
+
+	// each rect is compressed as a complete zlib stream on its own, so let clients reset stream 0 first
+	// to be able to decode it regardless of which updates they have received before
+	message.append( char(0x01) );
+	appendCompactLength( message, int(compressedSize) );
+	message.append( compressedData.constData(), int(compressedSize) );
+}
+
+
+
+bool DemoFramebuffer::appendTightJpegRect( QByteArray& message, const QRect& rect, int jpegQuality ) const
+{
+	static constexpr auto MaximumCompactLength = ( 1 << 22 ) - 1;
+
+	QByteArray jpegData;
+	QBuffer buffer( &jpegData );
+	buffer.open( QBuffer::WriteOnly ); // Flawfinder: ignore
+
+	if( m_framebuffer.copy( rect ).save( &buffer, "JPG", jpegQuality ) == false ||
+		jpegData.size() > MaximumCompactLength )
+	{
+		return false;
+	}
+
+	appendRectHeader( message, rect, rfbEncodingTight );
+
+	message.append( char( rfbTightJpeg << 4 ) );
+	appendCompactLength( message, jpegData.size() );
+	message.append( jpegData );
+
+	return true;
+}
+
+
+
+bool DemoFramebuffer::readCompactLength( const QByteArray& message, qint64& offset, int& length )
+{
+	// length is transmitted in a compact representation with 7 bits per byte
+	length = 0;
+
+	for( int i = 0; i < 3; ++i )
+	{
+		if( offset >= message.size() )
+		{
+			return false;
+		}
+
+		const auto byte = int(uint8_t(message[int(offset++)]));
+		if( i == 2 )
+		{
+			length |= byte << 14;
+			break;
+		}
+
+		length |= ( byte & 0x7f ) << ( 7 * i );
+		if( ( byte & 0x80 ) == 0 )
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+
+
+void DemoFramebuffer::appendCompactLength( QByteArray& message, int length )
+{
+	message.append( char( ( length & 0x7f ) | ( length > 0x7f ? 0x80 : 0 ) ) );
+	if( length > 0x7f )
+	{
+		message.append( char( ( ( length >> 7 ) & 0x7f ) | ( length > 0x3fff ? 0x80 : 0 ) ) );
+		if( length > 0x3fff )
+		{
+			message.append( char( ( length >> 14 ) & 0xff ) );
+		}
+	}
+}
+
+
+
+void DemoFramebuffer::appendTightPixel( QByteArray& message, QRgb pixel )
+{
+	// Tight sends 24 bit colors as three bytes in RGB order
+	message.append( char( qRed( pixel ) ) );
+	message.append( char( qGreen( pixel ) ) );
+	message.append( char( qBlue( pixel ) ) );
+}
+
+
+
+QRgb DemoFramebuffer::tightPixel( const char* data )
+{
+	return qRgb( uint8_t(data[0]), uint8_t(data[1]), uint8_t(data[2]) );
+}
+
+
+
+void DemoFramebuffer::appendRectHeader( QByteArray& message, const QRect& rect, uint32_t encoding )
+{
+	rfbFramebufferUpdateRectHeader rectHeader;
+	rectHeader.r.x = qToBigEndian<uint16_t>( rect.x() );
+	rectHeader.r.y = qToBigEndian<uint16_t>( rect.y() );
+	rectHeader.r.w = qToBigEndian<uint16_t>( rect.width() );
+	rectHeader.r.h = qToBigEndian<uint16_t>( rect.height() );
+	rectHeader.encoding = qToBigEndian<uint32_t>( encoding );
+
+	message.append( reinterpret_cast<const char *>( &rectHeader ), sz_rfbFramebufferUpdateRectHeader );
+}
+
+
+
+void DemoFramebuffer::finishMessage( QByteArray& message, int rectCount )
+{
+	rfbFramebufferUpdateMsg header{};
+	header.type = rfbFramebufferUpdate;
+
+	// 0xffff rects means the update is terminated by a LastRect pseudo rect
+	if( rectCount >= 0xffff )
+	{
+		appendRectHeader( message, {}, rfbEncodingLastRect );
+		rectCount = 0xffff;
+	}
+
+	header.nRects = qToBigEndian<uint16_t>( rectCount );
+	memcpy( message.data(), &header, sz_rfbFramebufferUpdateMsg ); // Flawfinder: ignore
+}
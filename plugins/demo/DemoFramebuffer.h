@@ -0,0 +1,130 @@
+/*
+ * DemoFramebuffer.h - declaration of DemoFramebuffer class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include <QHash>
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+#include <zlib.h>
+
+#include "rfb/rfbproto.h"
+
+/**
+ * \brief Up-to-date copy of the framebuffer shown to demo clients
+ *
+ * The VNC server is asked for Tight updates in the quality of the default quality tier. They are
+ * decoded into a local framebuffer and forwarded to the clients of that tier as they are, unless
+ * they depend on the state of zlib streams only the demo server knows. Clients of other quality
+ * tiers get updates encoded from the framebuffer, and key frames containing the whole screen are
+ * synthesized from it and cached until the framebuffer changes. All methods except
+ * takeFullUpdateRequirement() must be called from the same (non-GUI) thread.
+ */
+class DemoFramebuffer
+{
+public:
+	// rects are sent without lossy compression
+	static constexpr auto LosslessQualityLevel = -1;
+	static constexpr auto MinimumQualityLevel = 0;
+	static constexpr auto MaximumQualityLevel = 9;
+
+	DemoFramebuffer();
+	~DemoFramebuffer();
+
+	static QVector<uint32_t> serverEncodings( int qualityLevel );
+
+	QSize size() const
+	{
+		return m_framebuffer.size();
+	}
+
+	void resize( QSize size );
+
+	// may be called from any thread
+	bool takeFullUpdateRequirement()
+	{
+		return m_fullUpdateRequired.exchange( false );
+	}
+
+	// applies an update received from the VNC server and returns the update to send to demo clients
+	// for each of the given quality levels - the update is passed on unmodified for the quality level
+	// requested from the VNC server whenever clients are able to decode it
+	QVector<QByteArray> processFramebufferUpdate( const QByteArray& message, const QVector<int>& qualityLevels,
+												  int serverQualityLevel );
+
+	// returns an update which transfers the whole framebuffer including its size
+	QByteArray keyFrame( int qualityLevel );
+
+private:
+	static constexpr auto MaximumRectCount = 32;
+	static constexpr auto MaximumRectWidth = 2048;
+	static constexpr auto MaximumRectHeight = 256;
+	static constexpr auto MinimumJpegRectArea = 16*16;
+	static constexpr auto MinimumCompressedDataSize = 12;
+	static constexpr auto ZlibStreamCount = 4;
+	static constexpr auto ZlibCompressionLevel = 6;
+	static constexpr auto TightPixelSize = 3;
+
+	struct CachedKeyFrame
+	{
+		quint64 generation{0};
+		QByteArray message;
+	};
+
+	void copyRawRect( const char* data, const QRect& rect );
+	void copyRect( QPoint source, const QRect& rect );
+
+	bool decodeTightRect( const QByteArray& message, qint64& offset, const QRect& rect, bool& selfContained );
+	bool decodeTightJpegRect( const QByteArray& message, qint64& offset, const QRect& rect );
+	bool inflateTightData( int streamId, const char* data, int size, QByteArray& output );
+
+	void appendRegion( QVector<QByteArray>& messages, QVector<int>& rectCounts, const QVector<int>& qualityLevels,
+					   const QVector<int>& indices, const QRegion& region ) const;
+	int appendRect( QByteArray& message, const QRect& rect, int qualityLevel ) const;
+	bool appendTightFillRect( QByteArray& message, const QRect& rect ) const;
+	void appendTightBasicRect( QByteArray& message, const QRect& rect ) const;
+	bool appendTightJpegRect( QByteArray& message, const QRect& rect, int jpegQuality ) const;
+
+	static bool readCompactLength( const QByteArray& message, qint64& offset, int& length );
+	static void appendCompactLength( QByteArray& message, int length );
+	static void appendTightPixel( QByteArray& message, QRgb pixel );
+	static QRgb tightPixel( const char* data );
+	static void appendRectHeader( QByteArray& message, const QRect& rect, uint32_t encoding );
+	static void finishMessage( QByteArray& message, int rectCount );
+
+	QImage m_framebuffer;
+	quint64 m_generation{0};
+	QHash<int, CachedKeyFrame> m_keyFrames;
+
+	z_stream m_zlibStreams[ZlibStreamCount];
+	bool m_zlibStreamActive[ZlibStreamCount]{};
+
+	std::atomic<bool> m_fullUpdateRequired{false};
+
+} ;
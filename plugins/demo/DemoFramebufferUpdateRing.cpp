@@ -0,0 +1,120 @@
+/*
+ * DemoFramebufferUpdateRing.cpp - implementation of DemoFramebufferUpdateRing class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "DemoFramebufferUpdateRing.h"
+
+
+void DemoFramebufferUpdateRing::append( const QByteArray& message )
+{
+	const auto sequence = m_head.load( std::memory_order_relaxed );
+	auto tail = m_tail.load( std::memory_order_relaxed );
+
+	// make room by releasing the oldest messages - readers which did not send them yet
+	// notice the gap and continue with a key frame instead of incomplete incremental updates
+	while( tail < sequence &&
+		   ( sequence - tail >= Capacity || m_size + message.size() > m_memoryLimit ) )
+	{
+		m_tail.store( tail + 1, std::memory_order_release );
+		releaseSlots( tail, tail + 1 );
+		++tail;
+	}
+
+	auto& slot = m_slots[sequence & ( Capacity - 1 )];
+
+	slot.mutex.lock();
+	slot.sequence = sequence;
+	slot.message = message;
+	slot.mutex.unlock();
+
+	m_size += message.size();
+
+	m_head.store( sequence + 1, std::memory_order_release );
+}
+
+
+
+void DemoFramebufferUpdateRing::invalidate()
+{
+	const auto head = m_head.load( std::memory_order_relaxed );
+	const auto tail = m_tail.load( std::memory_order_relaxed );
+
+	// skip one sequence so even readers which are up to date notice the discontinuity
+	m_tail.store( head + 1, std::memory_order_release );
+	releaseSlots( tail, head );
+	m_head.store( head + 1, std::memory_order_release );
+}
+
+
+
+DemoFramebufferUpdateRing::ReadResult DemoFramebufferUpdateRing::read( Sequence& cursor, MessageList& messages ) const
+{
+	messages.clear();
+
+	const auto tail = m_tail.load( std::memory_order_acquire );
+	const auto head = m_head.load( std::memory_order_acquire );
+
+	// never continue with whatever happens to be the oldest message as the updates
+	// in between would be missing
+	if( cursor < tail || cursor > head )
+	{
+		return ReadResult::KeyFrameMissing;
+	}
+
+	for( auto sequence = cursor; sequence < head; ++sequence )
+	{
+		const auto& slot = m_slots[sequence & ( Capacity - 1 )];
+
+		QMutexLocker locker( &slot.mutex );
+		if( slot.sequence != sequence )
+		{
+			// released while reading
+			messages.clear();
+			return ReadResult::KeyFrameMissing;
+		}
+
+		messages.append( slot.message );
+	}
+
+	cursor = head;
+
+	return messages.isEmpty() ? ReadResult::NoMessages : ReadResult::Messages;
+}
+
+
+
+void DemoFramebufferUpdateRing::releaseSlots( Sequence begin, Sequence end )
+{
+	for( auto sequence = begin; sequence < end; ++sequence )
+	{
+		auto& slot = m_slots[sequence & ( Capacity - 1 )];
+
+		QMutexLocker locker( &slot.mutex );
+		if( slot.sequence == sequence )
+		{
+			m_size -= slot.message.size();
+			slot.sequence = InvalidSequence;
+			slot.message.clear();
+		}
+	}
+}
@@ -0,0 +1,119 @@
+/*
+ * DemoFramebufferUpdateRing.h - declaration of DemoFramebufferUpdateRing class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QVector>
+
+#include <array>
+#include <atomic>
+#include <limits>
+
+/**
+ * \brief Append-only ring of encoded framebuffer updates shared by all demo clients
+ *
+ * The demo server appends each framebuffer update message exactly once while every client
+ * connection keeps its own cursor into the ring and sends everything between its cursor and the
+ * head. Messages are implicitly shared so sending them does not copy any data. The ring only
+ * contains incremental updates. Once it is full or exceeds its memory limit, the oldest messages
+ * are released and clients which did not send them yet have to continue with a key frame provided
+ * separately. Slots are guarded individually so readers never block the writer for more than
+ * copying a single message reference.
+ */
+class DemoFramebufferUpdateRing
+{
+public:
+	using Sequence = quint64;
+	using MessageList = QVector<QByteArray>;
+
+	enum class ReadResult {
+		NoMessages,
+		Messages,
+		// messages following the cursor have been released - reader has to continue with a key frame
+		KeyFrameMissing
+	};
+
+	static constexpr int Capacity = 4096;
+
+	DemoFramebufferUpdateRing() = default;
+
+	// must be called before appending any messages
+	void setMemoryLimit( qint64 memoryLimit )
+	{
+		m_memoryLimit = memoryLimit;
+	}
+
+	// must only be called from one thread
+	void append( const QByteArray& message );
+
+	// releases all messages after a discontinuity so all readers have to continue with a key frame
+	// matching the current head, must only be called from the appending thread
+	void invalidate();
+
+	Sequence head() const
+	{
+		return m_head.load( std::memory_order_acquire );
+	}
+
+	// sequence of the oldest message still available
+	Sequence tail() const
+	{
+		return m_tail.load( std::memory_order_acquire );
+	}
+
+	// returns whether all messages following the given sequence are available
+	bool contains( Sequence sequence ) const
+	{
+		return sequence >= tail() && sequence <= head();
+	}
+
+	// may be called from any thread
+	ReadResult read( Sequence& cursor, MessageList& messages ) const;
+
+private:
+	static_assert( ( Capacity & ( Capacity - 1 ) ) == 0, "Capacity has to be a power of two" );
+
+	static constexpr Sequence InvalidSequence = std::numeric_limits<Sequence>::max();
+
+	struct Slot
+	{
+		mutable QMutex mutex;
+		Sequence sequence{InvalidSequence};
+		QByteArray message;
+	};
+
+	void releaseSlots( Sequence begin, Sequence end );
+
+	std::array<Slot, Capacity> m_slots;
+
+	std::atomic<Sequence> m_head{0};
+	std::atomic<Sequence> m_tail{0};
+
+	// only accessed by the writing thread
+	qint64 m_memoryLimit{std::numeric_limits<qint64>::max()};
+	qint64 m_size{0};
+
+} ;
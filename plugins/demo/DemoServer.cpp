@@ -26,6 +26,7 @@
 #include "rfb/rfbproto.h"
 
 #include <QTcpSocket>
+#include <QThread>
 
 #include "DemoConfiguration.h"
 #include "DemoServer.h"
@@ -37,18 +38,38 @@
 
 DemoServer::DemoServer( int vncServerPort, const Password& vncServerPassword, const Password& demoAccessToken,
 						const DemoConfiguration& configuration, int demoServerPort, QObject *parent ) :
+	DemoServer( QHostAddress( QHostAddress::LocalHost ).toString(), vncServerPort, vncServerPassword,
+				demoAccessToken, false, configuration, demoServerPort, parent )
+{
+}
+
+
+
+DemoServer::DemoServer( const QString& upstreamDemoServerHost, int upstreamDemoServerPort, const Password& demoAccessToken,
+						const DemoConfiguration& configuration, int demoServerPort, QObject *parent ) :
+	DemoServer( upstreamDemoServerHost, upstreamDemoServerPort, {},
+				demoAccessToken, true, configuration, demoServerPort, parent )
+{
+}
+
+
+
+DemoServer::DemoServer( const QString& vncServerHost, int vncServerPort, const Password& vncServerPassword,
+						const Password& demoAccessToken, bool relay,
+						const DemoConfiguration& configuration, int demoServerPort, QObject *parent ) :
 	QTcpServer( parent ),
 	m_configuration( configuration ),
 	m_memoryLimit(m_configuration.memoryLimit() * BytesPerMB),
 	m_keyFrameInterval( m_configuration.keyFrameInterval() * 1000 ),
+	m_vncServerHost( vncServerHost ),
 	m_vncServerPort( vncServerPort ),
+	m_relay( relay ),
 	m_demoAccessToken( demoAccessToken ),
 	m_vncServerSocket( new QTcpSocket( this ) ),
 	m_vncClientProtocol( new VncClientProtocol( m_vncServerSocket, vncServerPassword ) ),
 	m_framebufferUpdateTimer( this ),
-	m_lastFullFramebufferUpdate(),
-	m_requestFullFramebufferUpdate( false ),
-	m_keyFrame(0)
+	m_qualityTierUpdateTimer( this ),
+	m_requestFullFramebufferUpdate( false )
 {
 	auto bandwidthLimit = m_configuration.bandwidthLimit();
 	if (bandwidthLimit == DefaultBandwidthLimit)
@@ -71,12 +92,46 @@ DemoServer::DemoServer( int vncServerPort, const Password& vncServerPassword, co
 		}
 	}
 
-	m_maxKBytesPerSecond = qMax(1, bandwidthLimit) * BytesPerKB;
+	m_maxBytesPerSecond = qint64(qMax(1, bandwidthLimit)) * BytesPerMB;
+
+	// quality levels and bitrates relative to each other as a rough guess for tiers not encoded yet
+	static constexpr std::pair<int, int> QualityTierParameters[QualityTierCount] = {
+		{ DemoFramebuffer::LosslessQualityLevel, 32 },
+		{ 9, 4 },
+		{ 6, 2 },
+		{ 2, 1 }
+	};
+
+	for( int i = 0; i < QualityTierCount; ++i )
+	{
+		m_qualityTiers[i].qualityLevel = QualityTierParameters[i].first;
+		m_qualityTiers[i].relativeBitrate = QualityTierParameters[i].second;
+		m_qualityTiers[i].updates.setMemoryLimit( m_memoryLimit );
+	}
+
+	m_qualityTiers[int(QualityTier::Lossless)].enabled = m_configuration.losslessQualityTier();
 
 	connect( m_vncServerSocket, &QTcpSocket::readyRead, this, &DemoServer::readFromVncServer );
 	connect( m_vncServerSocket, &QTcpSocket::disconnected, this, &DemoServer::reconnectToVncServer );
 
 	connect( &m_framebufferUpdateTimer, &QTimer::timeout, this, &DemoServer::requestFramebufferUpdate );
+	connect( &m_qualityTierUpdateTimer, &QTimer::timeout, this, &DemoServer::updateQualityTiers );
+
+	if( m_relay )
+	{
+		// authenticate at the upstream demo server the same way as demo clients do
+		m_vncClientProtocol->setAuthenticationToken( m_demoAccessToken );
+
+		// the upstream demo server may not be reachable yet or may have been restarted
+		connect( m_vncServerSocket, &QTcpSocket::errorOccurred, this, [this]() {
+			QTimer::singleShot( UpstreamReconnectDelay, this, [this]() {
+				if( m_vncServerSocket->state() == QAbstractSocket::UnconnectedState )
+				{
+					reconnectToVncServer();
+				}
+			} );
+		} );
+	}
 
 	if( listen( QHostAddress::Any, demoServerPort ) == false )
 	{
@@ -84,8 +139,23 @@ DemoServer::DemoServer( int vncServerPort, const Password& vncServerPassword, co
 		return;
 	}
 
+	startWorkerThreads();
+
+	if( m_relay == false )
+	{
+		startEncoderThread();
+	}
+
 	m_framebufferUpdateTimer.start( m_configuration.framebufferUpdateInterval() );
 
+	// quality tiers have been assigned by the upstream demo server already when relaying
+	if( m_relay == false )
+	{
+		m_qualityTierUpdateTimer.start( QualityTierUpdateInterval );
+	}
+	m_qualityTierStatisticsTimer.start();
+	m_keyFrameTimer.start();
+
 	reconnectToVncServer();
 }
 
@@ -93,6 +163,9 @@ DemoServer::DemoServer( int vncServerPort, const Password& vncServerPassword, co
 
 DemoServer::~DemoServer()
 {
+	stopConnections();
+	stopEncoderThread();
+
 	delete m_vncClientProtocol;
 	delete m_vncServerSocket;
 }
@@ -103,71 +176,188 @@ void DemoServer::terminate()
 {
 	m_vncServerSocket->disconnect( this );
 
-	const auto connections = findChildren<DemoServerConnection *>();
-	if( connections.isEmpty() )
+	stopConnections();
+
+	deleteLater();
+}
+
+
+
+const QByteArray& DemoServer::serverInitMessage() const
+{
+	return m_vncClientProtocol->serverInitMessage();
+}
+
+
+
+void DemoServer::incomingConnection( qintptr socketDescriptor )
+{
+	vDebug() << socketDescriptor;
+
+	m_pendingConnections.append( socketDescriptor );
+
+	if( m_vncClientProtocol->state() == VncClientProtocol::State::Running )
 	{
-		deleteLater();
+		acceptPendingConnections();
 	}
-	else
+}
+
+
+
+void DemoServer::acceptPendingConnections()
+{
+	while( m_pendingConnections.isEmpty() == false )
 	{
-		for( auto connection : connections )
-		{
-			connection->quit();
-		}
+		auto connection = new DemoServerConnection( this, m_demoAccessToken, m_pendingConnections.takeFirst() );
+
+		connect( connection, &DemoServerConnection::closed, this, [=]() { closeConnection( connection ); } );
+		connect( this, &DemoServer::framebufferUpdatesAvailable,
+				 connection, &DemoServerConnection::sendFramebufferUpdate );
+
+		const auto workerThread = leastLoadedWorkerThread();
 
-		for( auto connection : connections )
+		m_connections.append( connection );
+
+		if( workerThread )
 		{
-			connection->wait( ConnectionThreadWaitTime );
+			connection->moveToThread( workerThread );
 		}
 
-		QTimer::singleShot( TerminateRetryInterval, this, &DemoServer::terminate );
+		// set up the socket in the thread the connection lives in
+		QMetaObject::invokeMethod( connection, &DemoServerConnection::start, Qt::QueuedConnection );
+
+		assignQualityTier( connection, m_relay ? RelayQualityTier : DefaultQualityTier );
 	}
 }
 
 
 
-const QByteArray& DemoServer::serverInitMessage() const
+void DemoServer::closeConnection( DemoServerConnection* connection )
 {
-	return m_vncClientProtocol->serverInitMessage();
+	if( m_connections.removeAll( connection ) > 0 )
+	{
+		--m_qualityTiers[int(m_clientStates.take( connection ).tier)].clientCount;
+
+		connection->deleteLater();
+	}
 }
 
 
 
-void DemoServer::lockDataForRead()
+void DemoServer::stopConnections()
 {
-	QElapsedTimer readLockTimer;
-	readLockTimer.restart();
+	for( auto connection : std::as_const( m_connections ) )
+	{
+		if( connection->thread() == thread() )
+		{
+			delete connection;
+		}
+		else
+		{
+			// objects have to be deleted in the thread they live in
+			QMetaObject::invokeMethod( connection, [connection]() { delete connection; }, Qt::BlockingQueuedConnection );
+		}
+	}
 
-	m_dataLock.lockForRead();
+	m_connections.clear();
+	m_clientStates.clear();
 
-	if( readLockTimer.elapsed() > 100 )
+	for( auto& tier : m_qualityTiers )
 	{
-		vDebug() << "locking for read took" << readLockTimer.elapsed() << "ms in thread"
-				 << QThread::currentThreadId();
+		tier.clientCount = 0;
 	}
+
+	stopWorkerThreads();
 }
 
 
 
-void DemoServer::incomingConnection( qintptr socketDescriptor )
+void DemoServer::startWorkerThreads()
 {
-	vDebug() << socketDescriptor;
+	auto threadCount = m_configuration.workerThreadCount();
+	if( threadCount < 0 )
+	{
+		threadCount = qBound( 1, QThread::idealThreadCount() / 2, MaximumWorkerThreadCount );
+	}
 
-	m_pendingConnections.append( socketDescriptor );
+	for( int i = m_workerThreads.count(); i < threadCount; ++i )
+	{
+		auto thread = new QThread;
+		thread->setObjectName( QStringLiteral("DemoServerWorker%1").arg( i ) );
+		thread->start();
 
-	if( m_vncClientProtocol->state() == VncClientProtocol::State::Running )
+		m_workerThreads.append( thread );
+	}
+}
+
+
+
+void DemoServer::stopWorkerThreads()
+{
+	for( auto thread : std::as_const( m_workerThreads ) )
 	{
-		acceptPendingConnections();
+		thread->quit();
+		thread->wait();
+		delete thread;
 	}
+
+	m_workerThreads.clear();
 }
 
 
 
-void DemoServer::acceptPendingConnections()
+QThread* DemoServer::leastLoadedWorkerThread() const
 {
-	while( m_pendingConnections.isEmpty() == false )
+	if( m_workerThreads.isEmpty() )
+	{
+		return nullptr;
+	}
+
+	auto workerThread = m_workerThreads.first();
+	auto minimumConnectionCount = m_connections.count() + 1;
+
+	for( auto thread : std::as_const( m_workerThreads ) )
 	{
-		new DemoServerConnection( this, m_demoAccessToken, m_pendingConnections.takeFirst() );
+		const auto connectionCount = std::count_if( m_connections.cbegin(), m_connections.cend(),
+													[thread]( const DemoServerConnection* c ) { return c->thread() == thread; } );
+		if( connectionCount < minimumConnectionCount )
+		{
+			workerThread = thread;
+			minimumConnectionCount = int(connectionCount);
+		}
+	}
+
+	return workerThread;
+}
+
+
+
+void DemoServer::startEncoderThread()
+{
+	m_encoderThread = new QThread;
+	m_encoderThread->setObjectName( QStringLiteral("DemoServerEncoder") );
+
+	// context object for running functions in the encoder thread
+	m_encoder = new QObject;
+	m_encoder->moveToThread( m_encoderThread );
+
+	m_encoderThread->start();
+}
+
+
+
+void DemoServer::stopEncoderThread()
+{
+	if( m_encoderThread )
+	{
+		m_encoderThread->quit();
+		m_encoderThread->wait();
+
+		delete m_encoder;
+		delete m_encoderThread;
+
+		m_encoder = nullptr;
+		m_encoderThread = nullptr;
 	}
 }
 
@@ -177,7 +367,7 @@ void DemoServer::reconnectToVncServer()
 {
 	m_vncClientProtocol->start();
 
-	m_vncServerSocket->connectToHost( QHostAddress::LocalHost, static_cast<quint16>( m_vncServerPort ) );
+	m_vncServerSocket->connectToHost( m_vncServerHost, static_cast<quint16>( m_vncServerPort ) );
 }
 
 
@@ -197,9 +387,34 @@ void DemoServer::readFromVncServer()
 	}
 	else
 	{
+		const auto updateCount = [this]() {
+			DemoFramebufferUpdateRing::Sequence count = 0;
+			for( const auto& tier : m_qualityTiers )
+			{
+				count += tier.updates.head();
+			}
+			return count;
+		};
+
+		const auto previousUpdateCount = updateCount();
+
 		while( receiveVncServerMessage() )
 		{
 		}
+
+		processPendingFramebufferUpdateMessages();
+
+		// wake up all clients at once instead of per message
+		if( updateCount() != previousUpdateCount )
+		{
+			Q_EMIT framebufferUpdatesAvailable();
+
+			// ask for the next update right away so relaying does not add latency
+			if( m_relay )
+			{
+				requestRelayedFramebufferUpdate();
+			}
+		}
 	}
 }
 
@@ -212,12 +427,20 @@ void DemoServer::requestFramebufferUpdate()
 		return;
 	}
 
-	if( m_requestFullFramebufferUpdate ||
-		m_lastFullFramebufferUpdate.elapsed() >= m_keyFrameInterval )
+	if( m_relay )
+	{
+		requestRelayedFramebufferUpdate();
+		return;
+	}
+
+	// key frames are synthesized from our own framebuffer, so there's no need to ask the VNC server for
+	// a full update
+	QMetaObject::invokeMethod( m_encoder, [this]() { updateKeyFrames(); }, Qt::QueuedConnection );
+
+	if( m_requestFullFramebufferUpdate || m_framebuffer.takeFullUpdateRequirement() )
 	{
 		vDebug() << "Requesting full framebuffer update";
 		m_vncClientProtocol->requestFramebufferUpdate( false );
-		m_lastFullFramebufferUpdate.restart();
 		m_requestFullFramebufferUpdate = false;
 	}
 	else
@@ -228,13 +451,49 @@ void DemoServer::requestFramebufferUpdate()
 
 
 
+void DemoServer::requestRelayedFramebufferUpdate()
+{
+	// relayed key frames can't be synthesized locally as we do not decode any updates, so
+	// forward requests of joining or lagging clients as a full update request to the upstream
+	// demo server unless the updates following the last key frame received are still available
+	auto& tier = m_qualityTiers[int(RelayQualityTier)];
+
+	if( m_keyFrameRequests.load() == 0 ||
+		( tier.keyFrame.message.isEmpty() == false && tier.updates.contains( tier.keyFrame.sequence ) ) )
+	{
+		m_keyFrameRequests = 0;
+		m_vncClientProtocol->requestFramebufferUpdate( true );
+		return;
+	}
+
+	// keep the request pending until the upstream server may be asked for a key frame again
+	if( tier.lastKeyFrame.isValid() && tier.lastKeyFrame.elapsed() < MinimumKeyFrameInterval )
+	{
+		m_vncClientProtocol->requestFramebufferUpdate( true );
+		return;
+	}
+
+	m_keyFrameRequests = 0;
+	tier.lastKeyFrame.restart();
+	m_vncClientProtocol->requestFramebufferUpdate( false );
+}
+
+
+
 bool DemoServer::receiveVncServerMessage()
 {
 	if( m_vncClientProtocol->receiveMessage() )
 	{
 		if( m_vncClientProtocol->lastMessageType() == rfbFramebufferUpdate )
 		{
-			enqueueFramebufferUpdateMessage( m_vncClientProtocol->lastMessage() );
+			if( m_relay )
+			{
+				relayFramebufferUpdateMessage( m_vncClientProtocol->lastMessage() );
+			}
+			else
+			{
+				enqueueFramebufferUpdateMessage( m_vncClientProtocol->lastMessage() );
+			}
 		}
 		else
 		{
@@ -251,86 +510,341 @@ bool DemoServer::receiveVncServerMessage()
 
 void DemoServer::enqueueFramebufferUpdateMessage( const QByteArray& message )
 {
-	QElapsedTimer writeLockTime;
-	writeLockTime.start();
+	m_pendingFramebufferUpdateMessages.append( message );
+}
+
 
-	m_dataLock.lockForWrite();
 
-	if( writeLockTime.elapsed() > 10 )
+void DemoServer::processPendingFramebufferUpdateMessages()
+{
+	if( m_pendingFramebufferUpdateMessages.isEmpty() )
 	{
-		vDebug() << "locking for write took" << writeLockTime.elapsed() << "ms";
+		return;
 	}
 
-	const auto lastUpdatedRect = m_vncClientProtocol->lastUpdatedRect();
+	// decoding and encoding updates must not block the GUI thread, so hand them over in batches
+	QMetaObject::invokeMethod( m_encoder, [this, messages = std::exchange( m_pendingFramebufferUpdateMessages, {} )]() {
+		encodeFramebufferUpdates( messages );
+	}, Qt::QueuedConnection );
+}
+
 
-	const bool isFullUpdate = ( lastUpdatedRect.x() == 0 && lastUpdatedRect.y() == 0 &&
-								lastUpdatedRect.width() == m_vncClientProtocol->framebufferWidth() &&
-								lastUpdatedRect.height() == m_vncClientProtocol->framebufferHeight() );
 
-	const auto queueSize = framebufferUpdateMessageQueueSize();
+void DemoServer::encodeFramebufferUpdates( const QVector<QByteArray>& messages )
+{
+	// only encode updates for tiers with clients assigned
+	QVector<int> activeTiers;
+	QVector<int> qualityLevels;
 
-	if( isFullUpdate || queueSize > m_memoryLimit*2 )
+	for( int i = 0; i < QualityTierCount; ++i )
 	{
-		if( m_keyFrameTimer.elapsed() > 1 )
+		if( m_qualityTiers[i].clientCount > 0 )
 		{
-			const auto totalKBytes = queueSize / BytesPerKB;
-			const auto kbytesPerSecond = qMax<int>(1, (totalKBytes * 1000) / m_keyFrameTimer.elapsed());
-			const auto clientCount = qMin(1, findChildren<DemoServerConnection *>().count());
-			const auto totalKBytesPerSecond = kbytesPerSecond * clientCount;
+			activeTiers.append( i );
+			qualityLevels.append( m_qualityTiers[i].qualityLevel );
+		}
+	}
 
-			auto newQuality = m_quality;
-			if (totalKBytesPerSecond > m_maxKBytesPerSecond)
+	const auto serverQualityLevel = m_qualityTiers[int(ServerQualityTier)].qualityLevel;
+	auto updatesAppended = false;
+
+	for( const auto& message : messages )
+	{
+		const auto updates = m_framebuffer.processFramebufferUpdate( message, qualityLevels, serverQualityLevel );
+
+		for( int i = 0; i < updates.count(); ++i )
+		{
+			if( updates[i].isEmpty() )
 			{
-				newQuality = qMax(int(MinimumQuality),
-								  m_quality - qMax(1, int(totalKBytesPerSecond / m_maxKBytesPerSecond)));
+				continue;
 			}
-			else if (totalKBytesPerSecond < m_maxKBytesPerSecond * 4 / 5)
+
+			auto& tier = m_qualityTiers[activeTiers[i]];
+
+			// the ring releases the oldest updates when reaching its memory limit and
+			// clients not having sent them yet continue with a key frame
+			tier.updates.append( updates[i] );
+			tier.bytesSinceStatistics += updates[i].size();
+			updatesAppended = true;
+		}
+	}
+
+	if( updatesAppended )
+	{
+		Q_EMIT framebufferUpdatesAvailable();
+	}
+}
+
+
+
+void DemoServer::relayFramebufferUpdateMessage( const QByteArray& message )
+{
+	auto& tier = m_qualityTiers[int(RelayQualityTier)];
+
+	if( isKeyFrame( message ) )
+	{
+		// the upstream server may have skipped updates before sending the key frame (e.g. when
+		// we requested it or fell behind) so all clients have to continue with the key frame
+		tier.updates.invalidate();
+		setKeyFrame( RelayQualityTier, message );
+		return;
+	}
+
+	// incremental updates are useless without a key frame to start with
+	if( tier.keyFrame.message.isEmpty() )
+	{
+		return;
+	}
+
+	// pass on the encoded message as it is
+	tier.updates.append( message );
+}
+
+
+
+bool DemoServer::isKeyFrame( const QByteArray& message ) const
+{
+	// key frames synthesized by DemoFramebuffer start with a NewFBSize rect followed by the whole framebuffer
+	if( message.size() < sz_rfbFramebufferUpdateMsg + sz_rfbFramebufferUpdateRectHeader ||
+		m_vncClientProtocol->lastUpdatedRect() !=
+			QRect( 0, 0, m_vncClientProtocol->framebufferWidth(), m_vncClientProtocol->framebufferHeight() ) )
+	{
+		return false;
+	}
+
+	rfbFramebufferUpdateRectHeader rectHeader;
+	memcpy( &rectHeader, message.constData() + sz_rfbFramebufferUpdateMsg, sz_rfbFramebufferUpdateRectHeader ); // Flawfinder: ignore
+
+	return qFromBigEndian( rectHeader.encoding ) == uint32_t(rfbEncodingNewFBSize);
+}
+
+
+
+void DemoServer::updateKeyFrames()
+{
+	// the current key frame still is up to date if no updates have been appended since
+	const auto keyFrameRequests = m_keyFrameRequests.exchange( 0 );
+	const auto keyFrameIntervalElapsed = m_keyFrameTimer.elapsed() >= m_keyFrameInterval;
+
+	auto keyFramesUpdated = false;
+	int deferredKeyFrameRequests = 0;
+
+	for( int i = 0; i < QualityTierCount; ++i )
+	{
+		const auto& tier = m_qualityTiers[i];
+		const auto keyFrameRequested = ( keyFrameRequests & ( 1 << i ) ) != 0;
+
+		if( tier.clientCount == 0 || ( keyFrameRequested == false && keyFrameIntervalElapsed == false ) ||
+			( tier.keyFrame.message.isEmpty() == false && tier.keyFrame.sequence == tier.updates.head() ) )
+		{
+			continue;
+		}
+
+		// grant requests of each tier at most once per MinimumKeyFrameInterval
+		if( keyFrameIntervalElapsed == false && tier.lastKeyFrame.isValid() &&
+			tier.lastKeyFrame.elapsed() < MinimumKeyFrameInterval )
+		{
+			deferredKeyFrameRequests |= 1 << i;
+			continue;
+		}
+
+		updateKeyFrame( QualityTier(i) );
+		keyFramesUpdated = true;
+	}
+
+	m_keyFrameRequests.fetch_or( deferredKeyFrameRequests );
+
+	if( keyFrameIntervalElapsed )
+	{
+		m_keyFrameTimer.restart();
+	}
+
+	if( keyFramesUpdated )
+	{
+		Q_EMIT framebufferUpdatesAvailable();
+	}
+}
+
+
+
+void DemoServer::updateKeyFrame( QualityTier tier )
+{
+	const auto keyFrame = m_framebuffer.keyFrame( m_qualityTiers[int(tier)].qualityLevel );
+	if( keyFrame.isEmpty() == false )
+	{
+		setKeyFrame( tier, keyFrame );
+	}
+}
+
+
+
+void DemoServer::setKeyFrame( QualityTier tier, const QByteArray& message )
+{
+	auto& tierData = m_qualityTiers[int(tier)];
+
+	// key frames are sent to individual clients only instead of being appended to the updates
+	// so clients keeping up with the updates never receive the whole framebuffer again
+	QMutexLocker locker( &m_keyFrameMutex );
+	tierData.keyFrame = { message, tierData.updates.head() };
+	tierData.lastKeyFrame.restart();
+}
+
+
+
+void DemoServer::updateQualityTiers()
+{
+	const auto elapsed = qMax<qint64>( 1, m_qualityTierStatisticsTimer.restart() );
+
+	for( auto& tier : m_qualityTiers )
+	{
+		if( tier.clientCount > 0 )
+		{
+			const auto bytesPerSecond = tier.bytesSinceStatistics.exchange( 0 ) * 1000 / elapsed;
+			tier.bytesPerSecond = tier.bytesPerSecond > 0 ? ( tier.bytesPerSecond + bytesPerSecond ) / 2 : bytesPerSecond;
+		}
+		else
+		{
+			tier.bytesSinceStatistics = 0;
+		}
+	}
+
+	const auto adjacentTier = [this]( int tier, int direction ) {
+		for( tier += direction; tier >= 0 && tier < QualityTierCount; tier += direction )
+		{
+			if( m_qualityTiers[tier].enabled )
 			{
-				newQuality = qMin(int(MaximumQuality),
-								  m_quality + qMax(1, int(m_maxKBytesPerSecond / totalKBytesPerSecond)));
+				return tier;
 			}
+		}
+		return -1;
+	};
+
+	QHash<DemoServerConnection *, int> newTiers;
+	qint64 totalBitrate = 0;
+
+	for( auto it = m_clientStates.begin(), end = m_clientStates.end(); it != end; ++it )
+	{
+		const auto connection = it.key();
+		auto& clientState = it.value();
+
+		auto tier = int(clientState.tier);
 
-			if (newQuality != m_quality)
+		if( connection->takeLagging() )
+		{
+			const auto lowerTier = adjacentTier( tier, 1 );
+			if( lowerTier >= 0 )
 			{
-				setVncServerEncodings(newQuality);
+				tier = lowerTier;
 			}
+			clientState.lastDowngrade.restart();
+		}
+		else if( clientState.lastDowngrade.isValid() == false ||
+				 clientState.lastDowngrade.elapsed() >= QualityTierUpgradeHoldTime )
+		{
+			// upgrade if the client's link has been measured to be fast enough for the next higher tier
+			const auto higherTier = adjacentTier( tier, -1 );
+			const auto bandwidth = connection->estimatedBandwidth();
+			if( higherTier >= 0 && bandwidth > 0 && estimatedBitrate( QualityTier(higherTier) ) * 5 / 4 < bandwidth )
+			{
+				tier = higherTier;
+			}
+		}
+
+		newTiers[connection] = tier;
+		totalBitrate += estimatedBitrate( QualityTier(tier) );
+	}
 
-			vDebug() << "message count:" << m_framebufferUpdateMessages.size()
-					 << "queue size (KB):" << totalKBytes
-					 << "total bandwidth (KB/s):" << totalKBytesPerSecond << "of" << m_maxKBytesPerSecond
-					 << "bandwidth per client (KB/s):" << kbytesPerSecond
-					 << "quality" << m_quality;
+	// stay within the bandwidth limit by degrading the clients with the highest quality first
+	while( totalBitrate > m_maxBytesPerSecond )
+	{
+		auto it = std::min_element( newTiers.begin(), newTiers.end(), [&]( int a, int b ) {
+			return ( adjacentTier( a, 1 ) >= 0 ? a : QualityTierCount ) <
+				   ( adjacentTier( b, 1 ) >= 0 ? b : QualityTierCount );
+		} );
+
+		if( it == newTiers.end() || adjacentTier( it.value(), 1 ) < 0 )
+		{
+			break;
 		}
-		m_keyFrameTimer.restart();
-		++m_keyFrame;
 
-		m_framebufferUpdateMessages.clear();
+		totalBitrate -= estimatedBitrate( QualityTier(it.value()) );
+		it.value() = adjacentTier( it.value(), 1 );
+		totalBitrate += estimatedBitrate( QualityTier(it.value()) );
 	}
 
-	m_framebufferUpdateMessages.append( message );
+	for( auto it = newTiers.cbegin(), end = newTiers.cend(); it != end; ++it )
+	{
+		if( QualityTier(it.value()) != m_clientStates[it.key()].tier )
+		{
+			assignQualityTier( it.key(), QualityTier(it.value()) );
+		}
+	}
 
-	m_dataLock.unlock();
+	for( int i = 0; i < QualityTierCount; ++i )
+	{
+		const auto& tier = m_qualityTiers[i];
+		if( tier.clientCount > 0 )
+		{
+			vDebug() << QualityTier(i) << "clients:" << tier.clientCount
+					 << "bandwidth per client (KB/s):" << tier.bytesPerSecond / BytesPerKB
+					 << "total bandwidth (KB/s):" << tier.clientCount * tier.bytesPerSecond / BytesPerKB;
+		}
+	}
 
-	// we're about to reach memory limits?
-	if( framebufferUpdateMessageQueueSize() > m_memoryLimit )
+	if( m_clientStates.isEmpty() == false )
 	{
-		// then request a full update so we can clear our queue
-		m_requestFullFramebufferUpdate = true;
+		vDebug() << "estimated total bandwidth (KB/s):" << totalBitrate / BytesPerKB
+				 << "of" << m_maxBytesPerSecond / BytesPerKB;
 	}
 }
 
 
 
-qint64 DemoServer::framebufferUpdateMessageQueueSize() const
+void DemoServer::assignQualityTier( DemoServerConnection* connection, QualityTier tier )
 {
-	qint64 size = 0;
+	const auto it = m_clientStates.find( connection );
+	if( it != m_clientStates.end() )
+	{
+		--m_qualityTiers[int(it->tier)].clientCount;
+	}
 
-	for( const auto& message : std::as_const( m_framebufferUpdateMessages ) )
+	auto& tierData = m_qualityTiers[int(tier)];
+	if( tierData.clientCount++ == 0 && m_relay == false )
 	{
-		size += message.size();
+		// tier has not been encoded so far so provide an up-to-date key frame to start with
+		QMetaObject::invokeMethod( m_encoder, [this, tier]() {
+			updateKeyFrame( tier );
+			Q_EMIT framebufferUpdatesAvailable();
+		}, Qt::QueuedConnection );
 	}
 
-	return size;
+	m_clientStates[connection].tier = tier;
+
+	// client switches to the new tier with its next key frame
+	connection->setQualityTier( tier );
+	QMetaObject::invokeMethod( connection, &DemoServerConnection::sendFramebufferUpdate, Qt::QueuedConnection );
+}
+
+
+
+qint64 DemoServer::estimatedBitrate( QualityTier tier ) const
+{
+	const auto& tierData = m_qualityTiers[int(tier)];
+	if( tierData.clientCount > 0 )
+	{
+		return tierData.bytesPerSecond;
+	}
+
+	// derive from the bitrate of a tier currently being encoded
+	for( const auto& other : m_qualityTiers )
+	{
+		if( other.clientCount > 0 && other.bytesPerSecond > 0 )
+		{
+			return other.bytesPerSecond * tierData.relativeBitrate / other.relativeBitrate;
+		}
+	}
+
+	return tierData.bytesPerSecond;
 }
 
 
@@ -339,9 +853,27 @@ void DemoServer::start()
 {
 	vDebug();
 
+	if( m_relay )
+	{
+		// the upstream demo server decides about pixel format and encodings and sends a key frame first
+		m_vncClientProtocol->requestFramebufferUpdate( false );
+
+		while( receiveVncServerMessage() )
+		{
+		}
+
+		acceptPendingConnections();
+		return;
+	}
+
 	setVncServerPixelFormat();
-	setVncServerEncodings(DefaultQuality);
+	setVncServerEncodings();
 
+	const QSize framebufferSize( m_vncClientProtocol->framebufferWidth(), m_vncClientProtocol->framebufferHeight() );
+	QMetaObject::invokeMethod( m_encoder, [this, framebufferSize]() {
+		m_framebuffer.resize( framebufferSize );
+		m_framebuffer.takeFullUpdateRequirement();
+	}, Qt::QueuedConnection );
 	m_requestFullFramebufferUpdate = true;
 
 	requestFramebufferUpdate();
@@ -350,6 +882,8 @@ void DemoServer::start()
 	{
 	}
 
+	processPendingFramebufferUpdateMessages();
+
 	acceptPendingConnections();
 }
 
@@ -379,25 +913,10 @@ bool DemoServer::setVncServerPixelFormat()
 
 
 
-bool DemoServer::setVncServerEncodings(int quality)
+bool DemoServer::setVncServerEncodings()
 {
-	m_quality = quality;
-
-	m_vncClientProtocol->setEncodings({
-										  rfbEncodingTight,
-										  rfbEncodingZYWRLE,
-										  rfbEncodingZRLE,
-										  rfbEncodingUltra,
-										  rfbEncodingCopyRect,
-										  rfbEncodingHextile,
-										  rfbEncodingCoRRE,
-										  rfbEncodingRRE,
-										  rfbEncodingRaw,
-										  rfbEncodingCompressLevel9,
-										  rfbEncodingQualityLevel0 + quality,
-										  rfbEncodingNewFBSize,
-										  rfbEncodingLastRect
-									  });
+	// updates are decoded into our framebuffer for encoding other quality tiers and key frames
+	m_vncClientProtocol->setEncodings( DemoFramebuffer::serverEncodings( m_qualityTiers[int(ServerQualityTier)].qualityLevel ) );
 
 	return m_vncClientProtocol->sendEncodings();
 }
@@ -26,13 +26,20 @@
 #pragma once
 
 #include <QElapsedTimer>
-#include <QReadWriteLock>
+#include <QHash>
+#include <QMutex>
 #include <QTcpServer>
 #include <QTimer>
 
+#include <array>
+#include <atomic>
+
 #include "CryptoCore.h"
+#include "DemoFramebuffer.h"
+#include "DemoFramebufferUpdateRing.h"
 
 class DemoConfiguration;
+class DemoServerConnection;
 class QTcpServer;
 class QTcpSocket;
 class VncClientProtocol;
@@ -42,13 +49,40 @@ class DemoServer : public QTcpServer
 	Q_OBJECT
 public:
 	using Password = CryptoCore::SecureArray;
-	using MessageList = QVector<QByteArray>;
 	static constexpr auto DefaultBandwidthLimit = 100;
 
+	// ordered from highest to lowest quality
+	enum class QualityTier {
+		Lossless,
+		High,
+		Medium,
+		Low,
+		Count
+	};
+	Q_ENUM(QualityTier)
+
+	static constexpr auto QualityTierCount = int(QualityTier::Count);
+
+	// update transferring the whole framebuffer as it was after all updates before the given sequence
+	struct KeyFrame
+	{
+		QByteArray message;
+		DemoFramebufferUpdateRing::Sequence sequence{0};
+	};
+
 	DemoServer( int vncServerPort, const Password& vncServerPassword, const Password& demoAccessToken,
 				const DemoConfiguration& configuration, int demoServerPort, QObject *parent );
+
+	// relay mode: distribute the updates of an upstream demo server as they are received
+	DemoServer( const QString& upstreamDemoServerHost, int upstreamDemoServerPort, const Password& demoAccessToken,
+				const DemoConfiguration& configuration, int demoServerPort, QObject *parent );
 	~DemoServer() override;
 
+	bool isRelay() const
+	{
+		return m_relay;
+	}
+
 	void terminate();
 
 	const DemoConfiguration& configuration() const
@@ -58,66 +92,130 @@ public:
 
 	const QByteArray& serverInitMessage() const;
 
-	void lockDataForRead();
-
-	void unlockData()
+	const DemoFramebufferUpdateRing& framebufferUpdates( QualityTier tier ) const
 	{
-		m_dataLock.unlock();
+		return m_qualityTiers[int(tier)].updates;
 	}
 
-	int keyFrame() const
+	// may be called from any thread
+	KeyFrame keyFrame( QualityTier tier ) const
 	{
-		return m_keyFrame;
+		QMutexLocker locker( &m_keyFrameMutex );
+		return m_qualityTiers[int(tier)].keyFrame;
 	}
 
-	const MessageList& framebufferUpdateMessages() const
+	// may be called from any thread, e.g. by joining or lagging clients
+	void requestKeyFrame( QualityTier tier )
 	{
-		return m_framebufferUpdateMessages;
+		m_keyFrameRequests.fetch_or( 1 << int(tier) );
 	}
 
+Q_SIGNALS:
+	void framebufferUpdatesAvailable();
+
 private:
+	DemoServer( const QString& vncServerHost, int vncServerPort, const Password& vncServerPassword,
+				const Password& demoAccessToken, bool relay,
+				const DemoConfiguration& configuration, int demoServerPort, QObject *parent );
+
 	void incomingConnection( qintptr socketDescriptor ) override;
 	void acceptPendingConnections();
+	void closeConnection( DemoServerConnection* connection );
+	void stopConnections();
+
+	void startWorkerThreads();
+	void stopWorkerThreads();
+	QThread* leastLoadedWorkerThread() const;
+
+	void startEncoderThread();
+	void stopEncoderThread();
+
 	void reconnectToVncServer();
 	void readFromVncServer();
 	void requestFramebufferUpdate();
+	void requestRelayedFramebufferUpdate();
 
 	bool receiveVncServerMessage();
 	void enqueueFramebufferUpdateMessage( const QByteArray& message );
-
-	qint64 framebufferUpdateMessageQueueSize() const;
+	void processPendingFramebufferUpdateMessages();
+	void encodeFramebufferUpdates( const QVector<QByteArray>& messages );
+	void relayFramebufferUpdateMessage( const QByteArray& message );
+	bool isKeyFrame( const QByteArray& message ) const;
+	void updateKeyFrames();
+	void updateKeyFrame( QualityTier tier );
+	void setKeyFrame( QualityTier tier, const QByteArray& message );
+
+	void updateQualityTiers();
+	void assignQualityTier( DemoServerConnection* connection, QualityTier tier );
+	qint64 estimatedBitrate( QualityTier tier ) const;
 
 	void start();
 	bool setVncServerPixelFormat();
-	bool setVncServerEncodings(int quality);
-
-	static constexpr auto ConnectionThreadWaitTime = 5000;
-	static constexpr auto TerminateRetryInterval = 1000;
-	static constexpr auto MinimumQuality = 0;
-	static constexpr auto DefaultQuality = 6;
-	static constexpr auto MaximumQuality = 9;
+	bool setVncServerEncodings();
+
+	static constexpr int MaximumWorkerThreadCount = 4;
+	static constexpr auto DefaultQualityTier = QualityTier::Medium;
+	// updates of the VNC server are requested in the quality of this tier and passed on to its clients
+	static constexpr auto ServerQualityTier = DefaultQualityTier;
+	// relayed updates are passed on in whatever quality the upstream server sends them
+	static constexpr auto RelayQualityTier = DefaultQualityTier;
+	// lagging or joining clients request key frames but must not make us encode them all the time
+	static constexpr auto MinimumKeyFrameInterval = 1000;
+	static constexpr auto UpstreamReconnectDelay = 1000;
+	static constexpr auto QualityTierUpdateInterval = 2000;
+	static constexpr auto QualityTierUpgradeHoldTime = 30000;
 	static constexpr auto BytesPerKB = 1024;
 	static constexpr auto BytesPerMB = BytesPerKB * BytesPerKB;
 
 	const DemoConfiguration& m_configuration;
 	const qint64 m_memoryLimit;
 	const int m_keyFrameInterval;
+	const QString m_vncServerHost;
 	const int m_vncServerPort;
+	const bool m_relay;
 	const Password m_demoAccessToken;
 
 	QList<quintptr> m_pendingConnections;
+	QList<DemoServerConnection *> m_connections;
+	QVector<QThread *> m_workerThreads;
+	// decodes updates of the VNC server and encodes updates and key frames for all quality tiers
+	QThread* m_encoderThread{nullptr};
+	QObject* m_encoder{nullptr};
+	QVector<QByteArray> m_pendingFramebufferUpdateMessages;
 	QTcpSocket* m_vncServerSocket;
 	VncClientProtocol* m_vncClientProtocol;
 
-	QReadWriteLock m_dataLock;
 	QTimer m_framebufferUpdateTimer;
-	QElapsedTimer m_lastFullFramebufferUpdate;
+	QTimer m_qualityTierUpdateTimer;
+	QElapsedTimer m_qualityTierStatisticsTimer;
 	QElapsedTimer m_keyFrameTimer;
 	bool m_requestFullFramebufferUpdate;
+	std::atomic<int> m_keyFrameRequests{0};
 
-	int m_keyFrame;
-	MessageList m_framebufferUpdateMessages;
-	int m_quality = DefaultQuality;
-	int m_maxKBytesPerSecond = 0;
+	struct QualityTierData
+	{
+		int qualityLevel{DemoFramebuffer::LosslessQualityLevel};
+		int relativeBitrate{1};
+		bool enabled{true};
+		std::atomic<int> clientCount{0};
+		std::atomic<qint64> bytesSinceStatistics{0};
+		qint64 bytesPerSecond{0};
+		QElapsedTimer lastKeyFrame;
+		DemoFramebufferUpdateRing updates;
+		KeyFrame keyFrame;
+	};
+
+	struct ClientState
+	{
+		QualityTier tier{DefaultQualityTier};
+		QElapsedTimer lastDowngrade;
+	};
+
+	// accessed by the encoder thread only
+	DemoFramebuffer m_framebuffer;
+	mutable QMutex m_keyFrameMutex;
+	std::array<QualityTierData, QualityTierCount> m_qualityTiers;
+	QHash<DemoServerConnection *, ClientState> m_clientStates;
+	qint64 m_maxBytesPerSecond = 0;
 
 } ;
@@ -36,27 +36,32 @@
 DemoServerConnection::DemoServerConnection( DemoServer* demoServer,
 											const Password& demoAccessToken,
 											quintptr socketDescriptor ) :
-	QThread( demoServer ),
 	m_demoAccessToken( demoAccessToken ),
 	m_demoServer( demoServer ),
+	m_serverInitMessage( demoServer->serverInitMessage() ),
 	m_socketDescriptor( socketDescriptor ),
-	m_vncServerClient(),
+	m_vncServerClient( this ),
 	m_rfbClientToServerMessageSizes( {
 									 std::pair<int, int>( rfbSetPixelFormat, sz_rfbSetPixelFormatMsg ),
 									 std::pair<int, int>( rfbFramebufferUpdateRequest, sz_rfbFramebufferUpdateRequestMsg ),
 									 std::pair<int, int>( rfbKeyEvent, sz_rfbKeyEventMsg ),
 									 std::pair<int, int>( rfbPointerEvent, sz_rfbPointerEventMsg ),
 									 } ),
-	m_keyFrame( -1 ),
-	m_framebufferUpdateMessageIndex( 0 ),
-	m_framebufferUpdateInterval( m_demoServer->configuration().framebufferUpdateInterval() )
+	m_backlogLimit( qint64( demoServer->configuration().clientBacklogLimit() ) * 1024 )
 {
-	start();
 }
 
 
 
-void DemoServerConnection::run()
+DemoServerConnection::~DemoServerConnection()
+{
+	delete m_serverProtocol;
+	delete m_socket;
+}
+
+
+
+void DemoServerConnection::start()
 {
 	vDebug() << m_socketDescriptor;
 
@@ -65,28 +70,21 @@ void DemoServerConnection::run()
 	if( m_socket->setSocketDescriptor( m_socketDescriptor ) == false )
 	{
 		vCritical() << "failed to set socket descriptor";
-		delete m_socket;
-		m_socket = nullptr;
-		deleteLater();
+		Q_EMIT closed();
 		return;
 	}
 
-	connect( m_socket, &QTcpSocket::readyRead, this, &DemoServerConnection::processClient, Qt::DirectConnection );
-	connect( m_socket, &QTcpSocket::disconnected, this, &DemoServerConnection::quit );
+	connect( m_socket, &QTcpSocket::readyRead, this, &DemoServerConnection::processClient );
+	connect( m_socket, &QTcpSocket::disconnected, this, &DemoServerConnection::closed );
+	connect( m_socket, &QTcpSocket::bytesWritten, this, [this]( qint64 bytes ) {
+		updateBandwidthEstimate( bytes );
+		sendFramebufferUpdate();
+	} );
 
-	m_serverProtocol = new DemoServerProtocol( m_demoAccessToken, m_socket, &m_vncServerClient ),
+	m_serverProtocol = new DemoServerProtocol( m_demoAccessToken, m_socket, &m_vncServerClient );
 
-	m_serverProtocol->setServerInitMessage( m_demoServer->serverInitMessage() );
+	m_serverProtocol->setServerInitMessage( m_serverInitMessage );
 	m_serverProtocol->start();
-
-	exec();
-
-	delete m_serverProtocol;
-	delete m_socket;
-
-	m_socket = nullptr;
-
-	deleteLater();
 }
 
 
@@ -165,10 +163,15 @@ bool DemoServerConnection::receiveClientMessage()
 			return false;
 		}
 
-		m_socket->read( m_rfbClientToServerMessageSizes[messageType] );
+		const auto message = m_socket->read( m_rfbClientToServerMessageSizes[messageType] );
 
 		if( messageType == rfbFramebufferUpdateRequest )
 		{
+			// clients such as demo relays ask for a full update when they need a new key frame
+			const auto updateRequest = reinterpret_cast<const rfbFramebufferUpdateRequestMsg *>( message.constData() );
+			m_keyFrameRequested = m_keyFrameRequested || updateRequest->incremental == 0;
+
+			m_framebufferUpdateRequested = true;
 			sendFramebufferUpdate();
 		}
 
@@ -182,32 +185,163 @@ bool DemoServerConnection::receiveClientMessage()
 
 void DemoServerConnection::sendFramebufferUpdate()
 {
-	m_demoServer->lockDataForRead();
+	if( m_framebufferUpdateRequested == false || m_socket == nullptr )
+	{
+		return;
+	}
+
+	const auto qualityTier = m_qualityTier.load();
+	if( qualityTier < 0 )
+	{
+		return;
+	}
+
+	const auto& framebufferUpdates = m_demoServer->framebufferUpdates( DemoServer::QualityTier(qualityTier) );
+
+	// switch to the updates of a different quality tier with a key frame of that tier
+	if( qualityTier != m_currentQualityTier || m_keyFrameRequested )
+	{
+		m_currentQualityTier = qualityTier;
+		m_keyFrameRequested = false;
+		m_keyFrameRequired = true;
+		m_keyFrameRequestPending = false;
+	}
+
+	// client can't keep up? then stop queueing incremental updates which would only be outdated
+	// when finally received and continue with a key frame once the backlog has been sent
+	if( m_socket->bytesToWrite() > m_backlogLimit )
+	{
+		// let the demo server assign a lower quality tier
+		m_lagging = true;
+
+		if( m_keyFrameRequired == false )
+		{
+			vDebug() << "skipping updates for client" << m_socket->peerAddress().toString()
+					 << "with backlog (KB):" << m_socket->bytesToWrite() / 1024;
+			m_keyFrameRequired = true;
+			m_keyFrameRequestPending = false;
+		}
+		return;
+	}
+
+	const auto idle = m_socket->bytesToWrite() == 0;
+	auto updateSent = false;
+
+	if( m_keyFrameRequired )
+	{
+		if( sendKeyFrame( DemoServer::QualityTier(qualityTier) ) == false )
+		{
+			// wait for DemoServer::framebufferUpdatesAvailable() to be emitted with a new key frame
+			return;
+		}
+		updateSent = true;
+	}
+
+	auto readResult = framebufferUpdates.read( m_framebufferUpdateCursor, m_framebufferUpdateMessages );
+
+	if( readResult == DemoFramebufferUpdateRing::ReadResult::KeyFrameMissing )
+	{
+		// updates we did not send yet have been released so incremental updates would leave
+		// parts of the screen outdated - continue with a key frame instead
+		m_keyFrameRequired = true;
+		m_keyFrameRequestPending = false;
+
+		if( sendKeyFrame( DemoServer::QualityTier(qualityTier) ) == false )
+		{
+			return;
+		}
+		updateSent = true;
+
+		readResult = framebufferUpdates.read( m_framebufferUpdateCursor, m_framebufferUpdateMessages );
+	}
+
+	if( readResult == DemoFramebufferUpdateRing::ReadResult::Messages )
+	{
+		for( const auto& message : std::as_const( m_framebufferUpdateMessages ) )
+		{
+			m_socket->write( message );
+		}
+
+		// drop references immediately so messages released by the ring can be freed
+		m_framebufferUpdateMessages.clear();
+		updateSent = true;
+	}
+
+	if( updateSent )
+	{
+		m_framebufferUpdateRequested = false;
+
+		if( idle )
+		{
+			m_drainTimer.start();
+			m_drainedBytes = 0;
+		}
+	}
+
+	// otherwise send updates as soon as DemoServer::framebufferUpdatesAvailable() or
+	// QTcpSocket::bytesWritten() is emitted
+}
 
-	const auto& framebufferUpdateMessages = m_demoServer->framebufferUpdateMessages();
 
-	const int framebufferUpdateMessageCount = framebufferUpdateMessages.count();
 
-	if( m_demoServer->keyFrame() != m_keyFrame ||
-			m_framebufferUpdateMessageIndex > framebufferUpdateMessageCount )
+bool DemoServerConnection::sendKeyFrame( DemoServer::QualityTier qualityTier )
+{
+	const auto& framebufferUpdates = m_demoServer->framebufferUpdates( qualityTier );
+
+	if( m_keyFrameRequestPending == false )
 	{
-		m_framebufferUpdateMessageIndex = 0;
-		m_keyFrame = m_demoServer->keyFrame();
+		// a key frame at the current head (e.g. since there were no updates) is fine already
+		m_keyFrameRequestSequence = framebufferUpdates.head();
 	}
 
-	bool sentUpdates = false;
-	while( m_framebufferUpdateMessageIndex < framebufferUpdateMessageCount )
+	const auto keyFrame = m_demoServer->keyFrame( qualityTier );
+
+	// rather wait for a freshly synthesized key frame than replaying all updates since an older one -
+	// relays can't synthesize key frames though and replay the updates since the last one received
+	const auto upToDate = keyFrame.sequence >= m_keyFrameRequestSequence || m_demoServer->isRelay();
+
+	if( keyFrame.message.isEmpty() || upToDate == false || framebufferUpdates.contains( keyFrame.sequence ) == false )
 	{
-		m_socket->write( framebufferUpdateMessages[m_framebufferUpdateMessageIndex] );
-		++m_framebufferUpdateMessageIndex;
-		sentUpdates = true;
+		if( m_keyFrameRequestPending == false )
+		{
+			m_keyFrameRequestPending = true;
+			m_demoServer->requestKeyFrame( qualityTier );
+		}
+		return false;
 	}
 
-	m_demoServer->unlockData();
+	// send the key frame to this client only and continue with the updates following it,
+	// so other clients are not affected at all
+	m_socket->write( keyFrame.message );
+	m_framebufferUpdateCursor = keyFrame.sequence;
+
+	m_keyFrameRequired = false;
+	m_keyFrameRequestPending = false;
+
+	return true;
+}
+
+
+
+void DemoServerConnection::updateBandwidthEstimate( qint64 bytes )
+{
+	m_drainedBytes += bytes;
+
+	if( m_socket->bytesToWrite() > 0 || m_drainTimer.isValid() == false )
+	{
+		return;
+	}
 
-	if( sentUpdates == false )
+	// everything has been handed over to the network stack - small amounts of data only fill up
+	// the socket's send buffer, so only large ones (e.g. key frames) tell something about the link
+	const auto elapsed = m_drainTimer.elapsed();
+	if( m_drainedBytes >= MinimumBandwidthSampleSize && elapsed > 0 )
 	{
-		// did not send updates but client still waiting for update? then try again soon
-		QTimer::singleShot( m_framebufferUpdateInterval, m_socket, [this]() { sendFramebufferUpdate(); } );
+		const auto bandwidth = m_drainedBytes * 1000 / elapsed;
+		const auto previousBandwidth = m_estimatedBandwidth.load();
+
+		m_estimatedBandwidth = previousBandwidth > 0 ? ( previousBandwidth * 3 + bandwidth ) / 4 : bandwidth;
 	}
+
+	m_drainTimer.invalidate();
 }
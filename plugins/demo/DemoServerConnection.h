@@ -24,16 +24,20 @@
 
 #pragma once
 
-#include "DemoServerProtocol.h"
+#include <QElapsedTimer>
+
+#include <atomic>
 
-class DemoServer;
+#include "DemoFramebufferUpdateRing.h"
+#include "DemoServer.h"
+#include "DemoServerProtocol.h"
 
 // clazy:excludeall=ctor-missing-parent-argument
 
-// the demo server creates an instance of this class for each client connection,
-// i.e. each client is connected to a different server thread for best
-// performance
-class DemoServerConnection : public QThread
+// the demo server creates an instance of this class for each client connection
+// and distributes all connections across a small pool of worker threads, each
+// running an event loop serving many clients
+class DemoServerConnection : public QObject
 {
 	Q_OBJECT
 public:
@@ -44,18 +48,44 @@ public:
 	};
 
 	DemoServerConnection( DemoServer* demoServer, const Password& demoAccessToken, quintptr socketDescriptor );
-	~DemoServerConnection() = default;
+	~DemoServerConnection() override;
 
-private:
-	void run() override;
+	void start();
 
-	void processClient(); // clazy:exclude=thread-with-slots
 	void sendFramebufferUpdate();
 
+	// the following methods may be called from any thread
+	void setQualityTier( DemoServer::QualityTier tier )
+	{
+		m_qualityTier = int(tier);
+	}
+
+	bool takeLagging()
+	{
+		return m_lagging.exchange( false );
+	}
+
+	qint64 estimatedBandwidth() const
+	{
+		return m_estimatedBandwidth;
+	}
+
+Q_SIGNALS:
+	void closed();
+
+private:
+	void processClient();
+
 	bool receiveClientMessage();
 
+	bool sendKeyFrame( DemoServer::QualityTier qualityTier );
+	void updateBandwidthEstimate( qint64 bytes );
+
+	static constexpr auto MinimumBandwidthSampleSize = 256 * 1024;
+
 	const Password m_demoAccessToken;
 	DemoServer* m_demoServer;
+	const QByteArray m_serverInitMessage;
 
 	quintptr m_socketDescriptor;
 	QTcpSocket* m_socket{nullptr};
@@ -65,9 +95,22 @@ private:
 
 	const QMap<int, int> m_rfbClientToServerMessageSizes;
 
-	int m_keyFrame;
-	int m_framebufferUpdateMessageIndex;
+	DemoFramebufferUpdateRing::Sequence m_framebufferUpdateCursor{0};
+	DemoFramebufferUpdateRing::MessageList m_framebufferUpdateMessages;
+	bool m_framebufferUpdateRequested{false};
+	bool m_keyFrameRequested{false};
+
+	const qint64 m_backlogLimit;
+	bool m_keyFrameRequired{true};
+	bool m_keyFrameRequestPending{false};
+	DemoFramebufferUpdateRing::Sequence m_keyFrameRequestSequence{0};
+
+	std::atomic<int> m_qualityTier{-1};
+	int m_currentQualityTier{-1};
+	std::atomic<bool> m_lagging{false};
 
-	const int m_framebufferUpdateInterval;
+	std::atomic<qint64> m_estimatedBandwidth{0};
+	QElapsedTimer m_drainTimer;
+	qint64 m_drainedBytes{0};
 
 } ;
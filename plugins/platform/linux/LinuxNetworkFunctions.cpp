@@ -31,6 +31,7 @@
 
 #include "LinuxNetworkFunctions.h"
 #include "ProcessHelper.h"
+#include "ReachabilityProbe.h"
 
 LinuxNetworkFunctions::PingResult LinuxNetworkFunctions::ping(const QString& hostAddress)
 {
@@ -53,6 +54,14 @@ LinuxNetworkFunctions::PingResult LinuxNetworkFunctions::ping(const QString& hos
 
 
 
+QVector<LinuxNetworkFunctions::PingResult> LinuxNetworkFunctions::pingHosts(const QStringList& hostAddresses, int port, int timeout)
+{
+	return ReachabilityProbe(ReachabilityProbe::Method::IcmpEcho | ReachabilityProbe::Method::TcpConnect,
+							 port, timeout).probe(hostAddresses);
+}
+
+
+
 bool LinuxNetworkFunctions::configureFirewallException( const QString& applicationPath, const QString& description, bool enabled )
 {
 	Q_UNUSED(applicationPath)
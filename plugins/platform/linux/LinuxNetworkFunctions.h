@@ -32,6 +32,7 @@ class LinuxNetworkFunctions : public PlatformNetworkFunctions
 {
 public:
 	PingResult ping(const QString& hostAddress) override;
+	QVector<PingResult> pingHosts(const QStringList& hostAddresses, int port, int timeout) override;
 	bool configureFirewallException( const QString& applicationPath, const QString& description, bool enabled ) override;
 
 	bool configureSocketKeepalive( Socket socket, bool enabled, int idleTime, int interval, int probes ) override;
@@ -40,6 +40,7 @@
 #include <X11/keysymdef.h>
 #include <X11/Xlib.h>
 
+#include <cerrno>
 #include <grp.h>
 #include <pwd.h>
 #include <unistd.h>
@@ -174,28 +175,85 @@ QStringList LinuxUserFunctions::userGroups( bool queryDomainGroups )
 
 
 
+bool LinuxUserFunctions::isGroupMember( const group* groupEntry, const QByteArray& username )
+{
+	for( auto member = groupEntry->gr_mem; member && *member; ++member )
+	{
+		if( username == *member )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+
 QStringList LinuxUserFunctions::groupsOfUser( const QString& username, bool queryDomainGroups )
 {
 	Q_UNUSED(queryDomainGroups)
 
+	const auto name = username.toUtf8();
+
+	// use reentrant functions as group memberships may be queried from multiple threads
+	passwd pwEntry{};
+	passwd* pwResult = nullptr;
+	QByteArray buffer( int(qBound( MinimumNssBufferSize, sysconf( _SC_GETPW_R_SIZE_MAX ), MaximumNssBufferSize )), Qt::Uninitialized );
+
+	while( getpwnam_r( name.constData(), &pwEntry, buffer.data(), size_t(buffer.size()), &pwResult ) == ERANGE &&
+		   buffer.size() < MaximumNssBufferSize )
+	{
+		buffer.resize( buffer.size() * 2 );
+	}
+
+	if( pwResult == nullptr )
+	{
+		return {};
+	}
+
+	// let NSS resolve memberships through its backends (e.g. SSSD or LDAP) instead of enumerating all groups
+	int groupCount = InitialGroupCount;
+	QVector<gid_t> groupIds( groupCount );
+
+	while( getgrouplist( name.constData(), pwEntry.pw_gid, groupIds.data(), &groupCount ) < 0 )
+	{
+		// groupCount holds the required size now
+		if( groupCount <= groupIds.size() || groupCount > MaximumGroupCount )
+		{
+			vWarning() << "could not query groups of user" << username;
+			return {};
+		}
+		groupIds.resize( groupCount );
+	}
+
 	QStringList groupList;
+	groupList.reserve( groupCount );
 
-	QProcess getentProcess;
-	getentProcess.start( QStringLiteral("getent"), { QStringLiteral("group") } );
-	getentProcess.waitForFinished();
+	buffer.resize( int(qBound( MinimumNssBufferSize, sysconf( _SC_GETGR_R_SIZE_MAX ), MaximumNssBufferSize )) );
 
-	const auto groups = QString::fromUtf8( getentProcess.readAll() ).split( QLatin1Char('\n') );
-	for( const auto& group : groups )
+	for( int i = 0; i < groupCount; ++i )
 	{
-		const auto groupComponents = group.split( QLatin1Char(':') );
-		if( groupComponents.size() == 4 &&
-			groupComponents.last().split( QLatin1Char(',') ).contains(username))
+		group groupEntry{};
+		group* groupResult = nullptr;
+
+		while( getgrgid_r( groupIds[i], &groupEntry, buffer.data(), size_t(buffer.size()), &groupResult ) == ERANGE &&
+			   buffer.size() < MaximumNssBufferSize )
+		{
+			buffer.resize( buffer.size() * 2 );
+		}
+
+		// getgrouplist() always adds the primary group, which group enumeration only reported
+		// if the user is listed as a member explicitly, so keep access control results unchanged
+		if( groupResult && groupResult->gr_name &&
+			( groupIds[i] != pwEntry.pw_gid || isGroupMember( groupResult, name ) ) )
 		{
-			groupList += groupComponents.first(); // clazy:exclude=reserve-candidates
+			groupList.append( QString::fromUtf8( groupResult->gr_name ) );
 		}
 	}
 
 	groupList.removeAll( QString() );
+	groupList.removeDuplicates();
 
 	return groupList;
 }
@@ -29,6 +29,7 @@
 #include "LogonHelper.h"
 #include "PlatformUserFunctions.h"
 
+#include <grp.h>
 #include <pwd.h>
 
 // clazy:excludeall=copyable-polymorphic
@@ -57,10 +58,17 @@ public:
 	static QVariant getUserProperty(const QString& userPath, const QString& property, bool logErrors = true);
 
 private:
+	static bool isGroupMember( const group* groupEntry, const QByteArray& username );
+
 	QDBusConnection m_systemBus = QDBusConnection::systemBus();
 
 	static constexpr auto AuthHelperTimeout = 10000;
 
+	static constexpr int InitialGroupCount = 64;
+	static constexpr int MaximumGroupCount = 65536;
+	static constexpr long MinimumNssBufferSize = 16384;
+	static constexpr long MaximumNssBufferSize = 16*1024*1024;
+
 	LogonHelper m_logonHelper{};
 
 };
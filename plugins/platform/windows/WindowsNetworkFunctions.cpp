@@ -37,6 +37,7 @@
 #include <QProcess>
 
 #include "HostAddress.h"
+#include "ReachabilityProbe.h"
 #include "WindowsCoreFunctions.h"
 #include "WindowsNetworkFunctions.h"
 
@@ -255,6 +256,15 @@ WindowsNetworkFunctions::PingResult WindowsNetworkFunctions::ping(const QString&
 
 
 
+QVector<WindowsNetworkFunctions::PingResult> WindowsNetworkFunctions::pingHosts(const QStringList& hostAddresses, int port, int timeout)
+{
+	// there are no unprivileged ICMP sockets on Windows and the asynchronous ICMP API requires
+	// an APC or event per request, so only probe the TCP port here
+	return ReachabilityProbe(ReachabilityProbe::Method::TcpConnect, port, timeout).probe(hostAddresses);
+}
+
+
+
 bool WindowsNetworkFunctions::configureFirewallException( const QString& applicationPath, const QString& description, bool enabled )
 {
 	HRESULT hr = S_OK;
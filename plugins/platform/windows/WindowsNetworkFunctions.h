@@ -36,6 +36,7 @@ public:
 	WindowsNetworkFunctions();
 
 	PingResult ping(const QString& hostAddress) override;
+	QVector<PingResult> pingHosts(const QStringList& hostAddresses, int port, int timeout) override;
 	bool configureFirewallException( const QString& applicationPath, const QString& description, bool enabled ) override;
 
 	bool configureSocketKeepalive( Socket socket, bool enabled, int idleTime, int interval, int probes ) override;
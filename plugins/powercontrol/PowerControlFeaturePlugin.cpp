@@ -136,6 +136,12 @@ bool PowerControlFeaturePlugin::controlFeature( Feature::Uid featureUid,
 		for (const auto& controlInterface : computerControlInterfaces)
 		{
 			hosts.append(controlInterface->computer());
+
+			// host is about to come up so stop backing off from connection attempts
+			if (controlInterface->vncConnection())
+			{
+				controlInterface->vncConnection()->resetConnectionRetryDelay();
+			}
 		}
 
 		(void) QtConcurrent::run([hosts]() {
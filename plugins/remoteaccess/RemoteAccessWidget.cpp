@@ -347,6 +347,11 @@ RemoteAccessWidget::RemoteAccessWidget( const ComputerControlInterface::Pointer&
 	connect( m_vncView, &VncViewWidget::mouseAtBorder, m_toolBar, &RemoteAccessWidgetToolBar::appear );
 	connect( m_vncView, &VncViewWidget::sizeHintChanged, this, &RemoteAccessWidget::updateSize );
 
+	if( m_vncView->connection() )
+	{
+		m_vncView->connection()->resetInputEventStatistics();
+	}
+
 	showMaximized();
 	VeyonCore::platform().coreFunctions().raiseWindow( this, false );
 
@@ -361,6 +366,15 @@ RemoteAccessWidget::RemoteAccessWidget( const ComputerControlInterface::Pointer&
 
 RemoteAccessWidget::~RemoteAccessWidget()
 {
+	if( m_vncView->connection() )
+	{
+		const auto statistics = m_vncView->connection()->inputEventStatistics();
+		vDebug() << "sent input events:" << statistics.sentEvents
+				 << "coalesced:" << statistics.coalescedEvents
+				 << "average latency (µs):" << statistics.averageLatency
+				 << "maximum latency (µs):" << statistics.maximumLatency;
+	}
+
 	delete m_vncView;
 }
 
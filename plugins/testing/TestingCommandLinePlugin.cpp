@@ -22,10 +22,191 @@
  *
  */
 
+#include <cmath>
+#include <limits>
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QtEndian>
+
 #include "CommandLineIO.h"
 #include "AccessControlProvider.h"
+#include "BuiltinFeatures.h"
+#include "ComputerControlInterface.h"
+#include "CryptoCore.h"
+#include "FeatureManager.h"
+#include "HostAddress.h"
+#include "ImageScaler.h"
+#include "MonitoringMode.h"
 #include "PlatformNetworkFunctions.h"
 #include "TestingCommandLinePlugin.h"
+#include "VeyonConfiguration.h"
+#include "VeyonConnection.h"
+#include "VncClientProtocol.h"
+#include "VncConnection.h"
+
+
+namespace {
+
+// provides data to VncClientProtocol piece by piece like a socket receiving TCP segments
+class ChunkedInputDevice : public QIODevice
+{
+public:
+	explicit ChunkedInputDevice( const QByteArray& data ) :
+		m_data( data )
+	{
+		open( QIODevice::ReadOnly ); // Flawfinder: ignore
+	}
+
+	bool isSequential() const override
+	{
+		return true;
+	}
+
+	qint64 bytesAvailable() const override
+	{
+		return m_availableSize - m_readPosition + QIODevice::bytesAvailable();
+	}
+
+	bool feed( qint64 size )
+	{
+		if( m_availableSize >= m_data.size() )
+		{
+			return false;
+		}
+
+		m_availableSize = qMin<qint64>( m_data.size(), m_availableSize + size );
+
+		return true;
+	}
+
+protected:
+	qint64 readData( char* data, qint64 maxSize ) override
+	{
+		const auto size = qMin( maxSize, m_availableSize - m_readPosition );
+		memcpy( data, m_data.constData() + m_readPosition, size_t(size) ); // Flawfinder: ignore
+		m_readPosition += size;
+
+		return size;
+	}
+
+	qint64 writeData( const char* data, qint64 size ) override
+	{
+		Q_UNUSED(data)
+		Q_UNUSED(size)
+
+		return -1;
+	}
+
+private:
+	const QByteArray m_data;
+	qint64 m_availableSize{0};
+	qint64 m_readPosition{0};
+
+};
+
+
+
+class RunningVncClientProtocol : public VncClientProtocol
+{
+public:
+	explicit RunningVncClientProtocol( QIODevice* socket ) :
+		VncClientProtocol( socket, {} )
+	{
+		rfbPixelFormat format{};
+		format.bitsPerPixel = 32;
+		format.depth = 24;
+		format.trueColour = 1;
+		format.redMax = 255;
+		format.greenMax = 255;
+		format.blueMax = 255;
+		setPixelFormat( format );
+
+		setState( Running );
+	}
+
+};
+
+
+
+// returns the peak signal-to-noise ratio in dB and the maximum difference of all channels of two images
+std::pair<double, int> compareImages( const QImage& first, const QImage& second )
+{
+	const auto a = first.convertToFormat( QImage::Format_ARGB32 );
+	const auto b = second.convertToFormat( QImage::Format_ARGB32 );
+
+	double squaredErrorSum = 0;
+	int maximumDifference = 0;
+
+	for( int y = 0; y < a.height(); ++y )
+	{
+		const auto lineA = reinterpret_cast<const QRgb *>( a.constScanLine( y ) );
+		const auto lineB = reinterpret_cast<const QRgb *>( b.constScanLine( y ) );
+		for( int x = 0; x < a.width(); ++x )
+		{
+			for( int shift = 0; shift < 32; shift += 8 )
+			{
+				const auto difference = qAbs( int( ( lineA[x] >> shift ) & 0xff ) - int( ( lineB[x] >> shift ) & 0xff ) );
+				squaredErrorSum += difference * difference;
+				maximumDifference = qMax( maximumDifference, difference );
+			}
+		}
+	}
+
+	const auto meanSquaredError = squaredErrorSum / ( double( a.width() ) * a.height() * 4 );
+	if( meanSquaredError <= 0 )
+	{
+		return { std::numeric_limits<double>::infinity(), maximumDifference };
+	}
+
+	return { 10 * std::log10( 255.0 * 255.0 / meanSquaredError ), maximumDifference };
+}
+
+
+
+// generates framebuffer updates made up of ZRLE rects with random payload
+QByteArray createFramebufferUpdates( int messageCount, int rectCount, int rectDataSize )
+{
+	QByteArray data;
+	data.reserve( messageCount * ( sz_rfbFramebufferUpdateMsg +
+								   rectCount * ( sz_rfbFramebufferUpdateRectHeader + sz_rfbZRLEHeader + rectDataSize ) ) );
+
+	QByteArray rectData( rectDataSize, 0 );
+
+	for( int i = 0; i < messageCount; ++i )
+	{
+		rfbFramebufferUpdateMsg message{};
+		message.type = rfbFramebufferUpdate;
+		message.nRects = qToBigEndian<uint16_t>( uint16_t(rectCount) );
+		data.append( reinterpret_cast<const char *>( &message ), sz_rfbFramebufferUpdateMsg );
+
+		for( int j = 0; j < rectCount; ++j )
+		{
+			rfbFramebufferUpdateRectHeader rectHeader{};
+			rectHeader.r.x = qToBigEndian<uint16_t>( uint16_t( ( j % 30 ) * 64 ) );
+			rectHeader.r.y = qToBigEndian<uint16_t>( uint16_t( ( j / 30 ) * 64 ) );
+			rectHeader.r.w = qToBigEndian<uint16_t>( 64 );
+			rectHeader.r.h = qToBigEndian<uint16_t>( 64 );
+			rectHeader.encoding = qToBigEndian<uint32_t>( rfbEncodingZRLE );
+			data.append( reinterpret_cast<const char *>( &rectHeader ), sz_rfbFramebufferUpdateRectHeader );
+
+			rfbZRLEHeader zrleHeader{};
+			zrleHeader.length = qToBigEndian<uint32_t>( uint32_t(rectDataSize) );
+			data.append( reinterpret_cast<const char *>( &zrleHeader ), sz_rfbZRLEHeader );
+
+			QRandomGenerator::global()->fillRange( reinterpret_cast<quint32 *>( rectData.data() ), rectDataSize / 4 );
+			data.append( rectData );
+		}
+	}
+
+	return data;
+}
+
+}
 
 
 TestingCommandLinePlugin::TestingCommandLinePlugin( QObject* parent ) :
@@ -35,6 +216,13 @@ TestingCommandLinePlugin::TestingCommandLinePlugin( QObject* parent ) :
 { QStringLiteral("authorizedgroups"), QStringLiteral( "check if specified user is in authorized groups [ACCESSING USER]" ) },
 { QStringLiteral("accesscontrolrules"), QStringLiteral( "process access control rules with arguments [ACCESSING USER] [ACCESSING COMPUTER] [LOCAL USER] [LOCAL COMPUTER] [CONNECTED USER]" ) },
 { QStringLiteral("isaccessdeniedbylocalstate"), QStringLiteral( "check if access would be denied by local state") },
+{ QStringLiteral("benchmarkaccesscontrol"), QStringLiteral( "benchmark evaluation of generated access control rules with optional arguments [RULES] [USERS] [CHECKS]" ) },
+{ QStringLiteral("benchmarkimagescaler"), QStringLiteral( "benchmark ImageScaler against QImage::scaled() with optional arguments [SOURCE WIDTH] [SOURCE HEIGHT] [SCALED WIDTH] [SCALED HEIGHT] [ITERATIONS]" ) },
+{ QStringLiteral("benchmarkvncclientprotocol"), QStringLiteral( "benchmark parsing server messages fed in chunks with optional arguments [CHUNK SIZE] [FILE WITH RECORDED SERVER MESSAGES]" ) },
+{ QStringLiteral("sessiontickets"), QStringLiteral( "connect to the Veyon Server on the given host repeatedly and check that every reconnect resumes the session with the ticket issued before with arguments [HOST] [RESUMPTIONS]" ) },
+{ QStringLiteral("disconnectedinputevents"), QStringLiteral( "check that input events are not queued while a VNC connection is not established" ) },
+{ QStringLiteral("stressproxy"), QStringLiteral( "open many concurrent connections to the Veyon Server on the given host and measure ping round trip times with arguments [HOST] [CONNECTIONS] [DURATION IN SECONDS]" ) },
+{ QStringLiteral("demoloadtest"), QStringLiteral( "start a demo server on the given host, connect many demo clients to it and measure framebuffer update rates with arguments [HOST] [CLIENTS] [DURATION IN SECONDS] [RELAYS] - demo relays are run on the same host and forward the demo to the clients" ) },
 				} )
 {
 }
@@ -124,6 +312,98 @@ CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_isaccessd
 
 
 
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_benchmarkaccesscontrol( const QStringList& arguments )
+{
+	const auto ruleCount = qMax( 1, arguments.value( 0, QStringLiteral("100") ).toInt() );
+	const auto userCount = qMax( 1, arguments.value( 1, QStringLiteral("1000") ).toInt() );
+	const auto checkCount = qMax( 1, arguments.value( 2, QStringLiteral("10000") ).toInt() );
+
+	// generate rules with conditions of different costs where only few rules match - location based
+	// conditions are left out as they would mainly measure name resolution of the generated hosts
+	QJsonArray rules;
+	for( int i = 0; i < ruleCount - 1; ++i )
+	{
+		AccessControlRule rule;
+		rule.setName( QStringLiteral("Rule %1").arg( i ) );
+		rule.setAction( i % 2 ? AccessControlRule::Action::Deny : AccessControlRule::Action::Allow );
+
+		switch( i % 4 )
+		{
+		case 0:
+			rule.setConditionEnabled( AccessControlRule::Condition::MemberOfUserGroup, true );
+			rule.setSubject( AccessControlRule::Condition::MemberOfUserGroup, AccessControlRule::Subject::AccessingUser );
+			rule.setArgument( AccessControlRule::Condition::MemberOfUserGroup,
+							  i % 8 ? QStringLiteral("group-%1").arg( i ) : QStringLiteral("/^group-%1.*/").arg( i ) );
+			break;
+		case 1:
+			rule.setConditionEnabled( AccessControlRule::Condition::GroupsInCommon, true );
+			rule.setConditionEnabled( AccessControlRule::Condition::AccessFromLocalUser, true );
+			break;
+		case 2:
+			rule.setConditionEnabled( AccessControlRule::Condition::MemberOfUserGroup, true );
+			rule.setSubject( AccessControlRule::Condition::MemberOfUserGroup, AccessControlRule::Subject::LocalUser );
+			rule.setArgument( AccessControlRule::Condition::MemberOfUserGroup, QStringLiteral("group-%1").arg( i ) );
+			rule.setConditionEnabled( AccessControlRule::Condition::AccessFromAlreadyConnectedUser, true );
+			break;
+		default:
+			rule.setConditionEnabled( AccessControlRule::Condition::AccessFromLocalHost, true );
+			rule.setConditionEnabled( AccessControlRule::Condition::ComputerAlreadyBeingAccessed, true );
+			break;
+		}
+
+		rules.append( rule.toJson() );
+	}
+
+	AccessControlRule fallbackRule;
+	fallbackRule.setName( QStringLiteral("Fallback") );
+	fallbackRule.setAction( AccessControlRule::Action::Deny );
+	fallbackRule.setConditionsIgnored( true );
+	rules.append( fallbackRule.toJson() );
+
+	const auto originalRules = VeyonCore::config().accessControlRules();
+	VeyonCore::config().setAccessControlRules( rules );
+
+	QElapsedTimer timer;
+	timer.start();
+
+	AccessControlProvider provider;
+
+	const auto compileTime = timer.nsecsElapsed();
+
+	const auto localUser = VeyonCore::platform().userFunctions().currentUser();
+	const auto localComputer = HostAddress::localFQDN();
+
+	QMap<AccessControlRule::Action, int> results;
+
+	timer.restart();
+
+	for( int i = 0; i < checkCount; ++i )
+	{
+		const auto user = QStringLiteral("user-%1").arg( i % userCount );
+		const auto computer = QStringLiteral("10.%1.%2.%3").arg( ( i >> 16 ) & 0xff ).arg( ( i >> 8 ) & 0xff ).arg( i & 0xff );
+		const QStringList connectedUsers{ i % 3 ? QString{} : user };
+
+		const auto rule = provider.processAccessControlRules( user, computer, localUser, localComputer, connectedUsers );
+		results[rule ? rule->action() : AccessControlRule::Action::None]++;
+	}
+
+	const auto elapsed = timer.nsecsElapsed();
+
+	VeyonCore::config().setAccessControlRules( originalRules );
+
+	printf( "[TEST]: BenchmarkAccessControl: %d rules, %d users, %d checks\n", ruleCount, userCount, checkCount );
+	printf( "[TEST]: BenchmarkAccessControl: compiled rules in %.3f ms\n", double( compileTime ) / 1000000 );
+	printf( "[TEST]: BenchmarkAccessControl: %.1f us per check (%.0f checks/s)\n",
+			double( elapsed ) / checkCount / 1000, double( checkCount ) * 1000000000 / double( qMax<qint64>( 1, elapsed ) ) );
+	printf( "[TEST]: BenchmarkAccessControl: %d allowed, %d denied, %d unmatched\n",
+			results.value( AccessControlRule::Action::Allow ), results.value( AccessControlRule::Action::Deny ),
+			results.value( AccessControlRule::Action::None ) );
+
+	return Successful;
+}
+
+
+
 CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_ping( const QStringList& arguments )
 {
 	if( arguments.count() < 1 )
@@ -131,5 +411,601 @@ CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_ping( con
 		return NotEnoughArguments;
 	}
 
-	return VeyonCore::platform().networkFunctions().ping( arguments.first() ) == PlatformNetworkFunctions::PingResult::ReplyReceived ? Successful : Failed;
+	if( arguments.count() == 1 )
+	{
+		return VeyonCore::platform().networkFunctions().ping( arguments.first() ) == PlatformNetworkFunctions::PingResult::ReplyReceived ? Successful : Failed;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	const auto results = VeyonCore::platform().networkFunctions().pingHosts( arguments, VeyonCore::config().veyonServerPort() );
+
+	const auto elapsed = timer.elapsed();
+
+	int reachableHosts = 0;
+	for( int i = 0; i < arguments.count(); ++i )
+	{
+		const auto reachable = results.value( i ) == PlatformNetworkFunctions::PingResult::ReplyReceived;
+		reachableHosts += reachable ? 1 : 0;
+		printf( "[TEST]: Ping: %s: %s\n", qUtf8Printable( arguments[i] ), reachable ? "ONLINE" : "OFFLINE" );
+	}
+
+	printf( "[TEST]: Ping: %d of %d hosts online, probed in %lld ms\n", reachableHosts, int(arguments.count()), elapsed );
+
+	return reachableHosts == arguments.count() ? Successful : Failed;
+}
+
+
+
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_benchmarkimagescaler( const QStringList& arguments )
+{
+	const QSize sourceSize( arguments.value( 0, QStringLiteral("1920") ).toInt(), arguments.value( 1, QStringLiteral("1080") ).toInt() );
+	const QSize scaledSize( arguments.value( 2, QStringLiteral("320") ).toInt(), arguments.value( 3, QStringLiteral("180") ).toInt() );
+	const auto iterations = qMax( 1, arguments.value( 4, QStringLiteral("100") ).toInt() );
+
+	if( sourceSize.isEmpty() || scaledSize.isEmpty() )
+	{
+		return NotEnoughArguments;
+	}
+
+	// fill with random data so results are not affected by shortcuts for uniform areas
+	QImage source( sourceSize, QImage::Format_RGB32 );
+	for( int y = 0; y < source.height(); ++y )
+	{
+		QRandomGenerator::global()->fillRange( reinterpret_cast<quint32 *>( source.scanLine( y ) ), source.width() );
+	}
+
+	const auto measure = [&]( const std::function<QImage()>& scale ) {
+		QElapsedTimer timer;
+		timer.start();
+		for( int i = 0; i < iterations; ++i )
+		{
+			scale();
+		}
+		return double( timer.nsecsElapsed() ) / iterations / 1000000;
+	};
+
+	const auto reference = measure( [&]() { return source.scaled( scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ); } );
+	printf( "[TEST]: BenchmarkImageScaler: %dx%d -> %dx%d, %d iterations\n",
+			sourceSize.width(), sourceSize.height(), scaledSize.width(), scaledSize.height(), iterations );
+	printf( "[TEST]: BenchmarkImageScaler: QImage::scaled: %.3f ms\n", reference );
+
+	const std::initializer_list<std::pair<ImageScaler::Implementation, const char*>> implementations{
+		{ ImageScaler::Implementation::Scalar, "Scalar" },
+		{ ImageScaler::Implementation::SSE2, "SSE2" },
+		{ ImageScaler::Implementation::AVX2, "AVX2" }
+	};
+
+	for( const auto& implementation : implementations )
+	{
+		if( implementation.first > ImageScaler::bestAvailableImplementation() )
+		{
+			continue;
+		}
+
+		ImageScaler::setImplementation( implementation.first );
+
+		const auto result = measure( [&]() { return ImageScaler::scaled( source, scaledSize ); } );
+		printf( "[TEST]: BenchmarkImageScaler: ImageScaler (%s): %.3f ms (%.1fx)\n",
+				implementation.second, result, reference / result );
+	}
+
+	// random data averages to the same grey with any filter, so check the output quality with gradients,
+	// edges and translucency instead
+	QImage pattern( sourceSize, QImage::Format_ARGB32 );
+	for( int y = 0; y < pattern.height(); ++y )
+	{
+		auto line = reinterpret_cast<QRgb *>( pattern.scanLine( y ) );
+		for( int x = 0; x < pattern.width(); ++x )
+		{
+			line[x] = qRgba( x * 255 / pattern.width(), y * 255 / pattern.height(),
+							 ( ( x / 16 + y / 16 ) % 2 ) * 255, 255 - x * 127 / pattern.width() );
+		}
+	}
+
+	const auto referenceImage = pattern.scaled( scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation );
+
+	ImageScaler::setImplementation( ImageScaler::Implementation::Scalar );
+	const auto scalarImage = ImageScaler::scaled( pattern, scaledSize );
+
+	auto result = Successful;
+
+	for( const auto& implementation : implementations )
+	{
+		if( implementation.first > ImageScaler::bestAvailableImplementation() )
+		{
+			continue;
+		}
+
+		ImageScaler::setImplementation( implementation.first );
+
+		const auto image = ImageScaler::scaled( pattern, scaledSize );
+		const auto quality = compareImages( image, referenceImage );
+		const auto deviation = compareImages( image, scalarImage ).second;
+
+		printf( "[TEST]: BenchmarkImageScaler: ImageScaler (%s): PSNR %.1f dB, maximum difference %d "
+				"compared to QImage::scaled(), %d compared to scalar implementation\n",
+				implementation.second, quality.first, quality.second, deviation );
+
+		// kernels may only differ in rounding
+		if( image.format() != pattern.format() || quality.first < MinimumImageScalerPsnr || deviation > 1 )
+		{
+			CommandLineIO::error( tr( "Output of ImageScaler (%1) differs too much from reference" )
+								  .arg( QLatin1String( implementation.second ) ) );
+			result = Failed;
+		}
+	}
+
+	ImageScaler::setImplementation( ImageScaler::Implementation::Auto );
+
+	return result;
+}
+
+
+
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_benchmarkvncclientprotocol( const QStringList& arguments )
+{
+	const auto chunkSize = qMax( 1, arguments.value( 0, QStringLiteral("1460") ).toInt() );
+
+	QByteArray data;
+	if( arguments.count() > 1 )
+	{
+		QFile file( arguments[1] );
+		if( file.open( QFile::ReadOnly ) == false ) // Flawfinder: ignore
+		{
+			CommandLineIO::error( tr( "Could not open file \"%1\" for reading." ).arg( arguments[1] ) );
+			return Failed;
+		}
+		data = file.readAll();
+	}
+	else
+	{
+		data = createFramebufferUpdates( 50, 100, 8192 );
+	}
+
+	const auto measure = [&data]( qint64 size, int* messageCount ) {
+		ChunkedInputDevice device( data );
+		RunningVncClientProtocol protocol( &device );
+
+		QElapsedTimer timer;
+		timer.start();
+
+		*messageCount = 0;
+		while( device.feed( size ) )
+		{
+			while( protocol.receiveMessage() )
+			{
+				++*messageCount;
+			}
+		}
+
+		return double( timer.nsecsElapsed() ) / 1000000;
+	};
+
+	int referenceMessageCount = 0;
+	const auto reference = measure( data.size(), &referenceMessageCount );
+
+	int messageCount = 0;
+	const auto result = measure( chunkSize, &messageCount );
+
+	printf( "[TEST]: BenchmarkVncClientProtocol: %d messages, %lld bytes\n", referenceMessageCount, qint64(data.size()) );
+	printf( "[TEST]: BenchmarkVncClientProtocol: all data at once: %.3f ms (%.1f MB/s)\n",
+			reference, double(data.size()) / 1024 / 1024 / ( reference / 1000 ) );
+	printf( "[TEST]: BenchmarkVncClientProtocol: chunks of %d bytes: %.3f ms (%.1f MB/s)\n",
+			chunkSize, result, double(data.size()) / 1024 / 1024 / ( result / 1000 ) );
+
+	if( messageCount != referenceMessageCount )
+	{
+		printf( "[TEST]: BenchmarkVncClientProtocol: FAIL (parsed %d instead of %d messages)\n", messageCount, referenceMessageCount );
+		return Failed;
+	}
+
+	return Successful;
+}
+
+
+
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_sessiontickets( const QStringList& arguments )
+{
+	if( arguments.count() < 1 )
+	{
+		return NotEnoughArguments;
+	}
+
+	const auto& host = arguments[0];
+	const auto resumptionCount = qMax( 1, arguments.value( 1, QStringLiteral("2") ).toInt() );
+	const auto server = QStringLiteral("%1:%2").arg( host ).arg( VeyonCore::config().veyonServerPort() );
+
+	static constexpr auto ConnectTimeout = 30000;
+
+	if( VeyonCore::instance()->initAuthentication() == false )
+	{
+		CommandLineIO::error( tr( "Failed to initialize credentials" ) );
+		return Failed;
+	}
+
+	// the first connection authenticates fully, every further one has to resume with the ticket issued
+	// to the previous one and receive a new ticket itself
+	for( int i = 0; i <= resumptionCount; ++i )
+	{
+		Computer computer;
+		computer.setHostAddress( host );
+
+		const auto computerControlInterface = ComputerControlInterface::Pointer::create( computer );
+
+		QEventLoop eventLoop;
+		connect( computerControlInterface.data(), &ComputerControlInterface::stateChanged, &eventLoop, [&]() {
+			if( computerControlInterface->state() == ComputerControlInterface::State::Connected )
+			{
+				eventLoop.quit();
+			}
+		} );
+		QTimer::singleShot( ConnectTimeout, &eventLoop, &QEventLoop::quit );
+
+		computerControlInterface->start();
+		eventLoop.exec();
+
+		const auto connected = computerControlInterface->state() == ComputerControlInterface::State::Connected;
+		computerControlInterface->stop();
+
+		if( connected == false )
+		{
+			printf( "[TEST]: SessionTickets: FAIL (connection %d could not be established)\n", i + 1 );
+			return Failed;
+		}
+
+		const auto resumptions = VeyonConnection::sessionTicketResumptions( server );
+		if( resumptions < 0 )
+		{
+			printf( "[TEST]: SessionTickets: FAIL (no session ticket received for connection %d)\n", i + 1 );
+			return Failed;
+		}
+
+		printf( "[TEST]: SessionTickets: connection %d: %s, new ticket received\n", i + 1,
+				resumptions > 0 ? "resumed" : "authenticated fully" );
+
+		if( resumptions != i )
+		{
+			printf( "[TEST]: SessionTickets: FAIL (%d instead of %d resumptions in a row)\n", resumptions, i );
+			return Failed;
+		}
+	}
+
+	return Successful;
+}
+
+
+
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_disconnectedinputevents( const QStringList& arguments )
+{
+	Q_UNUSED(arguments)
+
+	// never started and thus disconnected
+	auto connection = new VncConnection;
+
+	for( int i = 0; i < VncInputEventRing::Capacity * 2; ++i )
+	{
+		connection->mouseEvent( i % 100, i % 100, i % 2 );
+		connection->keyEvent( 'a', i % 2 == 0 );
+	}
+
+	const auto eventsQueued = connection->isEventQueueEmpty() == false;
+
+	connection->stopAndDeleteLater();
+
+	if( eventsQueued )
+	{
+		printf( "[TEST]: DisconnectedInputEvents: FAIL (events queued for replay after connecting)\n" );
+		return Failed;
+	}
+
+	printf( "[TEST]: DisconnectedInputEvents: OK\n" );
+
+	return Successful;
+}
+
+
+
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_stressproxy( const QStringList& arguments )
+{
+	if( arguments.count() < 1 )
+	{
+		return NotEnoughArguments;
+	}
+
+	const auto& host = arguments[0];
+	const auto connectionCount = qMax( 1, arguments.value( 1, QStringLiteral("50") ).toInt() );
+	const auto duration = qMax( 1, arguments.value( 2, QStringLiteral("30") ).toInt() ) * 1000;
+
+	static constexpr auto PingInterval = 1000;
+
+	if( VeyonCore::instance()->initAuthentication() == false )
+	{
+		CommandLineIO::error( tr( "Failed to initialize credentials" ) );
+		return Failed;
+	}
+
+	struct ConnectionStatistics
+	{
+		qint64 connectTime{-1};
+		qint64 pingSendTime{-1};
+		qint64 maximumPingTime{0};
+		qint64 totalPingTime{0};
+		int pingCount{0};
+		int framebufferUpdateCount{0};
+	};
+
+	auto& monitoringMode = VeyonCore::builtinFeatures().monitoringMode();
+
+	QVector<ConnectionStatistics> statistics( connectionCount );
+	ComputerControlInterfaceList computerControlInterfaces;
+	computerControlInterfaces.reserve( connectionCount );
+
+	QElapsedTimer timer;
+	timer.start();
+
+	for( int i = 0; i < connectionCount; ++i )
+	{
+		Computer computer;
+		computer.setHostAddress( host );
+
+		const auto computerControlInterface = ComputerControlInterface::Pointer::create( computer );
+
+		connect( computerControlInterface.data(), &ComputerControlInterface::stateChanged, computerControlInterface.data(), [&, i]() {
+			if( computerControlInterfaces.value( i ) &&
+				computerControlInterfaces[i]->state() == ComputerControlInterface::State::Connected &&
+				statistics[i].connectTime < 0 )
+			{
+				statistics[i].connectTime = timer.elapsed();
+
+				// replies to pings arrive as feature messages of the monitoring mode feature
+				connect( computerControlInterfaces[i]->connection(), &VeyonConnection::featureMessageReceived,
+						 computerControlInterfaces[i].data(),
+						 [&, i]( const FeatureMessage& message ) {
+					auto& connectionStatistics = statistics[i];
+					if( message.featureUid() == monitoringMode.feature().uid() && connectionStatistics.pingSendTime >= 0 )
+					{
+						const auto pingTime = timer.elapsed() - connectionStatistics.pingSendTime;
+						connectionStatistics.maximumPingTime = qMax( connectionStatistics.maximumPingTime, pingTime );
+						connectionStatistics.totalPingTime += pingTime;
+						++connectionStatistics.pingCount;
+						connectionStatistics.pingSendTime = -1;
+					}
+				} );
+			}
+		} );
+
+		connect( computerControlInterface.data(), &ComputerControlInterface::framebufferUpdated, computerControlInterface.data(), [&, i]() {
+			++statistics[i].framebufferUpdateCount;
+		} );
+
+		computerControlInterfaces.append( computerControlInterface );
+		computerControlInterface->start( {}, ComputerControlInterface::UpdateMode::Live );
+	}
+
+	QTimer pingTimer;
+	connect( &pingTimer, &QTimer::timeout, this, [&]() {
+		for( int i = 0; i < connectionCount; ++i )
+		{
+			// only one ping per connection in flight so stalled replies show up as long ping times
+			if( computerControlInterfaces[i]->state() == ComputerControlInterface::State::Connected &&
+				statistics[i].pingSendTime < 0 )
+			{
+				statistics[i].pingSendTime = timer.elapsed();
+				monitoringMode.ping( { computerControlInterfaces[i] } );
+			}
+		}
+	} );
+	pingTimer.start( PingInterval );
+
+	QEventLoop eventLoop;
+	QTimer::singleShot( duration, &eventLoop, &QEventLoop::quit );
+	eventLoop.exec();
+
+	pingTimer.stop();
+
+	int connectedCount = 0;
+	qint64 totalConnectTime = 0;
+	qint64 maximumConnectTime = 0;
+	qint64 totalPingTime = 0;
+	qint64 maximumPingTime = 0;
+	int pingCount = 0;
+	int unansweredPingCount = 0;
+	int framebufferUpdateCount = 0;
+
+	for( const auto& connectionStatistics : std::as_const( statistics ) )
+	{
+		if( connectionStatistics.connectTime >= 0 )
+		{
+			++connectedCount;
+			totalConnectTime += connectionStatistics.connectTime;
+			maximumConnectTime = qMax( maximumConnectTime, connectionStatistics.connectTime );
+		}
+
+		totalPingTime += connectionStatistics.totalPingTime;
+		maximumPingTime = qMax( maximumPingTime, connectionStatistics.maximumPingTime );
+		pingCount += connectionStatistics.pingCount;
+		unansweredPingCount += connectionStatistics.pingSendTime >= 0 ? 1 : 0;
+		framebufferUpdateCount += connectionStatistics.framebufferUpdateCount;
+	}
+
+	for( const auto& computerControlInterface : std::as_const( computerControlInterfaces ) )
+	{
+		computerControlInterface->stop();
+	}
+
+	printf( "[TEST]: StressProxy: %d of %d connections established (average %lld ms, maximum %lld ms)\n",
+			connectedCount, connectionCount,
+			connectedCount > 0 ? totalConnectTime / connectedCount : 0, maximumConnectTime );
+	printf( "[TEST]: StressProxy: %d framebuffer updates (%.1f per second)\n",
+			framebufferUpdateCount, double(framebufferUpdateCount) * 1000 / duration );
+	printf( "[TEST]: StressProxy: %d pings answered (average %lld ms, maximum %lld ms), %d unanswered\n",
+			pingCount, pingCount > 0 ? totalPingTime / pingCount : 0, maximumPingTime, unansweredPingCount );
+
+	return connectedCount == connectionCount && pingCount > 0 ? Successful : Failed;
+}
+
+
+
+CommandLinePluginInterface::RunResult TestingCommandLinePlugin::handle_demoloadtest( const QStringList& arguments )
+{
+	if( arguments.count() < 1 )
+	{
+		return NotEnoughArguments;
+	}
+
+	const auto& host = arguments[0];
+	const auto clientCount = qMax( 1, arguments.value( 1, QStringLiteral("200") ).toInt() );
+	const auto duration = qMax( 1, arguments.value( 2, QStringLiteral("30") ).toInt() ) * 1000;
+	const auto relayCount = qMax( 0, arguments.value( 3, QStringLiteral("0") ).toInt() );
+	const auto demoServerPort = VeyonCore::config().demoServerPort();
+
+	static const Feature::Uid demoServerFeatureUid( "e4b6e743-1f5b-491d-9364-e091086200f4" );
+
+	if( VeyonCore::instance()->initAuthentication() == false )
+	{
+		CommandLineIO::error( tr( "Failed to initialize credentials" ) );
+		return Failed;
+	}
+
+	// demo clients authenticate at the demo server using the demo access token only
+	const auto demoAccessToken = CryptoCore::generateChallenge();
+	VeyonCore::authenticationCredentials().setToken( demoAccessToken );
+
+	Computer serverComputer;
+	serverComputer.setHostAddress( host );
+
+	const auto serverControlInterface = ComputerControlInterface::Pointer::create( serverComputer );
+	serverControlInterface->start();
+
+	// the demo feature plugin repeats the start command until the connection has been established
+	VeyonCore::featureManager().controlFeature( demoServerFeatureUid, FeatureProviderInterface::Operation::Start,
+												{ { QStringLiteral("demoAccessToken"), demoAccessToken },
+												  { QStringLiteral("demoServerPort"), demoServerPort } },
+												{ serverControlInterface } );
+
+	// relays listen on the following ports and receive the demo from the demo server via loopback
+	QVector<int> clientPorts{ demoServerPort };
+	if( relayCount > 0 )
+	{
+		clientPorts.clear();
+		for( int i = 1; i <= relayCount; ++i )
+		{
+			VeyonCore::featureManager().controlFeature( demoServerFeatureUid, FeatureProviderInterface::Operation::Start,
+														{ { QStringLiteral("demoAccessToken"), demoAccessToken },
+														  { QStringLiteral("demoServerPort"), demoServerPort + i },
+														  { QStringLiteral("upstreamDemoServerHost"), QStringLiteral("127.0.0.1") },
+														  { QStringLiteral("upstreamDemoServerPort"), demoServerPort } },
+														{ serverControlInterface } );
+			clientPorts.append( demoServerPort + i );
+		}
+	}
+
+	struct ClientStatistics
+	{
+		qint64 connectTime{-1};
+		qint64 firstUpdateTime{-1};
+		int framebufferUpdateCount{0};
+	};
+
+	QVector<ClientStatistics> statistics( clientCount );
+	ComputerControlInterfaceList computerControlInterfaces;
+	computerControlInterfaces.reserve( clientCount );
+
+	QElapsedTimer timer;
+	timer.start();
+
+	for( int i = 0; i < clientCount; ++i )
+	{
+		Computer computer;
+		computer.setHostAddress( host );
+
+		const auto computerControlInterface = ComputerControlInterface::Pointer::create( computer, clientPorts[i % clientPorts.count()] );
+
+		connect( computerControlInterface.data(), &ComputerControlInterface::stateChanged, computerControlInterface.data(), [&, i]() {
+			if( computerControlInterfaces.value( i ) &&
+				computerControlInterfaces[i]->state() == ComputerControlInterface::State::Connected &&
+				statistics[i].connectTime < 0 )
+			{
+				statistics[i].connectTime = timer.elapsed();
+			}
+		} );
+
+		connect( computerControlInterface.data(), &ComputerControlInterface::framebufferUpdated, computerControlInterface.data(), [&, i]() {
+			if( statistics[i].firstUpdateTime < 0 )
+			{
+				statistics[i].firstUpdateTime = timer.elapsed() - qMax<qint64>( 0, statistics[i].connectTime );
+			}
+			++statistics[i].framebufferUpdateCount;
+		} );
+
+		computerControlInterfaces.append( computerControlInterface );
+		computerControlInterface->start( {}, ComputerControlInterface::UpdateMode::Live );
+	}
+
+	QEventLoop eventLoop;
+	QTimer::singleShot( duration, &eventLoop, &QEventLoop::quit );
+	eventLoop.exec();
+
+	int connectedCount = 0;
+	int updatedCount = 0;
+	qint64 totalConnectTime = 0;
+	qint64 maximumConnectTime = 0;
+	qint64 totalFirstUpdateTime = 0;
+	qint64 maximumFirstUpdateTime = 0;
+	int framebufferUpdateCount = 0;
+	int minimumFramebufferUpdateCount = -1;
+
+	for( const auto& clientStatistics : std::as_const( statistics ) )
+	{
+		if( clientStatistics.connectTime >= 0 )
+		{
+			++connectedCount;
+			totalConnectTime += clientStatistics.connectTime;
+			maximumConnectTime = qMax( maximumConnectTime, clientStatistics.connectTime );
+		}
+
+		if( clientStatistics.firstUpdateTime >= 0 )
+		{
+			++updatedCount;
+			totalFirstUpdateTime += clientStatistics.firstUpdateTime;
+			maximumFirstUpdateTime = qMax( maximumFirstUpdateTime, clientStatistics.firstUpdateTime );
+		}
+
+		framebufferUpdateCount += clientStatistics.framebufferUpdateCount;
+		minimumFramebufferUpdateCount = minimumFramebufferUpdateCount < 0 ?
+											clientStatistics.framebufferUpdateCount :
+											qMin( minimumFramebufferUpdateCount, clientStatistics.framebufferUpdateCount );
+	}
+
+	for( const auto& computerControlInterface : std::as_const( computerControlInterfaces ) )
+	{
+		computerControlInterface->stop();
+	}
+
+	VeyonCore::featureManager().controlFeature( demoServerFeatureUid, FeatureProviderInterface::Operation::Stop,
+												{}, { serverControlInterface } );
+
+	// give the stop command a chance to be delivered
+	QTimer::singleShot( 1000, &eventLoop, &QEventLoop::quit );
+	eventLoop.exec();
+
+	serverControlInterface->stop();
+
+	if( relayCount > 0 )
+	{
+		printf( "[TEST]: DemoLoadTest: %d relays forwarding to %d clients each\n",
+				relayCount, ( clientCount + relayCount - 1 ) / relayCount );
+	}
+	printf( "[TEST]: DemoLoadTest: %d of %d clients connected (average %lld ms, maximum %lld ms)\n",
+			connectedCount, clientCount,
+			connectedCount > 0 ? totalConnectTime / connectedCount : 0, maximumConnectTime );
+	printf( "[TEST]: DemoLoadTest: %d clients received updates, first update after average %lld ms, maximum %lld ms\n",
+			updatedCount, updatedCount > 0 ? totalFirstUpdateTime / updatedCount : 0, maximumFirstUpdateTime );
+	printf( "[TEST]: DemoLoadTest: %d framebuffer updates (%.1f per client and second, minimum %d per client)\n",
+			framebufferUpdateCount, double(framebufferUpdateCount) * 1000 / duration / clientCount,
+			minimumFramebufferUpdateCount );
+
+	return connectedCount == clientCount && updatedCount == clientCount ? Successful : Failed;
 }
@@ -84,9 +84,19 @@ public Q_SLOTS:
 	CommandLinePluginInterface::RunResult handle_authorizedgroups( const QStringList& arguments );
 	CommandLinePluginInterface::RunResult handle_accesscontrolrules( const QStringList& arguments );
 	CommandLinePluginInterface::RunResult handle_isaccessdeniedbylocalstate( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_benchmarkaccesscontrol( const QStringList& arguments );
 	CommandLinePluginInterface::RunResult handle_ping( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_benchmarkimagescaler( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_benchmarkvncclientprotocol( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_stressproxy( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_sessiontickets( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_disconnectedinputevents( const QStringList& arguments );
+	CommandLinePluginInterface::RunResult handle_demoloadtest( const QStringList& arguments );
 
 private:
+	// below this the output of ImageScaler is visibly worse than the one of QImage::scaled()
+	static constexpr auto MinimumImageScalerPsnr = 30.0;
+
 	QMap<QString, QString> m_commands;
 
 };
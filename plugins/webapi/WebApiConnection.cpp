@@ -26,14 +26,22 @@
 #include <QTimer>
 
 #include "ComputerControlInterface.h"
+#include "ImageScaler.h"
 #include "WebApiConnection.h"
 
 
 WebApiConnection::WebApiConnection( const QString& hostAddress ) :
 	m_controlInterface( ComputerControlInterface::Pointer::create( Computer( {}, hostAddress, hostAddress ) ) ),
 	m_idleTimer( new QTimer ),
-	m_lifetimeTimer( new QTimer )
+	m_lifetimeTimer( new QTimer ),
+	m_framebufferEncoderWatcher( new QFutureWatcher<EncodingResult> )
 {
+	QObject::connect( m_framebufferEncoderWatcher, &QFutureWatcherBase::finished, m_framebufferEncoderWatcher,
+					  [this]() {
+						  lock();
+						  updateEncodedFramebufferState();
+						  unlock();
+					  } );
 }
 
 
@@ -42,6 +50,9 @@ WebApiConnection::~WebApiConnection()
 {
 	m_framebufferEncoder.waitForFinished();
 
+	// a pending finished notification must not reach us anymore
+	m_framebufferEncoderWatcher->disconnect();
+	m_framebufferEncoderWatcher->deleteLater();
 	m_idleTimer->deleteLater();
 	m_lifetimeTimer->deleteLater();
 
@@ -85,13 +96,15 @@ QByteArray WebApiConnection::encodedFramebufferData( QSize size, const QByteArra
 	}
 
 	m_framebufferEncoder.waitForFinished();
+	// the finished notification of the watcher may still be pending
+	updateEncodedFramebufferState();
 
 	if( format != m_imageFormat ||
 		compression != m_imageCompression ||
 		quality != m_imageQuality ||
 		size != m_imageSize ||
 		m_framebufferEncoder.isCanceled() ||
-		m_framebufferEncoder.result().expired() )
+		( m_framebufferEncoder.result().expired() && isEncodedFramebufferOutdated() ) )
 	{
 		m_imageFormat = format;
 		m_imageCompression = compression;
@@ -115,7 +128,12 @@ QByteArray WebApiConnection::encodedFramebufferData( QSize size, const QByteArra
 		QTimer::singleShot( preencodeInterval,
 							m_controlInterface.data(), [this]() {
 								lock();
-								runFramebufferEncoder();
+								// no need to encode again if an encoder is still running or
+								// there hasn't been any update in the meantime
+								if( m_framebufferEncoder.isRunning() == false && isEncodedFramebufferOutdated() )
+								{
+									runFramebufferEncoder();
+								}
 								unlock();
 							} );
 	}
@@ -130,6 +148,33 @@ QByteArray WebApiConnection::encodedFramebufferData( QSize size, const QByteArra
 
 
 
+void WebApiConnection::updateEncodedFramebufferState()
+{
+	const auto future = m_framebufferEncoderWatcher->future();
+
+	if( future.isCanceled() || future.resultCount() < 1 )
+	{
+		m_encodedFramebufferAvailable = false;
+		return;
+	}
+
+	// the future has finished so this does not block
+	const auto result = future.result();
+
+	m_encodedFramebufferGeneration = result.framebufferGeneration;
+	m_encodedFramebufferAvailable = result.imageData.isEmpty() == false;
+}
+
+
+
+bool WebApiConnection::isEncodedFramebufferOutdated() const
+{
+	return m_encodedFramebufferAvailable == false ||
+		   m_encodedFramebufferGeneration != m_controlInterface->framebufferGeneration();
+}
+
+
+
 void WebApiConnection::runFramebufferEncoder()
 {
 	m_framebufferEncoder = QtConcurrent::run( [this]() {
@@ -138,6 +183,8 @@ void WebApiConnection::runFramebufferEncoder()
 		encodingTimer.start();
 
 		EncodingResult result;
+		// query generation first so we never consider outdated data as up to date
+		result.framebufferGeneration = m_controlInterface->framebufferGeneration();
 		QBuffer dataBuffer( &result.imageData );
 		dataBuffer.open( QBuffer::WriteOnly );
 		QImageWriter imageWriter( &dataBuffer, m_imageFormat );
@@ -159,10 +206,14 @@ void WebApiConnection::runFramebufferEncoder()
 			m_controlInterface->setScaledFramebufferSize(m_imageSize);
 		}
 
-		const auto writeResult = imageWriter.write(
-			m_imageSize.isEmpty() ?
-								 controlInterface()->framebuffer() :
-								 controlInterface()->scaledFramebuffer() );
+		auto image = m_imageSize.isEmpty() ? controlInterface()->framebuffer() : controlInterface()->scaledFramebuffer();
+		if( m_imageSize.isEmpty() == false && image.size() != m_imageSize )
+		{
+			// scaled framebuffer not available (yet) in requested size
+			image = ImageScaler::scaled( controlInterface()->framebuffer(), m_imageSize );
+		}
+
+		const auto writeResult = imageWriter.write( image );
 
 		dataBuffer.close();
 
@@ -176,4 +227,6 @@ void WebApiConnection::runFramebufferEncoder()
 
 		return result;
 	} );
+
+	m_framebufferEncoderWatcher->setFuture( m_framebufferEncoder );
 }
@@ -25,8 +25,11 @@
 #pragma once
 
 #include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QtConcurrent>
 
+#include <atomic>
+
 #include "ComputerControlInterface.h"
 
 class ComputerControlInterface;
@@ -74,6 +77,8 @@ public:
 
 private:
 	void runFramebufferEncoder();
+	void updateEncodedFramebufferState();
+	bool isEncodedFramebufferOutdated() const;
 
 	ComputerControlInterface::Pointer m_controlInterface;
 	QTimer* m_idleTimer{nullptr};
@@ -87,6 +92,7 @@ private:
 	struct EncodingResult {
 		QByteArray imageData{};
 		QString errorString{};
+		quint64 framebufferGeneration{0};
 		qint64 timestamp{QDateTime::currentMSecsSinceEpoch()};
 
 		bool expired() const
@@ -100,8 +106,13 @@ private:
 	static constexpr auto MinimumPreencodeInterval = 10;
 
 	QFuture<EncodingResult> m_framebufferEncoder;
+	QFutureWatcher<EncodingResult>* m_framebufferEncoderWatcher{nullptr};
 	QString m_encodingError;
 
+	// state of the last finished encoder run so it can be checked without waiting for a running one
+	std::atomic<bool> m_encodedFramebufferAvailable{false};
+	std::atomic<quint64> m_encodedFramebufferGeneration{0};
+
 	QElapsedTimer m_lastFramebufferRequestTimer;
 	qint64 m_lastFramebufferRequestInterval{0};
 	QAtomicInteger<qint64> m_framebufferEncodingTime{0};
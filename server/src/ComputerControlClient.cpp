@@ -23,7 +23,10 @@
  */
 
 #include <QTcpSocket>
+#include <QTimer>
+#include <QtEndian>
 
+#include "VeyonConfiguration.h"
 #include "VeyonCore.h"
 #include "ComputerControlClient.h"
 #include "ComputerControlServer.h"
@@ -41,16 +44,17 @@ ComputerControlClient::ComputerControlClient( ComputerControlServer* server,
 					  &m_serverClient,
 					  server->authenticationManager(),
 					  server->accessControlManager() ),
-	m_clientProtocol( vncServerSocket(), vncServerPassword )
+	m_clientProtocol( vncServerSocket(), vncServerPassword ),
+	m_bandwidthBucket( qint64(VeyonCore::config().clientBandwidthLimit()) * 1024 ),
+	m_deferredUpdateRequestTimer( new QTimer( this ) )
 {
 	m_framebufferUpdateTimer.start();
-}
-
 
+	m_deferredUpdateRequestTimer->setSingleShot(true);
+	connect(m_deferredUpdateRequestTimer, &QTimer::timeout,
+			this, &ComputerControlClient::sendDeferredFramebufferUpdateRequest);
 
-ComputerControlClient::~ComputerControlClient()
-{
-	m_server->accessControlManager().removeClient( &m_serverClient );
+	updateConnectionClass();
 }
 
 
@@ -70,27 +74,64 @@ bool ComputerControlClient::receiveClientMessage()
 		return m_server->handleFeatureMessage(this);
 	}
 
-	// filter framebuffer update requests when minimum framebuffer update interval is set
-	if (messageType == rfbFramebufferUpdateRequest && m_minimumFramebufferUpdateInterval > 0)
+	if (messageType == rfbSetEncodings)
+	{
+		return receiveSetEncodingsMessage();
+	}
+
+	if (messageType == rfbPointerEvent && m_framebufferScaler.isActive())
+	{
+		return receivePointerEventMessage();
+	}
+
+	// filter framebuffer update requests when minimum framebuffer update interval is set,
+	// translate them to the unscaled framebuffer when scaling and defer them while
+	// the client or host exceeds its bandwidth budget
+	if (messageType == rfbFramebufferUpdateRequest &&
+		(m_minimumFramebufferUpdateInterval > 0 || m_framebufferScaler.isActive() ||
+		 m_bandwidthBucket.isLimited() || m_server->hostBandwidthBucket(connectionClass()).isLimited()))
 	{
 		if (socket->bytesAvailable() < sz_rfbFramebufferUpdateRequestMsg)
 		{
 			return false;
 		}
 
-		const auto messageData = socket->read(sz_rfbFramebufferUpdateRequestMsg);
-		const auto updateRequestMessage = reinterpret_cast<const rfbFramebufferUpdateRequestMsg *>(messageData.constData());
+		auto messageData = socket->read(sz_rfbFramebufferUpdateRequestMsg);
+		auto updateRequestMessage = reinterpret_cast<rfbFramebufferUpdateRequestMsg *>(messageData.data());
 
-		if (updateRequestMessage->incremental &&
+		if (m_minimumFramebufferUpdateInterval > 0 &&
+			updateRequestMessage->incremental &&
 			m_framebufferUpdateTimer.hasExpired(m_minimumFramebufferUpdateInterval) == false)
 		{
 			// discard update request
 			return true;
 		}
 
+		if (m_framebufferScaler.isActive())
+		{
+			const auto rect = m_framebufferScaler.mapToSource(QRect(qFromBigEndian(updateRequestMessage->x),
+																	qFromBigEndian(updateRequestMessage->y),
+																	qFromBigEndian(updateRequestMessage->w),
+																	qFromBigEndian(updateRequestMessage->h)));
+			updateRequestMessage->x = qToBigEndian<uint16_t>(rect.x());
+			updateRequestMessage->y = qToBigEndian<uint16_t>(rect.y());
+			updateRequestMessage->w = qToBigEndian<uint16_t>(rect.width());
+			updateRequestMessage->h = qToBigEndian<uint16_t>(rect.height());
+
+			if (m_framebufferScaler.takeFullUpdateRequirement())
+			{
+				updateRequestMessage->incremental = 0;
+			}
+		}
+
+		if (deferFramebufferUpdateRequest(messageData))
+		{
+			return true;
+		}
+
 		// forward request to server
 		m_framebufferUpdateTimer.restart();
-		return vncServerSocket()->write(messageData) == messageData.size();
+		return writeToServer(messageData);
 	}
 
 	return VncProxyConnection::receiveClientMessage();
@@ -101,4 +142,217 @@ bool ComputerControlClient::receiveClientMessage()
 void ComputerControlClient::setMinimumFramebufferUpdateInterval(int interval)
 {
 	m_minimumFramebufferUpdateInterval = interval;
+
+	updateConnectionClass();
+}
+
+
+
+void ComputerControlClient::setScaledFramebufferSize(QSize size)
+{
+	if (size.isEmpty() == false &&
+		(FramebufferScaler::isSupportedPixelFormat(clientProtocol().pixelFormat()) == false ||
+		 m_clientEncodings.contains(rfbEncodingNewFBSize) == false))
+	{
+		vDebug() << "pixel format or encodings of client not suitable for scaling";
+		size = {};
+	}
+
+	const auto wasActive = m_framebufferScaler.isActive();
+
+	if (m_framebufferScaler.setTargetSize(size, {clientProtocol().framebufferWidth(),
+												 clientProtocol().framebufferHeight()}) == false ||
+		m_framebufferScaler.isActive() == wasActive)
+	{
+		return;
+	}
+
+	// let the VNC server send raw updates for decoding them when scaling
+	const auto encodings = m_framebufferScaler.isActive() ? FramebufferScaler::serverEncodings() : m_clientEncodings;
+	clientProtocol().setEncodings(encodings);
+	clientProtocol().sendEncodings();
+	setUpstreamEncodings(encodings);
+
+	m_restoreFramebufferSize = m_framebufferScaler.isActive() == false;
+
+	updateConnectionClass();
+}
+
+
+
+bool ComputerControlClient::isPassThroughAllowed() const
+{
+	return m_framebufferScaler.isActive() == false && m_restoreFramebufferSize == false;
+}
+
+
+
+void ComputerControlClient::processServerMessage(const QByteArray& message)
+{
+	if (isPassThroughAllowed() || uint8_t(message.at(0)) != rfbFramebufferUpdate)
+	{
+		writeToClient(message);
+		return;
+	}
+
+	if (m_framebufferScaler.isActive())
+	{
+		writeToClient(m_framebufferScaler.processFramebufferUpdate(message, clientProtocol().pixelFormat()));
+	}
+	else
+	{
+		writeToClient(FramebufferScaler::withFramebufferSize(message, {clientProtocol().framebufferWidth(),
+																	   clientProtocol().framebufferHeight()}));
+		m_restoreFramebufferSize = false;
+	}
+}
+
+
+
+bool ComputerControlClient::receiveSetEncodingsMessage()
+{
+	auto socket = proxyClientSocket();
+
+	rfbSetEncodingsMsg setEncodingsMessage;
+	if (socket->peek(reinterpret_cast<char *>(&setEncodingsMessage), sz_rfbSetEncodingsMsg) != sz_rfbSetEncodingsMsg)
+	{
+		return false;
+	}
+
+	const auto nEncodings = qFromBigEndian(setEncodingsMessage.nEncodings);
+	if (nEncodings > MAX_ENCODINGS)
+	{
+		vCritical() << "received too many encodings from client";
+		socket->close();
+		return false;
+	}
+
+	const auto messageSize = sz_rfbSetEncodingsMsg + nEncodings * int(sizeof(uint32_t));
+	if (socket->bytesAvailable() < messageSize)
+	{
+		return false;
+	}
+
+	const auto messageData = socket->read(messageSize);
+
+	m_clientEncodings.clear();
+	m_clientEncodings.reserve(nEncodings);
+	for (int i = 0; i < nEncodings; ++i)
+	{
+		m_clientEncodings.append(qFromBigEndian<uint32_t>(messageData.constData() + sz_rfbSetEncodingsMsg + i * int(sizeof(uint32_t))));
+	}
+
+	m_framebufferScaler.setClientEncodings(m_clientEncodings);
+
+	// VNC server has to keep sending raw updates while scaling
+	if (m_framebufferScaler.isActive())
+	{
+		return true;
+	}
+
+	return writeToServer(messageData);
+}
+
+
+
+ComputerControlServer::ConnectionClass ComputerControlClient::connectionClass() const
+{
+	// masters only throttle or scale updates of connections used for monitoring
+	if (m_minimumFramebufferUpdateInterval > 0 || m_framebufferScaler.isActive())
+	{
+		return ComputerControlServer::ConnectionClass::Monitoring;
+	}
+
+	return ComputerControlServer::ConnectionClass::Interactive;
+}
+
+
+
+void ComputerControlClient::updateConnectionClass()
+{
+	m_server->setConnectionClass(this, connectionClass());
+}
+
+
+
+bool ComputerControlClient::deferFramebufferUpdateRequest(const QByteArray& messageData)
+{
+	const auto delay = bandwidthDelay();
+
+	// keep order of requests while one is deferred already
+	if (delay <= 0 && m_deferredUpdateRequest.isEmpty())
+	{
+		return false;
+	}
+
+	const auto fullUpdateRequested = m_deferredUpdateRequest.isEmpty() == false &&
+			reinterpret_cast<const rfbFramebufferUpdateRequestMsg *>(m_deferredUpdateRequest.constData())->incremental == 0;
+
+	// only the latest request is sent to the server
+	m_deferredUpdateRequest = messageData;
+	if (fullUpdateRequested)
+	{
+		reinterpret_cast<rfbFramebufferUpdateRequestMsg *>(m_deferredUpdateRequest.data())->incremental = 0;
+	}
+
+	if (m_deferredUpdateRequestTimer->isActive() == false)
+	{
+		m_deferredUpdateRequestTimer->start(qMax(1, delay));
+	}
+
+	return true;
+}
+
+
+
+void ComputerControlClient::sendDeferredFramebufferUpdateRequest()
+{
+	const auto delay = bandwidthDelay();
+	if (delay > 0)
+	{
+		m_deferredUpdateRequestTimer->start(delay);
+		return;
+	}
+
+	m_framebufferUpdateTimer.restart();
+	writeToServer(std::exchange(m_deferredUpdateRequest, {}));
+}
+
+
+
+int ComputerControlClient::bandwidthDelay()
+{
+	// account data sent to the client since the last call
+	const auto bytesToClient = forwardingStatistics().bytesToClient;
+	const auto size = bytesToClient - m_accountedBytesToClient;
+	m_accountedBytesToClient = bytesToClient;
+
+	auto& hostBandwidthBucket = m_server->hostBandwidthBucket(connectionClass());
+
+	m_bandwidthBucket.consume(size);
+	hostBandwidthBucket.consume(size);
+
+	return qMax(m_bandwidthBucket.delay(), hostBandwidthBucket.delay());
+}
+
+
+
+bool ComputerControlClient::receivePointerEventMessage()
+{
+	auto socket = proxyClientSocket();
+
+	if (socket->bytesAvailable() < sz_rfbPointerEventMsg)
+	{
+		return false;
+	}
+
+	auto messageData = socket->read(sz_rfbPointerEventMsg);
+	auto pointerEventMessage = reinterpret_cast<rfbPointerEventMsg *>(messageData.data());
+
+	const auto position = m_framebufferScaler.mapToSource(QPoint(qFromBigEndian(pointerEventMessage->x),
+																 qFromBigEndian(pointerEventMessage->y)));
+	pointerEventMessage->x = qToBigEndian<uint16_t>(position.x());
+	pointerEventMessage->y = qToBigEndian<uint16_t>(position.y());
+
+	return writeToServer(messageData);
 }
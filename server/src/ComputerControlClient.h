@@ -26,13 +26,14 @@
 
 #include <QElapsedTimer>
 
+#include "ComputerControlServer.h"
+#include "FramebufferScaler.h"
+#include "TokenBucket.h"
 #include "VncClientProtocol.h"
 #include "VncProxyConnection.h"
 #include "VncServerClient.h"
 #include "VeyonServerProtocol.h"
 
-class ComputerControlServer;
-
 class ComputerControlClient : public VncProxyConnection
 {
 	Q_OBJECT
@@ -44,7 +45,6 @@ public:
 						   int vncServerPort,
 						   const Password& vncServerPassword,
 						   QObject* parent );
-	~ComputerControlClient() override;
 
 	bool receiveClientMessage() override;
 
@@ -54,8 +54,12 @@ public:
 	}
 
 	void setMinimumFramebufferUpdateInterval(int interval);
+	void setScaledFramebufferSize(QSize size);
 
 protected:
+	void processServerMessage(const QByteArray& message) override;
+	bool isPassThroughAllowed() const override;
+
 	VncClientProtocol& clientProtocol() override
 	{
 		return m_clientProtocol;
@@ -67,6 +71,16 @@ protected:
 	}
 
 private:
+	bool receiveSetEncodingsMessage();
+	bool receivePointerEventMessage();
+
+	ComputerControlServer::ConnectionClass connectionClass() const;
+	void updateConnectionClass();
+
+	bool deferFramebufferUpdateRequest(const QByteArray& messageData);
+	void sendDeferredFramebufferUpdateRequest();
+	int bandwidthDelay();
+
 	ComputerControlServer* m_server;
 
 	VncServerClient m_serverClient;
@@ -77,4 +91,13 @@ private:
 	int m_minimumFramebufferUpdateInterval{-1};
 	QElapsedTimer m_framebufferUpdateTimer;
 
+	QVector<uint32_t> m_clientEncodings;
+	FramebufferScaler m_framebufferScaler;
+	bool m_restoreFramebufferSize{false};
+
+	TokenBucket m_bandwidthBucket;
+	qint64 m_accountedBytesToClient{0};
+	QTimer* m_deferredUpdateRequestTimer;
+	QByteArray m_deferredUpdateRequest;
+
 } ;
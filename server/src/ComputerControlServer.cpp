@@ -23,6 +23,7 @@
  */
 
 #include <QCoreApplication>
+#include <QThread>
 
 #include "AccessControlProvider.h"
 #include "BuiltinFeatures.h"
@@ -31,6 +32,7 @@
 #include "FeatureManager.h"
 #include "FeatureMessage.h"
 #include "HostAddress.h"
+#include "MonitoringMode.h"
 #include "PlatformPluginInterface.h"
 #include "VeyonConfiguration.h"
 #include "SystemTrayIcon.h"
@@ -48,10 +50,16 @@ ComputerControlServer::ComputerControlServer( QObject* parent ) :
 						  QHostAddress::LocalHost : QHostAddress::Any,
 					  VeyonCore::config().veyonServerPort() + VeyonCore::sessionId(),
 					  this,
-					  this )
+					  this ),
+	m_hostBandwidthLimit( qint64(VeyonCore::config().hostBandwidthLimit()) * 1024 )
 {
+	updateHostBandwidthShares();
+
 	updateTrayIconToolTip();
 
+	connect( &m_trayIconToolTipUpdateTimer, &QTimer::timeout, this, &ComputerControlServer::updateTrayIconToolTip );
+	m_trayIconToolTipUpdateTimer.start( TrayIconToolTipUpdateInterval );
+
 	// make app terminate once the VNC server thread has finished
 	connect( &m_vncServer, &VncServer::finished, QCoreApplication::instance(), &QCoreApplication::quit );
 
@@ -63,6 +71,22 @@ ComputerControlServer::ComputerControlServer( QObject* parent ) :
 
 	connect(&m_vncProxyServer, &VncProxyServer::serverMessageProcessed,
 			 this, &ComputerControlServer::sendAsyncFeatureMessages, Qt::DirectConnection);
+	// push changes of the monitoring state right away instead of waiting for the next server message
+	connect(&VeyonCore::builtinFeatures().monitoringMode(), &MonitoringMode::stateChanged,
+			 this, &ComputerControlServer::sendAsyncFeatureMessagesToAllClients, Qt::QueuedConnection);
+	connect( &m_vncProxyServer, &VncProxyServer::connectionClosed, this, [this]( VncProxyConnection* connection ) {
+		auto client = qobject_cast<ComputerControlClient *>( connection );
+		if( client )
+		{
+			m_serverAccessControlManager.removeClient( client->serverClient() );
+
+			m_dataMutex.lock();
+			m_connectionClasses.remove( client );
+			m_dataMutex.unlock();
+
+			updateHostBandwidthShares();
+		}
+	} );
 	connect( &m_vncProxyServer, &VncProxyServer::connectionClosed, this, &ComputerControlServer::updateTrayIconToolTip );
 }
 
@@ -103,11 +127,34 @@ VncProxyConnection* ComputerControlServer::createVncProxyConnection( QTcpSocket*
 		[=]() { checkForIncompleteAuthentication( client->serverClient() ); },
 		Qt::DirectConnection );
 
+	// connection is established in this thread so the initial state directly follows the server init message
+	connect( client, &ComputerControlClient::established, this, [=]() {
+		if( client->serverClient()->handshakeFlags().testFlag( RfbVeyonAuth::HandshakeFlag::InitialState ) )
+		{
+			VeyonCore::builtinFeatures().monitoringMode().sendInitialState( *this, MessageContext{client->proxyClientSocket(), client} );
+		}
+	}, Qt::DirectConnection );
+
 	return client;
 }
 
 
 
+void ComputerControlServer::setConnectionClass( const ComputerControlClient* client, ConnectionClass connectionClass )
+{
+	m_dataMutex.lock();
+	const auto changed = m_connectionClasses.value( client, ConnectionClass::Count ) != connectionClass;
+	m_connectionClasses[client] = connectionClass;
+	m_dataMutex.unlock();
+
+	if( changed )
+	{
+		updateHostBandwidthShares();
+	}
+}
+
+
+
 bool ComputerControlServer::handleFeatureMessage(ComputerControlClient* client)
 {
 	auto socket = client->proxyClientSocket();
@@ -132,7 +179,24 @@ bool ComputerControlServer::handleFeatureMessage(ComputerControlClient* client)
 		return false;
 	}
 
-	VeyonCore::featureManager().handleFeatureMessage( *this, MessageContext{socket, client}, featureMessage );
+	const MessageContext messageContext{socket, client};
+
+	if (QThread::currentThread() == thread() ||
+		VeyonCore::builtinFeatures().monitoringMode().isConnectionLocalMessage(featureMessage))
+	{
+		VeyonCore::featureManager().handleFeatureMessage(*this, messageContext, featureMessage);
+	}
+	else
+	{
+		// connection is served by a proxy worker thread while feature plugins expect to be called
+		// in the main thread only
+		QMetaObject::invokeMethod(this, [=]() {
+			if (m_vncProxyServer.clients().contains(client))
+			{
+				VeyonCore::featureManager().handleFeatureMessage(*this, messageContext, featureMessage);
+			}
+		}, Qt::QueuedConnection);
+	}
 
 	return true;
 }
@@ -143,12 +207,21 @@ bool ComputerControlServer::sendFeatureMessageReply( const MessageContext& conte
 {
 	vDebug() << reply;
 
-	if (context.ioDevice())
+	const auto ioDevice = context.ioDevice();
+	if (ioDevice == nullptr)
 	{
-		return reply.sendAsRfbMessage(context.ioDevice());
+		return false;
 	}
 
-	return false;
+	if (QThread::currentThread() == thread() && isProxyClientSocket(ioDevice) &&
+		ioDevice->thread() != thread())
+	{
+		// socket has to be written in the thread serving the connection
+		QMetaObject::invokeMethod(ioDevice, [=]() { reply.sendAsRfbMessage(ioDevice); }, Qt::QueuedConnection);
+		return true;
+	}
+
+	return reply.sendAsRfbMessage(ioDevice);
 }
 
 
@@ -158,7 +231,18 @@ void ComputerControlServer::setMinimumFramebufferUpdateInterval(const MessageCon
 	auto client = qobject_cast<ComputerControlClient *>(context.connection());
 	if (client)
 	{
-		client->setMinimumFramebufferUpdateInterval(interval);
+		QMetaObject::invokeMethod(client, [=]() { client->setMinimumFramebufferUpdateInterval(interval); });
+	}
+}
+
+
+
+void ComputerControlServer::setScaledFramebufferSize(const MessageContext& context, QSize size)
+{
+	auto client = qobject_cast<ComputerControlClient *>(context.connection());
+	if (client)
+	{
+		QMetaObject::invokeMethod(client, [=]() { client->setScaledFramebufferSize(size); });
 	}
 }
 
@@ -280,7 +364,57 @@ QFutureWatcher<void>* ComputerControlServer::resolveFQDNs( const QStringList& ho
 
 void ComputerControlServer::sendAsyncFeatureMessages(VncProxyConnection* connection)
 {
-	VeyonCore::featureManager().sendAsyncFeatureMessages(*this, MessageContext{connection->proxyClientSocket()});
+	if (QThread::currentThread() == thread())
+	{
+		VeyonCore::featureManager().sendAsyncFeatureMessages(*this, MessageContext{connection->proxyClientSocket()});
+		return;
+	}
+
+	// called by a proxy worker thread after each server message so only queue
+	// one invocation per connection at a time
+	QMutexLocker locker(&m_dataMutex);
+
+	if (m_pendingAsyncFeatureMessageConnections.contains(connection))
+	{
+		return;
+	}
+
+	m_pendingAsyncFeatureMessageConnections.insert(connection);
+
+	QMetaObject::invokeMethod(this, [=]() {
+		m_dataMutex.lock();
+		m_pendingAsyncFeatureMessageConnections.remove(connection);
+		m_dataMutex.unlock();
+
+		if (m_vncProxyServer.clients().contains(connection))
+		{
+			VeyonCore::featureManager().sendAsyncFeatureMessages(*this, MessageContext{connection->proxyClientSocket()});
+		}
+	}, Qt::QueuedConnection);
+}
+
+
+
+void ComputerControlServer::sendAsyncFeatureMessagesToAllClients()
+{
+	for (auto connection : std::as_const(m_vncProxyServer.clients()))
+	{
+		// skip connections which are not authenticated yet
+		if (connection->isEstablished())
+		{
+			VeyonCore::featureManager().sendAsyncFeatureMessages(*this, MessageContext{connection->proxyClientSocket()});
+		}
+	}
+}
+
+
+
+bool ComputerControlServer::isProxyClientSocket(const QIODevice* ioDevice) const
+{
+	return std::any_of(m_vncProxyServer.clients().cbegin(), m_vncProxyServer.clients().cend(),
+					   [ioDevice](const VncProxyConnection* connection) {
+						   return connection->proxyClientSocket() == ioDevice;
+					   });
 }
 
 
@@ -304,15 +438,16 @@ void ComputerControlServer::updateTrayIconToolTip()
 
 	for( const auto* client : m_vncProxyServer.clients() )
 	{
-		const auto clientIpAddress = client->proxyClientSocket()->peerAddress().toString();
+		const auto& clientIpAddress = client->proxyClientAddress();
+		const auto dataRate = tr( "%1 kB/s" ).arg( client->clientDataRate() / 1024 );
 		if( m_resolvedHostNames.contains( clientIpAddress ) == false )
 		{
 			hostsToResolve.append( clientIpAddress );
-			clients.append( clientIpAddress );
+			clients.append( QStringLiteral("%1 (%2)").arg( clientIpAddress, dataRate ) );
 		}
 		else
 		{
-			clients.append( m_resolvedHostNames[clientIpAddress] );
+			clients.append( QStringLiteral("%1 (%2)").arg( m_resolvedHostNames[clientIpAddress], dataRate ) );
 		}
 	}
 
@@ -327,5 +462,40 @@ void ComputerControlServer::updateTrayIconToolTip()
 		toolTip += QLatin1Char('\n') + tr( "Active connections:") + QLatin1Char('\n') + clients.join( QLatin1Char('\n') );
 	}
 
-	VeyonCore::builtinFeatures().systemTrayIcon().setToolTip( toolTip, m_featureWorkerManager );
+	// do not bother the worker with unchanged tooltips on every periodic update
+	if( toolTip != m_trayIconToolTip )
+	{
+		m_trayIconToolTip = toolTip;
+		VeyonCore::builtinFeatures().systemTrayIcon().setToolTip( toolTip, m_featureWorkerManager );
+	}
+}
+
+
+
+void ComputerControlServer::updateHostBandwidthShares()
+{
+	QMutexLocker locker( &m_dataMutex );
+
+	std::array<bool, ConnectionClassCount> activeClasses{};
+	for( const auto connectionClass : std::as_const(m_connectionClasses) )
+	{
+		activeClasses[int(connectionClass)] = true;
+	}
+
+	// split the budget evenly between all classes with connections so e.g. a remote access session
+	// is not starved by many monitoring connections and vice versa
+	const auto activeClassCount = qMax<qint64>( 1, std::count( activeClasses.cbegin(), activeClasses.cend(), true ) );
+	const auto share = m_hostBandwidthLimit / activeClassCount;
+
+	if( share == m_hostBandwidthShare )
+	{
+		return;
+	}
+
+	m_hostBandwidthShare = share;
+
+	for( auto& bucket : m_hostBandwidthBuckets )
+	{
+		bucket.setRate( share );
+	}
 }
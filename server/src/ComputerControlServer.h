@@ -25,12 +25,17 @@
 #pragma once
 
 #include <QMutex>
+#include <QSet>
+#include <QTimer>
 #include <QtConcurrent>
 
+#include <array>
+
 #include "FeatureWorkerManager.h"
 #include "RfbVeyonAuth.h"
 #include "ServerAuthenticationManager.h"
 #include "ServerAccessControlManager.h"
+#include "TokenBucket.h"
 #include "VeyonServerInterface.h"
 #include "VncProxyServer.h"
 #include "VncProxyConnectionFactory.h"
@@ -42,6 +47,13 @@ class ComputerControlServer : public VeyonServerInterface, VncProxyConnectionFac
 {
 	Q_OBJECT
 public:
+	// connections of different classes do not compete for the host's bandwidth budget
+	enum class ConnectionClass {
+		Interactive,
+		Monitoring,
+		Count
+	};
+
 	explicit ComputerControlServer( QObject* parent = nullptr );
 	~ComputerControlServer() override;
 
@@ -57,6 +69,14 @@ public:
 		return m_serverAuthenticationManager;
 	}
 
+	// share of the host's data rate budget for all clients of the given class
+	TokenBucket& hostBandwidthBucket( ConnectionClass connectionClass )
+	{
+		return m_hostBandwidthBuckets[int(connectionClass)];
+	}
+
+	void setConnectionClass( const ComputerControlClient* client, ConnectionClass connectionClass );
+
 	ServerAccessControlManager& accessControlManager()
 	{
 		return m_serverAccessControlManager;
@@ -77,6 +97,7 @@ public:
 	}
 
 	void setMinimumFramebufferUpdateInterval(const MessageContext& context, int interval) override;
+	void setScaledFramebufferSize(const MessageContext& context, QSize size) override;
 
 private:
 	void checkForIncompleteAuthentication( VncServerClient* client );
@@ -85,13 +106,21 @@ private:
 	QFutureWatcher<void>* resolveFQDNs( const QStringList& hosts );
 
 	void sendAsyncFeatureMessages(VncProxyConnection* connection);
+	void sendAsyncFeatureMessagesToAllClients();
+	bool isProxyClientSocket(const QIODevice* ioDevice) const;
 	void updateTrayIconToolTip();
+	void updateHostBandwidthShares();
+
+	static constexpr auto ConnectionClassCount = int(ConnectionClass::Count);
+	static constexpr auto TrayIconToolTipUpdateInterval = 2000;
 
 	QMutex m_dataMutex;
 	QStringList m_allowedIPs;
 
 	QMap<QString, QString> m_resolvedHostNames;
 
+	QSet<VncProxyConnection *> m_pendingAsyncFeatureMessageConnections;
+
 	QStringList m_failedAuthHosts;
 	QStringList m_failedAccessControlHosts;
 
@@ -103,4 +132,13 @@ private:
 	VncServer m_vncServer;
 	VncProxyServer m_vncProxyServer;
 
+	// data rates shown in the tooltip change without any connection being opened or closed
+	QTimer m_trayIconToolTipUpdateTimer{this};
+	QString m_trayIconToolTip;
+
+	const qint64 m_hostBandwidthLimit;
+	qint64 m_hostBandwidthShare{-1};
+	std::array<TokenBucket, ConnectionClassCount> m_hostBandwidthBuckets;
+	QHash<const ComputerControlClient *, ConnectionClass> m_connectionClasses;
+
 } ;
@@ -0,0 +1,524 @@
+/*
+ * FramebufferScaler.cpp - implementation of the FramebufferScaler class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <QBuffer>
+#include <QSysInfo>
+#include <QtEndian>
+
+#include "FramebufferScaler.h"
+#include "ImageScaler.h"
+
+
+bool FramebufferScaler::isSupportedPixelFormat( const rfbPixelFormat& format )
+{
+	// pixels are converted from and to the client's format, so only colour maps are not supported
+	return ( format.bitsPerPixel == 8 || format.bitsPerPixel == 16 || format.bitsPerPixel == 32 ) &&
+		   format.trueColour &&
+		   format.redMax > 0 && format.greenMax > 0 && format.blueMax > 0;
+}
+
+
+
+QVector<uint32_t> FramebufferScaler::serverEncodings()
+{
+	return { rfbEncodingRaw, rfbEncodingNewFBSize, rfbEncodingLastRect };
+}
+
+
+
+QByteArray FramebufferScaler::withFramebufferSize( const QByteArray& framebufferUpdateMessage, QSize size )
+{
+	if( framebufferUpdateMessage.size() < sz_rfbFramebufferUpdateMsg )
+	{
+		return framebufferUpdateMessage;
+	}
+
+	rfbFramebufferUpdateMsg header;
+	memcpy( &header, framebufferUpdateMessage.constData(), sz_rfbFramebufferUpdateMsg ); // Flawfinder: ignore
+
+	// 0xffff rects means the update is terminated by a LastRect pseudo rect
+	const auto nRects = qFromBigEndian( header.nRects );
+	if( nRects < 0xffff )
+	{
+		header.nRects = qToBigEndian<uint16_t>( nRects + 1 );
+	}
+
+	QByteArray message;
+	message.reserve( framebufferUpdateMessage.size() + sz_rfbFramebufferUpdateRectHeader );
+	message.append( reinterpret_cast<const char *>( &header ), sz_rfbFramebufferUpdateMsg );
+	appendRectHeader( message, QRect( QPoint( 0, 0 ), size ), rfbEncodingNewFBSize );
+	message.append( framebufferUpdateMessage.constData() + sz_rfbFramebufferUpdateMsg,
+					framebufferUpdateMessage.size() - sz_rfbFramebufferUpdateMsg );
+
+	return message;
+}
+
+
+
+bool FramebufferScaler::setTargetSize( QSize targetSize, QSize sourceSize )
+{
+	if( targetSize.isEmpty() || sourceSize.isEmpty() )
+	{
+		if( isActive() == false )
+		{
+			return false;
+		}
+
+		m_targetSize = {};
+		m_scaledSize = {};
+		m_sourceFramebuffer = {};
+		m_scaledFramebuffer = {};
+		m_framebufferSizeChanged = false;
+
+		return true;
+	}
+
+	if( targetSize == m_targetSize && sourceSize == m_sourceFramebuffer.size() )
+	{
+		return false;
+	}
+
+	m_targetSize = targetSize;
+
+	resize( sourceSize );
+
+	return true;
+}
+
+
+
+void FramebufferScaler::setClientEncodings( const QVector<uint32_t>& encodings )
+{
+	static constexpr int JpegQualities[] = { 5, 10, 15, 25, 37, 50, 60, 70, 75, 80 };
+
+	bool tightEncoding = false;
+	int jpegQuality = -1;
+
+	for( const auto encoding : encodings )
+	{
+		if( encoding == rfbEncodingTight )
+		{
+			tightEncoding = true;
+		}
+		else if( encoding >= rfbEncodingQualityLevel0 && encoding <= rfbEncodingQualityLevel9 )
+		{
+			jpegQuality = JpegQualities[encoding - rfbEncodingQualityLevel0];
+		}
+	}
+
+	// JPEG data can only be sent if the client announced to be able to decode it
+	m_jpegQuality = tightEncoding ? jpegQuality : -1;
+}
+
+
+
+QPoint FramebufferScaler::mapToSource( QPoint point ) const
+{
+	if( isActive() == false )
+	{
+		return point;
+	}
+
+	const auto sourceSize = m_sourceFramebuffer.size();
+
+	return { qBound( 0, int( qint64(point.x()) * sourceSize.width() / m_scaledSize.width() ), sourceSize.width() - 1 ),
+			 qBound( 0, int( qint64(point.y()) * sourceSize.height() / m_scaledSize.height() ), sourceSize.height() - 1 ) };
+}
+
+
+
+QRect FramebufferScaler::mapToSource( const QRect& rect ) const
+{
+	if( isActive() == false )
+	{
+		return rect;
+	}
+
+	const auto sourceSize = m_sourceFramebuffer.size();
+
+	const auto mapX = [&]( int x ) { return int( ( qint64(x) * sourceSize.width() + m_scaledSize.width() - 1 ) / m_scaledSize.width() ); };
+	const auto mapY = [&]( int y ) { return int( ( qint64(y) * sourceSize.height() + m_scaledSize.height() - 1 ) / m_scaledSize.height() ); };
+
+	return QRect( QPoint( int( qint64(rect.x()) * sourceSize.width() / m_scaledSize.width() ),
+						  int( qint64(rect.y()) * sourceSize.height() / m_scaledSize.height() ) ),
+				  QPoint( mapX( rect.x() + rect.width() ) - 1,
+						  mapY( rect.y() + rect.height() ) - 1 ) ).intersected( m_sourceFramebuffer.rect() );
+}
+
+
+
+QByteArray FramebufferScaler::processFramebufferUpdate( const QByteArray& message, const rfbPixelFormat& format )
+{
+	if( isActive() == false || message.size() < sz_rfbFramebufferUpdateMsg )
+	{
+		return {};
+	}
+
+	const auto data = message.constData();
+
+	rfbFramebufferUpdateMsg header;
+	memcpy( &header, data, sz_rfbFramebufferUpdateMsg ); // Flawfinder: ignore
+
+	const auto nRects = qFromBigEndian( header.nRects );
+
+	QRegion changedRegion;
+	qint64 offset = sz_rfbFramebufferUpdateMsg;
+
+	for( int i = 0; i < nRects && offset + sz_rfbFramebufferUpdateRectHeader <= message.size(); ++i )
+	{
+		rfbFramebufferUpdateRectHeader rectHeader;
+		memcpy( &rectHeader, data + offset, sz_rfbFramebufferUpdateRectHeader ); // Flawfinder: ignore
+		offset += sz_rfbFramebufferUpdateRectHeader;
+
+		const auto encoding = qFromBigEndian( rectHeader.encoding );
+		const QRect rect( qFromBigEndian( rectHeader.r.x ), qFromBigEndian( rectHeader.r.y ),
+						  qFromBigEndian( rectHeader.r.w ), qFromBigEndian( rectHeader.r.h ) );
+
+		if( encoding == rfbEncodingLastRect )
+		{
+			break;
+		}
+
+		if( encoding == rfbEncodingNewFBSize )
+		{
+			resize( rect.size() );
+			changedRegion = {};
+			continue;
+		}
+
+		const auto rectDataSize = qint64(rect.width()) * rect.height() * ( format.bitsPerPixel / 8 );
+
+		// rects of other encodings may still arrive right after switching encodings and
+		// can't be skipped without decoding them so drop the rest of the update
+		if( encoding != rfbEncodingRaw || offset + rectDataSize > message.size() )
+		{
+			m_fullUpdateRequired = true;
+			break;
+		}
+
+		if( m_sourceFramebuffer.rect().contains( rect ) )
+		{
+			copyRawRect( data + offset, rect, format );
+			changedRegion += rect;
+		}
+
+		offset += rectDataSize;
+	}
+
+	QRegion scaledRegion;
+	if( m_framebufferSizeChanged )
+	{
+		scaledRegion = m_scaledFramebuffer.rect();
+	}
+	else
+	{
+		for( const auto& rect : std::as_const(changedRegion) )
+		{
+			scaledRegion += mapToScaled( rect );
+		}
+	}
+
+	QVector<QRect> scaledRects;
+	if( scaledRegion.rectCount() > MaximumRectCount )
+	{
+		scaledRects.append( scaledRegion.boundingRect() );
+	}
+	else
+	{
+		scaledRects.reserve( scaledRegion.rectCount() );
+		for( const auto& rect : std::as_const(scaledRegion) )
+		{
+			scaledRects.append( rect );
+		}
+	}
+
+	QByteArray update;
+	update.append( sz_rfbFramebufferUpdateMsg, 0 );
+
+	uint16_t rectCount = 0;
+
+	if( std::exchange( m_framebufferSizeChanged, false ) )
+	{
+		appendRectHeader( update, m_scaledFramebuffer.rect(), rfbEncodingNewFBSize );
+		++rectCount;
+	}
+
+	for( const auto& rect : std::as_const(scaledRects) )
+	{
+		ImageScaler::downscale( m_sourceFramebuffer, m_scaledFramebuffer, rect );
+		appendRect( update, rect, format );
+		++rectCount;
+	}
+
+	rfbFramebufferUpdateMsg updateHeader{};
+	updateHeader.type = rfbFramebufferUpdate;
+	updateHeader.nRects = qToBigEndian( rectCount );
+	memcpy( update.data(), &updateHeader, sz_rfbFramebufferUpdateMsg ); // Flawfinder: ignore
+
+	return update;
+}
+
+
+
+void FramebufferScaler::resize( QSize sourceSize )
+{
+	if( sourceSize.isEmpty() )
+	{
+		return;
+	}
+
+	if( sourceSize != m_sourceFramebuffer.size() )
+	{
+		m_sourceFramebuffer = QImage( sourceSize, QImage::Format_RGB32 );
+		m_sourceFramebuffer.fill( Qt::black );
+		m_fullUpdateRequired = true;
+		m_framebufferSizeChanged = true;
+	}
+
+	const auto scaledSize = sourceSize.scaled( m_targetSize, Qt::KeepAspectRatio )
+								.boundedTo( sourceSize ).expandedTo( QSize( 1, 1 ) );
+
+	if( scaledSize != m_scaledSize )
+	{
+		m_scaledSize = scaledSize;
+		m_scaledFramebuffer = QImage( m_scaledSize, QImage::Format_RGB32 );
+		m_scaledFramebuffer.fill( Qt::black );
+		m_framebufferSizeChanged = true;
+	}
+}
+
+
+
+QRect FramebufferScaler::mapToScaled( const QRect& rect ) const
+{
+	const auto sourceSize = m_sourceFramebuffer.size();
+
+	// include all destination pixels which are partially covered by the source rect
+	const auto left = int( qint64(rect.x()) * m_scaledSize.width() / sourceSize.width() );
+	const auto top = int( qint64(rect.y()) * m_scaledSize.height() / sourceSize.height() );
+	const auto right = int( qint64(rect.x() + rect.width()) * m_scaledSize.width() / sourceSize.width() ) + 1;
+	const auto bottom = int( qint64(rect.y() + rect.height()) * m_scaledSize.height() / sourceSize.height() ) + 1;
+
+	return QRect( left, top, right - left, bottom - top ).intersected( m_scaledFramebuffer.rect() );
+}
+
+
+
+bool FramebufferScaler::isNativePixelFormat( const rfbPixelFormat& format )
+{
+	// matches the memory layout of QImage::Format_RGB32
+	return format.bitsPerPixel == 32 &&
+		   ( format.bigEndian != 0 ) == ( QSysInfo::ByteOrder == QSysInfo::BigEndian ) &&
+		   format.redMax == 255 && format.greenMax == 255 && format.blueMax == 255 &&
+		   format.redShift == 16 && format.greenShift == 8 && format.blueShift == 0;
+}
+
+
+
+quint32 FramebufferScaler::readPixel( const uchar* data, const rfbPixelFormat& format )
+{
+	quint32 pixel = 0;
+
+	switch( format.bitsPerPixel )
+	{
+	case 8:
+		pixel = data[0];
+		break;
+	case 16:
+		pixel = format.bigEndian ? qFromBigEndian<quint16>( data ) : qFromLittleEndian<quint16>( data );
+		break;
+	default:
+		pixel = format.bigEndian ? qFromBigEndian<quint32>( data ) : qFromLittleEndian<quint32>( data );
+		break;
+	}
+
+	const auto channel = [pixel]( int shift, int max ) {
+		return ( ( pixel >> shift ) & max ) * 255 / max;
+	};
+
+	return qRgb( channel( format.redShift, format.redMax ),
+				 channel( format.greenShift, format.greenMax ),
+				 channel( format.blueShift, format.blueMax ) );
+}
+
+
+
+void FramebufferScaler::appendPixel( QByteArray& message, quint32 rgb, const rfbPixelFormat& format )
+{
+	const auto channel = []( int value, int shift, int max ) {
+		return quint32( ( value * max + 127 ) / 255 ) << shift;
+	};
+
+	const auto pixel = channel( qRed( rgb ), format.redShift, format.redMax ) |
+					   channel( qGreen( rgb ), format.greenShift, format.greenMax ) |
+					   channel( qBlue( rgb ), format.blueShift, format.blueMax );
+
+	uchar data[sizeof(quint32)];
+
+	switch( format.bitsPerPixel )
+	{
+	case 8:
+		data[0] = uchar(pixel);
+		break;
+	case 16:
+		format.bigEndian ? qToBigEndian<quint16>( quint16(pixel), data ) : qToLittleEndian<quint16>( quint16(pixel), data );
+		break;
+	default:
+		format.bigEndian ? qToBigEndian<quint32>( pixel, data ) : qToLittleEndian<quint32>( pixel, data );
+		break;
+	}
+
+	message.append( reinterpret_cast<const char *>( data ), format.bitsPerPixel / 8 );
+}
+
+
+
+void FramebufferScaler::copyRawRect( const char* data, const QRect& rect, const rfbPixelFormat& format )
+{
+	const auto width = rect.width();
+
+	if( isNativePixelFormat( format ) )
+	{
+		const auto source = reinterpret_cast<const quint32 *>( data );
+
+		for( int y = 0; y < rect.height(); ++y )
+		{
+			const auto sourceLine = source + y * width;
+			auto destinationLine = reinterpret_cast<quint32 *>( m_sourceFramebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+			// the padding byte is undefined in the RFB pixel format but has to be opaque for QImage
+			for( int x = 0; x < width; ++x )
+			{
+				destinationLine[x] = sourceLine[x] | 0xff000000;
+			}
+		}
+		return;
+	}
+
+	const auto bytesPerPixel = format.bitsPerPixel / 8;
+	auto source = reinterpret_cast<const uchar *>( data );
+
+	for( int y = 0; y < rect.height(); ++y )
+	{
+		auto destinationLine = reinterpret_cast<quint32 *>( m_sourceFramebuffer.scanLine( rect.y() + y ) ) + rect.x();
+
+		for( int x = 0; x < width; ++x, source += bytesPerPixel )
+		{
+			destinationLine[x] = readPixel( source, format );
+		}
+	}
+}
+
+
+
+void FramebufferScaler::appendRect( QByteArray& message, const QRect& rect, const rfbPixelFormat& format ) const
+{
+	// JPEG headers outweigh the savings for tiny rects, and clients do not decode JPEG data with 8 bits per pixel
+	if( m_jpegQuality >= 0 && format.bitsPerPixel >= 16 && rect.width() * rect.height() >= MinimumJpegRectArea &&
+		appendTightJpegRect( message, rect ) )
+	{
+		return;
+	}
+
+	appendRawRect( message, rect, format );
+}
+
+
+
+void FramebufferScaler::appendRawRect( QByteArray& message, const QRect& rect, const rfbPixelFormat& format ) const
+{
+	appendRectHeader( message, rect, rfbEncodingRaw );
+
+	if( isNativePixelFormat( format ) )
+	{
+		for( int y = rect.top(); y <= rect.bottom(); ++y )
+		{
+			message.append( reinterpret_cast<const char *>( m_scaledFramebuffer.constScanLine( y ) ) + rect.x() * 4,
+							rect.width() * 4 );
+		}
+		return;
+	}
+
+	message.reserve( message.size() + rect.width() * rect.height() * ( format.bitsPerPixel / 8 ) );
+
+	for( int y = rect.top(); y <= rect.bottom(); ++y )
+	{
+		const auto line = reinterpret_cast<const QRgb *>( m_scaledFramebuffer.constScanLine( y ) );
+		for( int x = rect.left(); x <= rect.right(); ++x )
+		{
+			appendPixel( message, line[x], format );
+		}
+	}
+}
+
+
+
+bool FramebufferScaler::appendTightJpegRect( QByteArray& message, const QRect& rect ) const
+{
+	static constexpr auto MaximumCompactLength = ( 1 << 22 ) - 1;
+
+	QByteArray jpegData;
+	QBuffer buffer( &jpegData );
+	buffer.open( QBuffer::WriteOnly ); // Flawfinder: ignore
+
+	if( m_scaledFramebuffer.copy( rect ).save( &buffer, "JPG", m_jpegQuality ) == false ||
+		jpegData.size() > MaximumCompactLength )
+	{
+		return false;
+	}
+
+	appendRectHeader( message, rect, rfbEncodingTight );
+
+	message.append( char( rfbTightJpeg << 4 ) );
+
+	// length is transmitted in a compact representation with 7 bits per byte
+	const auto length = jpegData.size();
+	message.append( char( ( length & 0x7f ) | ( length > 0x7f ? 0x80 : 0 ) ) );
+	if( length > 0x7f )
+	{
+		message.append( char( ( ( length >> 7 ) & 0x7f ) | ( length > 0x3fff ? 0x80 : 0 ) ) );
+		if( length > 0x3fff )
+		{
+			message.append( char( ( length >> 14 ) & 0xff ) );
+		}
+	}
+
+	message.append( jpegData );
+
+	return true;
+}
+
+
+
+void FramebufferScaler::appendRectHeader( QByteArray& message, const QRect& rect, uint32_t encoding )
+{
+	rfbFramebufferUpdateRectHeader rectHeader;
+	rectHeader.r.x = qToBigEndian<uint16_t>( rect.x() );
+	rectHeader.r.y = qToBigEndian<uint16_t>( rect.y() );
+	rectHeader.r.w = qToBigEndian<uint16_t>( rect.width() );
+	rectHeader.r.h = qToBigEndian<uint16_t>( rect.height() );
+	rectHeader.encoding = qToBigEndian<uint32_t>( encoding );
+
+	message.append( reinterpret_cast<const char *>( &rectHeader ), sz_rfbFramebufferUpdateRectHeader );
+}
@@ -0,0 +1,114 @@
+/*
+ * FramebufferScaler.h - header file for the FramebufferScaler class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <utility>
+
+#include <QImage>
+#include <QRegion>
+#include <QVector>
+
+#include "rfb/rfbproto.h"
+
+/**
+ * \brief Turns framebuffer updates of the VNC server into updates of a downscaled framebuffer
+ *
+ * The VNC server is asked for raw updates only (cheap on the loopback interface) which are applied
+ * to a local copy of the framebuffer. The changed areas get downscaled and are sent to the client
+ * as JPEG (Tight encoding) or raw rectangles so network traffic and client-side decoding effort
+ * only depend on the requested thumbnail size but no longer on the resolution of the screen.
+ */
+class FramebufferScaler
+{
+public:
+	static bool isSupportedPixelFormat( const rfbPixelFormat& format );
+
+	static QVector<uint32_t> serverEncodings();
+
+	// returns a copy of an update message with an additional rect announcing the given framebuffer size
+	static QByteArray withFramebufferSize( const QByteArray& framebufferUpdateMessage, QSize size );
+
+	bool isActive() const
+	{
+		return m_scaledSize.isEmpty() == false;
+	}
+
+	bool setTargetSize( QSize targetSize, QSize sourceSize );
+
+	QSize sourceSize() const
+	{
+		return m_sourceFramebuffer.size();
+	}
+
+	QSize scaledSize() const
+	{
+		return m_scaledSize;
+	}
+
+	void setClientEncodings( const QVector<uint32_t>& encodings );
+
+	QPoint mapToSource( QPoint point ) const;
+	QRect mapToSource( const QRect& rect ) const;
+
+	bool takeFullUpdateRequirement()
+	{
+		return std::exchange( m_fullUpdateRequired, false );
+	}
+
+	// updates are expected in and returned in the given pixel format of the client
+	QByteArray processFramebufferUpdate( const QByteArray& message, const rfbPixelFormat& format );
+
+private:
+	static constexpr auto MaximumRectCount = 32;
+	static constexpr auto MinimumJpegRectArea = 16*16;
+
+	void resize( QSize sourceSize );
+
+	QRect mapToScaled( const QRect& rect ) const;
+
+	static bool isNativePixelFormat( const rfbPixelFormat& format );
+	static quint32 readPixel( const uchar* data, const rfbPixelFormat& format );
+	static void appendPixel( QByteArray& message, quint32 rgb, const rfbPixelFormat& format );
+
+	void copyRawRect( const char* data, const QRect& rect, const rfbPixelFormat& format );
+
+	void appendRect( QByteArray& message, const QRect& rect, const rfbPixelFormat& format ) const;
+	void appendRawRect( QByteArray& message, const QRect& rect, const rfbPixelFormat& format ) const;
+	bool appendTightJpegRect( QByteArray& message, const QRect& rect ) const;
+
+	static void appendRectHeader( QByteArray& message, const QRect& rect, uint32_t encoding );
+
+	QSize m_targetSize;
+	QSize m_scaledSize;
+
+	QImage m_sourceFramebuffer;
+	QImage m_scaledFramebuffer;
+
+	int m_jpegQuality{-1};
+
+	bool m_fullUpdateRequired{false};
+	bool m_framebufferSizeChanged{false};
+
+} ;
@@ -22,6 +22,8 @@
  *
  */
 
+#include <QFileInfo>
+
 #include "AuthenticationCredentials.h"
 #include "ServerAuthenticationManager.h"
 #include "CryptoCore.h"
@@ -32,8 +34,12 @@
 
 
 ServerAuthenticationManager::ServerAuthenticationManager( QObject* parent ) :
-	QObject( parent )
+	QObject( parent ),
+	m_passwordVerifierKey( CryptoCore::generateSecret() )
 {
+	// tickets must not outlive the configuration (e.g. authentication method or keys) they have been issued for
+	connect( &VeyonCore::config(), &VeyonConfiguration::configurationChanged,
+			 this, &ServerAuthenticationManager::revokeSessionTickets );
 }
 
 
@@ -57,11 +63,31 @@ QVector<RfbVeyonAuth::Type> ServerAuthenticationManager::supportedAuthTypes() co
 		authTypes.append( RfbVeyonAuth::Token );
 	}
 
+	// announce session tickets last so clients not knowing them keep choosing the first type
+	if( VeyonCore::config().sessionTicketLifetime() > 0 &&
+		( authTypes.contains( RfbVeyonAuth::KeyFile ) || authTypes.contains( RfbVeyonAuth::Logon ) ) )
+	{
+		authTypes.append( RfbVeyonAuth::SessionTicket );
+	}
+
 	return authTypes;
 }
 
 
 
+void ServerAuthenticationManager::revokeSessionTickets()
+{
+	QMutexLocker locker( &m_mutex );
+
+	if( m_sessionTickets.isEmpty() == false )
+	{
+		vDebug() << "revoking" << m_sessionTickets.size() << "session tickets";
+		m_sessionTickets.clear();
+	}
+}
+
+
+
 void ServerAuthenticationManager::processAuthenticationMessage( VncServerClient* client,
 																VariantArrayMessage& message )
 {
@@ -85,12 +111,24 @@ void ServerAuthenticationManager::processAuthenticationMessage( VncServerClient*
 		client->setAuthState( performTokenAuthentication( client, message ) );
 		break;
 
+	case RfbVeyonAuth::SessionTicket:
+		client->setAuthState( performSessionTicketAuthentication( client, message ) );
+		break;
+
 	default:
 		// unknown or unsupported auth type
 		client->setAuthState( VncServerClient::AuthState::Failed );
 		break;
 	}
 
+	if( client->authState() == VncServerClient::AuthState::Successful &&
+		client->isSessionTicketRequested() &&
+		sendSessionTicket( client, message.ioDevice() ) == false )
+	{
+		vWarning() << "failed to send session ticket";
+		client->setAuthState( VncServerClient::AuthState::Failed );
+	}
+
 	switch( client->authState() )
 	{
 	case VncServerClient::AuthState::Failed:
@@ -110,6 +148,13 @@ VncServerClient::AuthState ServerAuthenticationManager::performKeyAuthentication
 	switch( client->authState() )
 	{
 	case VncServerClient::AuthState::Init:
+		// challenge has been sent along with the authentication types already
+		if( client->handshakeFlags().testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication ) &&
+			client->challenge().size() == CryptoCore::ChallengeSize )
+		{
+			return VncServerClient::AuthState::Challenge;
+		}
+
 		client->setChallenge( CryptoCore::generateChallenge() );
 		if( VariantArrayMessage( message.ioDevice() ).write( client->challenge() ).send() == false )
 		{
@@ -133,22 +178,20 @@ VncServerClient::AuthState ServerAuthenticationManager::performKeyAuthentication
 		// under which the client claims to run
 		const auto signature = message.read().toByteArray(); // Flawfinder: ignore
 
-		const auto publicKeyPath = VeyonCore::filesystem().publicKeyPath( authKeyName );
-
-		CryptoCore::PublicKey publicKey( publicKeyPath );
-		if( publicKey.isNull() || publicKey.isPublic() == false )
+		auto key = publicKey( authKeyName );
+		if( key.isNull() )
 		{
-			vWarning() << "failed to load public key from" << publicKeyPath;
 			return VncServerClient::AuthState::Failed;
 		}
 
-		vDebug() << "loaded public key from" << publicKeyPath;
-		if( publicKey.verifyMessage( client->challenge(), signature, CryptoCore::DefaultSignatureAlgorithm ) == false )
+		if( key.verifyMessage( client->challenge(), signature, CryptoCore::DefaultSignatureAlgorithm ) == false )
 		{
 			vWarning() << "FAIL";
 			return VncServerClient::AuthState::Failed;
 		}
 
+		client->setAuthenticationKeyName( authKeyName );
+
 		vDebug() << "SUCCESS";
 		return VncServerClient::AuthState::Successful;
 	}
@@ -183,6 +226,8 @@ VncServerClient::AuthState ServerAuthenticationManager::performLogonAuthenticati
 		auto privateKey = client->privateKey();
 
 		CryptoCore::SecureArray encryptedPassword( message.read().toByteArray() ); // Flawfinder: ignore
+		// optional key for encrypting the session ticket secret, only sent when requesting a session ticket
+		const CryptoCore::SecureArray encryptedSessionTicketKey( message.read().toByteArray() ); // Flawfinder: ignore
 
 		CryptoCore::SecureArray decryptedPassword;
 
@@ -198,6 +243,16 @@ VncServerClient::AuthState ServerAuthenticationManager::performLogonAuthenticati
 
 		if( VeyonCore::platform().userFunctions().authenticate( client->username(), decryptedPassword ) )
 		{
+			updatePasswordVerifier( client->username(), decryptedPassword );
+
+			CryptoCore::SecureArray sessionTicketKey;
+			if( client->isSessionTicketRequested() && encryptedSessionTicketKey.isEmpty() == false &&
+				privateKey.decrypt( encryptedSessionTicketKey, &sessionTicketKey,
+									CryptoCore::DefaultEncryptionAlgorithm ) )
+			{
+				client->setSessionTicketKey( sessionTicketKey.toByteArray() );
+			}
+
 			vDebug() << "SUCCESS";
 			return VncServerClient::AuthState::Successful;
 		}
@@ -244,3 +299,293 @@ VncServerClient::AuthState ServerAuthenticationManager::performTokenAuthenticati
 
 	return VncServerClient::AuthState::Failed;
 }
+
+
+
+VncServerClient::AuthState ServerAuthenticationManager::performSessionTicketAuthentication( VncServerClient* client,
+																						   VariantArrayMessage& message )
+{
+	switch( client->authState() )
+	{
+	case VncServerClient::AuthState::Init:
+		// challenge has been sent along with the authentication types already
+		if( client->handshakeFlags().testFlag( RfbVeyonAuth::HandshakeFlag::SpeculativeAuthentication ) &&
+			client->challenge().size() == CryptoCore::ChallengeSize )
+		{
+			return VncServerClient::AuthState::SessionTicket;
+		}
+
+		client->setChallenge( CryptoCore::generateChallenge() );
+		if( VariantArrayMessage( message.ioDevice() ).write( client->challenge() ).send() == false )
+		{
+			vWarning() << "failed to send challenge";
+			return VncServerClient::AuthState::Failed;
+		}
+		return VncServerClient::AuthState::SessionTicket;
+
+	case VncServerClient::AuthState::SessionTicket:
+	{
+		const auto ticketId = message.read().toByteArray(); // Flawfinder: ignore
+		const auto proof = message.read().toByteArray(); // Flawfinder: ignore
+		const auto fallbackAuthType = message.read().value<RfbVeyonAuth::Type>(); // Flawfinder: ignore
+
+		SessionTicket ticket;
+		if( ticketId.isEmpty() == false )
+		{
+			QMutexLocker locker( &m_mutex );
+			// tickets can be presented only once, regardless of whether they are accepted
+			ticket = m_sessionTickets.take( ticketId );
+		}
+
+		// the secret itself is never transmitted - the client proves its possession by authenticating our challenge
+		const auto accepted = isSessionTicketValid( ticket, client ) &&
+							  CryptoCore::isEqual( proof, CryptoCore::messageAuthenticationCode( ticket.secret,
+																							   client->challenge() ) );
+
+		if( VariantArrayMessage( message.ioDevice() ).write( accepted ).send() == false )
+		{
+			vWarning() << "failed to send session ticket result";
+			return VncServerClient::AuthState::Failed;
+		}
+
+		if( accepted )
+		{
+			// continue with the original authentication type so access control is performed as usual
+			client->setAuthType( ticket.authType );
+			client->setAuthenticationKeyName( ticket.authenticationKeyName );
+
+			if( ticket.authType == RfbVeyonAuth::Logon )
+			{
+				// the client does not send a new key when resuming but derives the same one as we do
+				client->setSessionTicketKey( CryptoCore::deriveSessionTicketKey( ticket.secret, client->challenge() ) );
+			}
+
+			vDebug() << "SUCCESS";
+			return VncServerClient::AuthState::Successful;
+		}
+
+		vDebug() << "FAIL";
+
+		return fallBackFromSessionTicket( client, fallbackAuthType, message );
+	}
+
+	default:
+		break;
+	}
+
+	return VncServerClient::AuthState::Failed;
+}
+
+
+
+VncServerClient::AuthState ServerAuthenticationManager::fallBackFromSessionTicket( VncServerClient* client,
+																				   RfbVeyonAuth::Type authType,
+																				   VariantArrayMessage& message )
+{
+	if( ( authType != RfbVeyonAuth::KeyFile && authType != RfbVeyonAuth::Logon ) ||
+		supportedAuthTypes().contains( authType ) == false )
+	{
+		vDebug() << "no fallback authentication type available";
+		return VncServerClient::AuthState::Failed;
+	}
+
+	vDebug() << "falling back to authentication type" << authType;
+
+	// restart with the full authentication method within the same handshake
+	client->setAuthType( authType );
+	client->setChallenge( {} );
+	client->setAuthState( VncServerClient::AuthState::Init );
+
+	if( authType == RfbVeyonAuth::KeyFile )
+	{
+		return performKeyAuthentication( client, message );
+	}
+
+	return performLogonAuthentication( client, message );
+}
+
+
+
+bool ServerAuthenticationManager::sendSessionTicket( VncServerClient* client, QIODevice* ioDevice )
+{
+	const auto lifetime = VeyonCore::config().sessionTicketLifetime();
+
+	QByteArray ticketId;
+	QByteArray encryptedSecret;
+
+	if( lifetime > 0 &&
+		( client->authType() == RfbVeyonAuth::KeyFile || client->authType() == RfbVeyonAuth::Logon ) )
+	{
+		SessionTicket ticket;
+		ticket.authType = client->authType();
+		ticket.username = client->username();
+		ticket.hostAddress = client->hostAddress();
+		ticket.authenticationKeyName = client->authenticationKeyName();
+		if( ticket.authType == RfbVeyonAuth::KeyFile )
+		{
+			ticket.publicKeyTimestamp = publicKeyTimestamp( ticket.authenticationKeyName );
+		}
+		ticket.secret = CryptoCore::generateSecret();
+		ticket.expiry.setRemainingTime( lifetime * 1000 );
+
+		const auto id = CryptoCore::generateSecret();
+
+		encryptedSecret = encryptSessionTicketSecret( client, id, ticket.secret );
+
+		QMutexLocker locker( &m_mutex );
+
+		for( auto it = m_sessionTickets.begin(); it != m_sessionTickets.end(); )
+		{
+			if( it->expiry.hasExpired() )
+			{
+				it = m_sessionTickets.erase( it );
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		if( encryptedSecret.isEmpty() == false && m_sessionTickets.size() < MaximumSessionTickets )
+		{
+			ticketId = id;
+			m_sessionTickets.insert( ticketId, ticket );
+		}
+		else
+		{
+			encryptedSecret.clear();
+		}
+	}
+
+	// always reply so the client does not wait for a ticket which is not going to be issued
+	return VariantArrayMessage( ioDevice ).write( ticketId ).write( encryptedSecret ).write( lifetime * 1000 ).send();
+}
+
+
+
+QByteArray ServerAuthenticationManager::encryptSessionTicketSecret( const VncServerClient* client,
+																	const QByteArray& ticketId,
+																	const QByteArray& secret )
+{
+	if( client->authType() == RfbVeyonAuth::KeyFile )
+	{
+		// only the owner of the private key the client authenticated with is able to decrypt the secret
+		auto key = publicKey( client->authenticationKeyName() );
+		if( key.isNull() || key.canEncrypt() == false )
+		{
+			vWarning() << "can't encrypt session ticket secret with public key" << client->authenticationKeyName();
+			return {};
+		}
+
+		return key.encrypt( CryptoCore::SecureArray( secret ), CryptoCore::DefaultEncryptionAlgorithm ).toByteArray();
+	}
+
+	// key has been transferred encrypted with the ephemeral key of the logon authentication
+	return CryptoCore::maskSecret( secret, client->sessionTicketKey(), ticketId );
+}
+
+
+
+bool ServerAuthenticationManager::isSessionTicketValid( const SessionTicket& ticket, const VncServerClient* client ) const
+{
+	if( ticket.authType == RfbVeyonAuth::Invalid )
+	{
+		vWarning() << "unknown session ticket presented by" << client->hostAddress();
+		return false;
+	}
+
+	if( ticket.expiry.hasExpired() )
+	{
+		vDebug() << "session ticket expired";
+		return false;
+	}
+
+	if( ticket.hostAddress != client->hostAddress() || ticket.username != client->username() )
+	{
+		vWarning() << "session ticket presented by different host or user" << client->hostAddress() << client->username();
+		return false;
+	}
+
+	if( supportedAuthTypes().contains( ticket.authType ) == false )
+	{
+		vDebug() << "authentication type of session ticket no longer supported";
+		return false;
+	}
+
+	if( ticket.authType == RfbVeyonAuth::KeyFile &&
+		publicKeyTimestamp( ticket.authenticationKeyName ) != ticket.publicKeyTimestamp )
+	{
+		vDebug() << "public key changed since session ticket has been issued";
+		return false;
+	}
+
+	return true;
+}
+
+
+
+void ServerAuthenticationManager::updatePasswordVerifier( const QString& username,
+														  const CryptoCore::SecureArray& password )
+{
+	// keyed hash of the password only suitable for detecting password changes within this process
+	const auto verifier = CryptoCore::messageAuthenticationCode( m_passwordVerifierKey, password.toByteArray() );
+
+	QMutexLocker locker( &m_mutex );
+
+	const auto previousVerifier = m_passwordVerifiers.value( username );
+	if( previousVerifier.isEmpty() == false && CryptoCore::isEqual( previousVerifier, verifier ) == false )
+	{
+		vDebug() << "password of user" << username << "changed - revoking session tickets";
+
+		for( auto it = m_sessionTickets.begin(); it != m_sessionTickets.end(); )
+		{
+			if( it->authType == RfbVeyonAuth::Logon && it->username == username )
+			{
+				it = m_sessionTickets.erase( it );
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	m_passwordVerifiers[username] = verifier;
+}
+
+
+
+CryptoCore::PublicKey ServerAuthenticationManager::publicKey( const QString& authKeyName )
+{
+	const auto publicKeyPath = VeyonCore::filesystem().publicKeyPath( authKeyName );
+	const auto timestamp = publicKeyTimestamp( authKeyName );
+
+	QMutexLocker locker( &m_mutex );
+
+	const auto cachedKey = m_publicKeys.constFind( publicKeyPath );
+	if( cachedKey != m_publicKeys.constEnd() && timestamp.isValid() && cachedKey->timestamp == timestamp )
+	{
+		return cachedKey->key;
+	}
+
+	CryptoCore::PublicKey key( publicKeyPath );
+	if( key.isNull() || key.isPublic() == false )
+	{
+		vWarning() << "failed to load public key from" << publicKeyPath;
+		m_publicKeys.remove( publicKeyPath );
+		return {};
+	}
+
+	vDebug() << "loaded public key from" << publicKeyPath;
+
+	m_publicKeys[publicKeyPath] = { timestamp, key };
+
+	return key;
+}
+
+
+
+QDateTime ServerAuthenticationManager::publicKeyTimestamp( const QString& authKeyName )
+{
+	return QFileInfo( VeyonCore::filesystem().publicKeyPath( authKeyName ) ).lastModified();
+}
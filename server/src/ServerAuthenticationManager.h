@@ -24,6 +24,9 @@
 
 #pragma once
 
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QHash>
 #include <QMutex>
 #include <QStringList>
 
@@ -49,13 +52,53 @@ public:
 	void processAuthenticationMessage( VncServerClient* client,
 									   VariantArrayMessage& message );
 
+	void revokeSessionTickets();
+
 
 Q_SIGNALS:
 	void finished( VncServerClient* client );
 
 private:
+	static constexpr int MaximumSessionTickets = 4096;
+
+	struct SessionTicket
+	{
+		RfbVeyonAuth::Type authType{RfbVeyonAuth::Invalid};
+		QString username;
+		QString hostAddress;
+		QString authenticationKeyName;
+		QDateTime publicKeyTimestamp;
+		QByteArray secret;
+		QDeadlineTimer expiry;
+	};
+
+	struct CachedPublicKey
+	{
+		QDateTime timestamp;
+		CryptoCore::PublicKey key;
+	};
+
 	VncServerClient::AuthState performKeyAuthentication( VncServerClient* client, VariantArrayMessage& message );
 	VncServerClient::AuthState performLogonAuthentication( VncServerClient* client, VariantArrayMessage& message );
 	VncServerClient::AuthState performTokenAuthentication( VncServerClient* client, VariantArrayMessage& message );
+	VncServerClient::AuthState performSessionTicketAuthentication( VncServerClient* client, VariantArrayMessage& message );
+
+	VncServerClient::AuthState fallBackFromSessionTicket( VncServerClient* client, RfbVeyonAuth::Type authType,
+														  VariantArrayMessage& message );
+
+	bool sendSessionTicket( VncServerClient* client, QIODevice* ioDevice );
+	QByteArray encryptSessionTicketSecret( const VncServerClient* client, const QByteArray& ticketId,
+										   const QByteArray& secret );
+	bool isSessionTicketValid( const SessionTicket& ticket, const VncServerClient* client ) const;
+	void updatePasswordVerifier( const QString& username, const CryptoCore::SecureArray& password );
+
+	CryptoCore::PublicKey publicKey( const QString& authKeyName );
+	static QDateTime publicKeyTimestamp( const QString& authKeyName );
+
+	QMutex m_mutex;
+	QHash<QByteArray, SessionTicket> m_sessionTickets;
+	const QByteArray m_passwordVerifierKey;
+	QHash<QString, QByteArray> m_passwordVerifiers;
+	QHash<QString, CachedPublicKey> m_publicKeys;
 
 } ;
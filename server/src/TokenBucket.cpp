@@ -0,0 +1,110 @@
+/*
+ * TokenBucket.cpp - implementation of TokenBucket class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <cmath>
+
+#include "TokenBucket.h"
+
+
+TokenBucket::TokenBucket( qint64 rate )
+{
+	setRate( rate );
+}
+
+
+
+void TokenBucket::setRate( qint64 rate )
+{
+	QMutexLocker locker( &m_mutex );
+
+	m_rate = qMax<qint64>( 0, rate );
+	m_tokens = m_rate * BurstDuration / 1000;
+	m_refillTimer.start();
+	m_lastRefillTime = 0;
+}
+
+
+
+bool TokenBucket::isLimited() const
+{
+	QMutexLocker locker( &m_mutex );
+
+	return m_rate > 0;
+}
+
+
+
+void TokenBucket::consume( qint64 size )
+{
+	QMutexLocker locker( &m_mutex );
+
+	// check rate while holding the lock as it may be changed concurrently
+	if( m_rate <= 0 || size <= 0 )
+	{
+		return;
+	}
+
+	refill();
+
+	m_tokens -= size;
+}
+
+
+
+int TokenBucket::delay()
+{
+	QMutexLocker locker( &m_mutex );
+
+	if( m_rate <= 0 )
+	{
+		return 0;
+	}
+
+	refill();
+
+	if( m_tokens > 0 )
+	{
+		return 0;
+	}
+
+	return int( std::ceil( double( -m_tokens + 1 ) * 1000 / double( m_rate ) ) );
+}
+
+
+
+void TokenBucket::refill()
+{
+	constexpr double NanosecondsPerSecond = 1e9;
+
+	const auto now = m_refillTimer.nsecsElapsed();
+	const auto tokens = qint64( double( now - m_lastRefillTime ) * double( m_rate ) / NanosecondsPerSecond );
+
+	if( tokens > 0 )
+	{
+		m_tokens = qMin( m_tokens + tokens, m_rate * BurstDuration / 1000 );
+
+		// only advance by the time corresponding to the added tokens so fractions do not get lost
+		m_lastRefillTime += qint64( double( tokens ) * NanosecondsPerSecond / double( m_rate ) );
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * TokenBucket.h - declaration of TokenBucket class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMutex>
+
+/**
+ * \brief Thread-safe token bucket for limiting data rates
+ *
+ * Tokens (bytes) are refilled continuously at the configured rate up to one second worth of data.
+ * Consumed data is accounted afterwards so the bucket can run into debt, which then has to be
+ * paid off before delay() returns 0 again.
+ */
+class TokenBucket
+{
+public:
+	explicit TokenBucket( qint64 rate = 0 );
+
+	// bytes per second, 0 disables limiting
+	void setRate( qint64 rate );
+
+	bool isLimited() const;
+
+	void consume( qint64 size );
+
+	// milliseconds until tokens are available again
+	int delay();
+
+private:
+	static constexpr int BurstDuration = 1000;
+
+	void refill();
+
+	mutable QMutex m_mutex;
+	qint64 m_rate{0};
+	qint64 m_tokens{0};
+	QElapsedTimer m_refillTimer;
+	qint64 m_lastRefillTime{0};
+
+} ;
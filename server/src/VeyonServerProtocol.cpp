@@ -48,6 +48,19 @@ QVector<RfbVeyonAuth::Type> VeyonServerProtocol::supportedAuthTypes() const
 
 
 
+RfbVeyonAuth::HandshakeFlags VeyonServerProtocol::supportedHandshakeFlags() const
+{
+	auto flags = VncServerProtocol::supportedHandshakeFlags();
+	if( flags )
+	{
+		flags |= RfbVeyonAuth::HandshakeFlag::InitialState;
+	}
+
+	return flags;
+}
+
+
+
 void VeyonServerProtocol::processAuthenticationMessage(VariantArrayMessage &message)
 {
 	m_serverAuthenticationManager.processAuthenticationMessage( client(), message );
@@ -43,6 +43,7 @@ public:
 
 protected:
 	QVector<RfbVeyonAuth::Type> supportedAuthTypes() const override;
+	RfbVeyonAuth::HandshakeFlags supportedHandshakeFlags() const override;
 	void processAuthenticationMessage( VariantArrayMessage& message ) override;
 	void performAccessControl() override;
 
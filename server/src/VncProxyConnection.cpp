@@ -22,14 +22,28 @@
  *
  */
 
+#include <QtGlobal>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include <QBuffer>
 #include <QHostAddress>
 #include <QTcpSocket>
+#include <QThread>
 #include <QTimer>
 
 #include "VncClientProtocol.h"
 #include "VncProxyConnection.h"
 #include "VncServerProtocol.h"
+#include "VncUpstreamSessionManager.h"
 
 VncProxyConnection::VncProxyConnection( QTcpSocket* clientSocket,
 										int vncServerPort,
@@ -37,25 +51,67 @@ VncProxyConnection::VncProxyConnection( QTcpSocket* clientSocket,
 	QObject( parent ),
 	m_vncServerPort( vncServerPort ),
 	m_proxyClientSocket( clientSocket ),
+	m_proxyClientAddress( clientSocket->peerAddress().toString() ),
 	m_vncServerSocket( new QTcpSocket( this ) ),
 	m_rfbClientToServerMessageSizes( {
 		{ rfbFramebufferUpdateRequest, sz_rfbFramebufferUpdateRequestMsg },
 		{ rfbKeyEvent, sz_rfbKeyEventMsg },
 		{ rfbPointerEvent, sz_rfbPointerEventMsg },
 		{ rfbXvp, sz_rfbXvpMsg },
-		} )
+		} ),
+	m_readFromServerTimer( new QTimer( this ) ),
+	m_readFromClientTimer( new QTimer( this ) )
 {
+	// let the client socket move along with the connection to a worker thread
+	m_proxyClientSocket->setParent( this );
+
+	m_readFromServerTimer->setSingleShot( true );
+	m_readFromServerTimer->setInterval( ProtocolRetryTime );
+	m_readFromClientTimer->setSingleShot( true );
+	m_readFromClientTimer->setInterval( ProtocolRetryTime );
+
+	connect( m_readFromServerTimer, &QTimer::timeout, this, &VncProxyConnection::readFromServer );
+	connect( m_readFromClientTimer, &QTimer::timeout, this, &VncProxyConnection::readFromClient );
+
 	connect( m_proxyClientSocket, &QTcpSocket::readyRead, this, &VncProxyConnection::readFromClient );
 	connect( m_vncServerSocket, &QTcpSocket::readyRead, this, &VncProxyConnection::readFromServer );
 
 	connect( m_vncServerSocket, &QTcpSocket::disconnected, this, &VncProxyConnection::clientConnectionClosed );
 	connect( m_proxyClientSocket, &QTcpSocket::disconnected, this, &VncProxyConnection::serverConnectionClosed );
+
+#if defined(Q_OS_LINUX)
+	if( pipe2( m_splicePipe, O_NONBLOCK | O_CLOEXEC ) == 0 )
+	{
+		// allow moving large chunks at once
+		fcntl( m_splicePipe[1], F_SETPIPE_SZ, int(SpliceChunkSize) );
+	}
+	else
+	{
+		vWarning() << "could not create pipe for forwarding data - falling back to copying";
+		m_splicePipe[0] = m_splicePipe[1] = -1;
+	}
+#endif
 }
 
 
 
 VncProxyConnection::~VncProxyConnection()
 {
+	if( m_upstreamSession )
+	{
+		m_upstreamSession->unsubscribe( this );
+	}
+
+	logForwardingStatistics();
+
+#if defined(Q_OS_LINUX)
+	if( m_splicePipe[0] >= 0 )
+	{
+		close( m_splicePipe[0] );
+		close( m_splicePipe[1] );
+	}
+#endif
+
 	// do not get notified about disconnects any longer
 	disconnect( m_vncServerSocket );
 	disconnect( m_proxyClientSocket );
@@ -68,11 +124,36 @@ VncProxyConnection::~VncProxyConnection()
 
 void VncProxyConnection::start()
 {
+	m_connectionTimer.start();
+	m_statisticsLogTimer.start();
+	m_dataRateMeasurementTimer.start();
+
 	serverProtocol().start();
 }
 
 
 
+void VncProxyConnection::moveToWorkerThread( QThread* thread )
+{
+	moveToThread( thread );
+
+	// process data which arrived while moving
+	QMetaObject::invokeMethod( this, &VncProxyConnection::readFromClient, Qt::QueuedConnection );
+	QMetaObject::invokeMethod( this, &VncProxyConnection::readFromServer, Qt::QueuedConnection );
+}
+
+
+
+VncProxyConnection::ForwardingStatistics VncProxyConnection::forwardingStatistics() const
+{
+	auto statistics = m_statistics;
+	statistics.elapsedTime = m_connectionTimer.isValid() ? m_connectionTimer.elapsed() : 0;
+
+	return statistics;
+}
+
+
+
 void VncProxyConnection::readFromClient()
 {
 	if( serverProtocol().state() != VncServerProtocol::State::Running )
@@ -88,9 +169,13 @@ void VncProxyConnection::readFromClient()
 	}
 	else if( clientProtocol().state() == VncClientProtocol::Running )
 	{
+		const auto cpuTimeStart = threadCpuTime();
+
 		while( receiveClientMessage() )
 		{
 		}
+
+		m_statistics.cpuTime += threadCpuTime() - cpuTimeStart;
 	}
 	else
 	{
@@ -105,6 +190,8 @@ void VncProxyConnection::readFromClient()
 
 		clientProtocol().start();
 	}
+
+	checkEstablished();
 }
 
 
@@ -126,21 +213,42 @@ void VncProxyConnection::readFromServer()
 			// we can forward to the real client
 			serverProtocol().setServerInitMessage( clientProtocol().serverInitMessage() );
 
+			m_upstreamProfile.pixelFormat = clientProtocol().pixelFormat();
+
 			readFromServerLater();
 		}
 	}
 	else if( serverProtocol().state() == VncServerProtocol::State::Running )
 	{
-		while( receiveServerMessage() )
+		for(;;)
 		{
+			const auto cpuTimeStart = threadCpuTime();
+			const auto messageReceived = receiveServerMessage();
+			m_statistics.cpuTime += threadCpuTime() - cpuTimeStart;
+
+			if( messageReceived == false )
+			{
+				break;
+			}
+
 			Q_EMIT serverMessageProcessed();
 		}
+
+		updateClientDataRate();
+
+		if( m_statisticsLogTimer.hasExpired( StatisticsLogInterval ) )
+		{
+			logForwardingStatistics();
+			m_statisticsLogTimer.restart();
+		}
 	}
 	else
 	{
 		// try again as server connection is not yet ready and we can't forward data
 		readFromServerLater();
 	}
+
+	checkEstablished();
 }
 
 
@@ -149,10 +257,11 @@ bool VncProxyConnection::forwardDataToClient( qint64 size )
 {
 	if( m_vncServerSocket->bytesAvailable() >= size )
 	{
-		const auto data = m_vncServerSocket->read( size ); // Flawfinder: ignore
-		if( data.size() == size )
+		m_forwardBuffer.resize( int(size) );
+		if( m_vncServerSocket->read( m_forwardBuffer.data(), size ) == size ) // Flawfinder: ignore
 		{
-			return m_proxyClientSocket->write( data ) == size;
+			m_statistics.bytesToClient += size;
+			return m_proxyClientSocket->write( m_forwardBuffer.constData(), size ) == size;
 		}
 	}
 
@@ -165,10 +274,10 @@ bool VncProxyConnection::forwardDataToServer( qint64 size )
 {
 	if( m_proxyClientSocket->bytesAvailable() >= size )
 	{
-		const auto data = m_proxyClientSocket->read( size ); // Flawfinder: ignore
-		if( data.size() == size )
+		m_forwardBuffer.resize( int(size) );
+		if( m_proxyClientSocket->read( m_forwardBuffer.data(), size ) == size ) // Flawfinder: ignore
 		{
-			return m_vncServerSocket->write( data ) == size;
+			return sendToServer( m_forwardBuffer.constData(), size );
 		}
 	}
 
@@ -177,16 +286,351 @@ bool VncProxyConnection::forwardDataToServer( qint64 size )
 
 
 
+bool VncProxyConnection::writeToClient( const QByteArray& data )
+{
+	if( data.isEmpty() )
+	{
+		return true;
+	}
+
+	m_statistics.bytesToClient += data.size();
+
+	// QByteArray is passed on to the socket's write buffer without copying
+	return m_proxyClientSocket->write( data ) == data.size();
+}
+
+
+
+bool VncProxyConnection::writeToServer( const QByteArray& data )
+{
+	if( data.isEmpty() )
+	{
+		return true;
+	}
+
+	return sendToServer( data.constData(), data.size() );
+}
+
+
+
+void VncProxyConnection::deliverSharedServerMessage( const VncUpstreamSession::Message& message )
+{
+	if( m_upstreamSessionAttached == false )
+	{
+		return;
+	}
+
+	const auto streamResets = m_upstreamSession->requiresStreamResets();
+
+	if( streamResets )
+	{
+		if( message.startsEpoch )
+		{
+			m_sharedEpoch = message.epoch;
+		}
+		else if( message.epoch != m_sharedEpoch )
+		{
+			// continues zlib streams whose beginning the client has not received
+			return;
+		}
+	}
+
+	++m_statistics.sharedUpdates;
+
+	if( m_sharedUpdateRequested )
+	{
+		m_sharedUpdateRequested = false;
+
+		processSharedServerMessage( message );
+
+		Q_EMIT serverMessageProcessed();
+		return;
+	}
+
+	// queued updates have been dropped already so the next request has to fetch a full update anyway
+	if( m_sharedFullUpdateRequired && streamResets == false )
+	{
+		return;
+	}
+
+	// keep update until the client asks for it so slow clients do not slow down others
+	m_sharedUpdateQueue.append( message );
+	m_sharedUpdateQueueSize += message.data.size();
+
+	const auto maximumQueueSize = qint64(MaximumSharedUpdateQueueFramebuffers) *
+								  message.framebufferSize.width() * message.framebufferSize.height() *
+								  qMax<int>( 1, clientProtocol().pixelFormat().bitsPerPixel / 8 );
+
+	if( m_sharedUpdateQueueSize > maximumQueueSize )
+	{
+		m_sharedUpdateQueue.clear();
+		m_sharedUpdateQueueSize = 0;
+		m_sharedFullUpdateRequired = true;
+
+		if( streamResets )
+		{
+			// dropped updates contained zlib data the following ones depend on
+			m_sharedEpoch = 0;
+			m_upstreamSession->requestStreamReset();
+		}
+	}
+}
+
+
+
+void VncProxyConnection::handleUpstreamSessionFailure()
+{
+	vDebug() << "falling back to own VNC server connection";
+
+	detachFromUpstreamSession();
+}
+
+
+
+void VncProxyConnection::setUpstreamEncodings( const QVector<uint32_t>& encodings )
+{
+	// the shared connection may use other encodings the client supports
+	const auto shareableEncodings = VncUpstreamSession::shareableEncodings( encodings );
+
+	if( shareableEncodings != m_upstreamProfile.encodings )
+	{
+		m_upstreamProfile.encodings = shareableEncodings;
+
+		// updates have to be encoded differently now
+		detachFromUpstreamSession();
+	}
+}
+
+
+
+bool VncProxyConnection::sendToServer( const char* data, qint64 size )
+{
+	switch( uint8_t(data[0]) )
+	{
+	case rfbFramebufferUpdateRequest:
+		if( size >= sz_rfbFramebufferUpdateRequestMsg )
+		{
+			const auto incremental = reinterpret_cast<const rfbFramebufferUpdateRequestMsg *>( data )->incremental != 0;
+			if( requestSharedFramebufferUpdate( incremental ) )
+			{
+				return true;
+			}
+
+			if( m_privateFullUpdateRequired )
+			{
+				// client received updates through the shared connection so far
+				m_privateFullUpdateRequired = false;
+				if( incremental )
+				{
+					clientProtocol().requestFramebufferUpdate( false );
+					return true;
+				}
+			}
+		}
+		break;
+
+	case rfbSetPixelFormat:
+		// pixel format of client protocol has been updated already
+		m_upstreamProfile.pixelFormat = clientProtocol().pixelFormat();
+		detachFromUpstreamSession();
+		break;
+
+	case rfbSetEncodings:
+		if( size >= sz_rfbSetEncodingsMsg )
+		{
+			const auto nEncodings = int( ( size - sz_rfbSetEncodingsMsg ) / int(sizeof(uint32_t)) );
+
+			QVector<uint32_t> encodings;
+			encodings.reserve( nEncodings );
+			for( int i = 0; i < nEncodings; ++i )
+			{
+				encodings.append( qFromBigEndian<uint32_t>( data + sz_rfbSetEncodingsMsg + i * int(sizeof(uint32_t)) ) );
+			}
+
+			setUpstreamEncodings( encodings );
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	m_statistics.bytesToServer += size;
+
+	return m_vncServerSocket->write( data, size ) == size;
+}
+
+
+
+bool VncProxyConnection::requestSharedFramebufferUpdate( bool incremental )
+{
+	if( m_upstreamSession.isNull() )
+	{
+		if( m_upstreamSessionManager == nullptr || VncUpstreamSession::isShareable( m_upstreamProfile ) == false )
+		{
+			return false;
+		}
+
+		m_upstreamSession = m_upstreamSessionManager->acquire( m_upstreamProfile );
+		if( m_upstreamSession.isNull() )
+		{
+			return false;
+		}
+	}
+
+	switch( m_upstreamSession->state() )
+	{
+	case VncUpstreamSession::State::Connecting:
+		// keep using own connection until the shared one is ready - attached clients wait for
+		// the session to reconnect
+		if( m_upstreamSessionAttached == false )
+		{
+			return false;
+		}
+		break;
+	case VncUpstreamSession::State::Failed:
+		detachFromUpstreamSession();
+		return false;
+	case VncUpstreamSession::State::Running:
+		break;
+	}
+
+	if( m_upstreamSessionAttached == false )
+	{
+		// updates must not be interleaved with a message partially passed through already
+		if( clientProtocol().isForwardingMessage() )
+		{
+			return false;
+		}
+
+		m_upstreamSession->subscribe( this );
+		m_upstreamSessionAttached = true;
+
+		// updates still requested through the own connection are discarded
+		m_sharedFullUpdateRequired = true;
+		m_privateFullUpdateRequired = false;
+		m_sharedCursorReplayRequired = true;
+		m_sharedEpoch = 0;
+
+		if( m_upstreamSession->requiresStreamResets() )
+		{
+			// let all subscribers start with new zlib streams
+			m_upstreamSession->requestStreamReset();
+		}
+	}
+
+	// queued updates can't be dropped when they continue zlib streams
+	if( incremental == false && m_upstreamSession->requiresStreamResets() == false )
+	{
+		m_sharedUpdateQueue.clear();
+		m_sharedUpdateQueueSize = 0;
+	}
+	else if( m_sharedUpdateQueue.isEmpty() == false )
+	{
+		// satisfy request with updates received in the meantime
+		const auto queue = std::exchange( m_sharedUpdateQueue, {} );
+		m_sharedUpdateQueueSize = 0;
+
+		for( const auto& message : queue )
+		{
+			processSharedServerMessage( message );
+		}
+
+		// fetch the requested full update with the next request
+		m_sharedFullUpdateRequired |= incremental == false;
+
+		Q_EMIT serverMessageProcessed();
+		return true;
+	}
+
+	m_sharedUpdateRequested = true;
+	m_upstreamSession->requestFramebufferUpdate( incremental && m_sharedFullUpdateRequired == false );
+	m_sharedFullUpdateRequired = false;
+
+	return true;
+}
+
+
+
+void VncProxyConnection::processSharedServerMessage( const VncUpstreamSession::Message& message )
+{
+	// the client's own connection does not receive any framebuffer updates while attached
+	clientProtocol().setFramebufferSize( message.framebufferSize.width(), message.framebufferSize.height() );
+
+	if( m_sharedCursorReplayRequired )
+	{
+		// cursor shape and position are only sent when changed so send the current ones first
+		m_sharedCursorReplayRequired = false;
+
+		const auto cursorUpdate = m_upstreamSession->cursorUpdateMessage();
+		if( cursorUpdate.isEmpty() == false )
+		{
+			processServerMessage( cursorUpdate );
+		}
+	}
+
+	processServerMessage( message.data );
+}
+
+
+
+void VncProxyConnection::detachFromUpstreamSession()
+{
+	if( m_upstreamSession.isNull() )
+	{
+		return;
+	}
+
+	m_upstreamSession->unsubscribe( this );
+	m_upstreamSession.reset();
+
+	if( m_upstreamSessionAttached == false )
+	{
+		return;
+	}
+
+	m_upstreamSessionAttached = false;
+	m_sharedUpdateQueue.clear();
+	m_sharedUpdateQueueSize = 0;
+	m_sharedEpoch = 0;
+
+	if( m_sharedUpdateRequested )
+	{
+		// client is still waiting for an update so request it through the own connection
+		m_sharedUpdateRequested = false;
+		clientProtocol().requestFramebufferUpdate( false );
+	}
+	else
+	{
+		m_privateFullUpdateRequired = true;
+	}
+}
+
+
+
 void VncProxyConnection::readFromServerLater()
 {
-	QTimer::singleShot( ProtocolRetryTime, this, &VncProxyConnection::readFromServer );
+	m_readFromServerTimer->start();
 }
 
 
 
 void VncProxyConnection::readFromClientLater()
 {
-	QTimer::singleShot( ProtocolRetryTime, this, &VncProxyConnection::readFromClient );
+	m_readFromClientTimer->start();
+}
+
+
+
+void VncProxyConnection::checkEstablished()
+{
+	if( m_established == false &&
+		serverProtocol().state() == VncServerProtocol::State::Running &&
+		clientProtocol().state() == VncClientProtocol::Running )
+	{
+		m_established = true;
+		Q_EMIT established();
+	}
 }
 
 
@@ -256,12 +700,211 @@ bool VncProxyConnection::receiveClientMessage()
 
 bool VncProxyConnection::receiveServerMessage()
 {
-	if( clientProtocol().receiveMessage() )
+	do
+	{
+		// remainder of a message passed through partially already must not be processed
+		const auto forwarding = clientProtocol().isForwardingMessage();
+
+		if( clientProtocol().receiveMessage() )
+		{
+			const auto messageType = clientProtocol().lastMessageType();
+
+			if( forwarding )
+			{
+				writeToClient( clientProtocol().lastMessage() );
+			}
+			else if( m_upstreamSessionAttached == false ||
+					 ( messageType != rfbFramebufferUpdate && messageType != rfbResizeFrameBuffer ) )
+			{
+				processServerMessage( clientProtocol().lastMessage() );
+			}
+
+			// framebuffer updates are received through the shared connection while attached
+
+			return true;
+		}
+	}
+	while( isPassThroughAllowed() && m_upstreamSessionAttached == false && forwardPayload() );
+
+	return false;
+}
+
+
+
+void VncProxyConnection::processServerMessage( const QByteArray& message )
+{
+	writeToClient( message );
+}
+
+
+
+bool VncProxyConnection::forwardPayload()
+{
+	auto& protocol = clientProtocol();
+
+	if( m_splicePipe[0] < 0 || protocol.missingPayloadSize() < MinimumSplicePayloadSize )
+	{
+		return false;
+	}
+
+	// data queued for the client has to be sent before bypassing the socket's write buffer
+	m_proxyClientSocket->flush();
+	if( m_proxyClientSocket->bytesToWrite() > 0 )
+	{
+		return false;
+	}
+
+	// message header and beginning of the payload have been received already
+	writeToClient( protocol.takeIncompleteMessage() );
+
+	m_proxyClientSocket->flush();
+	if( m_proxyClientSocket->bytesToWrite() > 0 )
+	{
+		return false;
+	}
+
+	const auto forwardedSize = splicePayload( protocol.missingPayloadSize() );
+	if( forwardedSize > 0 )
 	{
-		m_proxyClientSocket->write( clientProtocol().lastMessage() );
+		protocol.markPayloadForwarded( forwardedSize );
+
+		m_statistics.bytesToClient += forwardedSize;
+		m_statistics.splicedBytes += forwardedSize;
 
 		return true;
 	}
 
 	return false;
 }
+
+
+
+qint64 VncProxyConnection::splicePayload( qint64 size )
+{
+#if defined(Q_OS_LINUX)
+	const auto serverSocket = int( m_vncServerSocket->socketDescriptor() );
+	const auto clientSocket = int( m_proxyClientSocket->socketDescriptor() );
+
+	if( serverSocket < 0 || clientSocket < 0 )
+	{
+		return 0;
+	}
+
+	qint64 forwardedSize = 0;
+
+	while( forwardedSize < size )
+	{
+		const auto receivedSize = splice( serverSocket, nullptr, m_splicePipe[1], nullptr,
+										  size_t( qMin( size - forwardedSize, SpliceChunkSize ) ),
+										  SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+		if( receivedSize <= 0 )
+		{
+			// no more data available right now - a closed connection is handled by QTcpSocket
+			break;
+		}
+
+		auto pendingSize = qint64( receivedSize );
+		while( pendingSize > 0 )
+		{
+			const auto sentSize = splice( m_splicePipe[0], nullptr, clientSocket, nullptr,
+										  size_t( pendingSize ), SPLICE_F_MOVE | SPLICE_F_NONBLOCK );
+			if( sentSize <= 0 )
+			{
+				break;
+			}
+			pendingSize -= sentSize;
+		}
+
+		forwardedSize += receivedSize;
+
+		if( pendingSize > 0 )
+		{
+			// client does not accept more data right now so move the remaining data to the
+			// socket's write buffer to preserve the order of data sent afterwards
+			QByteArray data( int(pendingSize), Qt::Uninitialized );
+			if( ::read( m_splicePipe[0], data.data(), size_t(pendingSize) ) != pendingSize ) // Flawfinder: ignore
+			{
+				vCritical() << "could not drain pipe - closing connection";
+				m_proxyClientSocket->close();
+				return 0;
+			}
+
+			m_proxyClientSocket->write( data );
+			break;
+		}
+	}
+
+	return forwardedSize;
+#else
+	Q_UNUSED(size)
+
+	return 0;
+#endif
+}
+
+
+
+void VncProxyConnection::logForwardingStatistics()
+{
+	const auto statistics = forwardingStatistics();
+	const auto totalBytes = statistics.bytesToClient + statistics.bytesToServer;
+
+	if( totalBytes <= 0 || statistics.elapsedTime <= 0 )
+	{
+		return;
+	}
+
+	constexpr auto BytesPerMB = 1024.0 * 1024.0;
+
+	vDebug() << "forwarded" << statistics.bytesToClient / BytesPerMB << "MB to client and"
+			 << statistics.bytesToServer / BytesPerMB << "MB to server,"
+			 << totalBytes / BytesPerMB * 1000 / statistics.elapsedTime << "MB/s,"
+			 << statistics.splicedBytes * 100 / totalBytes << "% spliced,"
+			 << statistics.sharedUpdates << "shared updates,"
+			 << statistics.cpuTime / ( totalBytes / BytesPerMB ) << "us CPU time per MB,"
+			 << "currently" << m_clientDataRate / 1024 << "kB/s to client";
+}
+
+
+
+void VncProxyConnection::updateClientDataRate()
+{
+	const auto elapsed = m_dataRateMeasurementTimer.elapsed();
+	if( elapsed < DataRateMeasurementInterval )
+	{
+		return;
+	}
+
+	m_clientDataRate = ( m_statistics.bytesToClient - m_dataRateMeasurementBytes ) * 1000 / elapsed;
+
+	m_dataRateMeasurementBytes = m_statistics.bytesToClient;
+	m_dataRateMeasurementTimer.restart();
+}
+
+
+
+qint64 VncProxyConnection::threadCpuTime()
+{
+#if defined(Q_OS_WIN)
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if( GetThreadTimes( GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime ) == false )
+	{
+		return 0;
+	}
+
+	// FILETIME values are given in 100 ns units
+	const auto toMicroseconds = []( FILETIME time ) {
+		return ( qint64( time.dwHighDateTime ) << 32 | time.dwLowDateTime ) / 10;
+	};
+
+	return toMicroseconds( kernelTime ) + toMicroseconds( userTime );
+#else
+	timespec time{};
+	if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &time ) != 0 )
+	{
+		return 0;
+	}
+
+	return qint64( time.tv_sec ) * 1000000 + time.tv_nsec / 1000;
+#endif
+}
@@ -24,20 +24,40 @@
 
 #pragma once
 
+#include <atomic>
+
+#include <QElapsedTimer>
 #include <QObject>
 
+#include "VncUpstreamSession.h"
+
 class QBuffer;
 class QTcpSocket;
+class QThread;
+class QTimer;
 
 class VncClientProtocol;
 class VncServerProtocol;
+class VncUpstreamSessionManager;
 
 class VncProxyConnection : public QObject
 {
 	Q_OBJECT
 public:
 	enum {
-		ProtocolRetryTime = 250
+		ProtocolRetryTime = 250,
+		StatisticsLogInterval = 60000,
+		DataRateMeasurementInterval = 1000
+	};
+
+	struct ForwardingStatistics
+	{
+		qint64 bytesToClient{0};
+		qint64 bytesToServer{0};
+		qint64 splicedBytes{0};
+		qint64 sharedUpdates{0}; // framebuffer updates received through a shared VNC server connection
+		qint64 cpuTime{0}; // thread CPU time spent for forwarding in microseconds
+		qint64 elapsedTime{0}; // milliseconds since the connection has been started
 	};
 
 	VncProxyConnection( QTcpSocket* clientSocket, int vncServerPort, QObject* parent );
@@ -45,6 +65,29 @@ public:
 
 	void start();
 
+	bool isEstablished() const
+	{
+		return m_established;
+	}
+
+	// continues processing in the event loop of the given thread - must be called from the current thread
+	void moveToWorkerThread( QThread* thread );
+
+	// lets the connection share framebuffer updates with other connections - must be called before moving
+	void setUpstreamSessionManager( VncUpstreamSessionManager* manager )
+	{
+		m_upstreamSessionManager = manager;
+	}
+
+	bool isAttachedToUpstreamSession() const
+	{
+		return m_upstreamSessionAttached;
+	}
+
+	// called by VncUpstreamSession in the thread of the connection
+	void deliverSharedServerMessage( const VncUpstreamSession::Message& message );
+	void handleUpstreamSessionFailure();
+
 	QTcpSocket* proxyClientSocket() const
 	{
 		return m_proxyClientSocket;
@@ -55,6 +98,20 @@ public:
 		return m_vncServerSocket;
 	}
 
+	// captured at accept time so it can be read from any thread
+	const QString& proxyClientAddress() const
+	{
+		return m_proxyClientAddress;
+	}
+
+	ForwardingStatistics forwardingStatistics() const;
+
+	// bytes per second sent to the client during the last measurement interval - may be called from any thread
+	qint64 clientDataRate() const
+	{
+		return m_clientDataRate;
+	}
+
 protected Q_SLOTS:
 	void readFromClient();
 	void readFromServer();
@@ -63,26 +120,98 @@ protected:
 	bool forwardDataToClient( qint64 size );
 	bool forwardDataToServer( qint64 size );
 
+	bool writeToClient( const QByteArray& data );
+	bool writeToServer( const QByteArray& data );
+
 	void readFromServerLater();
 	void readFromClientLater();
 
 	virtual bool receiveClientMessage();
 	virtual bool receiveServerMessage();
+	virtual void processServerMessage( const QByteArray& message );
+
+	// whether server messages may be forwarded to the client without being processed
+	virtual bool isPassThroughAllowed() const
+	{
+		return true;
+	}
+
+	// has to be called when changing the encodings of the VNC server connection directly
+	void setUpstreamEncodings( const QVector<uint32_t>& encodings );
 
 	virtual VncClientProtocol& clientProtocol() = 0;
 	virtual VncServerProtocol& serverProtocol() = 0;
 
 private:
+	static constexpr qint64 MinimumSplicePayloadSize = 16*1024;
+	static constexpr qint64 SpliceChunkSize = 256*1024;
+
+	// limit of updates queued for a client sharing a VNC server connection, relative to the framebuffer size
+	static constexpr int MaximumSharedUpdateQueueFramebuffers = 2;
+
+	bool sendToServer( const char* data, qint64 size );
+
+	bool requestSharedFramebufferUpdate( bool incremental );
+	void processSharedServerMessage( const VncUpstreamSession::Message& message );
+	void detachFromUpstreamSession();
+
+	bool forwardPayload();
+	qint64 splicePayload( qint64 size );
+
+	void logForwardingStatistics();
+	void updateClientDataRate();
+
+	void checkEstablished();
+
+	static qint64 threadCpuTime();
+
 	const int m_vncServerPort;
 
 	QTcpSocket* m_proxyClientSocket;
+	const QString m_proxyClientAddress;
 	QTcpSocket* m_vncServerSocket;
 
 	const QMap<int, int> m_rfbClientToServerMessageSizes;
 
+	// retry timers are children so they move along with the connection to a worker thread
+	QTimer* m_readFromServerTimer;
+	QTimer* m_readFromClientTimer;
+
+	bool m_established{false};
+
+	// reused for forwarding client messages without allocating memory
+	QByteArray m_forwardBuffer;
+
+	// pipe for moving payload data from server to client socket inside the kernel
+	int m_splicePipe[2]{-1, -1};
+
+	VncUpstreamSessionManager* m_upstreamSessionManager{nullptr};
+	VncUpstreamSession::Pointer m_upstreamSession{};
+	VncUpstreamSession::Profile m_upstreamProfile{};
+	bool m_upstreamSessionAttached{false};
+	bool m_sharedUpdateRequested{false};
+	bool m_sharedFullUpdateRequired{false};
+	bool m_privateFullUpdateRequired{false};
+	bool m_sharedCursorReplayRequired{false};
+	// epoch of the shared connection the client can decode updates of (0 = none yet)
+	int m_sharedEpoch{0};
+
+	// updates received through the shared connection while the client did not request any
+	QList<VncUpstreamSession::Message> m_sharedUpdateQueue;
+	qint64 m_sharedUpdateQueueSize{0};
+
+	ForwardingStatistics m_statistics{};
+	QElapsedTimer m_connectionTimer{};
+	QElapsedTimer m_statisticsLogTimer{};
+
+	std::atomic<qint64> m_clientDataRate{0};
+	qint64 m_dataRateMeasurementBytes{0};
+	QElapsedTimer m_dataRateMeasurementTimer{};
+
 Q_SIGNALS:
 	void clientConnectionClosed();
 	void serverConnectionClosed();
 	void serverMessageProcessed();
+	void established();
 
 } ;
@@ -24,7 +24,9 @@
 
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QThread>
 
+#include "VeyonConfiguration.h"
 #include "VeyonCore.h"
 #include "VncProxyServer.h"
 #include "VncProxyConnection.h"
@@ -68,7 +70,11 @@ bool VncProxyServer::start( int vncServerPort, const Password& vncServerPassword
 		return false;
 	}
 
-	vDebug() << "started on port" << m_listenPort;
+	m_upstreamSessionManager.setVncServer( vncServerPort, vncServerPassword );
+
+	startWorkerThreads();
+
+	vDebug() << "started on port" << m_listenPort << "with" << m_workerThreads.count() << "worker threads";
 	return true;
 }
 
@@ -78,11 +84,21 @@ void VncProxyServer::stop()
 {
 	for( auto connection : std::as_const( m_connections ) )
 	{
-		delete connection;
+		if( connection->thread() == thread() )
+		{
+			delete connection;
+		}
+		else
+		{
+			// objects have to be deleted in the thread they live in
+			QMetaObject::invokeMethod( connection, [connection]() { delete connection; }, Qt::BlockingQueuedConnection );
+		}
 	}
 
 	m_connections.clear();
 
+	stopWorkerThreads();
+
 	delete m_server;
 	m_server = nullptr;
 }
@@ -106,8 +122,12 @@ void VncProxyServer::acceptConnection()
 	connect(connection, &VncProxyConnection::serverMessageProcessed, this,
 		[=]() { Q_EMIT serverMessageProcessed(connection); }, Qt::DirectConnection );
 
+	// connection signals are delivered through the event loop of this thread once the connection
+	// has been moved to a worker thread
 	connect( connection, &VncProxyConnection::clientConnectionClosed, this, [=]() { closeConnection( connection ); } );
 	connect( connection, &VncProxyConnection::serverConnectionClosed, this, [=]() { closeConnection( connection ); } );
+	connect( connection, &VncProxyConnection::established, this, [=]() { moveToWorkerThread( connection ); },
+			 Qt::QueuedConnection );
 
 	connection->start();
 
@@ -118,7 +138,11 @@ void VncProxyServer::acceptConnection()
 
 void VncProxyServer::closeConnection( VncProxyConnection* connection )
 {
-	m_connections.removeAll( connection );
+	// both sockets may report a closed connection
+	if( m_connections.removeAll( connection ) == 0 )
+	{
+		return;
+	}
 
 	Q_EMIT connectionClosed( connection );
 
@@ -131,3 +155,78 @@ void VncProxyServer::handleAcceptError( QAbstractSocket::SocketError socketError
 {
 	vCritical() << "error while accepting connection" << socketError;
 }
+
+
+
+void VncProxyServer::startWorkerThreads()
+{
+	auto threadCount = VeyonCore::config().proxyWorkerThreadCount();
+	if( threadCount < 0 )
+	{
+		threadCount = qBound( 1, QThread::idealThreadCount() / 2, MaximumWorkerThreadCount );
+	}
+
+	for( int i = m_workerThreads.count(); i < threadCount; ++i )
+	{
+		auto thread = new QThread;
+		thread->setObjectName( QStringLiteral("VncProxyWorker%1").arg( i ) );
+		thread->start();
+
+		m_workerThreads.append( thread );
+	}
+}
+
+
+
+void VncProxyServer::stopWorkerThreads()
+{
+	for( auto thread : std::as_const( m_workerThreads ) )
+	{
+		thread->quit();
+		thread->wait();
+		delete thread;
+	}
+
+	m_workerThreads.clear();
+}
+
+
+
+void VncProxyServer::moveToWorkerThread( VncProxyConnection* connection )
+{
+	// connection might have been closed in the meantime
+	if( m_connections.contains( connection ) == false )
+	{
+		return;
+	}
+
+	// let the connection share a VNC server connection as soon as it stays in its thread
+	if( VeyonCore::config().vncServerConnectionSharingEnabled() )
+	{
+		connection->setUpstreamSessionManager( &m_upstreamSessionManager );
+	}
+
+	if( m_workerThreads.isEmpty() )
+	{
+		return;
+	}
+
+	// pick the thread serving the least connections
+	auto workerThread = m_workerThreads.first();
+	auto minimumConnectionCount = m_connections.count() + 1;
+
+	for( auto thread : std::as_const( m_workerThreads ) )
+	{
+		const auto connectionCount = std::count_if( m_connections.cbegin(), m_connections.cend(),
+													[thread]( const VncProxyConnection* c ) { return c->thread() == thread; } );
+		if( connectionCount < minimumConnectionCount )
+		{
+			workerThread = thread;
+			minimumConnectionCount = int(connectionCount);
+		}
+	}
+
+	// objects with a parent can't be moved to a different thread
+	connection->setParent( nullptr );
+	connection->moveToWorkerThread( workerThread );
+}
@@ -28,8 +28,10 @@
 #include <QVector>
 
 #include "CryptoCore.h"
+#include "VncUpstreamSessionManager.h"
 
 class QTcpServer;
+class QThread;
 class VncProxyConnection;
 class VncProxyConnectionFactory;
 
@@ -59,10 +61,16 @@ Q_SIGNALS:
 	void connectionClosed( VncProxyConnection* connection );
 
 private:
+	static constexpr int MaximumWorkerThreadCount = 4;
+
 	void acceptConnection();
 	void closeConnection( VncProxyConnection* );
 	void handleAcceptError( QAbstractSocket::SocketError socketError );
 
+	void startWorkerThreads();
+	void stopWorkerThreads();
+	void moveToWorkerThread( VncProxyConnection* connection );
+
 	int m_vncServerPort;
 	Password m_vncServerPassword;
 	QHostAddress m_listenAddress;
@@ -71,4 +79,11 @@ private:
 	VncProxyConnectionFactory* m_connectionFactory;
 	VncProxyConnectionList m_connections;
 
+	// established connections are served by these threads so the main thread
+	// only has to deal with handshakes and feature messages
+	QVector<QThread *> m_workerThreads;
+
+	// connections with identical encoding settings share one VNC server connection
+	VncUpstreamSessionManager m_upstreamSessionManager;
+
 } ;
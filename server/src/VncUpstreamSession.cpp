@@ -0,0 +1,444 @@
+/*
+ * VncUpstreamSession.cpp - implementation of VncUpstreamSession class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include <QDataStream>
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QThread>
+#include <QTimer>
+#include <QtEndian>
+
+#include "VncProxyConnection.h"
+#include "VncUpstreamSession.h"
+
+
+VncUpstreamSession::VncUpstreamSession( const Profile& profile, int vncServerPort, const Password& vncServerPassword ) :
+	QObject(),
+	m_profile( profile ),
+	m_vncServerPort( vncServerPort ),
+	m_socket( new QTcpSocket( this ) ),
+	m_protocol( m_socket, vncServerPassword )
+{
+	connect( m_socket, &QTcpSocket::readyRead, this, &VncUpstreamSession::readFromServer );
+	// also covers failed connection attempts
+	connect( m_socket, &QTcpSocket::stateChanged, this, [this]( QAbstractSocket::SocketState state ) {
+		if( state == QAbstractSocket::UnconnectedState && m_reconnecting == false )
+		{
+			fail();
+		}
+	} );
+
+	connectToServer();
+}
+
+
+
+VncUpstreamSession::~VncUpstreamSession()
+{
+	disconnect( m_socket );
+
+	vDebug() << "received" << m_receivedUpdateCount << "framebuffer updates and distributed them"
+			 << m_distributedUpdateCount << "times to up to" << m_maximumSubscriberCount << "subscribers";
+}
+
+
+
+QByteArray VncUpstreamSession::Profile::key() const
+{
+	// compose key from individual fields as padding bytes are not initialized by all clients
+	QByteArray key;
+	QDataStream stream( &key, QIODevice::WriteOnly );
+
+	stream << pixelFormat.bitsPerPixel << pixelFormat.depth << pixelFormat.bigEndian << pixelFormat.trueColour
+		   << pixelFormat.redMax << pixelFormat.greenMax << pixelFormat.blueMax
+		   << pixelFormat.redShift << pixelFormat.greenShift << pixelFormat.blueShift
+		   << encodings;
+
+	return key;
+}
+
+
+
+bool VncUpstreamSession::isShareable( const Profile& profile )
+{
+	if( profile.encodings.isEmpty() || profile.pixelFormat.trueColour == 0 )
+	{
+		return false;
+	}
+
+	for( const auto encoding : profile.encodings )
+	{
+		switch( encoding )
+		{
+		case rfbEncodingRaw:
+		case rfbEncodingCopyRect:
+		case rfbEncodingRRE:
+		case rfbEncodingCoRRE:
+		case rfbEncodingHextile:
+		case rfbEncodingUltra:
+		// zlib streams are reset for all subscribers whenever one joins
+		case rfbEncodingTight:
+			break;
+		default:
+			// pseudo encodings have negative numbers and do not carry encoder state
+			if( int32_t(encoding) >= 0 )
+			{
+				return false;
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+
+
+QVector<uint32_t> VncUpstreamSession::shareableEncodings( const QVector<uint32_t>& encodings )
+{
+	QVector<uint32_t> shareable;
+	shareable.reserve( encodings.size() );
+
+	auto compressing = false;
+	auto dropped = false;
+
+	for( const auto encoding : encodings )
+	{
+		switch( encoding )
+		{
+		case rfbEncodingZlib:
+		case rfbEncodingZRLE:
+		case rfbEncodingZYWRLE:
+			// single zlib stream per connection which can't be reset, so let the VNC server
+			// use the next encoding the client supports
+			dropped = true;
+			break;
+		case rfbEncodingRRE:
+		case rfbEncodingCoRRE:
+		case rfbEncodingHextile:
+		case rfbEncodingUltra:
+		case rfbEncodingTight:
+			compressing = true;
+			shareable.append( encoding );
+			break;
+		default:
+			shareable.append( encoding );
+			break;
+		}
+	}
+
+	if( dropped && compressing == false )
+	{
+		return {};
+	}
+
+	return shareable;
+}
+
+
+
+void VncUpstreamSession::subscribe( VncProxyConnection* connection )
+{
+	QMutexLocker locker( &m_subscribersMutex );
+
+	if( m_subscribers.contains( connection ) == false )
+	{
+		m_subscribers.append( connection );
+		m_maximumSubscriberCount = qMax( m_maximumSubscriberCount, int(m_subscribers.count()) );
+	}
+}
+
+
+
+void VncUpstreamSession::unsubscribe( VncProxyConnection* connection )
+{
+	QMutexLocker locker( &m_subscribersMutex );
+
+	m_subscribers.removeAll( connection );
+}
+
+
+
+void VncUpstreamSession::requestFramebufferUpdate( bool incremental )
+{
+	QMetaObject::invokeMethod( this, [this, incremental]() {
+		m_updateRequestPending = true;
+		m_fullUpdateRequested |= incremental == false;
+
+		sendPendingFramebufferUpdateRequest();
+	} );
+}
+
+
+
+void VncUpstreamSession::requestStreamReset()
+{
+	QMetaObject::invokeMethod( this, [this]() { resetStreams(); } );
+}
+
+
+
+QByteArray VncUpstreamSession::cursorUpdateMessage() const
+{
+	QMutexLocker locker( &m_subscribersMutex );
+
+	const auto rectCount = int(m_cursorShapeRect.isEmpty() == false) + int(m_cursorPositionRect.isEmpty() == false);
+	if( rectCount == 0 )
+	{
+		return {};
+	}
+
+	rfbFramebufferUpdateMsg header{};
+	header.type = rfbFramebufferUpdate;
+	header.nRects = qToBigEndian<uint16_t>( rectCount );
+
+	QByteArray message( reinterpret_cast<const char *>( &header ), sz_rfbFramebufferUpdateMsg );
+	message.append( m_cursorShapeRect );
+	message.append( m_cursorPositionRect );
+
+	return message;
+}
+
+
+
+void VncUpstreamSession::connectToServer()
+{
+	m_reconnectTimer.restart();
+
+	m_state = State::Connecting;
+	m_updateRequestOutstanding = false;
+	m_streamResetPending = true;
+	m_epochStartPending = true;
+
+	m_socket->connectToHost( QHostAddress::LocalHost, quint16(m_vncServerPort) );
+
+	m_protocol.start();
+}
+
+
+
+void VncUpstreamSession::resetStreams()
+{
+	if( m_reconnectScheduled )
+	{
+		return;
+	}
+
+	// nothing to reset as long as no zlib stream has been used on the current connection
+	if( m_state != State::Running || m_streamResetPending )
+	{
+		m_epochStartPending = true;
+		return;
+	}
+
+	// do not let subscribers joining and falling behind make us reconnect all the time
+	const auto remainingTime = MinimumReconnectInterval - m_reconnectTimer.elapsed();
+	if( remainingTime > 0 )
+	{
+		m_reconnectScheduled = true;
+		QTimer::singleShot( int(remainingTime), this, [this]() {
+			m_reconnectScheduled = false;
+			resetStreams();
+		} );
+		return;
+	}
+
+	vDebug() << "reconnecting to VNC server to reset zlib streams";
+
+	// the VNC server starts new zlib streams with a new connection
+	m_reconnecting = true;
+	m_socket->abort();
+	m_reconnecting = false;
+
+	// subscribers have to receive a complete update from the new connection
+	m_updateRequestPending = true;
+	m_fullUpdateRequested = true;
+
+	connectToServer();
+}
+
+
+
+void VncUpstreamSession::readFromServer()
+{
+	if( m_protocol.state() != VncClientProtocol::Running )
+	{
+		while( m_protocol.read() ) // Flawfinder: ignore
+		{
+		}
+
+		if( m_protocol.state() != VncClientProtocol::Running )
+		{
+			return;
+		}
+
+		m_protocol.setPixelFormat( m_profile.pixelFormat );
+		m_protocol.setEncodings( m_profile.encodings );
+
+		if( m_protocol.sendPixelFormat() == false || m_protocol.sendEncodings() == false )
+		{
+			fail();
+			return;
+		}
+
+		m_state = State::Running;
+
+		sendPendingFramebufferUpdateRequest();
+	}
+
+	while( m_protocol.receiveMessage() )
+	{
+		switch( m_protocol.lastMessageType() )
+		{
+		case rfbFramebufferUpdate:
+			++m_receivedUpdateCount;
+			m_updateRequestOutstanding = false;
+			// request next update before distributing this one so both overlap
+			sendPendingFramebufferUpdateRequest();
+			distributeMessage( m_protocol.lastMessage() );
+			break;
+		case rfbResizeFrameBuffer:
+			distributeMessage( m_protocol.lastMessage() );
+			break;
+		default:
+			// all other messages are received by subscribers through their own connections
+			break;
+		}
+	}
+}
+
+
+
+void VncUpstreamSession::sendPendingFramebufferUpdateRequest()
+{
+	if( m_state != State::Running || m_updateRequestPending == false || m_updateRequestOutstanding )
+	{
+		return;
+	}
+
+	m_protocol.requestFramebufferUpdate( m_fullUpdateRequested == false );
+
+	m_updateRequestPending = false;
+	m_updateRequestOutstanding = true;
+	m_fullUpdateRequested = false;
+}
+
+
+
+void VncUpstreamSession::distributeMessage( QByteArray data )
+{
+	const auto isFramebufferUpdate = m_protocol.lastMessageType() == rfbFramebufferUpdate;
+	const auto& rects = m_protocol.lastMessageRects();
+
+	if( isFramebufferUpdate && m_streamResetPending )
+	{
+		// let the first Tight rect reset all zlib streams so subscribers can decode the new ones from the start
+		const auto firstTightRect = std::find_if( rects.cbegin(), rects.cend(), []( const VncClientProtocol::RectLocation& rect ) {
+			return rect.encoding == rfbEncodingTight;
+		} );
+		if( firstTightRect != rects.cend() )
+		{
+			const auto compressionControlIndex = int(firstTightRect->offset + sz_rfbFramebufferUpdateRectHeader);
+			data[compressionControlIndex] = char( data.at( compressionControlIndex ) | 0x0f );
+			m_streamResetPending = false;
+		}
+	}
+
+	Message message{ data, { m_protocol.framebufferWidth(), m_protocol.framebufferHeight() }, m_epoch, false };
+
+	if( m_epochStartPending )
+	{
+		m_epochStartPending = false;
+		message.epoch = ++m_epoch;
+		message.startsEpoch = true;
+	}
+
+	QList<VncProxyConnection *> localSubscribers;
+
+	{
+		// keep the lock while posting to subscribers in other threads so none of them gets deleted meanwhile
+		QMutexLocker locker( &m_subscribersMutex );
+
+		// cursor shape and position are only sent when changed
+		if( isFramebufferUpdate )
+		{
+			for( const auto& rect : rects )
+			{
+				if( rect.encoding == uint32_t(rfbEncodingXCursor) || rect.encoding == uint32_t(rfbEncodingRichCursor) )
+				{
+					m_cursorShapeRect = data.mid( int(rect.offset), int(rect.size) );
+				}
+				else if( rect.encoding == uint32_t(rfbEncodingPointerPos) )
+				{
+					m_cursorPositionRect = data.mid( int(rect.offset), int(rect.size) );
+				}
+			}
+		}
+
+		for( auto subscriber : std::as_const( m_subscribers ) )
+		{
+			if( subscriber->thread() == QThread::currentThread() )
+			{
+				localSubscribers.append( subscriber );
+			}
+			else
+			{
+				// message data is shared implicitly and not copied
+				QMetaObject::invokeMethod( subscriber, [subscriber, message]() {
+					subscriber->deliverSharedServerMessage( message );
+				}, Qt::QueuedConnection );
+			}
+		}
+
+		m_distributedUpdateCount += m_subscribers.count();
+	}
+
+	for( auto subscriber : std::as_const( localSubscribers ) )
+	{
+		subscriber->deliverSharedServerMessage( message );
+	}
+}
+
+
+
+void VncUpstreamSession::fail()
+{
+	if( m_state == State::Failed )
+	{
+		return;
+	}
+
+	vWarning() << "connection to VNC server failed or has been closed";
+
+	m_state = State::Failed;
+
+	QMutexLocker locker( &m_subscribersMutex );
+
+	for( auto subscriber : std::as_const( m_subscribers ) )
+	{
+		QMetaObject::invokeMethod( subscriber, [subscriber]() {
+			subscriber->handleUpstreamSessionFailure();
+		}, Qt::QueuedConnection );
+	}
+}
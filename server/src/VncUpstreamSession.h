@@ -0,0 +1,154 @@
+/*
+ * VncUpstreamSession.h - declaration of VncUpstreamSession class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QSize>
+
+#include "VncClientProtocol.h"
+
+class QTcpSocket;
+class VncProxyConnection;
+
+/**
+ * \brief Connection to the VNC server shared by multiple proxy connections
+ *
+ * All proxy connections using the same pixel format and encodings subscribe to one session so the
+ * VNC server only has to encode each framebuffer update once. The session requests updates on
+ * behalf of its subscribers and passes each received update to all of them. Subscribers may join
+ * at any time, so encodings with zlib streams spanning multiple updates are only shared if the
+ * streams can be reset for all subscribers at once (Tight). Whenever a subscriber needs a reset,
+ * the session reconnects to the VNC server and starts a new epoch whose first Tight rect resets
+ * all streams. Subscribers drop updates of an epoch they have not received the start of.
+ */
+class VncUpstreamSession : public QObject
+{
+	Q_OBJECT
+public:
+	using Password = VncClientProtocol::Password;
+	using Pointer = QSharedPointer<VncUpstreamSession>;
+
+	struct Profile
+	{
+		rfbPixelFormat pixelFormat{};
+		QVector<uint32_t> encodings{};
+
+		QByteArray key() const;
+	};
+
+	enum class State {
+		Connecting,
+		Running,
+		Failed
+	};
+
+	// framebuffer update or resize message along with the state required for passing it on
+	struct Message
+	{
+		QByteArray data{};
+		QSize framebufferSize{};
+		int epoch{0};
+		bool startsEpoch{false};
+	};
+
+	VncUpstreamSession( const Profile& profile, int vncServerPort, const Password& vncServerPassword );
+	~VncUpstreamSession() override;
+
+	static bool isShareable( const Profile& profile );
+
+	// returns the encodings of the given ones which a session can use, or none if clients
+	// would have to do with uncompressed updates instead
+	static QVector<uint32_t> shareableEncodings( const QVector<uint32_t>& encodings );
+
+	bool requiresStreamResets() const
+	{
+		return m_profile.encodings.contains( rfbEncodingTight );
+	}
+
+	const Profile& profile() const
+	{
+		return m_profile;
+	}
+
+	State state() const
+	{
+		return m_state;
+	}
+
+	// the following methods may be called from any thread
+	void subscribe( VncProxyConnection* connection );
+	void unsubscribe( VncProxyConnection* connection );
+
+	void requestFramebufferUpdate( bool incremental );
+	void requestStreamReset();
+
+	// update containing the current cursor shape and position for subscribers joining late
+	QByteArray cursorUpdateMessage() const;
+
+private:
+	static constexpr int MinimumReconnectInterval = 1000;
+
+	void connectToServer();
+	void resetStreams();
+	void readFromServer();
+	void sendPendingFramebufferUpdateRequest();
+	void distributeMessage( QByteArray data );
+	void fail();
+
+	const Profile m_profile;
+	const int m_vncServerPort;
+
+	QTcpSocket* m_socket;
+	VncClientProtocol m_protocol;
+
+	std::atomic<State> m_state{State::Connecting};
+
+	mutable QMutex m_subscribersMutex;
+	QList<VncProxyConnection *> m_subscribers;
+	int m_maximumSubscriberCount{0};
+	// protected by m_subscribersMutex so joining subscribers either get a cursor change replayed or receive it
+	QByteArray m_cursorShapeRect;
+	QByteArray m_cursorPositionRect;
+
+	bool m_updateRequestPending{false};
+	bool m_updateRequestOutstanding{false};
+	bool m_fullUpdateRequested{false};
+
+	bool m_reconnecting{false};
+	bool m_reconnectScheduled{false};
+	QElapsedTimer m_reconnectTimer;
+	// no zlib stream has been used on the current connection yet
+	bool m_streamResetPending{true};
+	bool m_epochStartPending{true};
+	int m_epoch{0};
+
+	qint64 m_receivedUpdateCount{0};
+	qint64 m_distributedUpdateCount{0};
+
+} ;
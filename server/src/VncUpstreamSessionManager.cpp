@@ -0,0 +1,79 @@
+/*
+ * VncUpstreamSessionManager.cpp - implementation of VncUpstreamSessionManager class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "VncUpstreamSessionManager.h"
+
+
+void VncUpstreamSessionManager::setVncServer( int vncServerPort, const Password& vncServerPassword )
+{
+	QMutexLocker locker( &m_mutex );
+
+	m_vncServerPort = vncServerPort;
+	m_vncServerPassword = vncServerPassword;
+}
+
+
+
+VncUpstreamSession::Pointer VncUpstreamSessionManager::acquire( const VncUpstreamSession::Profile& profile )
+{
+	if( VncUpstreamSession::isShareable( profile ) == false )
+	{
+		return {};
+	}
+
+	const auto key = profile.key();
+
+	QMutexLocker locker( &m_mutex );
+
+	if( m_vncServerPort < 0 )
+	{
+		return {};
+	}
+
+	auto session = m_sessions.value( key ).toStrongRef();
+	if( session && session->state() != VncUpstreamSession::State::Failed )
+	{
+		return session;
+	}
+
+	// drop sessions which have been closed in the meantime
+	for( auto it = m_sessions.begin(); it != m_sessions.end(); )
+	{
+		if( it->isNull() )
+		{
+			it = m_sessions.erase( it );
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	// sessions have to be deleted in the thread they live in
+	session = VncUpstreamSession::Pointer( new VncUpstreamSession( profile, m_vncServerPort, m_vncServerPassword ),
+										   &QObject::deleteLater );
+	m_sessions[key] = session;
+
+	return session;
+}
@@ -0,0 +1,56 @@
+/*
+ * VncUpstreamSessionManager.h - declaration of VncUpstreamSessionManager class
+ *
+ * Copyright (c) 2025 Tobias Junghans <tobydox@veyon.io>
+ *
+ * This file is part of Veyon - https://veyon.io
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program (see COPYING); if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ *
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+
+#include "VncUpstreamSession.h"
+
+/**
+ * \brief Keeps track of the VNC server sessions shared by proxy connections
+ *
+ * Sessions are created on demand in the thread of the first proxy connection requesting a
+ * particular profile and are closed as soon as the last subscriber releases them.
+ */
+class VncUpstreamSessionManager
+{
+public:
+	using Password = VncUpstreamSession::Password;
+
+	void setVncServer( int vncServerPort, const Password& vncServerPassword );
+
+	// thread-safe, returns an empty pointer if the profile can't be shared
+	VncUpstreamSession::Pointer acquire( const VncUpstreamSession::Profile& profile );
+
+private:
+	QMutex m_mutex;
+
+	int m_vncServerPort{-1};
+	Password m_vncServerPassword{};
+
+	QHash<QByteArray, QWeakPointer<VncUpstreamSession>> m_sessions;
+
+} ;